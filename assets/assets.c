@@ -3,25 +3,45 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "hashTable/hashTable.h"
 #include "log/log.h"
+#include "xxhash/xxhash.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef struct File {
   char *buff;
+  // Aberto apenas para arquivos não carregados para a memória, ou -1.
+  int fd;
   size_t size;
   char path[PATH_MAX];
+  // Versões comprimidas do arquivo (assets_encoded()), ou NULL.
+  struct File *encoded[ASSETS_ENCODINGS];
+  time_t mtime;
+  char etag[ASSETS_ETAG_SIZE];
 } File;
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Recebe, na ordem, os blocos do conteúdo de um arquivo (assets_read()). last
+ * indica o último bloco.
+ */
+typedef int (*AssetsBlockFunc)(void *context, const char *data, size_t len,
+                               bool last);
+
+////////////////////////////////////////////////////////////////////////////////
+
 typedef struct Assets {
   HashTable files;
 } Assets;
@@ -32,8 +52,21 @@ static Assets assets = {};
 
 ////////////////////////////////////////////////////////////////////////////////
 
+static const char *SUFFIXES[ASSETS_ENCODINGS] = {".gz", ".br"};
+
+////////////////////////////////////////////////////////////////////////////////
+
 static int assets_addFile(const char *path);
 static int assets_addDir(const char *dirPath);
+static int assets_addEncodings();
+static void assets_linkEncoded(File *file);
+static File *assets_gzip(const File *file);
+static int assets_deflate(void *context, const char *data, size_t len,
+                          bool last);
+static int assets_setEtag(File *file);
+static int assets_hash(void *context, const char *data, size_t len, bool last);
+static int assets_read(const File *file, AssetsBlockFunc func, void *context);
+static int assets_suffix(const char *path);
 static bool assets_isFile(const char *path);
 static char *assets_makePath(char *path, size_t pathSize, const char *dirPath,
                              const char *filename);
@@ -51,6 +84,11 @@ int assets_open(const char *dirPath) {
     goto error;
   }
 
+  if (assets_addEncodings()) {
+    log_erro("assets", "assets_addEncodings().\n");
+    goto error;
+  }
+
   return 0;
 
 error:
@@ -70,6 +108,46 @@ const char *assets_get(const char *path) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+const char *assets_encoded(const char *path, AssetsEncoding encoding) {
+  File *file = hashTable_value(&assets.files, path);
+  if (file == NULL || file->encoded[encoding] == NULL) {
+    return NULL;
+  }
+  return file->encoded[encoding]->path;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *assets_etag(const char *path) {
+  File *file = hashTable_value(&assets.files, path);
+  if (file == NULL) {
+    return NULL;
+  }
+  return file->etag;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+time_t assets_mtime(const char *path) {
+  File *file = hashTable_value(&assets.files, path);
+  if (file == NULL) {
+    return -1;
+  }
+  return file->mtime;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int assets_fd(const char *path) {
+  File *file = hashTable_value(&assets.files, path);
+  if (file == NULL) {
+    return -1;
+  }
+  return file->fd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 size_t assets_size(const char *path) {
   File *file = hashTable_value(&assets.files, path);
   if (file == NULL) {
@@ -93,6 +171,7 @@ void assets_close() {
   while (hashTable_itNext(&it)) {
     File *file = hashTable_itValue(&it);
     if (file != NULL) {
+      if (file->fd >= 0) close(file->fd);
       free(file->buff);
       free(file);
     }
@@ -115,16 +194,30 @@ static int assets_addFile(const char *path) {
 
   file->path[0] = '\0';
   file->buff = NULL;
+  file->fd = -1;
   file->size = 0;
+  file->mtime = -1;
+  file->etag[0] = '\0';
+
+  for (int i = 0; i < ASSETS_ENCODINGS; i++) file->encoded[i] = NULL;
 
   strcat(file->path, path);
 
-  fd = open(file->path, O_RDONLY);
+  fd = open(file->path, O_RDONLY | O_CLOEXEC);
 
   if (fd < 0) {
     goto error;
   }
 
+  struct stat st;
+
+  if (fstat(fd, &st)) {
+    log_erro("assets", "fstat(): %d - %s\n", errno, strerror(errno));
+    goto error;
+  }
+
+  file->mtime = st.st_mtime;
+
   off_t buffSize = lseek(fd, 0, SEEK_END);
 
   if (buffSize == -1) {
@@ -132,6 +225,21 @@ static int assets_addFile(const char *path) {
     goto error;
   }
 
+  // Arquivos grandes são enviados direto do file descriptor, com sendfile().
+  if (buffSize >= ASSETS_LARGE_FILE_SIZE) {
+    file->fd = fd;
+    file->size = buffSize;
+
+    if (assets_setEtag(file)) goto error;
+
+    if (hashTable_set(&assets.files, path, file)) {
+      log_erro("assets", "hashTable_set(): %d - %s\n", errno, strerror(errno));
+      goto error;
+    }
+
+    return 0;
+  }
+
   if (lseek(fd, 0, SEEK_SET)) {
     log_erro("assets", "lseek(): %d - %s\n", errno, strerror(errno));
     goto error;
@@ -157,6 +265,8 @@ static int assets_addFile(const char *path) {
     goto error;
   }
 
+  if (assets_setEtag(file)) goto error;
+
   if (hashTable_set(&assets.files, path, file)) {
     log_erro("assets", "hashTable_set(): %d - %s\n", errno, strerror(errno));
     goto error;
@@ -233,6 +343,308 @@ error:
   return -1;
 }
 
+/**
+ * Associa as versões comprimidas encontradas no diretório aos seus arquivos e
+ * gera a versão gzip dos demais. As versões geradas são adicionadas à tabela
+ * somente após percorrê-la.
+ */
+static int assets_addEncodings() {
+  HashTableIt it;
+  File **generated = NULL;
+  size_t generatedLen = 0;
+
+  hashTable_it(&assets.files, &it);
+  while (hashTable_itNext(&it)) {
+    assets_linkEncoded(hashTable_itValue(&it));
+  }
+
+  generated = malloc((hashTable_count(&assets.files) + 1) * sizeof(File *));
+
+  if (generated == NULL) {
+    log_erro("assets", "malloc(): %d - %s\n", errno, strerror(errno));
+    goto error;
+  }
+
+  hashTable_it(&assets.files, &it);
+  while (hashTable_itNext(&it)) {
+    File *file = hashTable_itValue(&it);
+
+    // As versões comprimidas não são comprimidas novamente.
+    if (file->encoded[ASSETS_ENCODING_GZIP] != NULL ||
+        assets_suffix(file->path) >= 0) {
+      continue;
+    }
+
+    File *gzip = assets_gzip(file);
+
+    if (gzip == NULL) continue;
+
+    file->encoded[ASSETS_ENCODING_GZIP] = gzip;
+    generated[generatedLen++] = gzip;
+  }
+
+  for (size_t i = 0; i < generatedLen; i++) {
+    if (hashTable_set(&assets.files, generated[i]->path, generated[i])) {
+      log_erro("assets", "hashTable_set(): %d - %s\n", errno, strerror(errno));
+      goto error;
+    }
+
+    generated[i] = NULL;
+  }
+
+  free(generated);
+
+  return 0;
+
+error:
+  // As versões ainda fora da tabela não seriam liberadas por assets_close().
+  for (size_t i = 0; i < generatedLen; i++) {
+    if (generated[i] != NULL) {
+      free(generated[i]->buff);
+      free(generated[i]);
+    }
+  }
+  free(generated);
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Caso file seja a versão comprimida de um arquivo carregado, como "app.js.gz"
+ * de "app.js", a associa ao arquivo.
+ */
+static void assets_linkEncoded(File *file) {
+  int encoding = assets_suffix(file->path);
+
+  if (encoding < 0) return;
+
+  char path[PATH_MAX];
+  size_t len = strlen(file->path) - strlen(SUFFIXES[encoding]);
+
+  memcpy(path, file->path, len);
+  path[len] = '\0';
+
+  File *original = hashTable_value(&assets.files, path);
+
+  if (original != NULL) original->encoded[encoding] = file;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Gera a versão gzip do arquivo, em memória, com o endereço do arquivo
+ * acrescido de ".gz".
+ *
+ * @return versão gzip, ou NULL, caso o arquivo não seja comprimido o bastante
+ *         ou ocorra algum erro.
+ */
+static File *assets_gzip(const File *file) {
+  z_stream stream = {.zalloc = Z_NULL, .zfree = Z_NULL, .opaque = Z_NULL};
+  File *gzip = NULL;
+  bool streamOk = false;
+
+  if (file->size > ASSETS_GZIP_MAX_SIZE ||
+      strlen(file->path) + strlen(SUFFIXES[ASSETS_ENCODING_GZIP]) >=
+          PATH_MAX) {
+    return NULL;
+  }
+
+  // A compressão é feita uma única vez: usa o nível máximo.
+  if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 16 + 15, 9,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    log_erro("assets", "deflateInit2(): %s\n",
+             (stream.msg != NULL) ? stream.msg : "");
+    goto error;
+  }
+
+  streamOk = true;
+
+  gzip = malloc(sizeof(File));
+
+  if (gzip == NULL) {
+    log_erro("assets", "malloc(): %d - %s\n", errno, strerror(errno));
+    goto error;
+  }
+
+  gzip->fd = -1;
+  gzip->size = deflateBound(&stream, file->size);
+  gzip->buff = malloc(gzip->size);
+  gzip->mtime = file->mtime;
+
+  for (int i = 0; i < ASSETS_ENCODINGS; i++) gzip->encoded[i] = NULL;
+
+  strcpy(gzip->path, file->path);
+  strcat(gzip->path, SUFFIXES[ASSETS_ENCODING_GZIP]);
+
+  if (gzip->buff == NULL) {
+    log_erro("assets", "malloc(): %d - %s\n", errno, strerror(errno));
+    goto error;
+  }
+
+  // Com deflateBound() bytes de saída, o deflate nunca aguarda espaço.
+  stream.next_out = (Bytef *)gzip->buff;
+  stream.avail_out = gzip->size;
+
+  if (assets_read(file, assets_deflate, &stream)) goto error;
+
+  gzip->size = stream.total_out;
+
+  deflateEnd(&stream);
+
+  // A versão que não reduz o arquivo em ao menos 10% não compensa o
+  // Content-Encoding, como nas imagens, já comprimidas.
+  if (gzip->size >= file->size - file->size / 10) {
+    free(gzip->buff);
+    free(gzip);
+    return NULL;
+  }
+
+  char *buff = realloc(gzip->buff, gzip->size);
+
+  if (buff != NULL) gzip->buff = buff;
+
+  if (assets_setEtag(gzip)) {
+    free(gzip->buff);
+    free(gzip);
+    return NULL;
+  }
+
+  log_dbug("assets", "Compressed: %s (%zu -> %zu)\n", file->path, file->size,
+           gzip->size);
+
+  return gzip;
+
+error:
+  if (streamOk) deflateEnd(&stream);
+  if (gzip != NULL) {
+    free(gzip->buff);
+    free(gzip);
+  }
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int assets_deflate(void *context, const char *data, size_t len,
+                          bool last) {
+  z_stream *stream = context;
+
+  stream->next_in = (Bytef *)data;
+  stream->avail_in = len;
+
+  int result = deflate(stream, last ? Z_FINISH : Z_NO_FLUSH);
+
+  if (result == Z_STREAM_ERROR || (last && result != Z_STREAM_END)) {
+    log_erro("assets", "deflate(): %d\n", result);
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Calcula a ETag do arquivo a partir do seu conteúdo.
+ */
+static int assets_setEtag(File *file) {
+  XXHash hash;
+
+  xxhash_init(&hash, 0);
+
+  if (assets_read(file, assets_hash, &hash)) return -1;
+
+  snprintf(file->etag, sizeof(file->etag), "\"%016" PRIx64 "\"",
+           xxhash_digest(&hash));
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int assets_hash(void *context, const char *data, size_t len,
+                       bool last) {
+  xxhash_update(context, data, len);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Entrega a func todo o conteúdo do arquivo: da memória, de uma só vez, ou,
+ * caso não tenha sido carregado, lido do file descriptor em blocos de
+ * ASSETS_LARGE_FILE_SIZE.
+ */
+static int assets_read(const File *file, AssetsBlockFunc func, void *context) {
+  if (file->buff != NULL || file->size == 0) {
+    return func(context, file->buff, file->size, true);
+  }
+
+  // O sendfile() usa o seu próprio offset: a posição do arquivo é livre.
+  if (lseek(file->fd, 0, SEEK_SET)) {
+    log_erro("assets", "lseek(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  char *block = malloc(ASSETS_LARGE_FILE_SIZE);
+  size_t offset = 0;
+
+  if (block == NULL) {
+    log_erro("assets", "malloc(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  while (offset < file->size) {
+    size_t len = file->size - offset;
+
+    if (len > ASSETS_LARGE_FILE_SIZE) len = ASSETS_LARGE_FILE_SIZE;
+
+    ssize_t nread = read(file->fd, block, len);
+
+    if (nread < 0 && errno == EINTR) continue;
+
+    if (nread <= 0) {
+      log_erro("assets", "read(): %d - %s\n", errno, strerror(errno));
+      free(block);
+      return -1;
+    }
+
+    offset += nread;
+
+    if (func(context, block, nread, offset == file->size)) {
+      free(block);
+      return -1;
+    }
+  }
+
+  free(block);
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Obtém a codificação indicada pelo sufixo do endereço, ou -1, caso não seja
+ * uma versão comprimida.
+ */
+static int assets_suffix(const char *path) {
+  size_t pathLen = strlen(path);
+
+  for (int i = 0; i < ASSETS_ENCODINGS; i++) {
+    size_t len = strlen(SUFFIXES[i]);
+
+    if (pathLen > len && strcmp(path + pathLen - len, SUFFIXES[i]) == 0) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 static bool assets_isFile(const char *path) {
   struct stat st_buf;
   int status = stat(path, &st_buf);
@@ -3,6 +3,35 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <time.h>
+
+/**
+ * Arquivos a partir deste tamanho não são carregados para a memória: o módulo
+ * mantém apenas o file descriptor aberto, para que o conteúdo seja enviado
+ * direto do arquivo (ver assets_fd()).
+ */
+#define ASSETS_LARGE_FILE_SIZE (64 * 1024)
+
+/**
+ * Arquivos maiores do que isso não ganham uma versão gzip gerada por
+ * assets_open(), apenas a carregada do diretório (ver assets_encoded()).
+ */
+#define ASSETS_GZIP_MAX_SIZE (8 * 1024 * 1024)
+
+/**
+ * Tamanho da ETag (assets_etag()): 16 dígitos hexadecimais, as aspas e o '\0'.
+ */
+#define ASSETS_ETAG_SIZE (16 + 3)
+
+/**
+ * Codificações das versões comprimidas dos arquivos, com os respectivos
+ * sufixos: ".gz" e ".br".
+ */
+typedef enum AssetsEncoding {
+  ASSETS_ENCODING_GZIP,
+  ASSETS_ENCODING_BR,
+  ASSETS_ENCODINGS,
+} AssetsEncoding;
 
 /**
  * Carrega para a memória todos os arquivos e subdiretórios
@@ -17,10 +46,55 @@ int assets_open(const char *dir);
  * Obtém o conteúdo de um arquivo.
  *
  * @param  path endereço relativo do arquivo.
- * @return      conteúdo do arquivo.
+ * @return      conteúdo do arquivo, ou NULL, caso o arquivo não exista ou não
+ *              tenha sido carregado para a memória (ASSETS_LARGE_FILE_SIZE).
  */
 const char *assets_get(const char *path);
 
+/**
+ * Obtém o endereço da versão comprimida de um arquivo, lida como os demais
+ * arquivos, com assets_get(), assets_fd() e assets_size().
+ *
+ * A versão é o arquivo de mesmo nome, acrescido do sufixo da codificação, no
+ * mesmo diretório, como "app.js.gz" e "app.js.br". Na falta do ".gz",
+ * assets_open() gera a versão gzip, mantida em memória, caso ela seja ao menos
+ * 10% menor do que o arquivo.
+ *
+ * @param  path     endereço relativo do arquivo.
+ * @param  encoding codificação.
+ * @return          endereço da versão comprimida, ou NULL, caso não exista.
+ */
+const char *assets_encoded(const char *path, AssetsEncoding encoding);
+
+/**
+ * Obtém a ETag forte do arquivo, calculada ao carregá-lo: o hash XXH64 do
+ * conteúdo, em hexadecimal e entre aspas, como "\"0123456789abcdef\"". Cada
+ * versão comprimida tem a sua.
+ *
+ * @param  path endereço relativo do arquivo.
+ * @return      ETag, ou NULL, caso o arquivo não exista.
+ */
+const char *assets_etag(const char *path);
+
+/**
+ * Obtém a data da última modificação do arquivo, ao ser carregado. A versão
+ * gzip gerada por assets_open() tem a data do arquivo original.
+ *
+ * @param  path endereço relativo do arquivo.
+ * @return      data, ou -1, caso o arquivo não exista.
+ */
+time_t assets_mtime(const char *path);
+
+/**
+ * Obtém o file descriptor de um arquivo que não foi carregado para a memória.
+ * O file descriptor permanece aberto até assets_close().
+ *
+ * @param  path endereço relativo do arquivo.
+ * @return      file descriptor do arquivo, ou -1, caso o arquivo não exista ou
+ *              tenha sido carregado para a memória.
+ */
+int assets_fd(const char *path);
+
 /**
  * Verifica se path é um diretório dentro da hierarquia de diretórios
  * carregados pela função assets_open().
@@ -47,7 +121,8 @@ size_t assets_size(const char *path);
 
 /**
  * Fecha o módulo assets, liberando toda a memória utilizada pelo módulo,
- * incluive o conteúdo dos arquivos carregados.
+ * incluive o conteúdo dos arquivos carregados, e fechando os file descriptors
+ * mantidos abertos.
  */
 void assets_close();
 
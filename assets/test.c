@@ -1,5 +1,7 @@
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "assets.h"
 
@@ -8,9 +10,14 @@ int main() {
 
   assert(assets_get("assets/example/index.html") != NULL);
   assert(assets_get("assets/example/css/style.css") != NULL);
-  assert(assets_get("assets/example/imgs/image-1.jpg") != NULL);
+  assert(assets_get("assets/example/imgs/image-1.jpg") == NULL);
   assert(assets_get("assets/example/imgs/image-2.jpg") != NULL);
 
+  assert(assets_fd("assets/example/index.html") == -1);
+  assert(assets_fd("assets/example/imgs/image-1.jpg") >= 0);
+  assert(assets_fd("assets/example/imgs/image-2.jpg") == -1);
+  assert(assets_fd("assets/example/none.html") == -1);
+
   assert(assets_size("assets/example/index.html") == 192);
   assert(assets_size("assets/example/css/style.css") == 84);
   assert(assets_size("assets/example/imgs/image-1.jpg") == 101267);
@@ -18,6 +25,46 @@ int main() {
 
   assert(assets_exists("assets/example/index.html") == true);
 
+  // XXH64 of the content, from memory and, for large files, read in blocks.
+  assert(strcmp(assets_etag("assets/example/index.html"),
+                "\"5bad08312e790b9b\"") == 0);
+  assert(strcmp(assets_etag("assets/example/css/style.css"),
+                "\"9884245bfdac3aca\"") == 0);
+  assert(strcmp(assets_etag("assets/example/imgs/image-1.jpg"),
+                "\"08464ae68f62c7fd\"") == 0);
+  assert(assets_etag("assets/example/none.html") == NULL);
+
+  struct stat st;
+
+  assert(stat("assets/example/index.html", &st) == 0);
+  assert(assets_mtime("assets/example/index.html") == st.st_mtime);
+  assert(assets_mtime("assets/example/none.html") == -1);
+
+  // Generated in memory: index.html shrinks, the JPEG does not.
+  const char *gzip = assets_encoded("assets/example/index.html",
+                                    ASSETS_ENCODING_GZIP);
+  assert(gzip != NULL && strcmp(gzip, "assets/example/index.html.gz") == 0);
+  assert(assets_get(gzip) != NULL && assets_fd(gzip) == -1);
+  assert(assets_size(gzip) > 0 && assets_size(gzip) < 192);
+  assert(assets_mtime(gzip) == st.st_mtime);
+  assert(strlen(assets_etag(gzip)) == ASSETS_ETAG_SIZE - 1);
+  assert(strcmp(assets_etag(gzip),
+                assets_etag("assets/example/index.html")) != 0);
+  assert(assets_encoded("assets/example/imgs/image-1.jpg",
+                        ASSETS_ENCODING_GZIP) == NULL);
+
+  // Loaded from the directory, even if not smaller.
+  gzip = assets_encoded("assets/example/css/style.css", ASSETS_ENCODING_GZIP);
+  assert(gzip != NULL && strcmp(gzip, "assets/example/css/style.css.gz") == 0);
+  assert(assets_size(gzip) == 84);
+  assert(assets_encoded("assets/example/css/style.css.gz",
+                        ASSETS_ENCODING_GZIP) == NULL);
+
+  assert(assets_encoded("assets/example/index.html", ASSETS_ENCODING_BR) ==
+         NULL);
+  assert(assets_encoded("assets/example/none.html", ASSETS_ENCODING_GZIP) ==
+         NULL);
+
   assert(assets_isDir("assets/example/index.html") == false);
   assert(assets_isDir("assets/example/") == true);
 
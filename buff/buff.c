@@ -21,6 +21,7 @@
 
 static size_t itoa(long long value, int radix, bool uppercase, bool unsig,
                    char *buff, size_t zero_pad);
+static void buff_reverse(char *data, size_t size);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -44,6 +45,46 @@ int buff_init(Buff *buff, size_t size) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+void buff_wrap(Buff *buff, char *data, size_t size) {
+  buff->data = data;
+  buff->iread = 0;
+  buff->imarkRead = 0;
+  buff->iwrite = 0;
+  buff->size = size;
+  buff->used = 0;
+  buff->markUsed = 0;
+  buff->reader.buff = buff;
+  buff->writer.buff = buff;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+char *buff_move(Buff *buff, char *data, size_t size) {
+  char *old = buff->data;
+  size_t used = buff->used;
+  size_t len = 0;
+
+  // Copia os até dois segmentos de leitura, em ordem.
+  while (len < used) {
+    size_t segmentSize = buff_reader_size(&buff->reader);
+    memcpy(data + len, buff_reader_data(&buff->reader), segmentSize);
+    buff_reader_commit(&buff->reader, segmentSize);
+    len += segmentSize;
+  }
+
+  buff->data = data;
+  buff->size = size;
+  buff->iread = 0;
+  buff->imarkRead = 0;
+  buff->iwrite = used % size;
+  buff->used = used;
+  buff->markUsed = used;
+
+  return old;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 void buff_reader_iovec(BuffReader *reader, struct iovec **iovec, size_t *count,
                        bool commit) {
   *count = 0;
@@ -66,6 +107,30 @@ void buff_reader_iovec(BuffReader *reader, struct iovec **iovec, size_t *count,
   *iovec = reader->buff->iov;
 }
 
+void buff_reader_linearize(BuffReader *reader) {
+  Buff *buff = reader->buff;
+
+  if (buff_reader_size(reader) == buff->used) return;
+
+  // Rotaciona a área inteira para a esquerda em iread posições, com três
+  // inversões.
+  buff_reverse(buff->data, buff->iread);
+  buff_reverse(buff->data + buff->iread, buff->size - buff->iread);
+  buff_reverse(buff->data, buff->size);
+
+  buff->imarkRead = (buff->imarkRead + buff->size - buff->iread) % buff->size;
+  buff->iread = 0;
+  buff->iwrite = buff->used % buff->size;
+}
+
+static void buff_reverse(char *data, size_t size) {
+  for (size_t i = 0, j = size; i + 1 < j; i++, j--) {
+    char c = data[i];
+    data[i] = data[j - 1];
+    data[j - 1] = c;
+  }
+}
+
 void buff_reader_mark(const BuffReader *reader) {
   reader->buff->imarkRead = reader->buff->iread;
   reader->buff->markUsed = reader->buff->used;
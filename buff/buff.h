@@ -66,6 +66,29 @@ struct Buff {
  */
 int buff_init(Buff *buff, size_t size);
 
+/**
+ * Inicializa uma instância de buffer sobre uma área de memória externa, por
+ * exemplo, obtida de um pool. A área não é liberada por buff_free(), portanto
+ * buff_free() não deve ser chamada para buffers inicializados por esta função.
+ *
+ * @param buff instância de buffer.
+ * @param data área de memória do buffer.
+ * @param size tamanho da área de memória.
+ */
+void buff_wrap(Buff *buff, char *data, size_t size);
+
+/**
+ * Move o conteúdo do buffer para outra área de memória, de forma contígua, a
+ * partir do início da nova área. Usada para aumentar ou diminuir o buffer.
+ *
+ * @param  buff instância de buffer.
+ * @param  data nova área de memória do buffer.
+ * @param  size tamanho da nova área, que deve ser maior ou igual a
+ *              buff_used().
+ * @return      a área de memória anterior, a ser liberada por quem a alocou.
+ */
+char *buff_move(Buff *buff, char *data, size_t size);
+
 /**
  * Obtém um cursor de buffer para somente leitura.
  *
@@ -260,6 +283,15 @@ void buff_reader_mark(const BuffReader *reader);
  */
 void buff_reader_rewind(const BuffReader *reader);
 
+/**
+ * Reorganiza os dados não lidos em um único segmento, a partir do início da
+ * área do buffer, sem memória auxiliar. Após a chamada, buff_reader_size() é
+ * igual a buff_used(). A posição marcada por buff_reader_mark() é preservada.
+ *
+ * @param reader cursor de leitura.
+ */
+void buff_reader_linearize(BuffReader *reader);
+
 /**
  * Passa os segmentos de leitura para um vetor de buffers do tipo struct iovec.
  * Esta estrutura é utilizada pelas funções de sistema writev() e readv().
@@ -27,6 +27,9 @@ static void testReaderIoVecOneSegment();
 static void testReaderIoVecTwoSegments();
 static void testReadSize();
 static void testWriteSize();
+static void testWrap();
+static void testMoveTwoSegments();
+static void testLinearize();
 
 int main() {
   testReadSize();
@@ -37,6 +40,9 @@ int main() {
   testWriterPrintf();
   testReaderIoVecOneSegment();
   testReaderIoVecTwoSegments();
+  testWrap();
+  testMoveTwoSegments();
+  testLinearize();
   return 0;
 }
 
@@ -341,3 +347,102 @@ static void testManyReadAndWrite() {
 
   printf("%s is ok\n", __FUNCTION__);
 }
+
+static void testWrap() {
+  Buff buff;
+  char data[4];
+
+  buff_wrap(&buff, data, sizeof(data));
+
+  BuffWriter *writer = buff_writer(&buff);
+
+  assert(buff_writer_write(writer, "abcdef", 6) == 4);
+  assert(buff_isfull(&buff));
+  assert(memcmp(data, "abcd", 4) == 0);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testMoveTwoSegments() {
+  Buff buff;
+  const char *c;
+  char small[10];
+  char large[20];
+
+  buff_wrap(&buff, small, sizeof(small));
+
+  BuffWriter *writer = buff_writer(&buff);
+  BuffReader *reader = buff_reader(&buff);
+
+  buff_writer_write(writer, "abcdefghij", 10);
+  buff_reader_commit(reader, 8);
+  buff_writer_write(writer, "klmnopqr", 8);
+  assert(buff_isfull(&buff));
+
+  // The wrapped content becomes a single segment at the start of new memory.
+  assert(buff_move(&buff, large, sizeof(large)) == small);
+  assert(buff_used(&buff) == 10);
+  assert(buff_freespace(&buff) == 10);
+  assert(buff_reader_size(reader) == 10);
+  assert(memcmp(buff_reader_data(reader), "ijklmnopqr", 10) == 0);
+
+  assert(buff_writer_write(writer, "stuvwxyz01", 10) == 10);
+  assert(buff_isfull(&buff));
+
+  assert(buff_reader_read(reader, &c, 20) == 20);
+  assert(memcmp(c, "ijklmnopqrstuvwxyz01", 20) == 0);
+
+  // Moving to memory of the same size as the content.
+  buff_writer_write(writer, "abc", 3);
+  assert(buff_move(&buff, small, 3) == large);
+  assert(buff_isfull(&buff));
+  assert(memcmp(buff_reader_data(reader), "abc", 3) == 0);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testLinearize() {
+  Buff buff;
+  const char *c;
+  char data[10];
+
+  buff_wrap(&buff, data, sizeof(data));
+
+  BuffWriter *writer = buff_writer(&buff);
+  BuffReader *reader = buff_reader(&buff);
+
+  // Already contiguous: nothing moves.
+  buff_writer_write(writer, "abcdefgh", 8);
+  buff_reader_commit(reader, 2);
+  buff_reader_linearize(reader);
+  assert(buff_reader_data(reader) == data + 2);
+  assert(buff_reader_size(reader) == 6);
+
+  // Wrapped content becomes a single segment at the start of the memory.
+  buff_writer_write(writer, "ijkl", 4);
+  assert(buff_isfull(&buff));
+  buff_reader_commit(reader, 1);
+  buff_reader_mark(reader);
+  buff_reader_commit(reader, 3);
+  assert(buff_reader_size(reader) == 4);
+
+  buff_reader_linearize(reader);
+  assert(buff_reader_data(reader) == data);
+  assert(buff_reader_size(reader) == 6);
+  assert(memcmp(data, "ghijkl", 6) == 0);
+  assert(buff_used(&buff) == 6);
+
+  // The mark follows the data, now in the segment before it.
+  buff_reader_rewind(reader);
+  assert(buff_used(&buff) == 9);
+  assert(buff_reader_read(reader, &c, 9) == 3);
+  assert(memcmp(c, "def", 3) == 0);
+  assert(buff_reader_read(reader, &c, 9) == 6);
+  assert(memcmp(c, "ghijkl", 6) == 0);
+
+  // New writes continue after the content.
+  assert(buff_writer_write(writer, "mnopqrstuvw", 11) == 10);
+  assert(buff_isfull(&buff));
+
+  printf("%s is ok\n", __FUNCTION__);
+}
@@ -0,0 +1,614 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "hpack.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Bytes contados por entrada da tabela dinâmica, além do nome e do valor.
+ */
+#define HPACK_ENTRY_OVERHEAD 32
+
+/**
+ * Entradas da tabela estática (RFC 7541, Apêndice A).
+ */
+#define HPACK_STATIC_LEN 61
+
+struct HpackEntry {
+  size_t nameLen;
+  size_t valueLen;
+  // Nome seguido do valor.
+  char data[];
+};
+
+typedef struct HpackStatic {
+  const char *name;
+  const char *value;
+} HpackStatic;
+
+static const HpackStatic STATIC_TABLE[HPACK_STATIC_LEN] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Código de Huffman (RFC 7541, Apêndice B). O código é canônico: os códigos de
+ * mesmo tamanho são consecutivos, a partir de HUFFMAN_FIRST, e os símbolos,
+ * ordenados por tamanho do código, estão em HUFFMAN_SYMBOLS, a partir de
+ * HUFFMAN_INDEX. Os três últimos são indexados pelo tamanho menos 5, o menor
+ * código. O símbolo 256 é o EOS.
+ */
+static const uint16_t HUFFMAN_SYMBOLS[] = {
+    48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51, 52, 53,
+    54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109, 110, 112, 114,
+    117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82,
+    83, 84, 85, 86, 87, 89, 106, 107, 113, 118, 119, 120, 121, 122, 38, 42, 44,
+    59, 88, 90, 33, 34, 40, 41, 63, 39, 43, 124, 35, 62, 0, 36, 64, 91, 93, 126,
+    94, 125, 60, 96, 123, 92, 195, 208, 128, 130, 131, 162, 184, 194, 224, 226,
+    153, 161, 167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129, 132,
+    133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170, 173, 178, 181, 185,
+    186, 187, 189, 190, 196, 198, 228, 232, 233, 1, 135, 137, 138, 139, 140,
+    141, 143, 147, 149, 150, 151, 152, 155, 157, 158, 165, 166, 168, 174, 175,
+    180, 182, 183, 188, 191, 197, 231, 239, 9, 142, 144, 145, 148, 159, 171,
+    206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193, 200, 201, 202, 205,
+    210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211, 212, 214, 221,
+    222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254, 2, 3, 4, 5,
+    6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20, 21, 23, 24, 25, 26, 27, 28, 29,
+    30, 31, 127, 220, 249, 10, 13, 22, 256,
+};
+
+static const uint32_t HUFFMAN_FIRST[] = {
+    0x0, 0x14, 0x5c, 0xf8, 0x0, 0x3f8, 0x7fa, 0xffa, 0x1ff8, 0x3ffc, 0x7ffc,
+    0x0, 0x0, 0x0, 0x7fff0, 0xfffe6, 0x1fffdc, 0x3fffd2, 0x7fffd8, 0xffffea,
+    0x1ffffec, 0x3ffffe0, 0x7ffffde, 0xfffffe2, 0x0, 0x3ffffffc,
+};
+
+static const uint16_t HUFFMAN_COUNT[] = {
+    10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3, 0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15,
+    19, 29, 0, 4,
+};
+
+static const uint16_t HUFFMAN_INDEX[] = {
+    0, 10, 36, 68, 0, 74, 79, 82, 84, 90, 92, 0, 0, 0, 95, 98, 106, 119, 145,
+    174, 186, 190, 205, 224, 0, 253,
+};
+
+#define HUFFMAN_MIN_BITS 5
+#define HUFFMAN_MAX_BITS 30
+#define HUFFMAN_EOS 256
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int hpack_int(const uint8_t *data, size_t size, size_t *pos, int prefix,
+                     size_t *value);
+static int hpack_string(Hpack *hpack, const uint8_t *data, size_t size,
+                        size_t *pos, const char **str, size_t *len,
+                        size_t *buffUsed);
+static int hpack_huffman(const uint8_t *src, size_t size, char *dst,
+                         size_t *len);
+static int hpack_lookup(const Hpack *hpack, size_t index, HpackField *field);
+static HpackEntry *hpack_newEntry(const HpackField *field);
+static int hpack_insert(Hpack *hpack, HpackEntry *entry);
+static void hpack_evict(Hpack *hpack, size_t needed);
+static int hpack_reserve(Hpack *hpack, size_t size);
+static size_t hpack_entrySize(const HpackEntry *entry);
+static size_t hpack_encodeInt(char *dst, size_t value, int prefix,
+                              uint8_t flags);
+
+////////////////////////////////////////////////////////////////////////////////
+
+void hpack_init(Hpack *hpack, size_t limit) {
+  hpack->entries = NULL;
+  hpack->entriesCap = 0;
+  hpack->entriesLen = 0;
+  hpack->first = 0;
+  hpack->size = 0;
+  hpack->maxSize = limit;
+  hpack->limit = limit;
+  hpack->buff = NULL;
+  hpack->buffSize = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int hpack_decode(Hpack *hpack, const char *data, size_t size,
+                 HpackOnField onField, void *context) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  bool fields = false;
+  size_t pos = 0;
+
+  // Cada byte do código de Huffman produz, no máximo, 8/5 de caractere.
+  if (hpack_reserve(hpack, size / HUFFMAN_MIN_BITS * 8 + 8)) return -1;
+
+  while (pos < size) {
+    uint8_t type = bytes[pos];
+    HpackField field;
+    size_t index;
+
+    // Campo indexado: 1xxxxxxx.
+    if (type & 0x80) {
+      if (hpack_int(bytes, size, &pos, 7, &index) ||
+          hpack_lookup(hpack, index, &field)) {
+        return -1;
+      }
+      fields = true;
+      onField(context, &field);
+      continue;
+    }
+
+    // Novo tamanho da tabela dinâmica: 001xxxxx, somente antes dos campos.
+    if ((type & 0xe0) == 0x20) {
+      if (fields || hpack_int(bytes, size, &pos, 5, &index) ||
+          index > hpack->limit) {
+        return -1;
+      }
+      hpack->maxSize = index;
+      hpack_evict(hpack, 0);
+      continue;
+    }
+
+    // Literal com indexação (01xxxxxx), sem indexação (0000xxxx) ou nunca
+    // indexado (0001xxxx): o nome é um índice ou um texto, seguido do valor.
+    bool indexing = (type & 0xc0) == 0x40;
+    size_t buffUsed = 0;
+
+    if (hpack_int(bytes, size, &pos, indexing ? 6 : 4, &index)) return -1;
+
+    if (index == 0) {
+      if (hpack_string(hpack, bytes, size, &pos, &field.name, &field.nameLen,
+                       &buffUsed)) {
+        return -1;
+      }
+    } else if (hpack_lookup(hpack, index, &field)) {
+      return -1;
+    }
+
+    if (hpack_string(hpack, bytes, size, &pos, &field.value, &field.valueLen,
+                     &buffUsed)) {
+      return -1;
+    }
+
+    fields = true;
+
+    if (!indexing) {
+      onField(context, &field);
+      continue;
+    }
+
+    // A cópia é feita antes da remoção das entradas antigas, já que o nome
+    // pode pertencer a uma delas.
+    HpackEntry *entry = hpack_newEntry(&field);
+
+    if (entry == NULL) return -1;
+
+    field.name = entry->data;
+    field.value = entry->data + entry->nameLen;
+
+    int inserted = hpack_insert(hpack, entry);
+
+    if (inserted < 0) {
+      free(entry);
+      return -1;
+    }
+
+    onField(context, &field);
+
+    // Maior do que a tabela inteira: a tabela apenas fica vazia.
+    if (inserted == 0) free(entry);
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void hpack_free(Hpack *hpack) {
+  for (size_t i = 0; i < hpack->entriesLen; i++) {
+    free(hpack->entries[(hpack->first + i) % hpack->entriesCap]);
+  }
+
+  free(hpack->entries);
+  free(hpack->buff);
+
+  hpack_init(hpack, hpack->limit);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t hpack_encodeSize(size_t nameLen, size_t valueLen) {
+  // Tipo do campo e os dois comprimentos, com até 10 bytes cada um.
+  return 1 + 10 + 10 + nameLen + valueLen;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t hpack_encode(char *dst, const char *name, size_t nameLen,
+                    const char *value, size_t valueLen) {
+  size_t nameIndex = 0;
+  size_t pos = 0;
+
+  for (size_t i = 0; i < HPACK_STATIC_LEN; i++) {
+    const HpackStatic *entry = &STATIC_TABLE[i];
+    size_t j = 0;
+
+    if (strlen(entry->name) != nameLen) continue;
+
+    for (; j < nameLen; j++) {
+      char c = name[j];
+      if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+      if (c != entry->name[j]) break;
+    }
+
+    if (j < nameLen) continue;
+
+    if (strlen(entry->value) == valueLen &&
+        memcmp(entry->value, value, valueLen) == 0) {
+      return hpack_encodeInt(dst, i + 1, 7, 0x80);
+    }
+
+    // As entradas de mesmo nome são consecutivas.
+    if (nameIndex == 0) nameIndex = i + 1;
+  }
+
+  // Literal sem indexação.
+  if (nameIndex > 0) {
+    pos = hpack_encodeInt(dst, nameIndex, 4, 0x00);
+  } else {
+    dst[pos++] = 0x00;
+    pos += hpack_encodeInt(dst + pos, nameLen, 7, 0x00);
+
+    for (size_t i = 0; i < nameLen; i++) {
+      char c = name[i];
+      dst[pos++] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+  }
+
+  pos += hpack_encodeInt(dst + pos, valueLen, 7, 0x00);
+  memcpy(dst + pos, value, valueLen);
+
+  return pos + valueLen;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Lê um inteiro com prefixo de N bits (RFC 7541, 5.1).
+ */
+static int hpack_int(const uint8_t *data, size_t size, size_t *pos, int prefix,
+                     size_t *value) {
+  size_t max = (1u << prefix) - 1;
+
+  if (*pos >= size) return -1;
+
+  size_t v = data[(*pos)++] & max;
+
+  if (v == max) {
+    for (int shift = 0;; shift += 7) {
+      // Valores maiores do que 2^35 não cabem em nenhum limite razoável.
+      if (*pos >= size || shift > 28) return -1;
+
+      uint8_t b = data[(*pos)++];
+      v += (size_t)(b & 0x7f) << shift;
+
+      if ((b & 0x80) == 0) break;
+    }
+  }
+
+  *value = v;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Lê um texto, literal ou no código de Huffman. Os textos de Huffman são
+ * escritos em hpack->buff, a partir de buffUsed.
+ */
+static int hpack_string(Hpack *hpack, const uint8_t *data, size_t size,
+                        size_t *pos, const char **str, size_t *len,
+                        size_t *buffUsed) {
+  if (*pos >= size) return -1;
+
+  bool huffman = (data[*pos] & 0x80) != 0;
+  size_t strLen;
+
+  if (hpack_int(data, size, pos, 7, &strLen) || strLen > size - *pos) {
+    return -1;
+  }
+
+  if (huffman) {
+    char *dst = hpack->buff + *buffUsed;
+
+    if (hpack_huffman(data + *pos, strLen, dst, len)) return -1;
+
+    *str = dst;
+    *buffUsed += *len;
+  } else {
+    *str = (const char *)data + *pos;
+    *len = strLen;
+  }
+
+  *pos += strLen;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Decodifica o texto, um bit por vez: a cada bit, o código acumulado é
+ * comparado com o intervalo dos códigos do seu tamanho.
+ */
+static int hpack_huffman(const uint8_t *src, size_t size, char *dst,
+                         size_t *len) {
+  uint32_t code = 0;
+  int bits = 0;
+  size_t n = 0;
+
+  for (size_t i = 0; i < size; i++) {
+    for (int bit = 7; bit >= 0; bit--) {
+      code = (code << 1) | ((src[i] >> bit) & 1);
+      bits++;
+
+      if (bits < HUFFMAN_MIN_BITS) continue;
+
+      uint32_t first = HUFFMAN_FIRST[bits - HUFFMAN_MIN_BITS];
+
+      if (code >= first &&
+          code - first < HUFFMAN_COUNT[bits - HUFFMAN_MIN_BITS]) {
+        uint16_t symbol =
+            HUFFMAN_SYMBOLS[HUFFMAN_INDEX[bits - HUFFMAN_MIN_BITS] + code -
+                            first];
+
+        if (symbol == HUFFMAN_EOS) return -1;
+
+        dst[n++] = (char)symbol;
+        code = 0;
+        bits = 0;
+      } else if (bits == HUFFMAN_MAX_BITS) {
+        return -1;
+      }
+    }
+  }
+
+  // O preenchimento tem menos de 8 bits, todos 1 (o início do EOS).
+  if (bits > 7 || code != (1u << bits) - 1) return -1;
+
+  *len = n;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Obtém o campo do índice: a tabela estática, seguida da dinâmica, da entrada
+ * mais nova para a mais antiga.
+ */
+static int hpack_lookup(const Hpack *hpack, size_t index, HpackField *field) {
+  if (index == 0) return -1;
+
+  if (index <= HPACK_STATIC_LEN) {
+    const HpackStatic *entry = &STATIC_TABLE[index - 1];
+    field->name = entry->name;
+    field->nameLen = strlen(entry->name);
+    field->value = entry->value;
+    field->valueLen = strlen(entry->value);
+    return 0;
+  }
+
+  index -= HPACK_STATIC_LEN + 1;
+
+  if (index >= hpack->entriesLen) return -1;
+
+  const HpackEntry *entry =
+      hpack->entries[(hpack->first + hpack->entriesLen - 1 - index) %
+                     hpack->entriesCap];
+
+  field->name = entry->data;
+  field->nameLen = entry->nameLen;
+  field->value = entry->data + entry->nameLen;
+  field->valueLen = entry->valueLen;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static HpackEntry *hpack_newEntry(const HpackField *field) {
+  HpackEntry *entry =
+      malloc(sizeof(HpackEntry) + field->nameLen + field->valueLen);
+
+  if (entry == NULL) return NULL;
+
+  entry->nameLen = field->nameLen;
+  entry->valueLen = field->valueLen;
+  memcpy(entry->data, field->name, field->nameLen);
+  memcpy(entry->data + field->nameLen, field->value, field->valueLen);
+
+  return entry;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Insere a entrada na tabela dinâmica, removendo as mais antigas.
+ *
+ * @return 1, caso a entrada tenha sido inserida, 0, caso seja maior do que a
+ *         tabela, ou -1, caso não haja memória.
+ */
+static int hpack_insert(Hpack *hpack, HpackEntry *entry) {
+  size_t size = hpack_entrySize(entry);
+
+  hpack_evict(hpack, size);
+
+  if (size > hpack->maxSize) return 0;
+
+  if (hpack->entriesLen == hpack->entriesCap) {
+    size_t cap = (hpack->entriesCap == 0) ? 16 : hpack->entriesCap * 2;
+    HpackEntry **entries = malloc(sizeof(HpackEntry *) * cap);
+
+    if (entries == NULL) return -1;
+
+    for (size_t i = 0; i < hpack->entriesLen; i++) {
+      entries[i] = hpack->entries[(hpack->first + i) % hpack->entriesCap];
+    }
+
+    free(hpack->entries);
+    hpack->entries = entries;
+    hpack->entriesCap = cap;
+    hpack->first = 0;
+  }
+
+  hpack->entries[(hpack->first + hpack->entriesLen) % hpack->entriesCap] =
+      entry;
+  hpack->entriesLen++;
+  hpack->size += size;
+
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Remove as entradas mais antigas até sobrar espaço para needed bytes.
+ */
+static void hpack_evict(Hpack *hpack, size_t needed) {
+  while (hpack->entriesLen > 0 && hpack->size + needed > hpack->maxSize) {
+    HpackEntry *entry = hpack->entries[hpack->first];
+
+    hpack->size -= hpack_entrySize(entry);
+    hpack->first = (hpack->first + 1) % hpack->entriesCap;
+    hpack->entriesLen--;
+
+    free(entry);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int hpack_reserve(Hpack *hpack, size_t size) {
+  if (hpack->buffSize >= size) return 0;
+
+  char *buff = realloc(hpack->buff, size);
+
+  if (buff == NULL) return -1;
+
+  hpack->buff = buff;
+  hpack->buffSize = size;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t hpack_entrySize(const HpackEntry *entry) {
+  return entry->nameLen + entry->valueLen + HPACK_ENTRY_OVERHEAD;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Escreve um inteiro com prefixo de N bits, nos bits menos significativos do
+ * primeiro byte, cujos demais bits são flags.
+ */
+static size_t hpack_encodeInt(char *dst, size_t value, int prefix,
+                              uint8_t flags) {
+  size_t max = (1u << prefix) - 1;
+  size_t pos = 0;
+
+  if (value < max) {
+    dst[pos++] = (char)(flags | value);
+    return pos;
+  }
+
+  dst[pos++] = (char)(flags | max);
+  value -= max;
+
+  while (value >= 0x80) {
+    dst[pos++] = (char)(0x80 | (value & 0x7f));
+    value >>= 7;
+  }
+
+  dst[pos++] = (char)value;
+
+  return pos;
+}
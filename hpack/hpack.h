@@ -0,0 +1,107 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+/**
+ * Compressão dos cabeçalhos do HTTP/2 (HPACK, RFC 7541).
+ *
+ * O decodificador acompanha a tabela dinâmica do outro lado da conexão, por
+ * isso cada conexão possui o seu, e todos os blocos de cabeçalhos recebidos
+ * devem ser decodificados, na ordem, mesmo os de requisições recusadas.
+ *
+ * O codificador não usa a tabela dinâmica nem o código de Huffman: cada campo
+ * é um índice da tabela estática ou um literal não indexado, o que dispensa
+ * estado por conexão.
+ */
+
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Tamanho inicial da tabela dinâmica (SETTINGS_HEADER_TABLE_SIZE).
+ */
+#define HPACK_TABLE_SIZE 4096
+
+typedef struct HpackEntry HpackEntry;
+
+typedef struct Hpack {
+  // Fila circular das entradas da tabela dinâmica: a mais antiga em first.
+  HpackEntry **entries;
+  size_t entriesCap;
+  size_t entriesLen;
+  size_t first;
+  // Tamanho da tabela, como definido pela RFC (32 bytes por entrada, além do
+  // nome e do valor), o máximo atual e o máximo que o outro lado pode definir.
+  size_t size;
+  size_t maxSize;
+  size_t limit;
+  // Textos decodificados do código de Huffman.
+  char *buff;
+  size_t buffSize;
+} Hpack;
+
+/**
+ * Campo decodificado. Os textos não são terminados em '\0' e são válidos
+ * somente durante a chamada a HpackOnField.
+ */
+typedef struct HpackField {
+  const char *name;
+  size_t nameLen;
+  const char *value;
+  size_t valueLen;
+} HpackField;
+
+typedef void (*HpackOnField)(void *context, const HpackField *field);
+
+/**
+ * Inicializa o decodificador, sem alocar memória.
+ *
+ * @param hpack decodificador.
+ * @param limit tamanho máximo da tabela dinâmica, anunciado ao outro lado.
+ */
+void hpack_init(Hpack *hpack, size_t limit);
+
+/**
+ * Decodifica um bloco de cabeçalhos completo (HEADERS e CONTINUATION),
+ * entregando cada campo, na ordem, a onField.
+ *
+ * @return 0, em caso de sucesso, -1, caso o bloco seja inválido
+ *         (COMPRESSION_ERROR) ou não haja memória. Nesse caso, a tabela
+ *         dinâmica deixa de acompanhar a do outro lado e a conexão deve ser
+ *         encerrada.
+ */
+int hpack_decode(Hpack *hpack, const char *data, size_t size,
+                 HpackOnField onField, void *context);
+
+void hpack_free(Hpack *hpack);
+
+/**
+ * Quantidade máxima de bytes escritos por hpack_encode().
+ */
+size_t hpack_encodeSize(size_t nameLen, size_t valueLen);
+
+/**
+ * Codifica o campo, com o nome em minúsculas, como exige o HTTP/2.
+ *
+ * @param  dst destino, com pelo menos hpack_encodeSize() bytes.
+ * @return     quantidade de bytes escritos.
+ */
+size_t hpack_encode(char *dst, const char *name, size_t nameLen,
+                    const char *value, size_t valueLen);
+
+#endif
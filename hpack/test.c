@@ -0,0 +1,219 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "hpack.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FIELDS_MAX 16
+
+typedef struct Fields {
+  char text[FIELDS_MAX][256];
+  int len;
+} Fields;
+
+static void testRequests();
+static void testEviction();
+static void testInvalid();
+static void testEncode();
+static int decode(Hpack *hpack, const char *hex, Fields *fields);
+static void onField(void *context, const HpackField *field);
+
+int main() {
+  testRequests();
+  testEviction();
+  testInvalid();
+  testEncode();
+  return 0;
+}
+
+static void testRequests() {
+  Hpack hpack;
+  Fields fields;
+
+  hpack_init(&hpack, HPACK_TABLE_SIZE);
+
+  // RFC 7541, C.4: requests with Huffman coding.
+  assert(decode(&hpack, "828684418cf1e3c2e5f23a6ba0ab90f4ff", &fields) == 0);
+  assert(fields.len == 4);
+  assert(strcmp(fields.text[0], ":method: GET") == 0);
+  assert(strcmp(fields.text[1], ":scheme: http") == 0);
+  assert(strcmp(fields.text[2], ":path: /") == 0);
+  assert(strcmp(fields.text[3], ":authority: www.example.com") == 0);
+  assert(hpack.entriesLen == 1 && hpack.size == 57);
+
+  assert(decode(&hpack, "828684be5886a8eb10649cbf", &fields) == 0);
+  assert(fields.len == 5);
+  assert(strcmp(fields.text[3], ":authority: www.example.com") == 0);
+  assert(strcmp(fields.text[4], "cache-control: no-cache") == 0);
+  assert(hpack.entriesLen == 2 && hpack.size == 110);
+
+  assert(decode(&hpack,
+                "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+                &fields) == 0);
+  assert(fields.len == 5);
+  assert(strcmp(fields.text[1], ":scheme: https") == 0);
+  assert(strcmp(fields.text[2], ":path: /index.html") == 0);
+  assert(strcmp(fields.text[4], "custom-key: custom-value") == 0);
+  assert(hpack.entriesLen == 3 && hpack.size == 164);
+
+  hpack_free(&hpack);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testEviction() {
+  Hpack hpack;
+  Fields fields;
+
+  hpack_init(&hpack, HPACK_TABLE_SIZE);
+
+  // RFC 7541, C.6: responses, after resizing the table to 256 bytes.
+  assert(decode(&hpack,
+                "3fe101488264025885aec3771a4b6196d07abe941054d444a820059504"
+                "0b8166e082a62d1bff6e919d29ad171863c78f0b97c8e9ae82ae43d3",
+                &fields) == 0);
+  assert(fields.len == 4);
+  assert(strcmp(fields.text[0], ":status: 302") == 0);
+  assert(strcmp(fields.text[2], "date: Mon, 21 Oct 2013 20:13:21 GMT") == 0);
+  assert(hpack.entriesLen == 4 && hpack.size == 222);
+
+  // ":status: 307" evicts ":status: 302".
+  assert(decode(&hpack, "4883640effc1c0bf", &fields) == 0);
+  assert(strcmp(fields.text[0], ":status: 307") == 0);
+  assert(strcmp(fields.text[3], "location: https://www.example.com") == 0);
+  assert(hpack.entriesLen == 4 && hpack.size == 222);
+
+  assert(decode(&hpack,
+                "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a83"
+                "9bd9ab77ad94e7821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1"
+                "ab270fb5291f9587316065c003ed4ee5b1063d5007",
+                &fields) == 0);
+  assert(fields.len == 6);
+  assert(strcmp(fields.text[0], ":status: 200") == 0);
+  assert(strcmp(fields.text[4], "content-encoding: gzip") == 0);
+  assert(strcmp(fields.text[5],
+                "set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; "
+                "version=1") == 0);
+  assert(hpack.entriesLen == 3 && hpack.size == 215);
+
+  // An entry larger than the table empties it.
+  assert(decode(&hpack, "20", &fields) == 0);
+  assert(hpack.entriesLen == 0 && hpack.size == 0);
+  assert(decode(&hpack, "4001610162", &fields) == 0);
+  assert(strcmp(fields.text[0], "a: b") == 0);
+  assert(hpack.entriesLen == 0);
+
+  hpack_free(&hpack);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testInvalid() {
+  Hpack hpack;
+  Fields fields;
+
+  hpack_init(&hpack, HPACK_TABLE_SIZE);
+
+  // Index 0 and an index past the dynamic table.
+  assert(decode(&hpack, "80", &fields) == -1);
+  assert(decode(&hpack, "be", &fields) == -1);
+  // Truncated integer and string.
+  assert(decode(&hpack, "ff", &fields) == -1);
+  assert(decode(&hpack, "0003616263", &fields) == -1);
+  // Table size above the limit, and after the first field.
+  assert(decode(&hpack, "3fe21f", &fields) == -1);
+  assert(decode(&hpack, "8220", &fields) == -1);
+  // Huffman: padding longer than 7 bits, padding with zeros, and EOS.
+  assert(decode(&hpack, "008161ff", &fields) == -1);
+  assert(decode(&hpack, "00811800", &fields) == -1);
+  assert(decode(&hpack, "0084fffffffc00", &fields) == -1);
+
+  hpack_free(&hpack);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testEncode() {
+  char block[1024];
+  char value[300];
+  size_t len = 0;
+  Hpack hpack;
+  Fields fields;
+
+  memset(value, 'v', sizeof(value) - 1);
+  value[sizeof(value) - 1] = '\0';
+
+  // Fully indexed.
+  len += hpack_encode(block + len, ":status", 7, "200", 3);
+  assert(len == 1 && (unsigned char)block[0] == 0x88);
+
+  // Indexed name.
+  len += hpack_encode(block + len, "Content-Type", 12, "text/html", 9);
+  assert((unsigned char)block[1] == 0x0f && block[2] == 0x10);
+
+  // New name, lowercased, with a value longer than the 7-bit prefix.
+  assert(hpack_encodeSize(5, strlen(value)) >= 5 + strlen(value) + 3);
+  len += hpack_encode(block + len, "X-Foo", 5, value, strlen(value));
+
+  hpack_init(&hpack, HPACK_TABLE_SIZE);
+
+  char hex[sizeof(block) * 2 + 1];
+
+  for (size_t i = 0; i < len; i++) {
+    sprintf(hex + i * 2, "%02x", (unsigned char)block[i]);
+  }
+
+  assert(decode(&hpack, hex, &fields) == 0);
+  assert(fields.len == 3);
+  assert(strcmp(fields.text[0], ":status: 200") == 0);
+  assert(strcmp(fields.text[1], "content-type: text/html") == 0);
+  assert(strncmp(fields.text[2], "x-foo: vvv", 10) == 0);
+  assert(strlen(fields.text[2]) == 255);
+
+  // Without indexing: the dynamic table is untouched.
+  assert(hpack.entriesLen == 0);
+
+  hpack_free(&hpack);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static int decode(Hpack *hpack, const char *hex, Fields *fields) {
+  char data[512];
+  size_t size = strlen(hex) / 2;
+
+  for (size_t i = 0; i < size; i++) {
+    unsigned byte;
+    sscanf(hex + i * 2, "%2x", &byte);
+    data[i] = (char)byte;
+  }
+
+  fields->len = 0;
+
+  return hpack_decode(hpack, data, size, onField, fields);
+}
+
+static void onField(void *context, const HpackField *field) {
+  Fields *fields = context;
+
+  assert(fields->len < FIELDS_MAX);
+
+  snprintf(fields->text[fields->len++], sizeof(fields->text[0]), "%.*s: %.*s",
+           (int)field->nameLen, field->name, (int)field->valueLen,
+           field->value);
+}
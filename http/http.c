@@ -20,68 +20,129 @@
 #include <errno.h>
 #include <limits.h>
 #include <regex.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <threads.h>
+#include <time.h>
 #include <unistd.h>
+#include <zlib.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "buff/buff.h"
+#include "hpack/hpack.h"
 #include "log/log.h"
+#include "router/router.h"
 #include "server/server.h"
-#include "str/str.h"
-#include "vetor/vetor.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Trecho da requisição no inbox, relativo ao início da requisição. Os trechos
+ * do cabeçalho são seguidos de '\0', escrito no lugar do delimitador.
+ */
+typedef struct HttpSpan {
+  uint32_t offset;
+  uint32_t len;
+} HttpSpan;
 
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef struct HttpHeader {
-  char name[HEADER_NAME_MAX];
-  char value[HEADER_VALUE_MAX];
-  size_t nameLen;
-  size_t valueLen;
+  HttpSpan name;
+  HttpSpan value;
 } HttpHeader;
 
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef struct HttpParam {
-  char name[PARAM_NAME_MAX];
-  char value[PARAM_VALUE_MAX];
-  size_t nameLen;
-  size_t valueLen;
+  HttpSpan name;
+  HttpSpan value;
 } HttpParam;
 
 ////////////////////////////////////////////////////////////////////////////////
 
-typedef FormatStatus (*HttpReqStateFn)(HttpClient *client, char c);
+typedef struct HttpHandler HttpHandler;
+
+typedef struct HttpH2 HttpH2;
+
+typedef struct HttpH2Stream HttpH2Stream;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Etapa da decodificação do corpo recebido com "Transfer-Encoding: chunked":
+ * "tamanho em hexadecimal[;extensões]\r\n", os dados e "\r\n", repetidos até
+ * a parte de tamanho zero, seguida dos trailers e de uma linha vazia.
+ */
+typedef enum HttpChunkState {
+  HTTP_CHUNK_SIZE,
+  HTTP_CHUNK_DATA,
+  HTTP_CHUNK_DATA_END,
+  HTTP_CHUNK_TRAILER,
+  HTTP_CHUNK_DONE,
+} HttpChunkState;
 
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef struct HttpReq {
-  HttpReqStateFn state;
+  // Cabeçalho já recebido e interpretado: falta apenas o corpo.
+  bool headParsed;
+  // Bytes já examinados na procura pelo fim do cabeçalho.
+  size_t headScanned;
+  size_t headLen;
 
-  char uri[URI_MAX];
-  int uriLen;
+  // Início da requisição no inbox. Entre as chamadas do onFormat o inbox pode
+  // ser movido; após FORMAT_OK, o servidor o retém até a resposta ser
+  // concluída.
+  const char *data;
 
-  char method[METHOD_MAX];
-  int methodLen;
+  HttpSpan method;
+  HttpSpan uri;
 
   int versionMajor;
   int versionMinor;
 
+  // A conexão continua aberta após a resposta (ver http_keepAlive()).
+  bool keepAlive;
+
   HttpHeader headers[HEADERS_MAX];
   int headersLen;
 
   HttpParam params[PARAMS_MAX];
   int paramsLen;
 
-  char args[ARGS_MAX][ARG_MAX];
+  // Argumentos do caminho, copiados para argsData e terminados em '\0', e os
+  // seus nomes no padrão (NULL, nos padrões de http_handlerRegex()).
+  const char *args[ARGS_MAX];
+  const char *argNames[ARGS_MAX];
   int argsLen;
+  char argsData[URI_MAX + ARGS_MAX];
+
+  size_t contentLength;
 
-  char body[BODY_MAX];
-  int bodyLen;
+  // Corpo em partes ("Transfer-Encoding: chunked"): etapa da decodificação,
+  // bytes restantes da parte atual e, no corpo armazenado, posição do próximo
+  // byte ainda não decodificado, a partir do início da requisição.
+  bool chunked;
+  HttpChunkState chunkState;
+  size_t chunkLeft;
+  size_t chunkPos;
 
-  int contentLength;
+  // Handler escolhido assim que o cabeçalho é interpretado, ou NULL.
+  const HttpHandler *handler;
+
+  // Corpo recebido em partes: cópia do cabeçalho, fora do inbox, e bytes do
+  // corpo já entregues ao handler.
+  char *head;
+  size_t bodyRead;
+  bool paused;
 
   // Transient, pattern used to route the request.
   const char *pattern;
@@ -89,27 +150,316 @@ typedef struct HttpReq {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Dados de cada conexão, obtidos com server_clientData(). A requisição em
+ * andamento é obtida com server_requestData() ao receber o seu primeiro byte e
+ * devolvida pelo servidor após o onClean.
+ */
 struct HttpClient {
   HttpReq *req;
-  str_t *resp;
   int fd;
+  // Resposta em andamento enviada em partes (http_sendChunk()), e a função que
+  // aguarda espaço na fila de saída para continuá-la (http_onWritable()).
+  bool streaming;
+  HttpWritableFunc onWritable;
+  // Requisições recebidas pela conexão.
+  int requests;
+  // Conexão HTTP/2, ou NULL, no HTTP/1.x.
+  HttpH2 *h2;
+  // Stream do HTTP/2 atendido por este cliente, que não é o da conexão, ou
+  // NULL.
+  HttpH2Stream *stream;
+  // Resposta adiada da requisição atual (http_defer()), ou NULL.
+  HttpDefer *defer;
+  // A resposta é de tipo textual (http_sendType()) e a aplicação não informou
+  // a sua própria Content-Encoding: pode ser comprimida.
+  bool compressible;
+  bool encoded;
+  // Compressor da resposta enviada com gzip, ou NULL.
+  z_stream *gzip;
+  // A resposta 304 não tem corpo, nem Content-Length.
+  bool notModified;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Resposta adiada. É compartilhada pela aplicação, até http_complete(), e pelo
+ * cliente, até a resposta ou o fechamento da conexão: quem a libera por
+ * último, possivelmente em outra thread, a destrói.
+ */
+struct HttpDefer {
+  ServerConnId conn;
+  HttpClient *client;
+  atomic_bool cancelled;
+  atomic_int refs;
+  HttpDeferFunc func;
+  void *arg;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
-typedef struct HttpHandler {
-  regex_t pattern;
-  char patternRaw[PATTERN_MAX];
+struct HttpHandler {
   char method[METHOD_MAX];
+  // Padrão como informado ao adicionar o handler (http_reqPattern()).
+  char *pattern;
+  // Expressão regular compilada, somente nos handlers de http_handlerRegex().
+  bool isRegex;
+  regex_t regex;
   HttpHandlerFunc func;
-} HttpHandler;
+  // Recebe o corpo em partes, em vez de armazená-lo (http_handlerStream()).
+  HttpBodyFunc onBody;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Rotas de um método, em árvore radix: a escolha do handler custa uma passada
+ * sobre o caminho, independente da quantidade de rotas.
+ */
+typedef struct HttpRoutes {
+  char method[METHOD_MAX];
+  Router router;
+} HttpRoutes;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Texto alocado que cresce conforme recebe dados.
+ */
+typedef struct HttpText {
+  char *data;
+  size_t len;
+  size_t cap;
+} HttpText;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Prefácio da conexão HTTP/2 com conhecimento prévio (h2c), enviado pelo
+// cliente antes do primeiro frame.
+#define HTTP_H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define HTTP_H2_PREFACE_LEN (sizeof(HTTP_H2_PREFACE) - 1)
+
+#define HTTP_H2_FRAME_HEAD 9
+
+// Maior frame recebido (o padrão de SETTINGS_MAX_FRAME_SIZE), que sempre cabe
+// no inbox.
+#define HTTP_H2_FRAME_MAX 16384
+
+// Janela inicial da conexão e dos streams, nos dois sentidos, e a maior
+// janela, que também é o maior identificador de stream.
+#define HTTP_H2_WINDOW 65535
+#define HTTP_H2_MAX 0x7fffffff
+
+// Maior cabeçalho de uma requisição, antes e depois de descompactado: como no
+// HTTP/1.x, em que deve caber no inbox.
+#define HTTP_H2_HEAD_MAX INBOX_MAX_SIZE
+
+// Maior :path, com os parâmetros.
+#define HTTP_H2_PATH_MAX \
+  (URI_MAX + PARAMS_MAX * (PARAM_NAME_MAX + PARAM_VALUE_MAX))
+
+typedef enum HttpH2FrameType {
+  HTTP_H2_FRAME_DATA = 0x0,
+  HTTP_H2_FRAME_HEADERS = 0x1,
+  HTTP_H2_FRAME_PRIORITY = 0x2,
+  HTTP_H2_FRAME_RST_STREAM = 0x3,
+  HTTP_H2_FRAME_SETTINGS = 0x4,
+  HTTP_H2_FRAME_PUSH_PROMISE = 0x5,
+  HTTP_H2_FRAME_PING = 0x6,
+  HTTP_H2_FRAME_GOAWAY = 0x7,
+  HTTP_H2_FRAME_WINDOW_UPDATE = 0x8,
+  HTTP_H2_FRAME_CONTINUATION = 0x9,
+} HttpH2FrameType;
+
+#define HTTP_H2_FLAG_END_STREAM 0x1
+#define HTTP_H2_FLAG_ACK 0x1
+#define HTTP_H2_FLAG_END_HEADERS 0x4
+#define HTTP_H2_FLAG_PADDED 0x8
+#define HTTP_H2_FLAG_PRIORITY 0x20
+
+typedef enum HttpH2Error {
+  HTTP_H2_ERROR_PROTOCOL = 0x1,
+  HTTP_H2_ERROR_INTERNAL = 0x2,
+  HTTP_H2_ERROR_FLOW_CONTROL = 0x3,
+  HTTP_H2_ERROR_STREAM_CLOSED = 0x5,
+  HTTP_H2_ERROR_FRAME_SIZE = 0x6,
+  HTTP_H2_ERROR_REFUSED_STREAM = 0x7,
+  HTTP_H2_ERROR_CANCEL = 0x8,
+  HTTP_H2_ERROR_COMPRESSION = 0x9,
+  HTTP_H2_ERROR_ENHANCE_YOUR_CALM = 0xb,
+} HttpH2Error;
+
+typedef enum HttpH2Setting {
+  HTTP_H2_SETTING_ENABLE_PUSH = 0x2,
+  HTTP_H2_SETTING_MAX_CONCURRENT_STREAMS = 0x3,
+  HTTP_H2_SETTING_INITIAL_WINDOW_SIZE = 0x4,
+  HTTP_H2_SETTING_MAX_FRAME_SIZE = 0x5,
+  HTTP_H2_SETTING_MAX_HEADER_LIST_SIZE = 0x6,
+} HttpH2Setting;
+
+typedef struct HttpH2Frame {
+  uint32_t len;
+  uint8_t type;
+  uint8_t flags;
+  uint32_t id;
+  const char *payload;
+} HttpH2Frame;
+
+/**
+ * Stream do HTTP/2: uma requisição, atendida pelo handler como no HTTP/1.x,
+ * por meio do seu próprio HttpClient.
+ */
+struct HttpH2Stream {
+  uint32_t id;
+  HttpH2 *h2;
+  HttpH2Stream *next;
+  HttpClient client;
+  HttpReq req;
+  // Cabeçalho da requisição, reescrito como no HTTP/1.x ("MÉTODO CAMINHO
+  // HTTP/2.0\r\n" e os campos), e o corpo, armazenado ou, com a entrega
+  // suspensa (http_pauseBody()), aguardando o handler.
+  HttpText head;
+  HttpText body;
+  // Espaço restante para o cliente enviar e bytes recebidos ainda não
+  // devolvidos com WINDOW_UPDATE.
+  int64_t recvWindow;
+  size_t recvConsumed;
+  // Espaço restante para o servidor enviar.
+  int64_t sendWindow;
+  // O cliente enviou END_STREAM.
+  bool remoteClosed;
+  // Entregue ao handler: a resposta está em andamento.
+  bool dispatched;
+  // A aplicação concluiu a resposta, e o END_STREAM já foi enviado.
+  bool ended;
+  bool endSent;
+  // Resposta com content-length, enviada de uma vez (http_h2Head()).
+  bool sized;
+  // Encerrado com RST_STREAM: as respostas são descartadas.
+  bool reset;
+  // Cabeçalho da resposta, codificado até o envio do corpo.
+  HttpText respHead;
+  // Corpo da resposta que aguarda espaço na janela, enviado nesta ordem:
+  // dados copiados, referenciados (http_sendRef()) e trecho de arquivo.
+  HttpText pending;
+  size_t pendingPos;
+  const char *ref;
+  size_t refLen;
+  bool refCopy;
+  int fileFd;
+  size_t fileOffset;
+  size_t fileLen;
+};
+
+/**
+ * Conexão HTTP/2, nos dados da conexão (HttpClient), enquanto ela existir.
+ */
+struct HttpH2 {
+  int fd;
+  // Decodificador dos cabeçalhos, que acompanha a tabela dinâmica do cliente.
+  Hpack hpack;
+  HttpH2Stream *streams;
+  int numStreams;
+  // Streams entregues aos handlers e ainda não concluídos.
+  int active;
+  uint32_t lastStreamId;
+  int64_t recvWindow;
+  size_t recvConsumed;
+  int64_t sendWindow;
+  // Configurações do cliente: janela inicial dos streams e maior frame.
+  int64_t initialWindow;
+  size_t maxFrame;
+  // O cliente já enviou o primeiro SETTINGS, que conclui o prefácio.
+  bool settled;
+  // Bloco de cabeçalhos dividido entre HEADERS e CONTINUATION: stream, ou 0,
+  // fora de um bloco, e END_STREAM do HEADERS.
+  HttpText block;
+  uint32_t blockStream;
+  bool blockEndStream;
+  // O cliente enviou GOAWAY: a conexão é fechada com o último stream.
+  bool goaway;
+  // O servidor enviou GOAWAY, por um erro de conexão.
+  bool failed;
+};
+
+/**
+ * Campos de um bloco de cabeçalhos, durante a decodificação. O cabeçalho
+ * Cookie pode ser dividido em vários campos, reunidos com "; ".
+ */
+typedef struct HttpH2Fields {
+  HttpH2Stream *stream;
+  bool trailers;
+  bool malformed;
+  bool regular;
+  bool scheme;
+  char method[METHOD_MAX];
+  size_t methodLen;
+  char path[HTTP_H2_PATH_MAX];
+  size_t pathLen;
+  char authority[HEADER_VALUE_MAX];
+  size_t authorityLen;
+  bool hasAuthority;
+  char cookie[HEADER_VALUE_MAX];
+  size_t cookieLen;
+} HttpH2Fields;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Trecho constante do cabeçalho da resposta, sem o '\0'.
+#define HTTP_BLOCK(text) ((HttpView){text, sizeof(text) - 1})
+
+#define HTTP_DATE_LEN (sizeof("Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n") - 1)
+
+// Última data com ano de 4 dígitos: 31/12/9999 23:59:59.
+#define HTTP_DATE_MAX 253402300799LL
+
+// Maior cabeçalho montado por http_sendHead(): Connection, Date e
+// Content-Length, este com até 20 dígitos.
+#define HTTP_HEAD_MAX (96 + HTTP_DATE_LEN)
+
+/**
+ * Cabeçalho Date de cada worker, formatado novamente apenas quando o segundo
+ * muda.
+ */
+typedef struct HttpDate {
+  time_t time;
+  char line[HTTP_DATE_LEN + 1];
+} HttpDate;
+
+static _Thread_local HttpDate DATE = {0};
+
+/**
+ * Compressor da última resposta comprimida de cada worker, reaproveitado pela
+ * próxima: o estado do deflate, de centenas de KB, não é alocado e
+ * inicializado a cada resposta.
+ */
+static _Thread_local z_stream *GZIP = NULL;
+
+// Saída do compressor, enviada a cada vez que enche.
+#define HTTP_GZIP_OUT (16 * 1024)
+
+////////////////////////////////////////////////////////////////////////////////
+
+static const char DIGITS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
 
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef struct HttpServer {
-  Vetor *clients;  // Vector of HttpClient *
-  HttpHandler handlers[HANDLERS_MAX];
+  // Todos os handlers, para liberá-los ao final.
+  HttpHandler **handlers;
   size_t handlersLen;
+  HttpRoutes *routes;
+  size_t routesLen;
+  // Handlers de http_handlerRegex(), consultados na ordem em que foram
+  // adicionados, somente quando nenhuma rota corresponde à requisição.
+  HttpHandler **regexHandlers;
+  size_t regexHandlersLen;
 } HttpServer;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -118,36 +468,28 @@ static HttpServer *http = NULL;
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateMetodoInicio(HttpClient *client, char c);
-static FormatStatus stateMetodo(HttpClient *client, char c);
-static FormatStatus stateUri(HttpClient *client, char c);
-static FormatStatus stateParamNome(HttpClient *client, char c);
-static FormatStatus stateParamValor(HttpClient *client, char c);
-static FormatStatus stateParamNovo(HttpClient *client, char c);
-static FormatStatus stateHttpVersionH(HttpClient *client, char c);
-static FormatStatus stateHttpVersionT1(HttpClient *client, char c);
-static FormatStatus stateHttpVersionT2(HttpClient *client, char c);
-static FormatStatus stateHttpVersionP(HttpClient *client, char c);
-static FormatStatus stateHttpVersionSlash(HttpClient *client, char c);
-static FormatStatus stateHttpVersao1Inicio(HttpClient *client, char c);
-static FormatStatus stateHttpVersao1(HttpClient *client, char c);
-static FormatStatus stateHttpVersao2Inicio(HttpClient *client, char c);
-static FormatStatus stateHttpVersao2(HttpClient *client, char c);
-static FormatStatus stateNovaLinha1(HttpClient *client, char c);
-static FormatStatus stateCabecalhoNovo(HttpClient *client, char c);
-static FormatStatus stateCabecalhoEspacoAntesDoValor(HttpClient *client,
-                                                     char c);
-static FormatStatus stateCabecalhoNome(HttpClient *client, char c);
-static FormatStatus stateCabecalhoValor(HttpClient *client, char c);
-static FormatStatus stateNovaLinha2(HttpClient *client, char c);
-static FormatStatus stateNovaLinha3(HttpClient *client, char c);
-static FormatStatus stateBody(HttpClient *client, char c);
-
-////////////////////////////////////////////////////////////////////////////////
-
-static bool http_isCtl(int c);
+static size_t http_scan(const char *data, size_t size, char a, char b);
+static size_t http_headEnd(const char *data, size_t size, size_t from);
+static FormatStatus http_parseHead(HttpClient *client, BuffReader *reader);
+static int http_parseRequestLine(HttpReq *req, const char *data, size_t size,
+                                 size_t *pos);
+static int http_parseQuery(HttpReq *req, const char *data, HttpSpan query);
+static int http_parseHeaders(HttpReq *req, const char *data, size_t size,
+                             size_t pos);
+static int http_parseContentLength(HttpClient *client);
+static int http_parseTransferEncoding(HttpClient *client);
+static int http_parseChunk(HttpReq *req, const char *data, size_t size,
+                           size_t *pos, HttpView *chunk);
+static FormatStatus http_readChunks(HttpClient *client, BuffReader *reader);
+static FormatStatus http_streamChunks(HttpClient *client, BuffReader *reader);
+static int http_keepHead(HttpReq *req, BuffReader *reader);
+static FormatStatus http_streamBody(HttpClient *client, BuffReader *reader);
+static void http_terminate(const char *data, HttpSpan span);
+static HttpView http_view(const HttpReq *req, HttpSpan span);
+static bool http_equals(const HttpReq *req, HttpSpan span, const char *str);
+static bool http_hasToken(HttpView list, const char *token);
 static bool http_isDigit(int c);
-static bool http_isLetter(char c);
+static bool http_isToken(char c);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -156,28 +498,122 @@ static void http_onMessage(int clientFd);
 static void http_onDisconnected(int clientFd);
 static void http_onConnected(int clientFd);
 static void http_onClean(int clientFd);
-static int http_dispatch(HttpClient *client);
+static void http_onClientWritable(int clientFd);
+static bool http_keepAlive(HttpClient *client);
+static bool http_isHttp10(const HttpReq *req);
+static const HttpHandler *http_route(HttpClient *client);
+static const HttpHandler *http_routeRegex(HttpClient *client);
+static void http_setArgs(HttpReq *req, const RouterArg *args, int len);
+static HttpRoutes *http_routes(const char *method);
+static HttpHandler *http_newHandler(const char *method, const char *pattern,
+                                    HttpHandlerFunc func, HttpBodyFunc onBody);
+static void http_freeHandler(HttpHandler *handler);
+static int http_append(void *array, size_t *len, size_t size,
+                       const void *item);
+static void http_deferRun(int clientFd, void *arg);
+static void http_deferDrop(HttpClient *client);
+static void http_deferRelease(HttpDefer *defer);
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static const char *http_strMimeType(HttpMimeType contentType);
-static const char *http_strStatus(HttpStatus status);
+static HttpView http_typeLine(HttpMimeType contentType);
+static HttpView http_connectionLine(HttpClient *client);
+static HttpView http_statusLine(HttpStatus status);
+static HttpView http_date();
+static void http_formatDate(char *date, time_t now);
+static int http_parseDate(HttpView value, time_t *time);
+static size_t http_itoa(char *dst, size_t value);
+static size_t http_xtoa(char *dst, size_t value);
+static size_t http_copy(char *dst, HttpView block);
 static size_t http_min(size_t a, size_t b);
+static int http_toInt(const char *value, int def);
+static void http_sendHead(HttpClient *client, size_t size);
+static void http_sendChunkedHead(HttpClient *client);
+static void http_sendLine(HttpClient *client, HttpView line);
+static void http_startStream(HttpClient *client);
+static void http_writeChunk(HttpClient *client, const char *data, size_t size);
+static bool http_sameName(const char *name, size_t len, const char *str);
+static bool http_codingAccepted(HttpView list, size_t pos, size_t end);
+static bool http_hasEtag(HttpView list, const char *etag);
+
+////////////////////////////////////////////////////////////////////////////////
+
+static bool http_gzipAccepted(HttpClient *client);
+static int http_gzipStart(HttpClient *client);
+static void http_gzipWrite(HttpClient *client, const char *data, size_t size,
+                           int flush);
+static void http_gzipFree(HttpClient *client);
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static HttpClient *http_newClient(int clientFd);
-static void http_freeClient(HttpClient *client);
-static void http_clearClient(HttpClient *client);
 static HttpClient *http_client(int clientFd);
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static HttpReq *http_newReq();
-static void http_freeReq(HttpReq *req);
+static HttpReq *http_req(HttpClient *client);
 static void http_clearReq(HttpReq *req);
 static int http_init();
 static void http_free();
+static int http_textReserve(HttpText *text, size_t len);
+static int http_textPut(HttpText *text, const char *data, size_t len);
+
+////////////////////////////////////////////////////////////////////////////////
+
+static FormatStatus http_h2Start(HttpClient *client, BuffReader *reader);
+static FormatStatus http_h2OnFormat(HttpH2 *h2, BuffReader *reader);
+static void http_h2OnFrame(HttpH2 *h2, const HttpH2Frame *frame);
+static void http_h2OnData(HttpH2 *h2, const HttpH2Frame *frame);
+static int http_h2OnBody(HttpH2Stream *stream, HttpView data, size_t len);
+static void http_h2OnHeaders(HttpH2 *h2, const HttpH2Frame *frame);
+static void http_h2OnContinuation(HttpH2 *h2, const HttpH2Frame *frame);
+static void http_h2OnBlock(HttpH2 *h2, HttpView fragment, bool end);
+static void http_h2Headers(HttpH2 *h2, uint32_t id, bool endStream,
+                           HttpView block);
+static void http_h2OnField(void *context, const HpackField *field);
+static void http_h2OnPseudo(HttpH2Fields *fields, const HpackField *field);
+static int http_h2Request(HttpH2Stream *stream, HttpH2Fields *fields);
+static void http_h2OnReset(HttpH2 *h2, const HttpH2Frame *frame);
+static void http_h2OnSettings(HttpH2 *h2, const HttpH2Frame *frame);
+static int http_h2SetWindow(HttpH2 *h2, int64_t window);
+static void http_h2OnPing(HttpH2 *h2, const HttpH2Frame *frame);
+static void http_h2OnGoaway(HttpH2 *h2, const HttpH2Frame *frame);
+static void http_h2OnWindowUpdate(HttpH2 *h2, const HttpH2Frame *frame);
+static void http_h2OnWritable(HttpH2 *h2);
+static int http_h2Unpad(const HttpH2Frame *frame, HttpView *data);
+static void http_h2Dispatch(HttpH2Stream *stream);
+static void http_h2ResumeBody(HttpH2Stream *stream);
+static void http_h2Ack(HttpH2 *h2, HttpH2Stream *stream);
+static void http_h2Field(HttpH2Stream *stream, const char *name,
+                         size_t nameLen, const char *value, size_t valueLen);
+static void http_h2Line(HttpH2Stream *stream, HttpView line);
+static void http_h2Head(HttpH2Stream *stream, size_t size);
+static void http_h2Data(HttpH2Stream *stream, const char *data, size_t size,
+                        bool copy);
+static void http_h2File(HttpH2Stream *stream, int fd, size_t offset,
+                        size_t size);
+static void http_h2End(HttpH2Stream *stream);
+static void http_h2Flush(HttpH2Stream *stream);
+static void http_h2Drain(HttpH2Stream *stream);
+static void http_h2DrainAll(HttpH2 *h2);
+static size_t http_h2Left(const HttpH2Stream *stream);
+static void http_h2Frame(HttpH2 *h2, HttpH2FrameType type, uint8_t flags,
+                         uint32_t id, const void *payload, size_t len);
+static void http_h2FrameHead(HttpH2 *h2, HttpH2FrameType type, uint8_t flags,
+                             uint32_t id, size_t len);
+static void http_h2WindowUpdate(HttpH2 *h2, uint32_t id, size_t increment);
+static void http_h2SendReset(HttpH2 *h2, uint32_t id, HttpH2Error error);
+static void http_h2Fail(HttpH2 *h2, HttpH2Error error);
+static void http_h2Reset(HttpH2Stream *stream);
+static HttpH2Stream *http_h2Stream(HttpH2 *h2, uint32_t id);
+static HttpH2Stream *http_h2NewStream(HttpH2 *h2, uint32_t id);
+static void http_h2Release(HttpH2Stream *stream);
+static void http_h2Close(HttpH2Stream *stream);
+static void http_h2FreeStream(HttpH2Stream *stream);
+static void http_h2Free(HttpH2 *h2);
+static void http_h2Hold(HttpH2 *h2);
+static bool http_h2Is(const char *data, size_t len, const char *str);
+static uint32_t http_h2Get32(const char *data);
+static void http_h2Put32(char *dst, uint32_t value);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -193,14 +629,27 @@ int http_start(int port, int maxClients) {
   ServerParams params;
   params.host = "127.0.0.1";
   params.port = port;
+  params.inboxInitSize = INBOX_INIT_SIZE;
   params.inboxMaxSize = INBOX_MAX_SIZE;
   params.outboxInitSize = OUTBOX_INIT_SIZE;
+  params.clientDataSize = sizeof(HttpClient);
+  params.requestDataSize = sizeof(HttpReq);
   params.maxClients = maxClients;
+  params.numWorkers = 0;
+  params.backlog = HTTP_BACKLOG;
+  params.deferAccept = HTTP_DEFER_ACCEPT;
+  params.acceptBatch = HTTP_ACCEPT_BATCH;
+  params.headerTimeout = HTTP_HEADER_TIMEOUT;
+  params.bodyTimeout = HTTP_BODY_TIMEOUT;
+  params.idleTimeout = HTTP_IDLE_TIMEOUT;
+  params.writeTimeout = HTTP_WRITE_TIMEOUT;
+  params.drainTimeout = HTTP_DRAIN_TIMEOUT;
   params.onConnected = http_onConnected;
   params.onFormat = http_onFormat;
   params.onMessage = http_onMessage;
   params.onDisconnected = http_onDisconnected;
   params.onClean = http_onClean;
+  params.onWritable = http_onClientWritable;
 
   // Execution...
 
@@ -221,16 +670,15 @@ static int http_init() {
   http = malloc(sizeof(HttpServer));
 
   if (http == NULL) {
-    free(http);
     return -1;
   }
 
-  http->clients = vetor_criar(HTTP_CLIENTS_INIT_SIZE);
-
-  if (http->clients == NULL) {
-    free(http);
-    return -1;
-  }
+  http->handlers = NULL;
+  http->handlersLen = 0;
+  http->routes = NULL;
+  http->routesLen = 0;
+  http->regexHandlers = NULL;
+  http->regexHandlersLen = 0;
 
   return 0;
 }
@@ -238,18 +686,17 @@ static int http_init() {
 ////////////////////////////////////////////////////////////////////////////////
 
 static void http_free() {
-  for (size_t i = 0; i < vetor_qtd(http->clients); i++) {
-    HttpClient *client = vetor_item(http->clients, i);
-    http_freeClient(client);
+  for (size_t i = 0; i < http->routesLen; i++) {
+    router_free(&http->routes[i].router);
   }
 
-  vetor_destruir(http->clients);
-  http->clients = NULL;
-
-  for (int i = 0; i < http->handlersLen; i++) {
-    regfree(&http->handlers[i].pattern);
+  for (size_t i = 0; i < http->handlersLen; i++) {
+    http_freeHandler(http->handlers[i]);
   }
 
+  free(http->routes);
+  free(http->handlers);
+  free(http->regexHandlers);
   free(http);
 
   http = NULL;
@@ -257,909 +704,3738 @@ static void http_free() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void http_freeClient(HttpClient *client) {
-  if (client == NULL) return;
-  http_freeReq(client->req);
-  str_free(&client->resp);
-  free(client);
+int http_handler(const char *method, const char *pattern,
+                 HttpHandlerFunc func) {
+  return http_handlerStream(method, pattern, func, NULL);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int http_handler(const char *method, const char *pattern,
-                 HttpHandlerFunc func) {
+int http_handlerStream(const char *method, const char *pattern,
+                       HttpHandlerFunc func, HttpBodyFunc onBody) {
   if (http_init()) {
     return -1;
   }
 
-  HttpHandler *handler = &http->handlers[http->handlersLen++];
+  HttpRoutes *routes = http_routes(method);
+  HttpHandler *handler = http_newHandler(method, pattern, func, onBody);
 
-  if (regcomp(&handler->pattern, pattern, REG_EXTENDED)) {
-    log_erro("http", "Erro ao compilar expressão regular: %s.\n", pattern);
-    http->handlersLen--;
+  if (routes == NULL || handler == NULL) {
+    http_freeHandler(handler);
     return -1;
   }
 
-  strncpy(handler->patternRaw, pattern, PATTERN_MAX);
-
-  handler->func = func;
+  if (router_add(&routes->router, pattern, handler)) {
+    log_erro("http", "Rota inválida ou repetida: %s %s.\n", method, pattern);
+    http_freeHandler(handler);
+    return -1;
+  }
 
-  handler->method[0] = '\0';
-  strncat(handler->method, method, METHOD_MAX - 1);
+  if (http_append(&http->handlers, &http->handlersLen, sizeof(HttpHandler *),
+                  &handler)) {
+    // A rota não pode ser removida da árvore: o handler permanece nela.
+    return -1;
+  }
 
   return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void http_stop(int result) {
-  log_dbug("http", "Closing...\n");
-  server_stop(result);
-}
+int http_handlerRegex(const char *method, const char *pattern,
+                      HttpHandlerFunc func) {
+  if (http_init()) {
+    return -1;
+  }
 
-////////////////////////////////////////////////////////////////////////////////
+  HttpHandler *handler = http_newHandler(method, pattern, func, NULL);
 
-static void http_onConnected(int clientFd) {
-  HttpClient *client = http_client(clientFd);
+  if (handler == NULL) return -1;
 
-  if (client == NULL) {
-    log_erro("http", "http_client()");
-    server_close(clientFd);
-    return;
+  if (regcomp(&handler->regex, pattern, REG_EXTENDED)) {
+    log_erro("http", "Erro ao compilar expressão regular: %s.\n", pattern);
+    http_freeHandler(handler);
+    return -1;
   }
 
-  log_dbug("http", "Client connected: %d\n", clientFd);
-}
-
-////////////////////////////////////////////////////////////////////////////////
+  handler->isRegex = true;
 
-static void http_onClean(int clientFd) {
-  HttpClient *client = http_client(clientFd);
+  if (http_append(&http->regexHandlers, &http->regexHandlersLen,
+                  sizeof(HttpHandler *), &handler)) {
+    http_freeHandler(handler);
+    return -1;
+  }
 
-  http_clearClient(client);
+  if (http_append(&http->handlers, &http->handlersLen, sizeof(HttpHandler *),
+                  &handler)) {
+    http->regexHandlersLen--;
+    http_freeHandler(handler);
+    return -1;
+  }
 
-  log_dbug("http", "Client connected: %d\n", clientFd);
+  return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void http_onDisconnected(int clientFd) {
-  log_dbug("http", "Client disconnected: %d\n", clientFd);
-}
-
-////////////////////////////////////////////////////////////////////////////////
+/**
+ * Obtém as rotas do método, criando-as, caso ainda não existam.
+ */
+static HttpRoutes *http_routes(const char *method) {
+  for (size_t i = 0; i < http->routesLen; i++) {
+    if (strcmp(http->routes[i].method, method) == 0) return &http->routes[i];
+  }
 
-static void http_clearClient(HttpClient *client) {
-  http_clearReq(client->req);
-  str_clear(client->resp);
-}
+  HttpRoutes routes;
 
-////////////////////////////////////////////////////////////////////////////////
+  routes.method[0] = '\0';
+  strncat(routes.method, method, METHOD_MAX - 1);
+  router_init(&routes.router);
 
-static HttpClient *http_client(int clientFd) {
-  HttpClient *client = vetor_item(http->clients, clientFd);
-  if (client == NULL) {
-    client = http_newClient(clientFd);
-    vetor_inserir(http->clients, clientFd, client);
+  if (http_append(&http->routes, &http->routesLen, sizeof(HttpRoutes),
+                  &routes)) {
+    return NULL;
   }
-  return client;
+
+  return &http->routes[http->routesLen - 1];
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static HttpClient *http_newClient(int clientFd) {
-  HttpClient *client = malloc(sizeof(HttpClient));
+static HttpHandler *http_newHandler(const char *method, const char *pattern,
+                                    HttpHandlerFunc func, HttpBodyFunc onBody) {
+  HttpHandler *handler = malloc(sizeof(HttpHandler));
 
-  if (client == NULL) {
-    log_erro("http", "malloc() - %d - %s\n", errno, strerror(errno));
+  if (handler == NULL) {
+    log_erro("http", "malloc(): %d - %s\n", errno, strerror(errno));
     return NULL;
   }
 
-  client->fd = clientFd;
-  client->req = http_newReq();
-  client->resp = str_new(HTTP_RESP_INIT_SIZE);
-  return client;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-static void http_onMessage(int clientFd) {
-  HttpClient *client = http_client(clientFd);
+  size_t patternLen = strlen(pattern);
 
-  log_info("http", "%s %s\n", http_reqMethod(client), http_reqPath(client));
+  handler->pattern = malloc(patternLen + 1);
 
-  if (http_dispatch(client)) {
-    log_dbug("http", "Recurso não encontrado: %s.\n", http_reqPath(client));
-    http_sendNotFound(client);
-    return;
+  if (handler->pattern == NULL) {
+    log_erro("http", "malloc(): %d - %s\n", errno, strerror(errno));
+    free(handler);
+    return NULL;
   }
-}
 
-////////////////////////////////////////////////////////////////////////////////
-
-static size_t http_min(size_t a, size_t b) { return (a > b) ? b : a; }
+  memcpy(handler->pattern, pattern, patternLen + 1);
 
-////////////////////////////////////////////////////////////////////////////////
+  handler->method[0] = '\0';
+  strncat(handler->method, method, METHOD_MAX - 1);
 
-static int http_dispatch(HttpClient *client) {
-  const HttpHandler *matchedHandler = NULL;
-  regmatch_t args[ARGS_MAX];
+  handler->isRegex = false;
+  handler->func = func;
+  handler->onBody = onBody;
 
-  for (int i = 0; i < http->handlersLen; i++) {
-    HttpHandler *handler = &http->handlers[i];
+  return handler;
+}
 
-    if (strcmp(handler->method, http_reqMethod(client)) == 0 &&
-        regexec(&handler->pattern, http_reqPath(client), ARGS_MAX, args, 0) ==
-            0) {
-      client->req->pattern = handler->patternRaw;
+////////////////////////////////////////////////////////////////////////////////
 
-      for (size_t i = 1; i < ARGS_MAX && args[i].rm_so != -1; i++) {
-        client->req->argsLen++;
-        client->req->args[i - 1][0] = '\0';
+static void http_freeHandler(HttpHandler *handler) {
+  if (handler == NULL) return;
 
-        strncat(client->req->args[i - 1], http_reqPath(client) + args[i].rm_so,
-                http_min(ARG_MAX - 1, args[i].rm_eo - args[i].rm_so));
+  if (handler->isRegex) regfree(&handler->regex);
 
-        log_dbug("http", "Argumento: %s\n", client->req->args[i - 1]);
-      }
+  free(handler->pattern);
+  free(handler);
+}
 
-      matchedHandler = handler;
+////////////////////////////////////////////////////////////////////////////////
 
-      break;
-    }
-  }
+/**
+ * Acrescenta um item ao final do vetor, realocando-o.
+ */
+static int http_append(void *array, size_t *len, size_t size,
+                       const void *item) {
+  char *items = realloc(*(void **)array, size * (*len + 1));
 
-  if (matchedHandler == NULL) {
+  if (items == NULL) {
+    log_erro("http", "realloc(): %d - %s\n", errno, strerror(errno));
     return -1;
   }
 
-  matchedHandler->func(client);
+  memcpy(items + size * *len, item, size);
+
+  *(void **)array = items;
+  (*len)++;
 
   return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static HttpReq *http_newReq() {
-  HttpReq *req = malloc(sizeof(HttpReq));
-
-  if (req == NULL) {
-    log_erro("http", "malloc(): %d -  %s\n", errno, strerror(errno));
-    return NULL;
-  }
-
-  http_clearReq(req);
-
-  return req;
+void http_stop(int result) {
+  log_dbug("http", "Closing...\n");
+  server_stop(result);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void http_freeReq(HttpReq *req) { free(req); }
+static void http_onConnected(int clientFd) {
+  HttpClient *client = http_client(clientFd);
+
+  client->fd = clientFd;
+  client->req = NULL;
+  client->streaming = false;
+  client->onWritable = NULL;
+  client->requests = 0;
+  client->h2 = NULL;
+  client->stream = NULL;
+  client->defer = NULL;
+  client->compressible = false;
+  client->encoded = false;
+  client->gzip = NULL;
+  client->notModified = false;
+
+  log_dbug("http", "Client connected: %d\n", clientFd);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void http_clearReq(HttpReq *req) {
-  req->uriLen = 0;
-  req->methodLen = 0;
-  req->versionMinor = 0;
-  req->versionMajor = 0;
+static void http_onClean(int clientFd) {
+  HttpClient *client = http_client(clientFd);
 
-  req->headersLen = 0;
-  memset(req->headers, 0x0, sizeof(req->headers));
+  if (client->req != NULL) free(client->req->head);
 
-  req->paramsLen = 0;
-  memset(req->params, 0x0, sizeof(req->params));
+  // O servidor devolve a requisição concluída ao pool.
+  client->req = NULL;
 
-  req->bodyLen = 0;
-  req->contentLength = 0;
+  // A resposta em partes foi concluída ou interrompida.
+  client->streaming = false;
+  client->onWritable = NULL;
 
-  req->argsLen = 0;
+  client->compressible = false;
+  client->encoded = false;
+  client->notModified = false;
+  http_gzipFree(client);
 
-  req->state = stateMetodoInicio;
+  log_dbug("http", "Client cleaned: %d\n", clientFd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus http_onFormat(int clientFd, BuffReader *reader) {
+static void http_onClientWritable(int clientFd) {
   HttpClient *client = http_client(clientFd);
-  const char *c = NULL;
-  size_t r;
-
-  while ((r = buff_reader_read(reader, &c, 1)) > 0) {
-    FormatStatus state = client->req->state(client, *c);
 
-    if (state != FORMAT_PART) {
-      return state;
-    }
+  if (client->h2 != NULL) {
+    http_h2OnWritable(client->h2);
+    return;
   }
 
-  return FORMAT_PART;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-static bool http_isCtl(int c) { return (c >= 0 && c <= 31) || (c == 127); }
+  HttpWritableFunc func = client->onWritable;
 
-////////////////////////////////////////////////////////////////////////////////
+  client->onWritable = NULL;
 
-static bool http_isLetter(char c) {
-  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
-    return true;
-  else
-    return false;
+  if (func != NULL) func(client);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static bool http_isDigit(int c) { return c >= '0' && c <= '9'; }
+static void http_onDisconnected(int clientFd) {
+  HttpClient *client = http_client(clientFd);
 
-////////////////////////////////////////////////////////////////////////////////
+  if (client == NULL) return;
 
-static FormatStatus stateMetodoInicio(HttpClient *client, char c) {
-  if (c < 'A' || c > 'Z') {
-    log_erro("http",
-             "stateMetodoInicio() - esperando a letra (A-Z), mas veio: %c.\n",
-             c);
-    return FORMAT_ERROR;
+  // Os streams em andamento são descartados com a conexão.
+  if (client->h2 != NULL) {
+    http_h2Free(client->h2);
+    client->h2 = NULL;
   }
 
-  client->req->state = stateMetodo;
-
-  client->req->method[client->req->methodLen++] = c;
-  client->req->method[client->req->methodLen] = '\0';
+  http_deferDrop(client);
 
-  return FORMAT_PART;
+  log_dbug("http", "Client disconnected: %d\n", clientFd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateMetodo(HttpClient *client, char c) {
-  if (c == ' ') {
-    log_dbug("http", "Método: %s\n", client->req->method);
-    client->req->state = stateUri;
-    return FORMAT_PART;
-  }
+static HttpClient *http_client(int clientFd) {
+  return server_clientData(clientFd);
+}
 
-  if (c < 'A' || c > 'Z') {
-    log_erro("http", "stateMetodo() - esperando a letra (A-Z), mas veio: %c.\n",
-             c);
-    return FORMAT_ERROR;
-  }
+////////////////////////////////////////////////////////////////////////////////
 
-  client->req->method[client->req->methodLen++] = c;
-  client->req->method[client->req->methodLen] = '\0';
+static void http_onMessage(int clientFd) {
+  HttpClient *client = http_client(clientFd);
 
-  return FORMAT_PART;
-}
+  log_info("http", "%s %s\n", http_reqMethod(client), http_reqPath(client));
 
-////////////////////////////////////////////////////////////////////////////////
+  client->requests++;
 
-static FormatStatus stateUri(HttpClient *client, char c) {
-  if (c == ' ') {
-    log_dbug("http", "Uri: %s\n", client->req->uri);
-    client->req->state = stateHttpVersionH;
-    return FORMAT_PART;
-  }
+  // Decidido antes do handler, que pode responder de forma assíncrona: as
+  // requisições seguintes não são processadas.
+  client->req->keepAlive = http_keepAlive(client);
 
-  if (http_isCtl(c)) {
-    log_erro("http",
-             "stateUri() - esperando a letra, número, símbolo ou "
-             "pontuação, mas veio: %02X.\n",
-             c);
-    return FORMAT_ERROR;
-  }
+  if (!client->req->keepAlive) server_closeAfter(clientFd);
 
-  if (c == '?') {
-    client->req->state = stateParamNovo;
-    return FORMAT_PART;
+  if (client->req->handler == NULL) {
+    log_dbug("http", "Recurso não encontrado: %s.\n", http_reqPath(client));
+    http_sendNotFound(client);
+    return;
   }
 
-  client->req->uri[client->req->uriLen++] = c;
-  client->req->uri[client->req->uriLen] = '\0';
-
-  return FORMAT_PART;
+  client->req->handler->func(client);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateParamNome(HttpClient *client, char c) {
-  HttpParam *param = &client->req->params[client->req->paramsLen - 1];
+/**
+ * Verifica se a conexão deve continuar aberta após a resposta: no HTTP/1.1,
+ * exceto se o cliente enviar "Connection: close"; no HTTP/1.0, somente se
+ * enviar "Connection: keep-alive". Em ambos, até HTTP_KEEPALIVE_MAX
+ * requisições por conexão.
+ */
+static bool http_keepAlive(HttpClient *client) {
+  HttpView connection = http_reqHeaderView(client, "connection");
 
-  if (c == ' ') {
-    log_dbug("http", "Nome de parâmetro: %s\n", param->name);
-    client->req->state = stateHttpVersionH;
-    return FORMAT_PART;
-  }
+  if (client->requests >= HTTP_KEEPALIVE_MAX) return false;
 
-  if (c == '=') {
-    log_dbug("http", "Nome de parâmetro: %s\n", param->name);
-    client->req->state = stateParamValor;
-    return FORMAT_PART;
-  }
+  if (http_hasToken(connection, "close")) return false;
 
-  if (http_isCtl(c)) {
-    log_erro("http",
-             "stateParamNome() - esperando a letra, número, símbolo ou "
-             "pontuação, mas veio: %02X.\n",
-             c);
-    return FORMAT_ERROR;
+  if (http_isHttp10(client->req)) {
+    return http_hasToken(connection, "keep-alive");
   }
 
-  if (param->nameLen >= PARAM_NAME_MAX) {
-    log_erro("http",
-             "stateParamNome() - nome do parâmetro maior do que o permitido: "
-             "%ld\n",
-             PARAM_NAME_MAX);
-    return FORMAT_ERROR;
-  }
+  return true;
+}
 
-  param->name[param->nameLen++] = c;
-  param->name[param->nameLen] = '\0';
+////////////////////////////////////////////////////////////////////////////////
 
-  return FORMAT_PART;
+static bool http_isHttp10(const HttpReq *req) {
+  return req->versionMajor < 1 ||
+         (req->versionMajor == 1 && req->versionMinor == 0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateParamValor(HttpClient *client, char c) {
-  HttpParam *param = &client->req->params[client->req->paramsLen - 1];
-
-  if (c == ' ') {
-    log_dbug("http", "Valor de parâmetro: %s\n", param->value);
-    client->req->state = stateHttpVersionH;
-    return FORMAT_PART;
-  }
+static size_t http_min(size_t a, size_t b) { return (a > b) ? b : a; }
 
-  if (c == '&') {
-    log_dbug("http", "Valor de parâmetro: %s\n", param->value);
-    client->req->state = stateParamNovo;
-    return FORMAT_PART;
-  }
+////////////////////////////////////////////////////////////////////////////////
 
-  if (http_isCtl(c)) {
-    log_erro("http",
-             "stateParamValor() - esperando a letra, número, símbolo ou "
-             "pontuação, mas veio: %02X.\n",
-             c);
-    return FORMAT_ERROR;
-  }
+static int http_toInt(const char *value, int def) {
+  if (value[0] == '\0') return def;
 
-  if (param->valueLen >= PARAM_VALUE_MAX) {
-    log_erro("http",
-             "stateParamValor() - valor do parâmetro maior do que o "
-             "permitido: %ld.\n",
-             PARAM_VALUE_MAX);
-    return FORMAT_ERROR;
-  }
+  errno = 0;
+  long r = strtol(value, NULL, 10);
 
-  param->value[param->valueLen++] = c;
-  param->value[param->valueLen] = '\0';
+  if (errno == ERANGE || r > INT_MAX || r < INT_MIN) return def;
 
-  return FORMAT_PART;
+  return (int)r;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateParamNovo(HttpClient *client, char c) {
-  if (http_isCtl(c)) {
-    log_erro("http",
-             "stateParamNovo() - esperando a letra, número, símbolo ou "
-             "pontuação, mas veio: %02X.\n",
-             c);
-    return FORMAT_ERROR;
-  }
+/**
+ * Escolhe o handler da requisição na árvore de rotas do método, guardando os
+ * argumentos capturados pelo padrão. As expressões regulares são consultadas
+ * somente se nenhuma rota corresponder.
+ *
+ * @return handler, ou NULL, caso nenhum corresponda à requisição.
+ */
+static const HttpHandler *http_route(HttpClient *client) {
+  HttpReq *req = client->req;
+  const char *method = http_reqMethod(client);
+  RouterMatch match;
+
+  for (size_t i = 0; i < http->routesLen; i++) {
+    if (strcmp(http->routes[i].method, method) != 0) continue;
+
+    if (router_find(&http->routes[i].router, http_reqPath(client), req->uri.len,
+                    &match)) {
+      const HttpHandler *handler = match.value;
+      req->pattern = handler->pattern;
+      http_setArgs(req, match.args, match.argsLen);
+      return handler;
+    }
 
-  if (client->req->paramsLen >= PARAMS_MAX) {
-    log_erro("http",
-             "stateParamNovo() - quantidade de parâmetros maior do que o "
-             "permitido: %ld\n",
-             PARAMS_MAX);
-    return FORMAT_ERROR;
+    break;
   }
 
-  log_dbug("http", "stateParamNovo()\n");
-
-  HttpParam *param = &client->req->params[client->req->paramsLen++];
-  param->name[param->nameLen++] = c;
-  param->name[param->nameLen] = '\0';
-
-  client->req->state = stateParamNome;
-  return FORMAT_PART;
+  return http_routeRegex(client);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateHttpVersionH(HttpClient *client, char c) {
-  if (c == 'H') {
-    client->req->state = stateHttpVersionT1;
-    return FORMAT_PART;
-  }
+static const HttpHandler *http_routeRegex(HttpClient *client) {
+  const char *path = http_reqPath(client);
+  regmatch_t groups[ARGS_MAX + 1];
+  RouterArg args[ARGS_MAX];
 
-  log_erro("http",
-           "stateHttpVersionH() - esperando a letra 'H', mas veio: %c.\n", c);
+  for (size_t i = 0; i < http->regexHandlersLen; i++) {
+    const HttpHandler *handler = http->regexHandlers[i];
 
-  return FORMAT_ERROR;
-}
+    if (strcmp(handler->method, http_reqMethod(client)) != 0 ||
+        regexec(&handler->regex, path, ARGS_MAX + 1, groups, 0) != 0) {
+      continue;
+    }
 
-////////////////////////////////////////////////////////////////////////////////
+    int len = 0;
 
-static FormatStatus stateHttpVersionT1(HttpClient *client, char c) {
-  if (c == 'T') {
-    client->req->state = stateHttpVersionT2;
-    return FORMAT_PART;
-  }
+    for (; len < ARGS_MAX && groups[len + 1].rm_so != -1; len++) {
+      regmatch_t *group = &groups[len + 1];
+      args[len] = (RouterArg){NULL, path + group->rm_so,
+                              group->rm_eo - group->rm_so};
+    }
+
+    client->req->pattern = handler->pattern;
+    http_setArgs(client->req, args, len);
 
-  log_erro("http",
-           "stateHttpVersionT1() - esperando a letra 'T', mas veio: %c.\n", c);
+    return handler;
+  }
 
-  return FORMAT_ERROR;
+  return NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateHttpVersionT2(HttpClient *client, char c) {
-  if (c == 'T') {
-    client->req->state = stateHttpVersionP;
-    return FORMAT_PART;
-  }
+/**
+ * Copia os argumentos, que apontam para o caminho, para a requisição, onde são
+ * terminados em '\0'.
+ */
+static void http_setArgs(HttpReq *req, const RouterArg *args, int len) {
+  size_t used = 0;
 
-  log_erro("http",
-           "stateHttpVersionT2() - esperando a letra 'T', mas veio: %c.\n", c);
+  req->argsLen = 0;
 
-  return FORMAT_ERROR;
-}
+  for (int i = 0; i < len && i < ARGS_MAX; i++) {
+    // Os grupos de uma expressão regular podem se sobrepor.
+    if (used + args[i].len + 1 > sizeof(req->argsData)) break;
 
-////////////////////////////////////////////////////////////////////////////////
+    char *arg = req->argsData + used;
 
-static FormatStatus stateHttpVersionP(HttpClient *client, char c) {
-  if (c == 'P') {
-    client->req->state = stateHttpVersionSlash;
-    return FORMAT_PART;
-  }
+    memcpy(arg, args[i].value, args[i].len);
+    arg[args[i].len] = '\0';
+    used += args[i].len + 1;
 
-  log_erro("http",
-           "stateHttpVersionP() - esperando a letra 'P', mas veio: %c.\n", c);
+    req->args[i] = arg;
+    req->argNames[i] = args[i].name;
+    req->argsLen++;
 
-  return FORMAT_ERROR;
+    log_dbug("http", "Argumento: %s\n", arg);
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateHttpVersionSlash(HttpClient *client, char c) {
-  if (c == '/') {
-    client->req->versionMajor = 0;
-    client->req->versionMinor = 0;
-    client->req->state = stateHttpVersao1Inicio;
-    return FORMAT_PART;
-  }
+/**
+ * Obtém a requisição em andamento, iniciando uma nova no primeiro byte.
+ */
+static HttpReq *http_req(HttpClient *client) {
+  if (client->req != NULL) return client->req;
 
-  log_erro("http",
-           "stateHttpVersionSlash() - esperando barra invertida (/), mas "
-           "veio: %c.\n",
-           c);
+  client->req = server_requestData(client->fd);
 
-  return FORMAT_ERROR;
+  if (client->req != NULL) http_clearReq(client->req);
+
+  return client->req;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateHttpVersao1Inicio(HttpClient *client, char c) {
-  if (http_isDigit(c)) {
-    client->req->versionMajor *= 10 + (unsigned)c - '0';
-    client->req->state = stateHttpVersao1;
-    return FORMAT_PART;
+/**
+ * Reinicia a requisição. Os cabeçalhos e parâmetros não são zerados: cada um é
+ * inicializado ao ser criado pelo parser.
+ */
+static void http_clearReq(HttpReq *req) {
+  req->data = NULL;
+  req->method = (HttpSpan){0, 0};
+  req->uri = (HttpSpan){0, 0};
+  req->versionMinor = 0;
+  req->versionMajor = 0;
+  req->keepAlive = true;
+
+  req->headersLen = 0;
+  req->paramsLen = 0;
+
+  req->contentLength = 0;
+
+  req->chunked = false;
+  req->chunkState = HTTP_CHUNK_SIZE;
+  req->chunkLeft = 0;
+  req->chunkPos = 0;
+
+  req->handler = NULL;
+  req->head = NULL;
+  req->bodyRead = 0;
+  req->paused = false;
+
+  req->argsLen = 0;
+  req->pattern = NULL;
+
+  req->headParsed = false;
+  req->headScanned = 0;
+  req->headLen = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static FormatStatus http_onFormat(int clientFd, BuffReader *reader) {
+  HttpClient *client = http_client(clientFd);
+
+  if (client->h2 != NULL) return http_h2OnFormat(client->h2, reader);
+
+  // O prefácio do HTTP/2 é esperado somente no início da conexão.
+  if (client->req == NULL && client->requests == 0) {
+    FormatStatus status = http_h2Start(client, reader);
+    if (status != FORMAT_OK) return status;
+  }
+
+  if (http_req(client) == NULL) {
+    log_erro("http", "http_req()\n");
+    return FORMAT_ERROR;
+  }
+
+  HttpReq *req = client->req;
+
+  if (!req->headParsed) {
+    FormatStatus status = http_parseHead(client, reader);
+
+    if (status != FORMAT_OK) return status;
+
+    if (req->contentLength > 0 || req->chunked) {
+      server_readBody(client->fd);
+
+      if (req->handler != NULL && req->handler->onBody != NULL &&
+          http_keepHead(req, reader)) {
+        return FORMAT_ERROR;
+      }
+    }
+  }
+
+  if (req->head != NULL) {
+    return req->chunked ? http_streamChunks(client, reader)
+                        : http_streamBody(client, reader);
+  }
+
+  if (req->chunked) return http_readChunks(client, reader);
+
+  // A requisição é consumida somente quando o corpo também estiver no inbox,
+  // contíguo ao cabeçalho.
+  size_t size = req->headLen + req->contentLength;
+
+  if (buff_reader_size(reader) < size) {
+    buff_reader_linearize(reader);
+    if (buff_reader_size(reader) < size) return FORMAT_PART;
+  }
+
+  req->data = buff_reader_data(reader);
+  buff_reader_commit(reader, size);
+
+  return FORMAT_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Procura o primeiro byte igual a a ou b, ou que seja caractere de controle
+ * (incluindo '\r', '\n' e '\t'), examinando 32 (AVX2) ou 16 (SSE2) bytes por
+ * vez. O restante e as demais arquiteturas são examinados byte a byte.
+ *
+ * @return posição do byte encontrado ou size, caso não exista.
+ */
+static size_t http_scan(const char *data, size_t size, char a, char b) {
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  const __m256i va = _mm256_set1_epi8(a);
+  const __m256i vb = _mm256_set1_epi8(b);
+  const __m256i vctl = _mm256_set1_epi8(0x1f);
+  const __m256i vdel = _mm256_set1_epi8(0x7f);
+
+  for (; i + 32 <= size; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, va),
+                                _mm256_cmpeq_epi8(v, vb));
+    // v <= 0x1f, sem sinal.
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(v, vctl), v));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, vdel));
+
+    unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+#elif defined(__SSE2__)
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  const __m128i vctl = _mm_set1_epi8(0x1f);
+  const __m128i vdel = _mm_set1_epi8(0x7f);
+
+  for (; i + 16 <= size; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb));
+    // v <= 0x1f, sem sinal.
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, vctl), v));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, vdel));
+
+    unsigned mask = (unsigned)_mm_movemask_epi8(m);
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; i < size; i++) {
+    unsigned char c = data[i];
+    if (data[i] == a || data[i] == b || c < 0x20 || c == 0x7f) return i;
+  }
+
+  return size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Procura o fim do cabeçalho ("\r\n\r\n"), continuando a partir dos bytes já
+ * examinados nas chamadas anteriores.
+ *
+ * @return posição seguinte ao fim do cabeçalho ou 0, caso ainda não tenha sido
+ *         recebido.
+ */
+static size_t http_headEnd(const char *data, size_t size, size_t from) {
+  // O fim pode ter chegado pela metade na leitura anterior.
+  size_t i = (from > 3) ? from - 3 : 0;
+
+  while (i < size) {
+    i += http_scan(data + i, size - i, '\r', '\r');
+
+    if (size - i >= 4 && memcmp(data + i, "\r\n\r\n", 4) == 0) {
+      return i + 4;
+    }
+
+    i++;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Interpreta o cabeçalho somente depois de recebido por completo, em uma única
+ * passada sobre o inbox. Cada campo é localizado como um trecho (HttpSpan) do
+ * próprio inbox, sem cópia. O cabeçalho não é consumido aqui: a requisição é
+ * consumida por inteiro, com o corpo, para que o servidor a retenha.
+ */
+static FormatStatus http_parseHead(HttpClient *client, BuffReader *reader) {
+  HttpReq *req = client->req;
+  const char *data = buff_reader_data(reader);
+  size_t size = buff_reader_size(reader);
+  size_t end = http_headEnd(data, size, req->headScanned);
+
+  if (end == 0) {
+    // O restante do cabeçalho pode estar no segundo segmento do inbox.
+    buff_reader_linearize(reader);
+    data = buff_reader_data(reader);
+    size = buff_reader_size(reader);
+    end = http_headEnd(data, size, req->headScanned);
+  }
+
+  if (end == 0) {
+    req->headScanned = size;
+    return FORMAT_PART;
+  }
+
+  size_t pos = 0;
+
+  req->data = data;
+
+  if (http_parseRequestLine(req, data, end, &pos) ||
+      http_parseHeaders(req, data, end, pos)) {
+    return FORMAT_ERROR;
+  }
+
+  // O handler define como o corpo será recebido.
+  req->handler = http_route(client);
+
+  if (http_parseContentLength(client) || http_parseTransferEncoding(client)) {
+    return FORMAT_ERROR;
+  }
+
+  req->headLen = end;
+  req->headParsed = true;
+
+  return FORMAT_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Interpreta a linha "MÉTODO URI[?PARÂMETROS] HTTP/X.Y\r\n". O cabeçalho
+ * completo termina com "\r\n\r\n", portanto cada busca encontra um delimitador
+ * ou um caractere de controle antes do fim dos dados.
+ */
+static int http_parseRequestLine(HttpReq *req, const char *data, size_t size,
+                                 size_t *pos) {
+  HttpSpan method = {0, http_scan(data, size, ' ', ' ')};
+
+  if (method.len == 0 || method.len >= METHOD_MAX || data[method.len] != ' ') {
+    log_erro("http", "http_parseRequestLine() - método inválido.\n");
+    return -1;
+  }
+
+  for (size_t i = 0; i < method.len; i++) {
+    if (data[i] < 'A' || data[i] > 'Z') {
+      log_erro("http",
+               "http_parseRequestLine() - esperando a letra (A-Z), mas veio: "
+               "%c.\n",
+               data[i]);
+      return -1;
+    }
+  }
+
+  HttpSpan path = {method.len + 1, 0};
+  path.len = http_scan(data + path.offset, size - path.offset, ' ', '?');
+
+  size_t i = path.offset + path.len;
+
+  if (path.len == 0 || path.len >= URI_MAX ||
+      (data[i] != ' ' && data[i] != '?')) {
+    log_erro("http", "http_parseRequestLine() - uri inválida.\n");
+    return -1;
+  }
+
+  if (data[i] == '?') {
+    HttpSpan query = {i + 1, 0};
+    query.len = http_scan(data + query.offset, size - query.offset, ' ', ' ');
+
+    i = query.offset + query.len;
+
+    if (data[i] != ' ') {
+      log_erro("http", "http_parseRequestLine() - parâmetros inválidos.\n");
+      return -1;
+    }
+
+    if (http_parseQuery(req, data, query)) {
+      return -1;
+    }
+  }
+
+  // HTTP-version = "HTTP/" DIGIT "." DIGIT
+  const char *version = data + i + 1;
+
+  if (size - i - 1 < 10 || memcmp(version, "HTTP/", 5) != 0 ||
+      !http_isDigit(version[5]) || version[6] != '.' ||
+      !http_isDigit(version[7]) || version[8] != '\r' || version[9] != '\n') {
+    log_erro("http", "http_parseRequestLine() - versão inválida.\n");
+    return -1;
+  }
+
+  req->method = method;
+  http_terminate(data, method);
+
+  req->uri = path;
+  http_terminate(data, path);
+
+  req->versionMajor = version[5] - '0';
+  req->versionMinor = version[7] - '0';
+
+  log_dbug("http", "Método: %s, Uri: %s\n", data + method.offset,
+           data + path.offset);
+
+  *pos = i + 1 + 10;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Separa os parâmetros "nome=valor" da uri, delimitados por '&'.
+ */
+static int http_parseQuery(HttpReq *req, const char *data, HttpSpan query) {
+  size_t i = query.offset;
+  size_t size = query.offset + query.len;
+
+  while (i < size) {
+    const char *amp = memchr(data + i, '&', size - i);
+    size_t end = (amp != NULL) ? (size_t)(amp - data) : size;
+
+    if (end > i) {
+      const char *eq = memchr(data + i, '=', end - i);
+      HttpSpan name = {i, end - i};
+      HttpSpan value = {end, 0};
+
+      if (eq != NULL) {
+        name.len = (size_t)(eq - data) - i;
+        value.offset = name.offset + name.len + 1;
+        value.len = end - value.offset;
+      }
+
+      if (req->paramsLen >= PARAMS_MAX) {
+        log_erro("http",
+                 "http_parseQuery() - quantidade de parâmetros maior do que o "
+                 "permitido: %d\n",
+                 PARAMS_MAX);
+        return -1;
+      }
+
+      if (name.len >= PARAM_NAME_MAX || value.len >= PARAM_VALUE_MAX) {
+        log_erro("http",
+                 "http_parseQuery() - parâmetro maior do que o permitido.\n");
+        return -1;
+      }
+
+      HttpParam *param = &req->params[req->paramsLen++];
+      param->name = name;
+      param->value = value;
+      http_terminate(data, name);
+      http_terminate(data, value);
+    }
+
+    i = end + 1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Interpreta as linhas "Nome: valor\r\n" a partir de pos, até a linha vazia.
+ */
+static int http_parseHeaders(HttpReq *req, const char *data, size_t size,
+                             size_t pos) {
+  while (data[pos] != '\r') {
+    if (req->headersLen >= HEADERS_MAX) {
+      log_erro("http",
+               "http_parseHeaders() - quantidade de cabecalhos maior do que o "
+               "permitido: %d.\n",
+               HEADERS_MAX);
+      return -1;
+    }
+
+    HttpSpan name = {pos, http_scan(data + pos, size - pos, ':', ':')};
+
+    pos += name.len;
+
+    if (name.len == 0 || name.len >= HEADER_NAME_MAX || data[pos] != ':') {
+      log_erro("http", "http_parseHeaders() - nome de cabeçalho inválido.\n");
+      return -1;
+    }
+
+    for (size_t i = name.offset; i < pos; i++) {
+      if (!http_isToken(data[i])) {
+        log_erro("http",
+                 "http_parseHeaders() - caractere inválido no nome do "
+                 "cabeçalho: %c.\n",
+                 data[i]);
+        return -1;
+      }
+    }
+
+    pos++;
+
+    while (data[pos] == ' ' || data[pos] == '\t') pos++;
+
+    HttpSpan value = {pos, 0};
+
+    // Tabulações são permitidas no valor, os demais caracteres de controle não.
+    for (;;) {
+      pos += http_scan(data + pos, size - pos, '\r', '\r');
+      if (data[pos] != '\t') break;
+      pos++;
+    }
+
+    if (data[pos] != '\r' || data[pos + 1] != '\n') {
+      log_erro("http",
+               "http_parseHeaders() - caractere de controle no valor do "
+               "cabeçalho: %02X.\n",
+               data[pos]);
+      return -1;
+    }
+
+    value.len = pos - value.offset;
+
+    while (value.len > 0 && (data[value.offset + value.len - 1] == ' ' ||
+                             data[value.offset + value.len - 1] == '\t')) {
+      value.len--;
+    }
+
+    if (value.len >= HEADER_VALUE_MAX) {
+      log_erro("http",
+               "http_parseHeaders() - valor do cabeçalho maior do que o "
+               "permitido: %d.\n",
+               HEADER_VALUE_MAX);
+      return -1;
+    }
+
+    HttpHeader *header = &req->headers[req->headersLen++];
+    header->name = name;
+    header->value = value;
+    http_terminate(data, name);
+    http_terminate(data, value);
+
+    pos += 2;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int http_parseContentLength(HttpClient *client) {
+  const char *contentLength = http_reqHeader(client, "Content-Length");
+
+  if (contentLength[0] == '\0') return 0;
+
+  const HttpHandler *handler = client->req->handler;
+  long max = (handler != NULL && handler->onBody != NULL) ? BODY_STREAM_MAX
+                                                          : BODY_MAX;
+  char *end = NULL;
+  long len = strtol(contentLength, &end, 10);
+
+  if (!http_isDigit(contentLength[0]) || *end != '\0' || len >= max) {
+    log_erro("http", "http_parseContentLength() - inválido: %s.\n",
+             contentLength);
+    return -1;
+  }
+
+  client->req->contentLength = (size_t)len;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Somente a codificação "chunked" é aceita, e não junto com Content-Length, o
+ * que permitiria ao cliente e a um proxy discordarem sobre o fim do corpo.
+ */
+static int http_parseTransferEncoding(HttpClient *client) {
+  HttpReq *req = client->req;
+
+  for (int i = 0; i < req->headersLen; i++) {
+    if (!http_equals(req, req->headers[i].name, "Transfer-Encoding")) continue;
+
+    if (req->chunked || req->contentLength > 0 ||
+        http_reqHeader(client, "Content-Length")[0] != '\0' ||
+        !http_equals(req, req->headers[i].value, "chunked")) {
+      log_erro("http", "http_parseTransferEncoding() - inválido: %s.\n",
+               req->data + req->headers[i].value.offset);
+      return -1;
+    }
+
+    req->chunked = true;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Avança a decodificação do corpo em partes sobre data, a partir de *pos. Os
+ * dados de uma parte, ou o trecho dela que já chegou, são apontados por chunk,
+ * sem cópia.
+ *
+ * @return 1, caso tenha avançado, 0, caso faltem dados para avançar, ou -1, em
+ *         caso de erro.
+ */
+static int http_parseChunk(HttpReq *req, const char *data, size_t size,
+                           size_t *pos, HttpView *chunk) {
+  size_t i = *pos;
+
+  *chunk = (HttpView){"", 0};
+
+  if (req->chunkState == HTTP_CHUNK_DATA) {
+    if (i == size) return 0;
+
+    size_t len = http_min(req->chunkLeft, size - i);
+
+    *chunk = (HttpView){data + i, len};
+    *pos = i + len;
+
+    req->chunkLeft -= len;
+    if (req->chunkLeft == 0) req->chunkState = HTTP_CHUNK_DATA_END;
+
+    return 1;
+  }
+
+  const char *lf = memchr(data + i, '\n', size - i);
+
+  if (lf == NULL) {
+    if (size - i >= HEADER_NAME_MAX + HEADER_VALUE_MAX) {
+      log_erro("http", "http_parseChunk() - linha maior do que a permitida.\n");
+      return -1;
+    }
+    return 0;
+  }
+
+  size_t end = (size_t)(lf - data);
+
+  if (end == i || data[end - 1] != '\r') {
+    log_erro("http", "http_parseChunk() - esperando \\r\\n.\n");
+    return -1;
+  }
+
+  *pos = end + 1;
+
+  switch (req->chunkState) {
+    case HTTP_CHUNK_SIZE: {
+      size_t len = 0;
+      size_t j = i;
+
+      for (; j < end - 1; j++) {
+        char c = data[j];
+        int digit;
+
+        if (http_isDigit(c)) {
+          digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+          digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+          digit = c - 'A' + 10;
+        } else {
+          break;
+        }
+
+        if (len > BODY_STREAM_MAX) break;
+
+        len = len * 16 + digit;
+      }
+
+      // As extensões (";nome=valor") são ignoradas.
+      if (j == i || len > BODY_STREAM_MAX ||
+          (j < end - 1 && data[j] != ';' && data[j] != ' ' &&
+           data[j] != '\t')) {
+        log_erro("http", "http_parseChunk() - tamanho inválido.\n");
+        return -1;
+      }
+
+      req->chunkLeft = len;
+      req->chunkState = (len > 0) ? HTTP_CHUNK_DATA : HTTP_CHUNK_TRAILER;
+      return 1;
+    }
+    case HTTP_CHUNK_DATA_END:
+      if (end - 1 != i) {
+        log_erro("http", "http_parseChunk() - parte maior do que o tamanho.\n");
+        return -1;
+      }
+      req->chunkState = HTTP_CHUNK_SIZE;
+      return 1;
+    case HTTP_CHUNK_TRAILER:
+      // Os trailers são ignorados, até a linha vazia.
+      if (end - 1 == i) req->chunkState = HTTP_CHUNK_DONE;
+      return 1;
+    default:
+      return -1;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Decodifica o corpo em partes no próprio inbox: os dados de cada parte são
+ * movidos para logo após o cabeçalho, sobre os delimitadores já interpretados.
+ * Ao final, o corpo é contíguo, como se tivesse sido enviado com
+ * Content-Length.
+ */
+static FormatStatus http_readChunks(HttpClient *client, BuffReader *reader) {
+  HttpReq *req = client->req;
+
+  // Os delimitadores podem estar divididos entre os dois segmentos do inbox.
+  buff_reader_linearize(reader);
+
+  char *data = (char *)buff_reader_data(reader);
+  size_t size = buff_reader_size(reader);
+  size_t pos = (req->chunkPos > 0) ? req->chunkPos : req->headLen;
+  HttpView chunk;
+  int r;
+
+  while (req->chunkState != HTTP_CHUNK_DONE &&
+         (r = http_parseChunk(req, data, size, &pos, &chunk)) != 0) {
+    if (r == -1) return FORMAT_ERROR;
+
+    if (req->contentLength + chunk.len >= BODY_MAX) {
+      log_erro("http", "http_readChunks() - corpo maior do que o permitido.\n");
+      return FORMAT_ERROR;
+    }
+
+    memmove(data + req->headLen + req->contentLength, chunk.data, chunk.len);
+    req->contentLength += chunk.len;
+  }
+
+  if (req->chunkState != HTTP_CHUNK_DONE) {
+    req->chunkPos = pos;
+    return FORMAT_PART;
+  }
+
+  req->data = data;
+  buff_reader_commit(reader, pos);
+
+  return FORMAT_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Como http_streamBody(), mas decodificando o corpo em partes: somente os dados
+ * de cada parte são entregues ao handler.
+ */
+static FormatStatus http_streamChunks(HttpClient *client, BuffReader *reader) {
+  HttpReq *req = client->req;
+  HttpView chunk;
+  size_t bodyRead = req->bodyRead;
+
+  while (!req->paused && req->chunkState != HTTP_CHUNK_DONE) {
+    const char *data = buff_reader_data(reader);
+    size_t size = buff_reader_size(reader);
+    size_t pos = 0;
+    int r = http_parseChunk(req, data, size, &pos, &chunk);
+
+    if (r == -1) return FORMAT_ERROR;
+
+    if (r == 0) {
+      // A linha pode estar dividida entre os dois segmentos do inbox.
+      buff_reader_linearize(reader);
+      if (buff_reader_size(reader) == size) break;
+      continue;
+    }
+
+    buff_reader_commit(reader, pos);
+
+    if (req->bodyRead + chunk.len > BODY_STREAM_MAX) {
+      log_erro("http",
+               "http_streamChunks() - corpo maior do que o permitido.\n");
+      return FORMAT_ERROR;
+    }
+
+    if (chunk.len > 0) {
+      req->bodyRead += chunk.len;
+      req->handler->onBody(client, chunk);
+    }
+  }
+
+  if (req->chunkState == HTTP_CHUNK_DONE) return FORMAT_OK;
+
+  // O corpo avançou: o prazo para a próxima parte é renovado.
+  if (req->bodyRead != bodyRead) server_readBody(client->fd);
+
+  return FORMAT_PART;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Copia o cabeçalho para fora do inbox, que fica livre para as partes do corpo.
+ */
+static int http_keepHead(HttpReq *req, BuffReader *reader) {
+  req->head = malloc(req->headLen);
+
+  if (req->head == NULL) {
+    log_erro("http", "malloc(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  memcpy(req->head, req->data, req->headLen);
+  req->data = req->head;
+
+  buff_reader_commit(reader, req->headLen);
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Entrega ao handler, direto do inbox, as partes do corpo que já chegaram. A
+ * requisição é concluída após a última parte.
+ */
+static FormatStatus http_streamBody(HttpClient *client, BuffReader *reader) {
+  HttpReq *req = client->req;
+  const char *data = NULL;
+  size_t bodyRead = req->bodyRead;
+  int len;
+
+  while (!req->paused && req->bodyRead < req->contentLength &&
+         (len = buff_reader_read(reader, &data,
+                                 req->contentLength - req->bodyRead)) > 0) {
+    req->bodyRead += len;
+    req->handler->onBody(client, (HttpView){data, len});
+  }
+
+  if (req->bodyRead == req->contentLength) return FORMAT_OK;
+
+  // O corpo avançou: o prazo para a próxima parte é renovado.
+  if (req->bodyRead != bodyRead) server_readBody(client->fd);
+
+  return FORMAT_PART;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Termina o trecho com '\0', no lugar do delimitador que o segue no inbox e que
+ * já foi interpretado. Assim, os campos são usados como strings sem cópia.
+ */
+static void http_terminate(const char *data, HttpSpan span) {
+  ((char *)data)[span.offset + span.len] = '\0';
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static HttpView http_view(const HttpReq *req, HttpSpan span) {
+  return (HttpView){req->data + span.offset, span.len};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Compara o trecho com str sem diferenciar maiúsculas de minúsculas (ASCII),
+ * como exigido para os nomes de cabeçalho.
+ */
+static bool http_equals(const HttpReq *req, HttpSpan span, const char *str) {
+  return http_sameName(req->data + span.offset, span.len, str);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Compara os len bytes de name com str, terminado em '\0', sem diferenciar
+ * maiúsculas de minúsculas (ASCII).
+ */
+static bool http_sameName(const char *name, size_t len, const char *str) {
+  for (size_t i = 0; i < len; i++) {
+    char a = name[i];
+    char b = str[i];
+
+    if (b == '\0') return false;
+    if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+    if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+    if (a != b) return false;
+  }
+
+  return str[len] == '\0';
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Procura o token, sem diferenciar maiúsculas de minúsculas, na lista separada
+ * por vírgulas, como o valor do cabeçalho Connection.
+ */
+static bool http_hasToken(HttpView list, const char *token) {
+  size_t len = strlen(token);
+  size_t i = 0;
+
+  while (i < list.len) {
+    while (i < list.len && (list.data[i] == ' ' || list.data[i] == '\t' ||
+                            list.data[i] == ',')) {
+      i++;
+    }
+
+    size_t start = i;
+
+    while (i < list.len && list.data[i] != ',' && list.data[i] != ' ' &&
+           list.data[i] != '\t') {
+      i++;
+    }
+
+    if (i - start != len) continue;
+
+    size_t j = 0;
+
+    for (; j < len; j++) {
+      char c = list.data[start + j];
+      if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+      if (c != token[j]) break;
+    }
+
+    if (j == len) return true;
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static bool http_isDigit(int c) { return c >= '0' && c <= '9'; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+static bool http_isToken(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || http_isDigit(c) ||
+         (c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendNotFound(HttpClient *client) {
+  http_sendStatus(client, HTTP_STATUS_NOT_FOUND);
+  http_send(client, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendError(HttpClient *client) {
+  http_sendStatus(client, HTTP_STATUS_INTERNAL_ERROR);
+  http_send(client, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendRedirect(HttpClient *client, const char *url) {
+  http_sendStatus(client, HTTP_STATUS_MOVED_PERMANENTLY);
+  http_sendHeader(client, "Location", url);
+  http_send(client, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendStatus(HttpClient *client, HttpStatus status) {
+  HttpView line = http_statusLine(status);
+
+  client->notModified = status == HTTP_STATUS_NOT_MODIFIED;
+
+  // O código, após "HTTP/1.1 ", é o campo :status.
+  if (client->stream != NULL) {
+    http_h2Field(client->stream, ":status", 7, line.data + 9, 3);
+    return;
+  }
+
+  server_append(client->fd, line.data, line.len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendType(HttpClient *client, HttpMimeType type) {
+  client->compressible = type != HTTP_TYPE_JPEG && type != HTTP_TYPE_PNG;
+
+  http_sendLine(client, http_typeLine(type));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendHeader(HttpClient *client, const char *name, const char *value) {
+  // O corpo já está codificado pela aplicação.
+  if (http_sameName(name, strlen(name), "content-encoding")) {
+    client->encoded = true;
+  }
+
+  if (client->stream != NULL) {
+    http_h2Field(client->stream, name, strlen(name), value, strlen(value));
+    return;
+  }
+
+  // Os trechos consecutivos formam um único segmento na fila de saída.
+  server_append(client->fd, name, strlen(name));
+  server_append(client->fd, ": ", 2);
+  server_append(client->fd, value, strlen(value));
+  server_append(client->fd, "\r\n", 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendHeaderInt(HttpClient *client, const char *name, int value) {
+  char line[24];
+  size_t len = 0;
+
+  line[len++] = ':';
+  line[len++] = ' ';
+
+  if (value < 0) line[len++] = '-';
+
+  len += http_itoa(line + len, (value < 0) ? -(size_t)value : (size_t)value);
+  len += http_copy(line + len, HTTP_BLOCK("\r\n"));
+
+  if (client->stream != NULL) {
+    http_h2Field(client->stream, name, strlen(name), line + 2, len - 4);
+    return;
+  }
+
+  server_append(client->fd, name, strlen(name));
+  server_append(client->fd, line, len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendHeaderTime(HttpClient *client, const char *name, time_t time) {
+  char line[HTTP_DATE_LEN + 1];
+
+  // Sem "Date: " e "\r\n".
+  http_formatDate(line, time);
+  line[HTTP_DATE_LEN - 2] = '\0';
+
+  http_sendHeader(client, name, line + 6);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_send(HttpClient *client, const char *body, size_t size) {
+  // O corpo comprimido segue como uma resposta em partes, sem Content-Length,
+  // que o HTTP/1.0 só delimitaria fechando a conexão.
+  if (body != NULL && size >= HTTP_GZIP_MIN_SIZE &&
+      (client->stream != NULL || !http_isHttp10(client->req)) &&
+      http_gzipAccepted(client) && http_gzipStart(client) == 0) {
+    http_startStream(client);
+    http_gzipWrite(client, body, size, Z_NO_FLUSH);
+    http_end(client);
+    return;
+  }
+
+  if (client->stream != NULL) {
+    http_h2Head(client->stream, (body == NULL) ? 0 : size);
+    http_h2Data(client->stream, body, (body == NULL) ? 0 : size, true);
+    http_h2End(client->stream);
+    return;
+  }
+
+  http_sendHead(client, (body == NULL) ? 0 : size);
+  server_append(client->fd, body, size);
+  server_end(client->fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendRef(HttpClient *client, const char *body, size_t size) {
+  if (client->stream != NULL) {
+    http_h2Head(client->stream, (body == NULL) ? 0 : size);
+    http_h2Data(client->stream, body, (body == NULL) ? 0 : size, false);
+    http_h2End(client->stream);
+    return;
+  }
+
+  http_sendHead(client, (body == NULL) ? 0 : size);
+  server_appendRef(client->fd, body, size);
+  server_end(client->fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_sendFile(HttpClient *client, int fd, size_t offset, size_t size) {
+  if (client->stream != NULL) {
+    http_h2Head(client->stream, size);
+    http_h2File(client->stream, fd, offset, size);
+    http_h2End(client->stream);
+    return;
+  }
+
+  http_sendHead(client, size);
+  server_appendFile(client->fd, fd, offset, size);
+  server_end(client->fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int http_sendChunk(HttpClient *client, const char *data, size_t size) {
+  if (!client->streaming) {
+    if (http_gzipAccepted(client)) http_gzipStart(client);
+
+    http_startStream(client);
+  }
+
+  // Cada parte é enviada assim que comprimida (Z_SYNC_FLUSH), para que o
+  // cliente não aguarde o fim da resposta para recebê-la.
+  if (client->gzip != NULL) {
+    if (size > 0) http_gzipWrite(client, data, size, Z_SYNC_FLUSH);
+  } else {
+    http_writeChunk(client, data, size);
+  }
+
+  if (client->stream != NULL && http_h2Left(client->stream) > 0) return 1;
+
+  return server_outboxFull(client->fd) ? 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_onWritable(HttpClient *client, HttpWritableFunc func) {
+  client->onWritable = func;
+
+  // O stream sem espaço na janela é avisado quando os dados pendentes forem
+  // enviados (http_h2Drain()).
+  if (client->stream != NULL && http_h2Left(client->stream) > 0) return;
+
+  server_watchWrite(client->fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_end(HttpClient *client) {
+  if (!client->streaming) {
+    http_send(client, NULL, 0);
+    return;
+  }
+
+  if (client->gzip != NULL) {
+    http_gzipWrite(client, NULL, 0, Z_FINISH);
+    http_gzipFree(client);
+  }
+
+  if (client->stream != NULL) {
+    http_h2End(client->stream);
+    return;
+  }
+
+  if (!http_isHttp10(client->req)) server_append(client->fd, "0\r\n\r\n", 5);
+
+  server_end(client->fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+HttpDefer *http_defer(HttpClient *client) {
+  HttpDefer *defer = malloc(sizeof(HttpDefer));
+
+  if (defer == NULL) {
+    log_erro("http", "malloc(): %d - %s\n", errno, strerror(errno));
+    return NULL;
+  }
+
+  defer->conn = server_connId(client->fd);
+  defer->client = client;
+  atomic_init(&defer->cancelled, false);
+  atomic_init(&defer->refs, 2);
+  defer->func = NULL;
+  defer->arg = NULL;
+
+  client->defer = defer;
+
+  return defer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int http_complete(HttpDefer *defer, HttpDeferFunc func, void *arg) {
+  defer->func = func;
+  defer->arg = arg;
+
+  // A referência da aplicação passa para a tarefa.
+  if (server_post(defer->conn, http_deferRun, defer)) {
+    http_deferRelease(defer);
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool http_isCancelled(const HttpDefer *defer) {
+  return atomic_load(&defer->cancelled);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Executa, na thread da conexão, a função de http_complete(). Com a conexão
+ * aberta, a requisição ainda aguarda a resposta: o cliente é válido.
+ */
+static void http_deferRun(int clientFd, void *arg) {
+  HttpDefer *defer = arg;
+  HttpDeferFunc func = defer->func;
+  void *funcArg = defer->arg;
+  HttpClient *client = NULL;
+
+  if (clientFd != -1) {
+    client = defer->client;
+    client->defer = NULL;
+    http_deferRelease(defer);
+  }
+
+  bool cancelled = atomic_load(&defer->cancelled);
+
+  http_deferRelease(defer);
+
+  if (client == NULL || !cancelled) {
+    func(client, funcArg);
+    return;
+  }
+
+  // Stream cancelado pelo cliente: concluído sem resposta.
+  func(NULL, funcArg);
+  http_h2End(client->stream);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Cancela a resposta adiada do cliente, que deixa de existir com a conexão.
+ */
+static void http_deferDrop(HttpClient *client) {
+  HttpDefer *defer = client->defer;
+
+  if (defer == NULL) return;
+
+  client->defer = NULL;
+  atomic_store(&defer->cancelled, true);
+  http_deferRelease(defer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void http_deferRelease(HttpDefer *defer) {
+  if (atomic_fetch_sub(&defer->refs, 1) == 1) free(defer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Termina o cabeçalho da resposta, montado sem formatação: apenas cópias de
+ * trechos prontos e os dígitos do tamanho do corpo.
+ */
+static void http_sendHead(HttpClient *client, size_t size) {
+  char head[HTTP_HEAD_MAX];
+  size_t len = http_copy(head, http_connectionLine(client));
+
+  len += http_copy(head + len, http_date());
+
+  if (!client->notModified) {
+    len += http_copy(head + len, HTTP_BLOCK("Content-Length: "));
+    len += http_itoa(head + len, size);
+    len += http_copy(head + len, HTTP_BLOCK("\r\n"));
+  }
+
+  len += http_copy(head + len, HTTP_BLOCK("\r\n"));
+
+  server_append(client->fd, head, len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void http_sendChunkedHead(HttpClient *client) {
+  char head[HTTP_HEAD_MAX];
+
+  if (http_isHttp10(client->req)) {
+    client->req->keepAlive = false;
+    server_closeAfter(client->fd);
+  }
+
+  size_t len = http_copy(head, http_connectionLine(client));
+
+  len += http_copy(head + len, http_date());
+
+  if (client->req->keepAlive) {
+    len += http_copy(head + len, HTTP_BLOCK("Transfer-Encoding: chunked\r\n"));
+  }
+
+  len += http_copy(head + len, HTTP_BLOCK("\r\n"));
+
+  server_append(client->fd, head, len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Envia a linha "Nome: valor\r\n" do cabeçalho da resposta.
+ */
+static void http_sendLine(HttpClient *client, HttpView line) {
+  if (client->stream != NULL) {
+    http_h2Line(client->stream, line);
+    return;
+  }
+
+  server_append(client->fd, line.data, line.len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Conclui o cabeçalho da resposta enviada em partes, sem o tamanho do corpo.
+ */
+static void http_startStream(HttpClient *client) {
+  client->streaming = true;
+
+  if (client->stream != NULL) {
+    http_h2Head(client->stream, 0);
+    return;
+  }
+
+  http_sendChunkedHead(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Envia uma parte do corpo da resposta iniciada por http_startStream().
+ */
+static void http_writeChunk(HttpClient *client, const char *data, size_t size) {
+  // No HTTP/2, cada parte segue em frames DATA, e o fim do corpo é o
+  // END_STREAM.
+  if (client->stream != NULL) {
+    http_h2Data(client->stream, data, size, true);
+    return;
+  }
+
+  // O HTTP/1.0 não conhece partes: o fim do corpo é o fechamento da conexão.
+  if (http_isHttp10(client->req)) {
+    server_append(client->fd, data, size);
+    return;
+  }
+
+  // Uma parte vazia indicaria o fim do corpo.
+  if (size == 0) return;
+
+  char line[24];
+  size_t len = http_xtoa(line, size);
+
+  len += http_copy(line + len, HTTP_BLOCK("\r\n"));
+
+  server_append(client->fd, line, len);
+  server_append(client->fd, data, size);
+  server_append(client->fd, "\r\n", 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Verifica se a resposta pode ser comprimida com gzip.
+ */
+static bool http_gzipAccepted(HttpClient *client) {
+  return client->compressible && !client->encoded &&
+         http_reqAcceptsEncoding(client, "gzip");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Inicia a compressão da resposta, informando Content-Encoding, antes do fim
+ * do cabeçalho. Em caso de erro, a resposta segue sem compressão.
+ */
+static int http_gzipStart(HttpClient *client) {
+  z_stream *gzip = GZIP;
+
+  GZIP = NULL;
+
+  if (gzip == NULL) {
+    gzip = malloc(sizeof(z_stream));
+
+    if (gzip == NULL) {
+      log_erro("http", "malloc(): %d - %s\n", errno, strerror(errno));
+      return -1;
+    }
+
+    gzip->zalloc = Z_NULL;
+    gzip->zfree = Z_NULL;
+    gzip->opaque = Z_NULL;
+
+    // Janela de 2^15 bytes, com o cabeçalho e o trailer do gzip (16).
+    if (deflateInit2(gzip, HTTP_GZIP_LEVEL, Z_DEFLATED, 16 + 15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      log_erro("http", "deflateInit2(): %s\n",
+               (gzip->msg != NULL) ? gzip->msg : "");
+      free(gzip);
+      return -1;
+    }
+  }
+
+  client->gzip = gzip;
+
+  http_sendLine(client, HTTP_BLOCK("Content-Encoding: gzip\r\n"));
+  http_sendLine(client, HTTP_BLOCK("Vary: Accept-Encoding\r\n"));
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Comprime os dados e envia a saída em partes de até HTTP_GZIP_OUT bytes, à
+ * medida que o deflate as produz. Com Z_NO_FLUSH, o deflate pode reter parte
+ * da saída até a próxima chamada.
+ */
+static void http_gzipWrite(HttpClient *client, const char *data, size_t size,
+                           int flush) {
+  z_stream *gzip = client->gzip;
+  char out[HTTP_GZIP_OUT];
+
+  // O avail_in é de 32 bits: os corpos maiores são comprimidos aos poucos.
+  while (true) {
+    uInt len = (size > UINT_MAX) ? UINT_MAX : (uInt)size;
+    int mode = (len < size) ? Z_NO_FLUSH : flush;
+
+    gzip->next_in = (Bytef *)data;
+    gzip->avail_in = len;
+
+    do {
+      gzip->next_out = (Bytef *)out;
+      gzip->avail_out = sizeof(out);
+
+      deflate(gzip, mode);
+
+      size_t produced = sizeof(out) - gzip->avail_out;
+
+      if (produced > 0) http_writeChunk(client, out, produced);
+    } while (gzip->avail_out == 0);
+
+    data += len;
+    size -= len;
+
+    if (size == 0) return;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Devolve o compressor ao worker, ou o libera, caso o worker já tenha um.
+ */
+static void http_gzipFree(HttpClient *client) {
+  z_stream *gzip = client->gzip;
+
+  if (gzip == NULL) return;
+
+  client->gzip = NULL;
+
+  if (GZIP == NULL && deflateReset(gzip) == Z_OK) {
+    GZIP = gzip;
+    return;
+  }
+
+  deflateEnd(gzip);
+  free(gzip);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static HttpView http_connectionLine(HttpClient *client) {
+  // O servidor está sendo drenado e fechará a conexão após esta resposta.
+  if (!client->req->keepAlive || server_isDraining()) {
+    return HTTP_BLOCK("Connection: close\r\n");
+  }
+
+  // No HTTP/1.0, a conexão é fechada se a resposta não disser o contrário.
+  if (http_isHttp10(client->req)) {
+    return HTTP_BLOCK("Connection: keep-alive\r\n");
+  }
+
+  return HTTP_BLOCK("");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static HttpView http_statusLine(HttpStatus status) {
+  switch (status) {
+    case HTTP_STATUS_OK:
+      return HTTP_BLOCK("HTTP/1.1 200 Ok\r\n");
+    case HTTP_STATUS_NOT_FOUND:
+      return HTTP_BLOCK("HTTP/1.1 404 Not Found\r\n");
+    case HTTP_STATUS_BAD_REQUEST:
+      return HTTP_BLOCK("HTTP/1.1 400 Bad Request\r\n");
+    case HTTP_STATUS_INTERNAL_ERROR:
+      return HTTP_BLOCK("HTTP/1.1 500 Internal Error\r\n");
+    case HTTP_STATUS_MOVED_PERMANENTLY:
+      return HTTP_BLOCK("HTTP/1.1 301 Moved Permanently\r\n");
+    case HTTP_STATUS_NOT_MODIFIED:
+      return HTTP_BLOCK("HTTP/1.1 304 Not Modified\r\n");
+  }
+  return HTTP_BLOCK("HTTP/1.1 500 Internal Error\r\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static HttpView http_typeLine(HttpMimeType contentType) {
+  switch (contentType) {
+    case HTTP_TYPE_HTML:
+      return HTTP_BLOCK("Content-Type: text/html; charset=utf8\r\n");
+    case HTTP_TYPE_JSON:
+      return HTTP_BLOCK("Content-Type: application/json; charset=utf8\r\n");
+    case HTTP_TYPE_TEXT:
+      return HTTP_BLOCK("Content-Type: text/plain; charset=utf8\r\n");
+    case HTTP_TYPE_CSS:
+      return HTTP_BLOCK("Content-Type: text/css; charset=utf8\r\n");
+    case HTTP_TYPE_JS:
+      return HTTP_BLOCK(
+          "Content-Type: application/javascript; charset=utf8\r\n");
+    case HTTP_TYPE_JPEG:
+      return HTTP_BLOCK("Content-Type: image/jpeg; charset=utf8\r\n");
+    case HTTP_TYPE_PNG:
+      return HTTP_BLOCK("Content-Type: image/png; charset=utf8\r\n");
+  }
+  return HTTP_BLOCK("Content-Type: text/plain; charset=utf8\r\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Obtém o cabeçalho Date da resposta. Cada worker o formata no máximo uma vez
+ * por segundo.
+ */
+static HttpView http_date() {
+  time_t now = time(NULL);
+
+  if (now != DATE.time) {
+    http_formatDate(DATE.line, now);
+    DATE.time = now;
+  }
+
+  return (HttpView){DATE.line, HTTP_DATE_LEN};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Formata a data no formato do HTTP (RFC 7231, IMF-fixdate), sem depender do
+ * locale nem de gmtime(), que não pode ser usada por várias threads.
+ *
+ * Os campos têm largura fixa: date recebe sempre HTTP_DATE_LEN caracteres,
+ * mais o '\0'. Datas fora do intervalo de 1970 a 9999 são limitadas a ele.
+ */
+static void http_formatDate(char *date, time_t now) {
+  static const char days[] = "ThuFriSatSunMonTueWed";
+  static const char months[] = "MarAprMayJunJulAugSepOctNovDecJanFeb";
+
+  long long secs = now;
+
+  if (secs < 0) secs = 0;
+  if (secs > HTTP_DATE_MAX) secs = HTTP_DATE_MAX;
+
+  long long day = secs / 86400;
+  int secsOfDay = secs % 86400;
+
+  // Ano, mês e dia, contados a partir de 1º de março do ano 0, para que o dia
+  // bissexto seja o último do ano.
+  long long z = day + 719468;
+  long long era = z / 146097;
+  int dayOfEra = z - era * 146097;
+  int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 -
+                   dayOfEra / 146096) / 365;
+  int dayOfYear =
+      dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  int month = (5 * dayOfYear + 2) / 153;
+  int year = era * 400 + yearOfEra + (month >= 10 ? 1 : 0);
+  int dayOfMonth = dayOfYear - (153 * month + 2) / 5 + 1;
+
+  memcpy(date, "Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n", HTTP_DATE_LEN + 1);
+  memcpy(date + 6, days + day % 7 * 3, 3);
+  memcpy(date + 11, DIGITS + dayOfMonth * 2, 2);
+  memcpy(date + 14, months + month * 3, 3);
+  memcpy(date + 18, DIGITS + year / 100 * 2, 2);
+  memcpy(date + 20, DIGITS + year % 100 * 2, 2);
+  memcpy(date + 23, DIGITS + secsOfDay / 3600 * 2, 2);
+  memcpy(date + 26, DIGITS + secsOfDay / 60 % 60 * 2, 2);
+  memcpy(date + 29, DIGITS + secsOfDay % 60 * 2, 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Interpreta a data no formato do HTTP, como "Sun, 06 Nov 1994 08:49:37 GMT",
+ * o inverso de http_formatDate(). Os formatos obsoletos (RFC 850 e asctime())
+ * não são aceitos.
+ *
+ * @return 0, em caso de sucesso, -1, caso value não seja uma data válida.
+ */
+static int http_parseDate(HttpView value, time_t *time) {
+  static const char months[] = "MarAprMayJunJulAugSepOctNovDecJanFeb";
+  static const char format[] = "Sun, 06 Nov 1994 08:49:37 GMT";
+  const char *d = value.data;
+
+  if (value.len != sizeof(format) - 1) return -1;
+
+  // Os dígitos e os separadores nas posições do formato.
+  for (size_t i = 0; i < value.len; i++) {
+    bool digit = http_isDigit(format[i]);
+
+    if (digit != http_isDigit(d[i])) return -1;
+    if (!digit && strchr(", :", format[i]) && d[i] != format[i]) return -1;
+  }
+
+  if (memcmp(d + 26, "GMT", 3) != 0) return -1;
+
+  int month = 0;
+
+  while (month < 12 && memcmp(months + month * 3, d + 8, 3) != 0) month++;
+
+  if (month == 12) return -1;
+
+  int day = (d[5] - '0') * 10 + (d[6] - '0');
+  int hour = (d[17] - '0') * 10 + (d[18] - '0');
+  int min = (d[20] - '0') * 10 + (d[21] - '0');
+  int sec = (d[23] - '0') * 10 + (d[24] - '0');
+  long long year = (d[12] - '0') * 1000 + (d[13] - '0') * 100 +
+                   (d[14] - '0') * 10 + (d[15] - '0');
+
+  if (day < 1 || day > 31 || hour > 23 || min > 59 || sec > 60) return -1;
+
+  // As datas anteriores a 1970 não são usadas por recursos, como arquivos.
+  if (year < 1970) return -1;
+
+  // Como em http_formatDate(), o ano começa em março: janeiro e fevereiro
+  // pertencem ao ano anterior.
+  if (month >= 10) year--;
+
+  long long era = year / 400;
+  int yearOfEra = year - era * 400;
+  int dayOfYear = (153 * month + 2) / 5 + day - 1;
+  int dayOfEra =
+      yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  long long days = era * 146097 + dayOfEra - 719468;
+
+  *time = days * 86400 + hour * 3600 + min * 60 + sec;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Escreve o número em decimal, dois dígitos por vez.
+ *
+ * @return quantidade de dígitos escritos.
+ */
+static size_t http_itoa(char *dst, size_t value) {
+  char digits[20];
+  char *pos = digits + sizeof(digits);
+
+  while (value >= 100) {
+    size_t i = (value % 100) * 2;
+    value /= 100;
+    *--pos = DIGITS[i + 1];
+    *--pos = DIGITS[i];
+  }
+
+  if (value >= 10) {
+    *--pos = DIGITS[value * 2 + 1];
+    *--pos = DIGITS[value * 2];
+  } else {
+    *--pos = '0' + value;
+  }
+
+  size_t len = digits + sizeof(digits) - pos;
+  memcpy(dst, pos, len);
+
+  return len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Escreve o número em hexadecimal, como o tamanho das partes do corpo.
+ */
+static size_t http_xtoa(char *dst, size_t value) {
+  char digits[16];
+  char *pos = digits + sizeof(digits);
+
+  do {
+    *--pos = "0123456789abcdef"[value & 0xf];
+    value >>= 4;
+  } while (value > 0);
+
+  size_t len = digits + sizeof(digits) - pos;
+  memcpy(dst, pos, len);
+
+  return len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t http_copy(char *dst, HttpView block) {
+  memcpy(dst, block.data, block.len);
+  return block.len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+HttpView http_reqHeaderView(HttpClient *client, const char *name) {
+  HttpReq *req = client->req;
+
+  for (int i = 0; i < req->headersLen; i++) {
+    if (http_equals(req, req->headers[i].name, name)) {
+      return http_view(req, req->headers[i].value);
+    }
+  }
+
+  return (HttpView){"", 0};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *http_reqHeader(HttpClient *client, const char *name) {
+  return http_reqHeaderView(client, name).data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+HttpView http_reqParamView(HttpClient *client, const char *name) {
+  HttpReq *req = client->req;
+
+  for (int i = 0; i < req->paramsLen; i++) {
+    HttpSpan span = req->params[i].name;
+
+    if (strncmp(req->data + span.offset, name, span.len) == 0 &&
+        name[span.len] == '\0') {
+      return http_view(req, req->params[i].value);
+    }
+  }
+
+  return (HttpView){"", 0};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *http_reqParam(HttpClient *client, const char *name) {
+  return http_reqParamView(client, name).data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int http_reqParamInt(HttpClient *client, const char *name, int def) {
+  return http_toInt(http_reqParamView(client, name).data, def);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *http_reqMethod(HttpClient *client) {
+  return http_view(client->req, client->req->method).data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *http_reqPath(HttpClient *client) {
+  return http_view(client->req, client->req->uri).data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *http_reqPattern(HttpClient *client) { return client->req->pattern; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *http_reqArg(HttpClient *client, int n) {
+  if (n < 0 || n >= client->req->argsLen) {
+    return "";
+  }
+  return client->req->args[n];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char *http_reqNamedArg(HttpClient *client, const char *name) {
+  HttpReq *req = client->req;
+
+  for (int i = 0; i < req->argsLen; i++) {
+    if (req->argNames[i] != NULL && strcmp(req->argNames[i], name) == 0) {
+      return req->args[i];
+    }
+  }
+
+  return "";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int http_reqNamedArgInt(HttpClient *client, const char *name, int def) {
+  return http_toInt(http_reqNamedArg(client, name), def);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+HttpView http_reqBody(HttpClient *client) {
+  HttpReq *req = client->req;
+
+  // O corpo recebido em partes não é armazenado.
+  if (req->head != NULL) return (HttpView){"", 0};
+
+  // No HTTP/2, o corpo é armazenado fora do cabeçalho.
+  if (client->stream != NULL) {
+    HttpText *body = &client->stream->body;
+
+    if (body->len == 0 ||
+        (req->handler != NULL && req->handler->onBody != NULL)) {
+      return (HttpView){"", 0};
+    }
+
+    return (HttpView){body->data, body->len};
+  }
+
+  return (HttpView){req->data + req->headLen, req->contentLength};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool http_reqAcceptsEncoding(HttpClient *client, const char *coding) {
+  HttpView list = http_reqHeaderView(client, "Accept-Encoding");
+  bool any = false;
+  size_t i = 0;
+
+  while (i < list.len) {
+    while (i < list.len && (list.data[i] == ' ' || list.data[i] == '\t' ||
+                            list.data[i] == ',')) {
+      i++;
+    }
+
+    size_t start = i;
+
+    while (i < list.len && http_isToken(list.data[i])) i++;
+
+    size_t nameLen = i - start;
+    size_t end = i;
+
+    while (end < list.len && list.data[end] != ',') end++;
+
+    bool accepted = http_codingAccepted(list, i, end);
+
+    i = end;
+
+    // A codificação informada pelo nome prevalece sobre "*".
+    if (http_sameName(list.data + start, nameLen, coding)) return accepted;
+
+    if (nameLen == 1 && list.data[start] == '*') any = accepted;
+  }
+
+  return any;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool http_reqNotModified(HttpClient *client, const char *etag, time_t mtime) {
+  HttpView match = http_reqHeaderView(client, "If-None-Match");
+
+  // O If-Modified-Since é ignorado na presença do If-None-Match (RFC 7232,
+  // 3.3), mais preciso.
+  if (match.len > 0) return etag != NULL && http_hasEtag(match, etag);
+
+  HttpView since = http_reqHeaderView(client, "If-Modified-Since");
+  time_t time;
+
+  if (since.len == 0 || mtime < 0 || http_parseDate(since, &time)) {
+    return false;
+  }
+
+  return mtime <= time;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Procura a ETag na lista do If-None-Match, como "\"a\", W/\"b\"", ou "*". A
+ * comparação é fraca: o prefixo "W/" é ignorado (RFC 7232, 2.3.2).
+ */
+static bool http_hasEtag(HttpView list, const char *etag) {
+  size_t len = strlen(etag);
+  size_t i = 0;
+
+  while (i < list.len) {
+    while (i < list.len && (list.data[i] == ' ' || list.data[i] == '\t' ||
+                            list.data[i] == ',')) {
+      i++;
+    }
+
+    if (i == list.len) break;
+
+    if (list.data[i] == '*') return true;
+
+    if (list.len - i > 2 && memcmp(list.data + i, "W/", 2) == 0) i += 2;
+
+    if (list.data[i] != '"') return false;
+
+    const char *end = memchr(list.data + i + 1, '"', list.len - i - 1);
+
+    if (end == NULL) return false;
+
+    size_t tagLen = end + 1 - (list.data + i);
+
+    if (tagLen == len && memcmp(list.data + i, etag, len) == 0) return true;
+
+    i += tagLen;
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Verifica se os parâmetros da codificação, no trecho [pos, end) da lista, não
+ * a recusam com "q=0" (ou "q=0.0", "q=0.00"...).
+ */
+static bool http_codingAccepted(HttpView list, size_t pos, size_t end) {
+  for (size_t i = pos; i + 1 < end; i++) {
+    char c = list.data[i];
+
+    if ((c != 'q' && c != 'Q') || list.data[i + 1] != '=') continue;
+
+    // O 'q' não é o primeiro byte do trecho, que segue o nome da codificação.
+    char prev = list.data[i - 1];
+
+    if (prev != ';' && prev != ' ' && prev != '\t') continue;
+
+    i += 2;
+
+    while (i < end && (list.data[i] == '0' || list.data[i] == '.')) i++;
+
+    return i < end && http_isDigit(list.data[i]);
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_pauseBody(HttpClient *client) {
+  client->req->paused = true;
+
+  // No HTTP/2, o cliente deixa de enviar quando a janela do stream se esgota.
+  if (client->stream != NULL) return;
+
+  server_pauseRead(client->fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void http_resumeBody(HttpClient *client) {
+  client->req->paused = false;
+
+  if (client->stream != NULL) {
+    http_h2ResumeBody(client->stream);
+    return;
+  }
+
+  server_resumeRead(client->fd);
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Reserva espaço para mais len bytes no texto, realocando-o.
+ */
+static int http_textReserve(HttpText *text, size_t len) {
+  if (text->len + len <= text->cap) return 0;
+
+  size_t cap = (text->cap > 0) ? text->cap : 256;
+
+  while (cap < text->len + len) cap *= 2;
+
+  char *data = realloc(text->data, cap);
+
+  if (data == NULL) {
+    log_erro("http", "realloc(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  text->data = data;
+  text->cap = cap;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int http_textPut(HttpText *text, const char *data, size_t len) {
+  if (http_textReserve(text, len)) return -1;
+
+  memcpy(text->data + text->len, data, len);
+  text->len += len;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Inicia o HTTP/2, caso a conexão comece pelo prefácio do cliente, e envia as
+ * configurações do servidor.
+ *
+ * @return FORMAT_SKIP, caso o prefácio tenha sido consumido, FORMAT_PART,
+ *         caso tenha chegado apenas o início dele, FORMAT_ERROR, caso não haja
+ *         memória, ou FORMAT_OK, caso a conexão não seja HTTP/2.
+ */
+static FormatStatus http_h2Start(HttpClient *client, BuffReader *reader) {
+  if (buff_reader_size(reader) < HTTP_H2_PREFACE_LEN) {
+    buff_reader_linearize(reader);
+  }
+
+  size_t len = http_min(buff_reader_size(reader), HTTP_H2_PREFACE_LEN);
+
+  if (memcmp(buff_reader_data(reader), HTTP_H2_PREFACE, len) != 0) {
+    return FORMAT_OK;
+  }
+
+  if (len < HTTP_H2_PREFACE_LEN) return FORMAT_PART;
+
+  HttpH2 *h2 = malloc(sizeof(HttpH2));
+
+  if (h2 == NULL) {
+    log_erro("http", "malloc(): %d - %s\n", errno, strerror(errno));
+    return FORMAT_ERROR;
+  }
+
+  h2->fd = client->fd;
+  hpack_init(&h2->hpack, HPACK_TABLE_SIZE);
+  h2->streams = NULL;
+  h2->numStreams = 0;
+  h2->active = 0;
+  h2->lastStreamId = 0;
+  h2->recvWindow = HTTP_H2_WINDOW;
+  h2->recvConsumed = 0;
+  h2->sendWindow = HTTP_H2_WINDOW;
+  h2->initialWindow = HTTP_H2_WINDOW;
+  h2->maxFrame = HTTP_H2_FRAME_MAX;
+  h2->settled = false;
+  h2->block = (HttpText){NULL, 0, 0};
+  h2->blockStream = 0;
+  h2->blockEndStream = false;
+  h2->goaway = false;
+  h2->failed = false;
+
+  client->h2 = h2;
+
+  buff_reader_commit(reader, HTTP_H2_PREFACE_LEN);
+
+  char settings[12];
+
+  settings[0] = 0;
+  settings[1] = HTTP_H2_SETTING_MAX_CONCURRENT_STREAMS;
+  http_h2Put32(settings + 2, HTTP_H2_STREAMS_MAX);
+  settings[6] = 0;
+  settings[7] = HTTP_H2_SETTING_MAX_HEADER_LIST_SIZE;
+  http_h2Put32(settings + 8, HTTP_H2_HEAD_MAX);
+
+  http_h2Frame(h2, HTTP_H2_FRAME_SETTINGS, 0, 0, settings, sizeof(settings));
+
+  log_dbug("http", "HTTP/2: %d\n", client->fd);
+
+  return FORMAT_SKIP;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Consome do inbox um frame completo por chamada. Nenhum frame forma uma
+ * requisição para o servidor: os streams são entregues aos handlers aqui
+ * mesmo, e as respostas seguem pela fila de saída da conexão.
+ */
+static FormatStatus http_h2OnFormat(HttpH2 *h2, BuffReader *reader) {
+  if (buff_reader_size(reader) < HTTP_H2_FRAME_HEAD) {
+    buff_reader_linearize(reader);
+    if (buff_reader_size(reader) < HTTP_H2_FRAME_HEAD) return FORMAT_PART;
+  }
+
+  const unsigned char *head = (const unsigned char *)buff_reader_data(reader);
+  HttpH2Frame frame;
+
+  frame.len = ((uint32_t)head[0] << 16) | (head[1] << 8) | head[2];
+  frame.type = head[3];
+  frame.flags = head[4];
+  frame.id = http_h2Get32((const char *)head + 5) & HTTP_H2_MAX;
+
+  if (frame.len > HTTP_H2_FRAME_MAX) {
+    buff_reader_commit(reader, HTTP_H2_FRAME_HEAD);
+    http_h2Fail(h2, HTTP_H2_ERROR_FRAME_SIZE);
+    return FORMAT_SKIP;
+  }
+
+  if (buff_reader_size(reader) < HTTP_H2_FRAME_HEAD + frame.len) {
+    buff_reader_linearize(reader);
+    if (buff_reader_size(reader) < HTTP_H2_FRAME_HEAD + frame.len) {
+      return FORMAT_PART;
+    }
+  }
+
+  frame.payload = buff_reader_data(reader) + HTTP_H2_FRAME_HEAD;
+
+  // O payload permanece no inbox durante o processamento: nada é lido do
+  // socket antes do retorno.
+  buff_reader_commit(reader, HTTP_H2_FRAME_HEAD + frame.len);
+
+  http_h2OnFrame(h2, &frame);
+
+  return FORMAT_SKIP;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void http_h2OnFrame(HttpH2 *h2, const HttpH2Frame *frame) {
+  // Após um erro de conexão, os frames restantes são descartados.
+  if (h2->failed) return;
+
+  // As partes de um bloco de cabeçalhos chegam sem outros frames entre elas.
+  if (h2->blockStream != 0 && (frame->type != HTTP_H2_FRAME_CONTINUATION ||
+                               frame->id != h2->blockStream)) {
+    http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
+  }
+
+  // O prefácio do cliente termina com o seu SETTINGS.
+  if (!h2->settled && (frame->type != HTTP_H2_FRAME_SETTINGS ||
+                       (frame->flags & HTTP_H2_FLAG_ACK))) {
+    http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
+  }
+
+  switch (frame->type) {
+    case HTTP_H2_FRAME_DATA:
+      http_h2OnData(h2, frame);
+      break;
+    case HTTP_H2_FRAME_HEADERS:
+      http_h2OnHeaders(h2, frame);
+      break;
+    case HTTP_H2_FRAME_PRIORITY:
+      // As prioridades não são consideradas.
+      if (frame->id == 0) http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+      break;
+    case HTTP_H2_FRAME_RST_STREAM:
+      http_h2OnReset(h2, frame);
+      break;
+    case HTTP_H2_FRAME_SETTINGS:
+      http_h2OnSettings(h2, frame);
+      break;
+    case HTTP_H2_FRAME_PUSH_PROMISE:
+      // Somente o servidor pode iniciar streams com PUSH_PROMISE.
+      http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+      break;
+    case HTTP_H2_FRAME_PING:
+      http_h2OnPing(h2, frame);
+      break;
+    case HTTP_H2_FRAME_GOAWAY:
+      http_h2OnGoaway(h2, frame);
+      break;
+    case HTTP_H2_FRAME_WINDOW_UPDATE:
+      http_h2OnWindowUpdate(h2, frame);
+      break;
+    case HTTP_H2_FRAME_CONTINUATION:
+      http_h2OnContinuation(h2, frame);
+      break;
+    default:
+      // Tipos desconhecidos são ignorados.
+      break;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void http_h2OnData(HttpH2 *h2, const HttpH2Frame *frame) {
+  HttpView data;
+
+  if (frame->id == 0 || http_h2Unpad(frame, &data)) {
+    http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
+  }
+
+  // O frame inteiro, inclusive o preenchimento, ocupa a janela da conexão,
+  // que é devolvida assim que os dados são consumidos.
+  h2->recvWindow -= frame->len;
+  h2->recvConsumed += frame->len;
+
+  if (h2->recvWindow < 0) {
+    http_h2Fail(h2, HTTP_H2_ERROR_FLOW_CONTROL);
+    return;
+  }
+
+  http_h2Ack(h2, NULL);
+
+  HttpH2Stream *stream = http_h2Stream(h2, frame->id);
+
+  // Os frames de um stream já encerrado pelo servidor são descartados.
+  if (stream == NULL) {
+    if (frame->id > h2->lastStreamId) http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
+  }
+
+  if (stream->remoteClosed) {
+    http_h2SendReset(h2, stream->id, HTTP_H2_ERROR_STREAM_CLOSED);
+    http_h2Reset(stream);
+    return;
+  }
+
+  stream->recvWindow -= frame->len;
+  stream->recvConsumed += frame->len;
+
+  if (stream->recvWindow < 0) {
+    http_h2SendReset(h2, stream->id, HTTP_H2_ERROR_FLOW_CONTROL);
+    http_h2Reset(stream);
+    return;
+  }
+
+  if (http_h2OnBody(stream, data, frame->len)) return;
+
+  if (frame->flags & HTTP_H2_FLAG_END_STREAM) {
+    stream->remoteClosed = true;
+    if (!stream->req.paused) http_h2Dispatch(stream);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Entrega ao handler de http_handlerStream() os dados recebidos, ou os
+ * armazena, caso a entrega esteja suspensa ou o handler receba o corpo
+ * inteiro.
+ *
+ * @return 0, ou -1, caso o stream tenha sido encerrado.
+ */
+static int http_h2OnBody(HttpH2Stream *stream, HttpView data, size_t len) {
+  HttpReq *req = &stream->req;
+  bool streamed = req->handler != NULL && req->handler->onBody != NULL;
+  size_t max = streamed ? BODY_STREAM_MAX : BODY_MAX;
+
+  if (req->bodyRead + stream->body.len + data.len >= max) {
+    log_erro("http", "http_h2OnBody() - corpo maior do que o permitido.\n");
+    http_h2SendReset(stream->h2, stream->id, HTTP_H2_ERROR_CANCEL);
+    http_h2Reset(stream);
+    return -1;
+  }
+
+  if (streamed && !req->paused) {
+    req->bodyRead += data.len;
+    if (data.len > 0) req->handler->onBody(&stream->client, data);
+    if (!req->paused) http_h2Ack(stream->h2, stream);
+    return 0;
+  }
+
+  // Com a entrega suspensa, a janela do stream limita o que é armazenado.
+  if (http_textPut(&stream->body, data.data, data.len)) {
+    http_h2SendReset(stream->h2, stream->id, HTTP_H2_ERROR_INTERNAL);
+    http_h2Reset(stream);
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void http_h2OnHeaders(HttpH2 *h2, const HttpH2Frame *frame) {
+  HttpView fragment;
+
+  // Os streams do cliente têm identificadores ímpares.
+  if (frame->id == 0 || (frame->id & 1) == 0 ||
+      http_h2Unpad(frame, &fragment)) {
+    http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
+  }
+
+  h2->blockStream = frame->id;
+  h2->blockEndStream = (frame->flags & HTTP_H2_FLAG_END_STREAM) != 0;
+  h2->block.len = 0;
+
+  http_h2OnBlock(h2, fragment, (frame->flags & HTTP_H2_FLAG_END_HEADERS) != 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void http_h2OnContinuation(HttpH2 *h2, const HttpH2Frame *frame) {
+  if (h2->blockStream == 0) {
+    http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
+  }
+
+  http_h2OnBlock(h2, (HttpView){frame->payload, frame->len},
+                 (frame->flags & HTTP_H2_FLAG_END_HEADERS) != 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Reúne as partes do bloco de cabeçalhos. O bloco que chega inteiro no
+ * HEADERS, o caso comum, é decodificado direto do inbox.
+ */
+static void http_h2OnBlock(HttpH2 *h2, HttpView fragment, bool end) {
+  uint32_t id = h2->blockStream;
+
+  if (end && h2->block.len == 0) {
+    h2->blockStream = 0;
+    http_h2Headers(h2, id, h2->blockEndStream, fragment);
+    return;
+  }
+
+  if (h2->block.len + fragment.len > HTTP_H2_HEAD_MAX) {
+    http_h2Fail(h2, HTTP_H2_ERROR_ENHANCE_YOUR_CALM);
+    return;
+  }
+
+  if (http_textPut(&h2->block, fragment.data, fragment.len)) {
+    http_h2Fail(h2, HTTP_H2_ERROR_INTERNAL);
+    return;
+  }
+
+  if (!end) return;
+
+  h2->blockStream = 0;
+  http_h2Headers(h2, id, h2->blockEndStream,
+                 (HttpView){h2->block.data, h2->block.len});
+  h2->block.len = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Inicia o stream com o bloco de cabeçalhos, ou recebe os trailers do corpo.
+ * O bloco é decodificado mesmo que o stream seja recusado, para que a tabela
+ * dinâmica continue igual à do cliente.
+ */
+static void http_h2Headers(HttpH2 *h2, uint32_t id, bool endStream,
+                           HttpView block) {
+  HttpH2Stream *stream = http_h2Stream(h2, id);
+  bool trailers = stream != NULL;
+  int error = 0;
+
+  if (trailers) {
+    if (stream->remoteClosed) {
+      error = HTTP_H2_ERROR_STREAM_CLOSED;
+    } else if (!endStream) {
+      error = HTTP_H2_ERROR_PROTOCOL;
+    }
+  } else if (id <= h2->lastStreamId) {
+    http_h2Fail(h2, HTTP_H2_ERROR_STREAM_CLOSED);
+    return;
+  } else {
+    h2->lastStreamId = id;
+
+    if (h2->numStreams >= HTTP_H2_STREAMS_MAX || h2->goaway ||
+        server_isDraining() || (stream = http_h2NewStream(h2, id)) == NULL) {
+      error = HTTP_H2_ERROR_REFUSED_STREAM;
+    }
+  }
+
+  HttpH2Fields fields;
+
+  fields.stream = (error == 0) ? stream : NULL;
+  fields.trailers = trailers;
+  fields.malformed = false;
+  fields.regular = false;
+  fields.scheme = false;
+  fields.methodLen = 0;
+  fields.pathLen = 0;
+  fields.authorityLen = 0;
+  fields.hasAuthority = false;
+  fields.cookieLen = 0;
+
+  if (hpack_decode(&h2->hpack, block.data, block.len, http_h2OnField,
+                   &fields)) {
+    log_erro("http", "hpack_decode() - bloco de cabeçalhos inválido.\n");
+    http_h2Fail(h2, HTTP_H2_ERROR_COMPRESSION);
+    return;
+  }
+
+  if (error != 0) {
+    http_h2SendReset(h2, id, error);
+    if (trailers) http_h2Reset(stream);
+    return;
+  }
+
+  if (fields.malformed || (!trailers && http_h2Request(stream, &fields))) {
+    http_h2SendReset(h2, id, HTTP_H2_ERROR_PROTOCOL);
+    http_h2Reset(stream);
+    return;
+  }
+
+  if (endStream) {
+    stream->remoteClosed = true;
+    if (!stream->req.paused) http_h2Dispatch(stream);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Acrescenta o campo decodificado ao cabeçalho da requisição, como
+ * "nome: valor\r\n". Os campos que o HTTP/2 proíbe, ou que não poderiam ser
+ * representados no HTTP/1.x, tornam a requisição malformada.
+ */
+static void http_h2OnField(void *context, const HpackField *field) {
+  HttpH2Fields *fields = context;
+
+  if (fields->malformed || fields->stream == NULL) return;
+
+  if (field->nameLen == 0 || memchr(field->value, '\0', field->valueLen) ||
+      memchr(field->value, '\r', field->valueLen) ||
+      memchr(field->value, '\n', field->valueLen)) {
+    fields->malformed = true;
+    return;
+  }
+
+  if (field->name[0] == ':') {
+    // Os pseudo-cabeçalhos precedem os demais e não aparecem nos trailers.
+    if (fields->trailers || fields->regular) {
+      fields->malformed = true;
+      return;
+    }
+    http_h2OnPseudo(fields, field);
+    return;
+  }
+
+  fields->regular = true;
+
+  for (size_t i = 0; i < field->nameLen; i++) {
+    char c = field->name[i];
+
+    if (!http_isToken(c) || (c >= 'A' && c <= 'Z')) {
+      fields->malformed = true;
+      return;
+    }
+  }
+
+  if (fields->trailers) return;
+
+  const char *name = field->name;
+  size_t nameLen = field->nameLen;
+
+  // Cabeçalhos específicos da conexão não existem no HTTP/2.
+  if (http_h2Is(name, nameLen, "connection") ||
+      http_h2Is(name, nameLen, "keep-alive") ||
+      http_h2Is(name, nameLen, "proxy-connection") ||
+      http_h2Is(name, nameLen, "transfer-encoding") ||
+      http_h2Is(name, nameLen, "upgrade") ||
+      (http_h2Is(name, nameLen, "te") &&
+       !http_h2Is(field->value, field->valueLen, "trailers"))) {
+    fields->malformed = true;
+    return;
+  }
+
+  if (http_h2Is(name, nameLen, "cookie")) {
+    size_t sep = (fields->cookieLen > 0) ? 2 : 0;
+
+    if (fields->cookieLen + sep + field->valueLen >= HEADER_VALUE_MAX) {
+      fields->malformed = true;
+      return;
+    }
+
+    memcpy(fields->cookie + fields->cookieLen, "; ", sep);
+    memcpy(fields->cookie + fields->cookieLen + sep, field->value,
+           field->valueLen);
+    fields->cookieLen += sep + field->valueLen;
+    return;
+  }
+
+  HttpText *head = &fields->stream->head;
+
+  if (head->len + nameLen + field->valueLen + 4 > HTTP_H2_HEAD_MAX ||
+      http_textReserve(head, nameLen + field->valueLen + 4)) {
+    fields->malformed = true;
+    return;
+  }
+
+  http_textPut(head, name, nameLen);
+  http_textPut(head, ": ", 2);
+  http_textPut(head, field->value, field->valueLen);
+  http_textPut(head, "\r\n", 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void http_h2OnPseudo(HttpH2Fields *fields, const HpackField *field) {
+  const char *name = field->name;
+  size_t nameLen = field->nameLen;
+  const char *value = field->value;
+  size_t valueLen = field->valueLen;
+
+  if (http_h2Is(name, nameLen, ":method") && fields->methodLen == 0 &&
+      valueLen > 0 && valueLen < METHOD_MAX) {
+    memcpy(fields->method, value, valueLen);
+    fields->methodLen = valueLen;
+  } else if (http_h2Is(name, nameLen, ":path") && fields->pathLen == 0 &&
+             valueLen > 0 && valueLen < HTTP_H2_PATH_MAX) {
+    memcpy(fields->path, value, valueLen);
+    fields->pathLen = valueLen;
+  } else if (http_h2Is(name, nameLen, ":authority") && !fields->hasAuthority &&
+             valueLen < HEADER_VALUE_MAX) {
+    memcpy(fields->authority, value, valueLen);
+    fields->authorityLen = valueLen;
+    fields->hasAuthority = true;
+  } else if (http_h2Is(name, nameLen, ":scheme") && !fields->scheme &&
+             valueLen > 0) {
+    fields->scheme = true;
+  } else {
+    // Pseudo-cabeçalho desconhecido, repetido ou vazio.
+    fields->malformed = true;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Completa o cabeçalho da requisição com a linha "MÉTODO CAMINHO HTTP/2.0\r\n",
+ * o Host, obtido de :authority, e o Cookie, e o interpreta com o mesmo parser
+ * do HTTP/1.x. O handler é escolhido aqui, antes do corpo, como no HTTP/1.x.
+ */
+static int http_h2Request(HttpH2Stream *stream, HttpH2Fields *fields) {
+  HttpText *head = &stream->head;
+  HttpReq *req = &stream->req;
+
+  // O método CONNECT, sem :scheme e :path, não é suportado.
+  if (fields->methodLen == 0 || fields->pathLen == 0 || !fields->scheme) {
+    return -1;
+  }
+
+  char line[METHOD_MAX + HTTP_H2_PATH_MAX + HEADER_VALUE_MAX + 32];
+  size_t len = 0;
+
+  memcpy(line, fields->method, fields->methodLen);
+  len += fields->methodLen;
+  line[len++] = ' ';
+  memcpy(line + len, fields->path, fields->pathLen);
+  len += fields->pathLen;
+  len += http_copy(line + len, HTTP_BLOCK(" HTTP/2.0\r\n"));
+
+  if (fields->hasAuthority) {
+    len += http_copy(line + len, HTTP_BLOCK("host: "));
+    memcpy(line + len, fields->authority, fields->authorityLen);
+    len += fields->authorityLen;
+    len += http_copy(line + len, HTTP_BLOCK("\r\n"));
+  }
+
+  if (head->len + len + fields->cookieLen + 12 > HTTP_H2_HEAD_MAX ||
+      http_textReserve(head, len + fields->cookieLen + 12)) {
+    return -1;
+  }
+
+  memmove(head->data + len, head->data, head->len);
+  memcpy(head->data, line, len);
+  head->len += len;
+
+  if (fields->cookieLen > 0) {
+    http_textPut(head, "cookie: ", 8);
+    http_textPut(head, fields->cookie, fields->cookieLen);
+    http_textPut(head, "\r\n", 2);
+  }
+
+  http_textPut(head, "\r\n", 2);
+
+  size_t pos = 0;
+
+  req->data = head->data;
+
+  if (http_parseRequestLine(req, head->data, head->len, &pos) ||
+      http_parseHeaders(req, head->data, head->len, pos)) {
+    return -1;
   }
 
-  log_erro("http",
-           "stateHttpVersao1Inicio() - esperando dígito (0-9), mas veio: %c.\n",
-           c);
+  req->headLen = head->len;
+  req->headParsed = true;
+  req->handler = http_route(&stream->client);
 
-  return FORMAT_ERROR;
+  return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateHttpVersao1(HttpClient *client, char c) {
-  if (c == '.') {
-    client->req->state = stateHttpVersao2Inicio;
-    return FORMAT_PART;
-  } else if (http_isDigit(c)) {
-    client->req->versionMajor *= 10 + (unsigned)c - '0';
-    return FORMAT_PART;
+static void http_h2OnReset(HttpH2 *h2, const HttpH2Frame *frame) {
+  if (frame->id == 0) {
+    http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
+  }
+
+  if (frame->len != 4) {
+    http_h2Fail(h2, HTTP_H2_ERROR_FRAME_SIZE);
+    return;
+  }
+
+  HttpH2Stream *stream = http_h2Stream(h2, frame->id);
+
+  if (stream == NULL) {
+    if (frame->id > h2->lastStreamId) http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
   }
 
-  log_erro("http",
-           "stateHttpVersao1() - esperando sinal de ponto-final (.) ou "
-           "dígito (0-9), mas veio: %c.\n",
-           c);
+  log_dbug("http", "HTTP/2: %d - stream %u cancelado pelo cliente.\n", h2->fd,
+           stream->id);
 
-  return FORMAT_ERROR;
+  http_h2Reset(stream);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateHttpVersao2Inicio(HttpClient *client, char c) {
-  if (http_isDigit(c)) {
-    client->req->versionMinor *= 10 + (unsigned)c - '0';
-    client->req->state = stateHttpVersao2;
-    return FORMAT_PART;
+static void http_h2OnSettings(HttpH2 *h2, const HttpH2Frame *frame) {
+  if (frame->id != 0) {
+    http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
   }
 
-  log_erro("http",
-           "stateHttpVersao2Inicio() - esperando dígito (0-9), mas veio: %c.\n",
-           c);
+  if (frame->flags & HTTP_H2_FLAG_ACK) {
+    if (frame->len != 0) http_h2Fail(h2, HTTP_H2_ERROR_FRAME_SIZE);
+    return;
+  }
+
+  if (frame->len % 6 != 0) {
+    http_h2Fail(h2, HTTP_H2_ERROR_FRAME_SIZE);
+    return;
+  }
+
+  for (size_t i = 0; i < frame->len; i += 6) {
+    const unsigned char *setting = (const unsigned char *)frame->payload + i;
+    uint32_t value = http_h2Get32(frame->payload + i + 2);
+
+    switch ((setting[0] << 8) | setting[1]) {
+      case HTTP_H2_SETTING_ENABLE_PUSH:
+        if (value > 1) {
+          http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+          return;
+        }
+        break;
+      case HTTP_H2_SETTING_INITIAL_WINDOW_SIZE:
+        if (value > HTTP_H2_MAX || http_h2SetWindow(h2, value)) {
+          http_h2Fail(h2, HTTP_H2_ERROR_FLOW_CONTROL);
+          return;
+        }
+        break;
+      case HTTP_H2_SETTING_MAX_FRAME_SIZE:
+        if (value < HTTP_H2_FRAME_MAX || value > 0xffffff) {
+          http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+          return;
+        }
+        h2->maxFrame = value;
+        break;
+      default:
+        // As demais não afetam o servidor: o codificador não usa a tabela
+        // dinâmica, e nenhum stream é iniciado pelo servidor.
+        break;
+    }
+  }
 
-  return FORMAT_ERROR;
+  h2->settled = true;
+
+  http_h2Frame(h2, HTTP_H2_FRAME_SETTINGS, HTTP_H2_FLAG_ACK, 0, NULL, 0);
+
+  // A janela inicial pode ter aumentado.
+  http_h2DrainAll(h2);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateHttpVersao2(HttpClient *client, char c) {
-  if (c == '\r') {
-    client->req->state = stateNovaLinha1;
-    return FORMAT_PART;
-  } else if (http_isDigit(c)) {
-    client->req->versionMinor *= 10 + (unsigned)c - '0';
-    return FORMAT_PART;
+/**
+ * Aplica a nova janela inicial aos streams abertos, pela diferença em relação
+ * à anterior.
+ *
+ * @return 0, ou -1, caso a janela de algum stream ultrapasse o máximo.
+ */
+static int http_h2SetWindow(HttpH2 *h2, int64_t window) {
+  int64_t delta = window - h2->initialWindow;
+
+  h2->initialWindow = window;
+
+  for (HttpH2Stream *stream = h2->streams; stream; stream = stream->next) {
+    stream->sendWindow += delta;
+    if (stream->sendWindow > HTTP_H2_MAX) return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void http_h2OnPing(HttpH2 *h2, const HttpH2Frame *frame) {
+  if (frame->id != 0) {
+    http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
+  }
+
+  if (frame->len != 8) {
+    http_h2Fail(h2, HTTP_H2_ERROR_FRAME_SIZE);
+    return;
   }
 
-  log_erro("http",
-           "stateHttpVersao2() - esperando retorno de cursor '\\r' ou dígito "
-           "(0-9), mas veio: %c.\n",
-           c);
+  if (frame->flags & HTTP_H2_FLAG_ACK) return;
 
-  return FORMAT_ERROR;
+  http_h2Frame(h2, HTTP_H2_FRAME_PING, HTTP_H2_FLAG_ACK, 0, frame->payload, 8);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateNovaLinha1(HttpClient *client, char c) {
-  if (c == '\n') {
-    client->req->state = stateCabecalhoNovo;
-    return FORMAT_PART;
+/**
+ * O cliente não iniciará novos streams: a conexão é fechada após os que estão
+ * em andamento.
+ */
+static void http_h2OnGoaway(HttpH2 *h2, const HttpH2Frame *frame) {
+  if (frame->id != 0) {
+    http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
   }
 
-  log_erro("http", "stateNovaLinha1() - esperando nova linha, mas veio: %c.\n",
-           c);
+  if (frame->len < 8) {
+    http_h2Fail(h2, HTTP_H2_ERROR_FRAME_SIZE);
+    return;
+  }
 
-  return FORMAT_ERROR;
+  h2->goaway = true;
+
+  if (h2->numStreams == 0) server_closeAfter(h2->fd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateCabecalhoNovo(HttpClient *client, char c) {
-  if (c == '\r') {
-    client->req->state = stateNovaLinha3;
-    return FORMAT_PART;
+static void http_h2OnWindowUpdate(HttpH2 *h2, const HttpH2Frame *frame) {
+  if (frame->len != 4) {
+    http_h2Fail(h2, HTTP_H2_ERROR_FRAME_SIZE);
+    return;
   }
 
-  if (!http_isLetter(c)) {
-    log_erro("http", "stateCabecalhoNovo() - esperando letra, mas veio: %c.\n",
-             c);
-    return FORMAT_ERROR;
+  uint32_t increment = http_h2Get32(frame->payload) & HTTP_H2_MAX;
+
+  if (frame->id == 0) {
+    if (increment == 0) {
+      http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    } else if (h2->sendWindow + increment > HTTP_H2_MAX) {
+      http_h2Fail(h2, HTTP_H2_ERROR_FLOW_CONTROL);
+    } else {
+      h2->sendWindow += increment;
+      http_h2DrainAll(h2);
+    }
+    return;
   }
 
-  if (client->req->headersLen >= HEADERS_MAX) {
-    log_erro("http",
-             "stateCabecalhoNovo() - quantidade de cabecalhos maior do que o "
-             "permitido: %ld.\n",
-             HEADERS_MAX);
-    return FORMAT_ERROR;
+  HttpH2Stream *stream = http_h2Stream(h2, frame->id);
+
+  if (stream == NULL) {
+    if (frame->id > h2->lastStreamId) http_h2Fail(h2, HTTP_H2_ERROR_PROTOCOL);
+    return;
   }
 
-  HttpHeader *header = &client->req->headers[client->req->headersLen++];
-  header->name[header->nameLen++] = c;
-  header->name[header->nameLen] = '\0';
+  if (increment == 0 || stream->sendWindow + increment > HTTP_H2_MAX) {
+    http_h2SendReset(h2, stream->id,
+                     (increment == 0) ? HTTP_H2_ERROR_PROTOCOL
+                                      : HTTP_H2_ERROR_FLOW_CONTROL);
+    http_h2Reset(stream);
+    return;
+  }
 
-  client->req->state = stateCabecalhoNome;
-  return FORMAT_PART;
+  stream->sendWindow += increment;
+  http_h2Drain(stream);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateCabecalhoEspacoAntesDoValor(HttpClient *client,
-                                                     char c) {
-  if (c == ' ') {
-    client->req->state = stateCabecalhoValor;
-    return FORMAT_PART;
+/**
+ * Avisa os streams que aguardam espaço na fila de saída (http_onWritable()),
+ * enquanto houver espaço. Os que aguardam espaço na janela são avisados por
+ * http_h2Drain().
+ */
+static void http_h2OnWritable(HttpH2 *h2) {
+  HttpH2Stream *next = NULL;
+
+  for (HttpH2Stream *stream = h2->streams; stream != NULL; stream = next) {
+    HttpWritableFunc func = stream->client.onWritable;
+
+    next = stream->next;
+
+    if (func == NULL || http_h2Left(stream) > 0) continue;
+
+    if (server_outboxFull(h2->fd)) {
+      server_watchWrite(h2->fd);
+      return;
+    }
+
+    // A função pode concluir a resposta, liberando o stream.
+    stream->client.onWritable = NULL;
+    func(&stream->client);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Obtém os dados do frame, sem o preenchimento (PADDED) e, no HEADERS, sem a
+ * prioridade (PRIORITY), que é ignorada.
+ *
+ * @return 0, ou -1, caso o preenchimento não caiba no frame.
+ */
+static int http_h2Unpad(const HttpH2Frame *frame, HttpView *data) {
+  size_t pos = 0;
+  size_t pad = 0;
+
+  if (frame->flags & HTTP_H2_FLAG_PADDED) {
+    if (frame->len < 1) return -1;
+    pad = (unsigned char)frame->payload[0];
+    pos = 1;
   }
 
-  log_erro("http",
-           "stateCabecalhoEspacoAntesDoValor() - esperando espaço em branco, "
-           "mas veio: %c.\n",
-           c);
+  if (frame->type == HTTP_H2_FRAME_HEADERS &&
+      (frame->flags & HTTP_H2_FLAG_PRIORITY)) {
+    pos += 5;
+  }
+
+  if (pos + pad > frame->len) return -1;
 
-  return FORMAT_ERROR;
+  *data = (HttpView){frame->payload + pos, frame->len - pos - pad};
+
+  return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateCabecalhoNome(HttpClient *client, char c) {
-  HttpHeader *header = &client->req->headers[client->req->headersLen - 1];
+/**
+ * Entrega a requisição completa ao handler. A partir daqui, a conexão é
+ * mantida aberta até a resposta ser concluída.
+ */
+static void http_h2Dispatch(HttpH2Stream *stream) {
+  HttpClient *client = &stream->client;
+  HttpReq *req = &stream->req;
 
-  if (c == ':') {
-    log_dbug("http", "Nome de cabeçalho: %s\n", header->name);
-    client->req->state = stateCabecalhoEspacoAntesDoValor;
-    return FORMAT_PART;
+  if (stream->dispatched || stream->reset) return;
+
+  stream->dispatched = true;
+  stream->h2->active++;
+  http_h2Hold(stream->h2);
+
+  if (req->handler == NULL || req->handler->onBody == NULL) {
+    req->contentLength = stream->body.len;
   }
 
-  if (!http_isLetter(c) && c != '-') {
-    log_erro("http",
-             "stateCabecalhoNome() - esperando letra ou traço, mas "
-             "veio: %c.\n",
-             c);
-    return FORMAT_ERROR;
+  log_info("http", "%s %s\n", http_reqMethod(client), http_reqPath(client));
+
+  if (req->handler == NULL) {
+    log_dbug("http", "Recurso não encontrado: %s.\n", http_reqPath(client));
+    http_sendNotFound(client);
+    return;
   }
 
-  if (header->nameLen >= HEADER_NAME_MAX) {
-    log_erro("http",
-             "stateCabecalhoNome() - nome do cabeçalho maior do que o "
-             "permitido: %ld.\n",
-             HEADER_NAME_MAX);
-    return FORMAT_ERROR;
+  req->handler->func(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Entrega ao handler o corpo armazenado durante a suspensão e devolve a
+ * janela do stream ao cliente.
+ */
+static void http_h2ResumeBody(HttpH2Stream *stream) {
+  HttpReq *req = &stream->req;
+
+  if (stream->reset) return;
+
+  bool streamed = req->handler != NULL && req->handler->onBody != NULL;
+
+  if (streamed && stream->body.len > 0) {
+    HttpView data = {stream->body.data, stream->body.len};
+
+    req->bodyRead += data.len;
+    req->handler->onBody(&stream->client, data);
+    stream->body.len = 0;
+
+    if (req->paused) return;
   }
 
-  header->name[header->nameLen++] = c;
-  header->name[header->nameLen] = '\0';
+  http_h2Ack(stream->h2, stream);
 
-  return FORMAT_PART;
+  if (stream->remoteClosed) http_h2Dispatch(stream);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateCabecalhoValor(HttpClient *client, char c) {
-  HttpHeader *header = &client->req->headers[client->req->headersLen - 1];
+/**
+ * Devolve ao cliente, com WINDOW_UPDATE, o espaço dos dados já consumidos do
+ * stream, ou da conexão, caso stream seja NULL, assim que somam metade da
+ * janela.
+ */
+static void http_h2Ack(HttpH2 *h2, HttpH2Stream *stream) {
+  int64_t *window = (stream != NULL) ? &stream->recvWindow : &h2->recvWindow;
+  size_t *consumed =
+      (stream != NULL) ? &stream->recvConsumed : &h2->recvConsumed;
 
-  if (c == '\r') {
-    log_dbug("http", "Valor de cabeçalho: %s\n", header->value);
-    client->req->state = stateNovaLinha2;
-    return FORMAT_PART;
+  if (*consumed < HTTP_H2_WINDOW / 2) return;
+
+  // O cliente não enviará mais nada no stream.
+  if (stream != NULL && stream->remoteClosed) return;
+
+  http_h2WindowUpdate(h2, (stream != NULL) ? stream->id : 0, *consumed);
+
+  *window += *consumed;
+  *consumed = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Codifica o campo no cabeçalho da resposta, enviado com o corpo.
+ */
+static void http_h2Field(HttpH2Stream *stream, const char *name,
+                         size_t nameLen, const char *value, size_t valueLen) {
+  HttpText *head = &stream->respHead;
+
+  if (stream->reset) return;
+
+  if (http_textReserve(head, hpack_encodeSize(nameLen, valueLen))) {
+    http_h2SendReset(stream->h2, stream->id, HTTP_H2_ERROR_INTERNAL);
+    http_h2Reset(stream);
+    return;
   }
 
-  if (http_isCtl(c)) {
-    log_erro("http",
-             "stateCabecalhoValor() - esperando letra, número ou símbolo, "
-             "mas veio caractere de controle: %02X.\n",
-             c);
-    return FORMAT_ERROR;
+  head->len += hpack_encode(head->data + head->len, name, nameLen, value,
+                            valueLen);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Codifica o campo a partir da linha "Nome: valor\r\n" do HTTP/1.x.
+ */
+static void http_h2Line(HttpH2Stream *stream, HttpView line) {
+  const char *colon = memchr(line.data, ':', line.len);
+  size_t nameLen = colon - line.data;
+
+  http_h2Field(stream, line.data, nameLen, colon + 2, line.len - nameLen - 4);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Envia o cabeçalho da resposta em HEADERS e, caso não caiba em um frame, em
+ * CONTINUATION. A resposta sem corpo termina aqui, com END_STREAM; a
+ * resposta em partes (http_sendChunk()) não informa o tamanho.
+ */
+static void http_h2Head(HttpH2Stream *stream, size_t size) {
+  HttpH2 *h2 = stream->h2;
+  HttpText *head = &stream->respHead;
+  bool streaming = stream->client.streaming;
+  HttpView date = http_date();
+  char length[24];
+
+  // "Date: " e "\r\n" ficam de fora.
+  http_h2Field(stream, "date", 4, date.data + 6, date.len - 8);
+
+  if (!streaming && !stream->client.notModified) {
+    http_h2Field(stream, "content-length", 14, length,
+                 http_itoa(length, size));
   }
 
-  if (header->valueLen >= HEADER_VALUE_MAX) {
-    log_erro("http",
-             "stateCabecalhoValor() - valor do cabeçalho maior do que o "
-             "permitido: %ld.\n",
-             HEADER_VALUE_MAX);
-    return FORMAT_ERROR;
+  if (stream->reset || h2->failed) return;
+
+  HttpH2FrameType type = HTTP_H2_FRAME_HEADERS;
+  size_t pos = 0;
+
+  while (pos < head->len) {
+    size_t len = http_min(head->len - pos, h2->maxFrame);
+    uint8_t flags = 0;
+
+    if (pos + len == head->len) flags |= HTTP_H2_FLAG_END_HEADERS;
+
+    if (type == HTTP_H2_FRAME_HEADERS && !streaming && size == 0) {
+      flags |= HTTP_H2_FLAG_END_STREAM;
+    }
+
+    http_h2Frame(h2, type, flags, stream->id, head->data + pos, len);
+
+    pos += len;
+    type = HTTP_H2_FRAME_CONTINUATION;
   }
 
-  header->value[header->valueLen++] = c;
-  header->value[header->valueLen] = '\0';
+  head->len = 0;
 
-  return FORMAT_PART;
+  if (!streaming && size == 0) stream->endSent = true;
+
+  // O corpo de tamanho conhecido segue inteiro, e o seu último frame já leva o
+  // END_STREAM.
+  stream->sized = !streaming;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateNovaLinha2(HttpClient *client, char c) {
-  if (c == '\n') {
-    client->req->state = stateCabecalhoNovo;
-    return FORMAT_PART;
+/**
+ * Envia o corpo em frames DATA, dentro das janelas da conexão e do stream. O
+ * que não couber aguarda WINDOW_UPDATE: copiado, caso copy seja verdadeiro, ou
+ * referenciado, como em http_sendRef().
+ */
+static void http_h2Data(HttpH2Stream *stream, const char *data, size_t size,
+                        bool copy) {
+  if (size == 0 || stream->reset || stream->h2->failed) return;
+
+  // Os dados seguem os que já aguardam a janela.
+  if (http_h2Left(stream) > 0) {
+    if (http_textPut(&stream->pending, data, size)) {
+      http_h2SendReset(stream->h2, stream->id, HTTP_H2_ERROR_INTERNAL);
+      http_h2Reset(stream);
+    }
+    return;
   }
 
-  log_erro("http",
-           "stateNovaLinha2() - esperando nova linha '\\n', mas veio: %c.\n",
-           c);
+  stream->ref = data;
+  stream->refLen = size;
+  stream->refCopy = copy;
+
+  http_h2Flush(stream);
+
+  if (!copy || stream->refLen == 0) return;
 
-  return FORMAT_ERROR;
+  // Os dados da aplicação são válidos somente durante a chamada.
+  if (http_textPut(&stream->pending, stream->ref, stream->refLen)) {
+    http_h2SendReset(stream->h2, stream->id, HTTP_H2_ERROR_INTERNAL);
+    http_h2Reset(stream);
+    return;
+  }
+
+  stream->ref = NULL;
+  stream->refLen = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateNovaLinha3(HttpClient *client, char c) {
-  if (c == '\n') {
-    const char *contentLength = http_reqHeader(client, "Content-Length");
+static void http_h2File(HttpH2Stream *stream, int fd, size_t offset,
+                        size_t size) {
+  if (size == 0 || stream->reset || stream->h2->failed) return;
 
-    if (contentLength != NULL) {
-      client->req->contentLength = atoi(contentLength);
+  stream->fileFd = fd;
+  stream->fileOffset = offset;
+  stream->fileLen = size;
 
-      if (client->req->contentLength >= BODY_MAX) {
-        return FORMAT_ERROR;
-      }
+  http_h2Flush(stream);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Conclui a resposta. O stream é liberado assim que o END_STREAM for enviado,
+ * o que pode aguardar a janela.
+ */
+static void http_h2End(HttpH2Stream *stream) {
+  stream->ended = true;
+  http_h2Flush(stream);
+  http_h2Release(stream);
+}
+
+////////////////////////////////////////////////////////////////////////////////
 
-      if (client->req->contentLength > 0) {
-        client->req->state = stateBody;
-        return FORMAT_PART;
+/**
+ * Envia o corpo pendente enquanto houver espaço nas janelas, em frames de até
+ * SETTINGS_MAX_FRAME_SIZE. O END_STREAM segue com o último frame da resposta
+ * concluída.
+ */
+static void http_h2Flush(HttpH2Stream *stream) {
+  HttpH2 *h2 = stream->h2;
+
+  if (stream->reset || h2->failed || stream->endSent) return;
+
+  size_t left;
+
+  while ((left = http_h2Left(stream)) > 0) {
+    int64_t window =
+        (stream->sendWindow < h2->sendWindow) ? stream->sendWindow
+                                              : h2->sendWindow;
+
+    if (window <= 0) return;
+
+    size_t pending = stream->pending.len - stream->pendingPos;
+    size_t len = (pending > 0)            ? pending
+                 : (stream->refLen > 0) ? stream->refLen
+                                        : stream->fileLen;
+
+    len = http_min(http_min(len, (size_t)window), h2->maxFrame);
+
+    bool last = (stream->ended || stream->sized) && len == left;
+
+    http_h2FrameHead(h2, HTTP_H2_FRAME_DATA,
+                     last ? HTTP_H2_FLAG_END_STREAM : 0, stream->id, len);
+
+    if (pending > 0) {
+      server_append(h2->fd, stream->pending.data + stream->pendingPos, len);
+      stream->pendingPos += len;
+      if (stream->pendingPos == stream->pending.len) {
+        stream->pending.len = 0;
+        stream->pendingPos = 0;
+      }
+    } else if (stream->refLen > 0) {
+      if (stream->refCopy) {
+        server_append(h2->fd, stream->ref, len);
+      } else {
+        server_appendRef(h2->fd, stream->ref, len);
       }
+      stream->ref += len;
+      stream->refLen -= len;
+    } else {
+      server_appendFile(h2->fd, stream->fileFd, stream->fileOffset, len);
+      stream->fileOffset += len;
+      stream->fileLen -= len;
     }
 
-    return FORMAT_OK;
-  }
+    stream->sendWindow -= len;
+    h2->sendWindow -= len;
 
-  log_erro("http",
-           "stateNovaLinha3() - esperando nova linha '\\n', mas veio: %c.\n",
-           c);
+    if (last) stream->endSent = true;
+  }
 
-  return FORMAT_ERROR;
+  if (stream->ended && !stream->endSent) {
+    http_h2FrameHead(h2, HTTP_H2_FRAME_DATA, HTTP_H2_FLAG_END_STREAM,
+                     stream->id, 0);
+    stream->endSent = true;
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static FormatStatus stateBody(HttpClient *client, char c) {
-  if (client->req->bodyLen < client->req->contentLength) {
-    client->req->body[client->req->bodyLen++] = c;
-    client->req->body[client->req->bodyLen] = 0;
-  }
+/**
+ * Envia o que aguardava espaço na janela e, caso tudo tenha sido enviado,
+ * avisa a aplicação que aguarda para continuar (http_onWritable()).
+ */
+static void http_h2Drain(HttpH2Stream *stream) {
+  if (http_h2Left(stream) == 0) return;
 
-  if (client->req->bodyLen == client->req->contentLength) {
-    return FORMAT_OK;
-  }
+  http_h2Flush(stream);
 
-  return FORMAT_PART;
+  if (http_h2Left(stream) > 0) return;
+
+  if (stream->client.onWritable != NULL) server_watchWrite(stream->h2->fd);
+
+  http_h2Release(stream);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void http_sendNotFound(HttpClient *client) {
-  http_sendStatus(client, HTTP_STATUS_NOT_FOUND);
-  http_send(client, NULL, 0);
+static void http_h2DrainAll(HttpH2 *h2) {
+  HttpH2Stream *next = NULL;
+
+  for (HttpH2Stream *stream = h2->streams; stream != NULL; stream = next) {
+    next = stream->next;
+    http_h2Drain(stream);
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void http_sendError(HttpClient *client) {
-  http_sendStatus(client, HTTP_STATUS_INTERNAL_ERROR);
-  http_send(client, NULL, 0);
+/**
+ * Bytes do corpo da resposta que aguardam espaço na janela.
+ */
+static size_t http_h2Left(const HttpH2Stream *stream) {
+  return stream->pending.len - stream->pendingPos + stream->refLen +
+         stream->fileLen;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void http_sendRedirect(HttpClient *client, const char *url) {
-  http_sendStatus(client, HTTP_STATUS_MOVED_PERMANENTLY);
-  http_sendHeader(client, "Location", url);
-  http_send(client, NULL, 0);
+static void http_h2Frame(HttpH2 *h2, HttpH2FrameType type, uint8_t flags,
+                         uint32_t id, const void *payload, size_t len) {
+  http_h2FrameHead(h2, type, flags, id, len);
+  if (len > 0) server_append(h2->fd, payload, len);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void http_sendStatus(HttpClient *client, HttpStatus status) {
-  str_fmt(client->resp, "HTTP/1.1 %d %s\r\n", status, http_strStatus(status));
+/**
+ * Envia o início do frame. O payload, acrescentado em seguida, forma com ele
+ * um único segmento da fila de saída, exceto quando referenciado.
+ */
+static void http_h2FrameHead(HttpH2 *h2, HttpH2FrameType type, uint8_t flags,
+                             uint32_t id, size_t len) {
+  char head[HTTP_H2_FRAME_HEAD];
+
+  head[0] = (char)(len >> 16);
+  head[1] = (char)(len >> 8);
+  head[2] = (char)len;
+  head[3] = (char)type;
+  head[4] = (char)flags;
+  http_h2Put32(head + 5, id);
+
+  server_append(h2->fd, head, sizeof(head));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void http_sendType(HttpClient *client, HttpMimeType type) {
-  str_fmt(client->resp, "Content-Type: %s\r\n", http_strMimeType(type));
+static void http_h2WindowUpdate(HttpH2 *h2, uint32_t id, size_t increment) {
+  char payload[4];
+
+  http_h2Put32(payload, (uint32_t)increment);
+  http_h2Frame(h2, HTTP_H2_FRAME_WINDOW_UPDATE, 0, id, payload,
+               sizeof(payload));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void http_sendHeader(HttpClient *client, const char *name, const char *value) {
-  str_fmt(client->resp, "%s: %s\r\n", name, value);
+static void http_h2SendReset(HttpH2 *h2, uint32_t id, HttpH2Error error) {
+  char payload[4];
+
+  if (h2->failed) return;
+
+  http_h2Put32(payload, error);
+  http_h2Frame(h2, HTTP_H2_FRAME_RST_STREAM, 0, id, payload, sizeof(payload));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void http_sendHeaderInt(HttpClient *client, const char *name, int value) {
-  str_fmt(client->resp, "%s: %d\r\n", name, value);
+/**
+ * Erro de conexão: envia GOAWAY e fecha a conexão assim que ele for enviado,
+ * mesmo com streams em andamento.
+ */
+static void http_h2Fail(HttpH2 *h2, HttpH2Error error) {
+  char payload[8];
+
+  if (h2->failed) return;
+
+  log_erro("http", "HTTP/2: %d - erro de conexão: %d.\n", h2->fd, error);
+
+  http_h2Put32(payload, h2->lastStreamId);
+  http_h2Put32(payload + 4, error);
+  http_h2Frame(h2, HTTP_H2_FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+
+  h2->failed = true;
+
+  http_h2Hold(h2);
+  server_closeAfter(h2->fd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void http_send(HttpClient *client, const char *body, size_t size) {
-  if (body == NULL || size == 0) {
-    http_sendHeader(client, "Content-Length", "0");
-    str_addcstr(&client->resp, "\r\n");
-  } else {
-    http_sendHeaderInt(client, "Content-Length", size);
-    str_addcstr(&client->resp, "\r\n");
-    str_addcstrlen(&client->resp, body, size);
+/**
+ * Encerra o stream, após RST_STREAM enviado ou recebido. Caso a resposta
+ * esteja em andamento, o stream é mantido até a aplicação concluí-la, e o que
+ * ela enviar é descartado.
+ */
+static void http_h2Reset(HttpH2Stream *stream) {
+  stream->reset = true;
+
+  stream->pending.len = 0;
+  stream->pendingPos = 0;
+  stream->ref = NULL;
+  stream->refLen = 0;
+  stream->fileLen = 0;
+
+  // A resposta adiada não será enviada, mas o stream permanece até
+  // http_complete().
+  if (stream->client.defer != NULL) {
+    atomic_store(&stream->client.defer->cancelled, true);
   }
 
-  log_dbug("http", "<<< %s\n", str_cstr(client->resp));
+  // A aplicação que aguarda a fila de saída deve prosseguir até concluir a
+  // resposta.
+  if (stream->client.onWritable != NULL) server_watchWrite(stream->h2->fd);
 
-  server_send(client->fd, str_cstr(client->resp), str_len(client->resp));
+  http_h2Release(stream);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static const char *http_strStatus(HttpStatus status) {
-  switch (status) {
-    case HTTP_STATUS_OK:
-      return "Ok";
-    case HTTP_STATUS_NOT_FOUND:
-      return "Not Found";
-    case HTTP_STATUS_BAD_REQUEST:
-      return "Bad Request";
-    case HTTP_STATUS_INTERNAL_ERROR:
-      return "Internal Error";
-    case HTTP_STATUS_MOVED_PERMANENTLY:
-      return "Moved Permanently";
+static HttpH2Stream *http_h2Stream(HttpH2 *h2, uint32_t id) {
+  for (HttpH2Stream *stream = h2->streams; stream; stream = stream->next) {
+    if (stream->id == id) return stream;
   }
+
   return NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static const char *http_strMimeType(HttpMimeType contentType) {
-  switch (contentType) {
-    case HTTP_TYPE_HTML:
-      return "text/html; charset=utf8";
-    case HTTP_TYPE_JSON:
-      return "application/json; charset=utf8";
-    case HTTP_TYPE_TEXT:
-      return "text/plain; charset=utf8";
-    case HTTP_TYPE_CSS:
-      return "text/css; charset=utf8";
-    case HTTP_TYPE_JS:
-      return "application/javascript; charset=utf8";
-    case HTTP_TYPE_JPEG:
-      return "image/jpeg; charset=utf8";
-    case HTTP_TYPE_PNG:
-      return "image/png; charset=utf8";
+static HttpH2Stream *http_h2NewStream(HttpH2 *h2, uint32_t id) {
+  HttpH2Stream *stream = malloc(sizeof(HttpH2Stream));
+
+  if (stream == NULL) {
+    log_erro("http", "malloc(): %d - %s\n", errno, strerror(errno));
+    return NULL;
   }
-  return NULL;
+
+  stream->id = id;
+  stream->h2 = h2;
+
+  stream->client.req = &stream->req;
+  stream->client.fd = h2->fd;
+  stream->client.streaming = false;
+  stream->client.onWritable = NULL;
+  stream->client.requests = 0;
+  stream->client.h2 = NULL;
+  stream->client.stream = stream;
+  stream->client.defer = NULL;
+  stream->client.compressible = false;
+  stream->client.encoded = false;
+  stream->client.gzip = NULL;
+  stream->client.notModified = false;
+
+  http_clearReq(&stream->req);
+
+  stream->head = (HttpText){NULL, 0, 0};
+  stream->body = (HttpText){NULL, 0, 0};
+  stream->recvWindow = HTTP_H2_WINDOW;
+  stream->recvConsumed = 0;
+  stream->sendWindow = h2->initialWindow;
+  stream->remoteClosed = false;
+  stream->dispatched = false;
+  stream->ended = false;
+  stream->sized = false;
+  stream->endSent = false;
+  stream->reset = false;
+  stream->respHead = (HttpText){NULL, 0, 0};
+  stream->pending = (HttpText){NULL, 0, 0};
+  stream->pendingPos = 0;
+  stream->ref = NULL;
+  stream->refLen = 0;
+  stream->refCopy = false;
+  stream->fileFd = -1;
+  stream->fileOffset = 0;
+  stream->fileLen = 0;
+
+  stream->next = h2->streams;
+  h2->streams = stream;
+  h2->numStreams++;
+
+  return stream;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-const char *http_reqHeader(HttpClient *client, const char *name) {
-  for (int i = 0; i < client->req->headersLen; i++) {
-    if (strcmp(client->req->headers[i].name, name) == 0) {
-      return client->req->headers[i].value;
-    }
-  }
-  return "";
+/**
+ * Libera o stream caso a resposta tenha sido enviada ou, após RST_STREAM, a
+ * aplicação não o utilize mais.
+ */
+static void http_h2Release(HttpH2Stream *stream) {
+  bool done = stream->ended ? (stream->endSent || stream->reset)
+                            : (stream->reset && !stream->dispatched);
+
+  if (done) http_h2Close(stream);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-const char *http_reqParam(HttpClient *client, const char *name) {
-  for (int i = 0; i < client->req->paramsLen; i++) {
-    if (strcmp(client->req->params[i].name, name) == 0) {
-      return client->req->params[i].value;
-    }
+static void http_h2Close(HttpH2Stream *stream) {
+  HttpH2 *h2 = stream->h2;
+  HttpH2Stream **link = &h2->streams;
+
+  while (*link != stream) link = &(*link)->next;
+
+  *link = stream->next;
+  h2->numStreams--;
+
+  if (stream->dispatched) {
+    h2->active--;
+    http_h2Hold(h2);
   }
-  return "";
+
+  http_h2FreeStream(stream);
+
+  if (h2->goaway && h2->numStreams == 0) server_closeAfter(h2->fd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int http_reqParamInt(HttpClient *client, const char *name, int def) {
-  for (int i = 0; i < client->req->paramsLen; i++) {
-    if (strcmp(client->req->params[i].name, name) == 0) {
-      int r = strtol(client->req->params[i].value, NULL, 10);
-      if ((r == LONG_MAX || r == LONG_MIN) && errno == ERANGE) {
-        return def;
-      } else {
-        return r;
-      }
-    }
-  }
-  return def;
+static void http_h2FreeStream(HttpH2Stream *stream) {
+  http_gzipFree(&stream->client);
+  free(stream->head.data);
+  free(stream->body.data);
+  free(stream->respHead.data);
+  free(stream->pending.data);
+  free(stream);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-const char *http_reqMethod(HttpClient *client) { return client->req->method; }
+static void http_h2Free(HttpH2 *h2) {
+  while (h2->streams != NULL) {
+    HttpH2Stream *next = h2->streams->next;
+    http_deferDrop(&h2->streams->client);
+    http_h2FreeStream(h2->streams);
+    h2->streams = next;
+  }
+
+  hpack_free(&h2->hpack);
+  free(h2->block.data);
+  free(h2);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
-const char *http_reqPath(HttpClient *client) { return client->req->uri; }
+/**
+ * Mantém a conexão aberta enquanto houver respostas em andamento, exceto após
+ * um erro de conexão.
+ */
+static void http_h2Hold(HttpH2 *h2) {
+  server_hold(h2->fd, h2->active > 0 && !h2->failed);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
-const char *http_reqPattern(HttpClient *client) { return client->req->pattern; }
+static bool http_h2Is(const char *data, size_t len, const char *str) {
+  return strlen(str) == len && memcmp(data, str, len) == 0;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
-const char *http_reqArg(HttpClient *client, int n) {
-  if (n >= client->req->argsLen) {
-    return "";
-  }
-  return client->req->args[n];
+static uint32_t http_h2Get32(const char *data) {
+  const unsigned char *bytes = (const unsigned char *)data;
+
+  return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) |
+         ((uint32_t)bytes[2] << 8) | bytes[3];
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-const char *http_reqBody(HttpClient *client) { return client->req->body; }
\ No newline at end of file
+static void http_h2Put32(char *dst, uint32_t value) {
+  dst[0] = (char)(value >> 24);
+  dst[1] = (char)(value >> 16);
+  dst[2] = (char)(value >> 8);
+  dst[3] = (char)value;
+}
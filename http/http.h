@@ -17,11 +17,9 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+#include <stdbool.h>
 #include <stddef.h>
-
-////////////////////////////////////////////////////////////////////////////////
-
-#define HANDLERS_MAX 100
+#include <time.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -29,10 +27,6 @@
 #define HEADER_VALUE_MAX 512
 #define HEADERS_MAX 32
 
-#define HTTP_RESP_INIT_SIZE (4 * 1024)
-
-#define HTTP_CLIENTS_INIT_SIZE 32
-
 ////////////////////////////////////////////////////////////////////////////////
 
 #define PARAM_NAME_MAX 128
@@ -43,22 +37,61 @@
 
 #define URI_MAX 256
 #define METHOD_MAX 8
-#define PATTERN_MAX URI_MAX
 
 ////////////////////////////////////////////////////////////////////////////////
 
-#define INBOX_MAX_SIZE (4 * 1024)
+#define INBOX_INIT_SIZE (4 * 1024)
+#define INBOX_MAX_SIZE (64 * 1024)
 #define OUTBOX_INIT_SIZE (4 * 1024)
 
 ////////////////////////////////////////////////////////////////////////////////
 
-#define ARGS_MAX 4
-#define ARG_MAX URI_MAX
+// Argumentos por padrão de rota (ver ROUTER_ARGS_MAX).
+#define ARGS_MAX 8
 
 ////////////////////////////////////////////////////////////////////////////////
 
 #define BODY_MAX (6 * 1024)
 
+// Corpo máximo das requisições recebidas em partes (http_handlerStream()).
+#define BODY_STREAM_MAX (1024L * 1024 * 1024)
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Prazos, em milissegundos, para receber o cabeçalho e o corpo de uma
+// requisição, para aguardar a próxima requisição numa conexão mantida aberta
+// (keep-alive) e para enviar as respostas.
+#define HTTP_HEADER_TIMEOUT (10 * 1000)
+#define HTTP_BODY_TIMEOUT (30 * 1000)
+#define HTTP_IDLE_TIMEOUT (60 * 1000)
+#define HTTP_WRITE_TIMEOUT (30 * 1000)
+
+// Requisições atendidas por conexão: a resposta da última leva
+// "Connection: close".
+#define HTTP_KEEPALIVE_MAX 1000
+
+// Streams simultâneos por conexão HTTP/2. A conexão que começa pelo prefácio
+// do HTTP/2 (h2c, sem Upgrade) é atendida com streams, cada um entregue aos
+// handlers como um HttpClient próprio.
+#define HTTP_H2_STREAMS_MAX 100
+
+// Fila de conexões pendentes, segundos de espera pelo primeiro dado antes de
+// entregar a conexão (TCP_DEFER_ACCEPT) e conexões aceitas por vez.
+#define HTTP_BACKLOG 4096
+#define HTTP_DEFER_ACCEPT (HTTP_HEADER_TIMEOUT / 1000)
+#define HTTP_ACCEPT_BATCH 64
+
+// Prazo, em milissegundos, para as requisições em andamento terminarem ao
+// encerrar o servidor com server_drain() (SIGTERM).
+#define HTTP_DRAIN_TIMEOUT (10 * 1000)
+
+// Respostas de tipo textual (http_sendType()) são comprimidas com gzip quando
+// o cliente aceita (Accept-Encoding): as de http_send() somente a partir de
+// HTTP_GZIP_MIN_SIZE bytes, abaixo do qual a compressão não compensa, e as de
+// http_sendChunk() sempre.
+#define HTTP_GZIP_MIN_SIZE 1024
+#define HTTP_GZIP_LEVEL 6
+
 ////////////////////////////////////////////////////////////////////////////////
 
 #define HTTP_WORKERS 4
@@ -67,6 +100,19 @@
 
 typedef struct HttpClient HttpClient;
 
+typedef struct HttpDefer HttpDefer;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Trecho de texto da requisição, sem cópia, não necessariamente terminado em
+ * '\0'.
+ */
+typedef struct HttpView {
+  const char *data;
+  size_t len;
+} HttpView;
+
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef enum HttpMimeType {
@@ -87,30 +133,65 @@ typedef enum HttpStatus {
   HTTP_STATUS_BAD_REQUEST = 400,
   HTTP_STATUS_INTERNAL_ERROR = 500,
   HTTP_STATUS_MOVED_PERMANENTLY = 301,
+  // Resposta sem corpo: a cópia em cache do cliente continua válida (ver
+  // http_reqNotModified()).
+  HTTP_STATUS_NOT_MODIFIED = 304,
 } HttpStatus;
 
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef void (*HttpHandlerFunc)(HttpClient *client);
 
+typedef void (*HttpBodyFunc)(HttpClient *client, HttpView chunk);
+
+typedef void (*HttpWritableFunc)(HttpClient *client);
+
+typedef void (*HttpDeferFunc)(HttpClient *client, void *arg);
+
 ////////////////////////////////////////////////////////////////////////////////
 // STARTUP FUNCTIONS
 ////////////////////////////////////////////////////////////////////////////////
 
 int http_start(int port, int maxClients);
 
+// O caminho da requisição é comparado com o padrão path, como "/people/:id",
+// por uma árvore de rotas (ver router.h): trechos fixos têm prioridade sobre
+// argumentos, independente da ordem em que os handlers são adicionados.
 int http_handler(const char *method, const char *path, HttpHandlerFunc func);
 
+// Como http_handler(), mas o corpo não é armazenado: cada parte é entregue a
+// onBody assim que chega, direto do inbox e válida somente durante a chamada.
+// Após a última parte, func é chamada para responder. O corpo pode ter até
+// BODY_STREAM_MAX bytes.
+int http_handlerStream(const char *method, const char *path,
+                       HttpHandlerFunc func, HttpBodyFunc onBody);
+
+// Como http_handler(), mas o caminho é comparado com a expressão regular
+// pattern, e os argumentos são os grupos capturados. As expressões regulares
+// são consultadas, na ordem em que foram adicionadas, somente quando nenhuma
+// rota de http_handler() corresponde à requisição.
+int http_handlerRegex(const char *method, const char *pattern,
+                      HttpHandlerFunc func);
+
 void http_stop(int result);
 
 ////////////////////////////////////////////////////////////////////////////////
 // REQUEST FUNCTIONS
+//
+// Os valores apontam para o inbox da conexão, sem cópia, e são válidos até a
+// resposta ser concluída (http_send(), por exemplo). Os cabeçalhos, parâmetros,
+// método e caminho são terminados em '\0'; os ausentes são "".
 ////////////////////////////////////////////////////////////////////////////////
 
 const char *http_reqHeader(HttpClient *client, const char *name);
 
+// O nome do cabeçalho é comparado sem diferenciar maiúsculas de minúsculas.
+HttpView http_reqHeaderView(HttpClient *client, const char *name);
+
 const char *http_reqParam(HttpClient *client, const char *name);
 
+HttpView http_reqParamView(HttpClient *client, const char *name);
+
 int http_reqParamInt(HttpClient *client, const char *name, int def);
 
 const char *http_reqMethod(HttpClient *client);
@@ -121,7 +202,33 @@ const char *http_reqPattern(HttpClient *client);
 
 const char *http_reqArg(HttpClient *client, int n);
 
-const char *http_reqBody(HttpClient *client);
+// Argumento do caminho pelo nome no padrão, por exemplo, "id" em
+// "/people/:id".
+const char *http_reqNamedArg(HttpClient *client, const char *name);
+
+int http_reqNamedArgInt(HttpClient *client, const char *name, int def);
+
+// O corpo não é terminado em '\0'. Para os handlers de http_handlerStream(), é
+// vazio.
+HttpView http_reqBody(HttpClient *client);
+
+// Verifica se o cliente aceita a codificação coding, como "gzip" ou "br", no
+// cabeçalho Accept-Encoding, diretamente ou por "*", e sem "q=0".
+bool http_reqAcceptsEncoding(HttpClient *client, const char *coding);
+
+// Verifica se a cópia em cache do cliente, validada pelos cabeçalhos
+// If-None-Match ou, na sua falta, If-Modified-Since, corresponde ao recurso
+// com a ETag etag (entre aspas, como "\"abc\"") e modificado em mtime. Nesse
+// caso, a resposta de um GET pode ser HTTP_STATUS_NOT_MODIFIED, sem corpo.
+// etag pode ser NULL e mtime, -1, caso o recurso não os tenha.
+bool http_reqNotModified(HttpClient *client, const char *etag, time_t mtime);
+
+// Suspende a entrega das partes do corpo, e a leitura da conexão, até
+// http_resumeBody(). Por exemplo, enquanto as partes anteriores são gravadas.
+// Ambas devem ser chamadas na thread que atende a conexão.
+void http_pauseBody(HttpClient *client);
+
+void http_resumeBody(HttpClient *client);
 
 ////////////////////////////////////////////////////////////////////////////////
 // RESPONSE FUNCTIONS
@@ -141,6 +248,68 @@ void http_sendHeader(HttpClient *client, const char *nome, const char *valor);
 
 void http_sendHeaderInt(HttpClient *client, const char *nome, int valor);
 
+// Envia o cabeçalho com uma data no formato do HTTP, como Last-Modified.
+void http_sendHeaderTime(HttpClient *client, const char *name, time_t time);
+
+// O corpo de tipo textual pode ser enviado comprimido, sem Content-Length (ver
+// HTTP_GZIP_MIN_SIZE). A aplicação que informa a sua própria Content-Encoding
+// com http_sendHeader() envia o corpo como está.
 void http_send(HttpClient *client, const char *body, size_t size);
 
+// Como http_send(), mas sem copiar o corpo, que deve permanecer válido até ser
+// enviado (por exemplo, arquivos carregados pelo módulo assets).
+void http_sendRef(HttpClient *client, const char *body, size_t size);
+
+// Como http_send(), mas o corpo é o trecho [offset, offset + size) do arquivo,
+// enviado com sendfile(). O arquivo deve permanecer aberto até ser enviado.
+// Os corpos desta função e de http_sendRef() nunca são comprimidos: o módulo
+// assets mantém as versões já comprimidas dos arquivos (ver assets_encoded()).
+void http_sendFile(HttpClient *client, int fd, size_t offset, size_t size);
+
+// Envia parte do corpo, com "Transfer-Encoding: chunked", para respostas cujo
+// tamanho não é conhecido de antemão (relatórios, resultados de consultas). O
+// status e os cabeçalhos são enviados antes da primeira parte, que envia o fim
+// do cabeçalho. Os dados são copiados, ou comprimidos, caso o cliente aceite,
+// sem acumular a resposta inteira: cada parte é enviada comprimida assim que
+// http_sendChunk() é chamada.
+//
+// Retorna 1 quando a fila de saída da conexão está cheia: a aplicação deve
+// parar e continuar somente quando chamada por http_onWritable(). Caso
+// contrário, retorna 0.
+int http_sendChunk(HttpClient *client, const char *data, size_t size);
+
+// Chama func, uma única vez, na thread da conexão, quando a fila de saída
+// voltar a ter espaço. Não é chamada caso a conexão seja fechada antes.
+void http_onWritable(HttpClient *client, HttpWritableFunc func);
+
+// Conclui a resposta enviada com http_sendChunk().
+void http_end(HttpClient *client);
+
+////////////////////////////////////////////////////////////////////////////////
+// DEFERRED RESPONSE FUNCTIONS
+////////////////////////////////////////////////////////////////////////////////
+
+// Adia a resposta para depois do retorno do handler, por exemplo, até o
+// resultado de uma consulta ao banco de dados. A requisição, com os seus
+// parâmetros e cabeçalhos, permanece válida até a resposta, e as requisições
+// seguintes da conexão aguardam.
+//
+// A resposta é enviada por meio de http_complete(), que deve ser chamada uma
+// única vez para cada http_defer(). Retorna NULL caso não haja memória: a
+// resposta deve ser enviada antes de o handler retornar.
+HttpDefer *http_defer(HttpClient *client);
+
+// Chama func na thread da conexão, com o cliente da requisição adiada, para
+// que envie a resposta. Pode ser chamada de qualquer thread, e libera defer.
+//
+// Caso o cliente desconecte antes, ou cancele a requisição (RST_STREAM, no
+// HTTP/2), func é chamada com client NULL, e deve apenas liberar arg. Retorna
+// -1, sem chamar func, caso a conexão já esteja fechada ou não haja memória.
+int http_complete(HttpDefer *defer, HttpDeferFunc func, void *arg);
+
+// Verifica se o cliente desconectou ou cancelou a requisição adiada, para
+// interromper o trabalho que seria descartado. Pode ser chamada de qualquer
+// thread, até http_complete().
+bool http_isCancelled(const HttpDefer *defer);
+
 #endif
@@ -0,0 +1,1608 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+// The parser is made of static functions: the test includes the source and
+// replaces the server with a single in-memory connection.
+#include "http.c"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FD 3
+#define OUT_MAX (1024 * 1024)
+#define TASKS_MAX 16
+#define CHUNKS_MAX 8
+
+// Parses a complete head given as a string literal, which may contain '\0'.
+#define PARSE(text) parse(text, sizeof(text) - 1, &req)
+
+// Delivers a string literal as one read.
+#define FEED(text) feed(text, sizeof(text) - 1)
+
+typedef struct Conn {
+  HttpClient client;
+  HttpReq req;
+  Buff inbox;
+  size_t requestSize;
+  bool connected;
+  bool busy;
+  bool pumping;
+  bool closing;
+  bool held;
+  bool paused;
+  bool failed;
+  bool watching;
+  char out[OUT_MAX];
+  size_t outLen;
+  // Frames of the output already examined by the HTTP/2 tests.
+  size_t outPos;
+  ServerTask tasks[TASKS_MAX];
+  void *taskArgs[TASKS_MAX];
+  int tasksLen;
+} Conn;
+
+typedef struct Frame {
+  int type;
+  int flags;
+  uint32_t id;
+  const char *payload;
+  size_t len;
+} Frame;
+
+static Conn conn;
+
+static int calls;
+static char lastPath[URI_MAX];
+static char lastHeader[HEADER_VALUE_MAX];
+static char lastBody[HTTP_H2_WINDOW];
+static size_t lastBodyLen;
+static bool pauseBody;
+static HttpDefer *deferred;
+static bool deferDone;
+static bool deferCancelled;
+static int chunkRounds;
+static char chunk[HTTP_H2_FRAME_MAX];
+
+static void testScan();
+static void testScanBoundaries();
+static void testRequestLine();
+static void testHeaders();
+static void testLimits();
+static void testSplitHead();
+static void testPipelined();
+static void testChunkParse();
+static void testChunkedBody();
+static void testChunkedStream();
+static void testChunkedErrors();
+static void testH2Request();
+static void testH2Preface();
+static void testH2FrameSize();
+static void testH2Continuation();
+static void testH2DataWindow();
+static void testH2ResetDeferred();
+static void testH2ResetStreaming();
+static void testH2WindowUpdate();
+static int parse(const char *text, size_t len, HttpReq *req);
+static size_t scanRef(const char *data, size_t size, char a, char b);
+static int decode(const char *data, size_t size, HttpReq *req);
+static void h2Open();
+static void sendFrame(int type, int flags, uint32_t id, const void *payload,
+                      size_t len);
+static void sendHeaders(uint32_t id, int flags, const char *method,
+                        const char *path);
+static size_t encodeRequest(char *dst, const char *method, const char *path);
+static bool nextFrame(Frame *frame);
+static bool findFrame(int type, uint32_t id, Frame *frame);
+static uint32_t goawayError();
+static uint32_t resetError(uint32_t id);
+static int responseStatus(uint32_t id, char *body, size_t *bodyLen);
+static void onStatus(void *context, const HpackField *field);
+static void openConn();
+static void closeConn();
+static void feed(const char *data, size_t len);
+static void pump();
+static void clean();
+static void runTasks();
+static size_t count(const char *str);
+static void onHello(HttpClient *client);
+static void onEcho(HttpClient *client);
+static void onStreamBody(HttpClient *client, HttpView chunk);
+static void onDefer(HttpClient *client);
+static void onDeferDone(HttpClient *client, void *arg);
+static void onChunks(HttpClient *client);
+
+int main() {
+  // Most cases are rejected on purpose.
+  log_ignore("http", LOG_ERRO);
+
+  assert(buff_init(&conn.inbox, INBOX_MAX_SIZE) == 0);
+  assert(http_handler("GET", "/hello", onHello) == 0);
+  assert(http_handler("POST", "/echo", onEcho) == 0);
+  assert(http_handlerStream("POST", "/stream", onEcho, onStreamBody) == 0);
+  assert(http_handler("GET", "/defer", onDefer) == 0);
+  assert(http_handler("GET", "/chunks", onChunks) == 0);
+
+  testScan();
+  testScanBoundaries();
+  testRequestLine();
+  testHeaders();
+  testLimits();
+  testSplitHead();
+  testPipelined();
+  testChunkParse();
+  testChunkedBody();
+  testChunkedStream();
+  testChunkedErrors();
+  testH2Request();
+  testH2Preface();
+  testH2FrameSize();
+  testH2Continuation();
+  testH2DataWindow();
+  testH2ResetDeferred();
+  testH2ResetStreaming();
+  testH2WindowUpdate();
+
+  http_free();
+  buff_free(&conn.inbox);
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Head parser
+////////////////////////////////////////////////////////////////////////////////
+
+static void testScan() {
+  char data[128];
+
+  // Every byte, alone in the block, against the scalar definition.
+  for (int c = 0; c < 256; c++) {
+    memset(data, 'x', sizeof(data));
+    data[40] = (char)c;
+
+    size_t expected = scanRef(data, sizeof(data), ':', '?');
+
+    assert(http_scan(data, sizeof(data), ':', '?') == expected);
+    assert(expected == ((c < 0x20 || c == 0x7f || c == ':' || c == '?')
+                            ? 40
+                            : sizeof(data)));
+  }
+
+  // Nothing found: the size is returned, including the empty block.
+  memset(data, 'x', sizeof(data));
+  assert(http_scan(data, 0, ':', ':') == 0);
+  assert(http_scan(data, sizeof(data), ':', ':') == sizeof(data));
+
+  // A delimiter past the size is not seen.
+  data[20] = ':';
+  assert(http_scan(data, 20, ':', ':') == 20);
+
+  // The first of several matches wins, whichever kind it is.
+  data[10] = '\t';
+  assert(http_scan(data, sizeof(data), ':', ':') == 10);
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testScanBoundaries() {
+  static const char bytes[] = {':', '?', '\r', '\n', '\t', 0x01, 0x1f, 0x7f};
+  char block[160];
+
+  // Delimiters on each side of the 16- and 32-byte blocks, at unaligned
+  // starts and with sizes that leave a scalar tail.
+  for (size_t start = 0; start < 4; start++) {
+    for (size_t size = 0; size + start <= 100; size++) {
+      for (size_t pos = 0; pos < size; pos++) {
+        for (size_t k = 0; k < sizeof(bytes); k++) {
+          char *data = block + start;
+
+          memset(block, 'a', sizeof(block));
+          data[pos] = bytes[k];
+
+          assert(http_scan(data, size, ':', '?') == pos);
+        }
+      }
+
+      memset(block, 'a', sizeof(block));
+      assert(http_scan(block + start, size, ':', '?') == size);
+    }
+  }
+
+  // obs-text is not a control character.
+  memset(block, 0x80, sizeof(block));
+  assert(http_scan(block, sizeof(block), ':', ':') == sizeof(block));
+  memset(block, 0xff, sizeof(block));
+  assert(http_scan(block, sizeof(block), ':', ':') == sizeof(block));
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testRequestLine() {
+  HttpReq req;
+  char text[512];
+
+  assert(PARSE("GET /a/b?x=1&y HTTP/1.1\r\n\r\n") == 0);
+  assert(req.versionMajor == 1 && req.versionMinor == 1);
+  assert(req.method.len == 3 && req.uri.len == 4);
+  assert(req.paramsLen == 2);
+
+  // The path ends on each side of the SIMD blocks.
+  for (size_t len = 1; len < 100; len++) {
+    size_t n = (size_t)sprintf(text, "GET /");
+
+    memset(text + n, 'p', len - 1);
+    n += len - 1;
+    n += (size_t)sprintf(text + n, " HTTP/1.0\r\n\r\n");
+
+    assert(parse(text, n, &req) == 0);
+    assert(req.uri.offset == 4 && req.uri.len == len);
+    assert(req.versionMinor == 0);
+  }
+
+  // obs-text is accepted in the path, control characters are not.
+  assert(PARSE("GET /caf\xc3\xa9 HTTP/1.1\r\n\r\n") == 0);
+  assert(PARSE("GET /a\x01 HTTP/1.1\r\n\r\n") == -1);
+  assert(PARSE("GET /a\x7f HTTP/1.1\r\n\r\n") == -1);
+  assert(PARSE("GET /a\tb HTTP/1.1\r\n\r\n") == -1);
+
+  // Bare LF, lowercase method, missing parts and bad versions.
+  assert(PARSE("GET / HTTP/1.1\n\r\n") == -1);
+  assert(PARSE("get / HTTP/1.1\r\n\r\n") == -1);
+  assert(PARSE(" / HTTP/1.1\r\n\r\n") == -1);
+  assert(PARSE("GET  HTTP/1.1\r\n\r\n") == -1);
+  assert(PARSE("GET /\r\n\r\n") == -1);
+  assert(PARSE("GET / HTTP/1\r\n\r\n") == -1);
+  assert(PARSE("GET / http/1.1\r\n\r\n") == -1);
+  assert(PARSE("GET / HTTP/1.1 \r\n\r\n") == -1);
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testHeaders() {
+  HttpReq req;
+  char text[512];
+
+  const char *valid =
+      "GET / HTTP/1.1\r\nHost: a\r\nX-Tab: \t1\t2 \t\r\nEmpty:\r\n\r\n";
+
+  assert(parse(valid, strlen(valid), &req) == 0);
+  assert(req.headersLen == 3);
+  assert(strcmp(req.data + req.headers[0].value.offset, "a") == 0);
+  // Tabs are kept inside the value and trimmed around it.
+  assert(strcmp(req.data + req.headers[1].value.offset, "1\t2") == 0);
+  assert(req.headers[2].value.len == 0);
+
+  // The name and the value end on each side of the SIMD blocks.
+  for (size_t len = 1; len < 100; len++) {
+    size_t n = (size_t)sprintf(text, "GET / HTTP/1.1\r\n");
+
+    memset(text + n, 'n', len);
+    n += len;
+    n += (size_t)sprintf(text + n, ": ");
+    memset(text + n, 'v', len);
+    n += len;
+    n += (size_t)sprintf(text + n, "\r\n\r\n");
+
+    assert(parse(text, n, &req) == 0);
+    assert(req.headersLen == 1);
+    assert(req.headers[0].name.len == len);
+    assert(req.headers[0].value.len == len);
+  }
+
+  // obs-text is accepted in values, but not in names.
+  assert(PARSE("GET / HTTP/1.1\r\nX: caf\xc3\xa9\x80\xff\r\n\r\n") ==
+         0);
+  assert(req.headers[0].value.len == 7);
+  assert(PARSE("GET / HTTP/1.1\r\nX\xc3: a\r\n\r\n") == -1);
+
+  // Control characters other than the tab.
+  assert(PARSE("GET / HTTP/1.1\r\nX: a\x01z\r\n\r\n") == -1);
+  assert(PARSE("GET / HTTP/1.1\r\nX: a\x7fz\r\n\r\n") == -1);
+  assert(PARSE("GET / HTTP/1.1\r\nX: a\rz\r\n\r\n") == -1);
+  assert(PARSE("GET / HTTP/1.1\r\nX\x01: a\r\n\r\n") == -1);
+
+  // Bare LF ends neither a line nor the head.
+  assert(PARSE("GET / HTTP/1.1\r\nX: a\nY: b\r\n\r\n") == -1);
+  assert(http_headEnd("GET / HTTP/1.1\n\n", 16, 0) == 0);
+  assert(http_headEnd("GET / HTTP/1.1\r\nX: a\n\r\n", 23, 0) == 0);
+
+  // Malformed names.
+  assert(PARSE("GET / HTTP/1.1\r\n: a\r\n\r\n") == -1);
+  assert(PARSE("GET / HTTP/1.1\r\nX : a\r\n\r\n") == -1);
+  assert(PARSE("GET / HTTP/1.1\r\nX(y): a\r\n\r\n") == -1);
+  assert(PARSE("GET / HTTP/1.1\r\nNoColon\r\n\r\n") == -1);
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testLimits() {
+  static char text[HEADERS_MAX * 16 + HEADER_VALUE_MAX + URI_MAX + 64];
+  HttpReq req;
+  size_t n;
+
+  // Method.
+  assert(PARSE("ABCDEFG / HTTP/1.1\r\n\r\n") == 0);
+  assert(METHOD_MAX == 8);
+  assert(PARSE("ABCDEFGH / HTTP/1.1\r\n\r\n") == -1);
+
+  // Path.
+  for (size_t len = URI_MAX - 1; len <= URI_MAX; len++) {
+    n = (size_t)sprintf(text, "GET /");
+    memset(text + n, 'u', len - 1);
+    n += len - 1;
+    n += (size_t)sprintf(text + n, " HTTP/1.1\r\n\r\n");
+
+    assert(parse(text, n, &req) == (len < URI_MAX ? 0 : -1));
+  }
+
+  // Header name.
+  for (size_t len = HEADER_NAME_MAX - 1; len <= HEADER_NAME_MAX; len++) {
+    n = (size_t)sprintf(text, "GET / HTTP/1.1\r\n");
+    memset(text + n, 'n', len);
+    n += len;
+    n += (size_t)sprintf(text + n, ": v\r\n\r\n");
+
+    assert(parse(text, n, &req) == (len < HEADER_NAME_MAX ? 0 : -1));
+  }
+
+  // Header value.
+  for (size_t len = HEADER_VALUE_MAX - 1; len <= HEADER_VALUE_MAX; len++) {
+    n = (size_t)sprintf(text, "GET / HTTP/1.1\r\nX: ");
+    memset(text + n, 'v', len);
+    n += len;
+    n += (size_t)sprintf(text + n, "\r\n\r\n");
+
+    assert(parse(text, n, &req) == (len < HEADER_VALUE_MAX ? 0 : -1));
+  }
+
+  // Number of headers.
+  for (int headers = HEADERS_MAX; headers <= HEADERS_MAX + 1; headers++) {
+    n = (size_t)sprintf(text, "GET / HTTP/1.1\r\n");
+    for (int i = 0; i < headers; i++) {
+      n += (size_t)sprintf(text + n, "H%d: %d\r\n", i, i);
+    }
+    n += (size_t)sprintf(text + n, "\r\n");
+
+    assert(parse(text, n, &req) == (headers <= HEADERS_MAX ? 0 : -1));
+  }
+
+  // A head that does not fit the inbox closes the connection: the fake inbox
+  // does not grow, so the server sees FORMAT_PART with the inbox full.
+  openConn();
+  n = (size_t)sprintf(text, "GET /hello HTTP/1.1\r\nX: ");
+  feed(text, n);
+  memset(text, 'v', 1024);
+  while (buff_freespace(&conn.inbox) > 0 && !conn.failed) {
+    feed(text, http_min(1024, buff_freespace(&conn.inbox)));
+  }
+  assert(conn.failed && calls == 0 && conn.outLen == 0);
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testSplitHead() {
+  const char *request =
+      "GET /hello?name=value HTTP/1.1\r\nHost: localhost\r\n"
+      "X-Value: 0123456789abcdef0123456789abcdef\r\n\r\n";
+  size_t len = strlen(request);
+
+  // Every split point, including inside the final "\r\n\r\n".
+  for (size_t split = 1; split < len; split++) {
+    openConn();
+
+    feed(request, split);
+    assert(calls == 0 && conn.outLen == 0 && !conn.failed);
+
+    feed(request + split, len - split);
+    assert(calls == 1 && !conn.failed);
+    assert(strcmp(lastPath, "/hello") == 0);
+    assert(strcmp(lastHeader, "0123456789abcdef0123456789abcdef") == 0);
+    assert(count("hello") == 1);
+    assert(buff_used(&conn.inbox) == 0);
+
+    closeConn();
+  }
+
+  // One byte per read.
+  openConn();
+  for (size_t i = 0; i < len; i++) feed(request + i, 1);
+  assert(calls == 1 && count("hello") == 1);
+  closeConn();
+
+  // An invalid head is only detected once it is complete.
+  openConn();
+  FEED("GET /hello HTTP/1.1\r\nX: a\x01");
+  assert(!conn.failed);
+  FEED("b\r\n\r\n");
+  assert(conn.failed && calls == 0);
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testPipelined() {
+  static char data[INBOX_MAX_SIZE * 2];
+  char request[256];
+  size_t len = 0;
+  size_t total = 0;
+  int requests = 0;
+
+  len += (size_t)sprintf(request, "GET /hello HTTP/1.1\r\nX-Value: ");
+  memset(request + len, 'p', 100);
+  len += 100;
+  len += (size_t)sprintf(request + len, "\r\n\r\n");
+
+  // More than the inbox holds, so that heads wrap around its end, fed in
+  // reads that do not match the requests. The connection closes after
+  // HTTP_KEEPALIVE_MAX requests.
+  while (total + len <= sizeof(data)) {
+    memcpy(data + total, request, len);
+    total += len;
+    requests++;
+  }
+
+  assert(total > INBOX_MAX_SIZE && requests < HTTP_KEEPALIVE_MAX);
+
+  openConn();
+
+  for (size_t pos = 0; pos < total; pos += 1000) {
+    feed(data + pos, http_min(1000, total - pos));
+  }
+
+  assert(!conn.failed && !conn.closing);
+  assert(calls == requests);
+  assert(count("hello") == (size_t)requests);
+
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Chunked body
+////////////////////////////////////////////////////////////////////////////////
+
+// Decodes a body given as a string literal, which may contain '\0'.
+#define DECODE(text) decode(text, sizeof(text) - 1, &req)
+
+static void testChunkParse() {
+  static char text[HEADER_NAME_MAX + HEADER_VALUE_MAX + 16];
+  HttpReq req;
+
+  assert(DECODE("5\r\nhello\r\n0\r\n\r\n") == 1);
+  assert(lastBodyLen == 5 && memcmp(lastBody, "hello", 5) == 0);
+
+  assert(DECODE("A\r\n0123456789\r\nb\r\n0123456789a\r\n0\r\n\r\n") == 1);
+  assert(lastBodyLen == 21);
+
+  // Extensions are ignored, with or without a value and whitespace.
+  assert(DECODE("5;name=value\r\nhello\r\n6 ; x\r\n world\r\n"
+                "0\t;last\r\n\r\n") == 1);
+  assert(lastBodyLen == 11 && memcmp(lastBody, "hello world", 11) == 0);
+
+  // Trailers are skipped up to the empty line.
+  assert(DECODE("5\r\nhello\r\n0\r\nX-Trailer: 1\r\nY: 2\r\n\r\n") == 1);
+  assert(lastBodyLen == 5);
+
+  // Data and delimiters that have not arrived yet.
+  assert(DECODE("5\r\nhel") == 0);
+  assert(req.chunkState == HTTP_CHUNK_DATA && req.chunkLeft == 2);
+  assert(DECODE("5\r\nhello") == 0);
+  assert(req.chunkState == HTTP_CHUNK_DATA_END);
+  assert(DECODE("5\r\nhello\r") == 0);
+  assert(DECODE("5\r\nhello\r\n0\r\nX: 1\r\n") == 0);
+  assert(req.chunkState == HTTP_CHUNK_TRAILER);
+
+  // Invalid sizes.
+  assert(DECODE("\r\nhello\r\n") == -1);
+  assert(DECODE(";x\r\nhello\r\n") == -1);
+  assert(DECODE("g\r\nhello\r\n") == -1);
+  assert(DECODE("5x\r\nhello\r\n") == -1);
+  assert(DECODE("-5\r\nhello\r\n") == -1);
+  assert(DECODE("0x5\r\nhello\r\n") == -1);
+
+  // Bare LF and a bad CRLF after the data.
+  assert(DECODE("5\nhello\r\n") == -1);
+  assert(DECODE("5\r\nhello\n0\r\n\r\n") == -1);
+  assert(DECODE("5\r\nhelloX\r\n0\r\n\r\n") == -1);
+  assert(DECODE("5\r\nhello\r\n0\r\nX: 1\n\r\n") == -1);
+
+  // Sizes over the largest body, including ones that overflow size_t.
+  assert(BODY_STREAM_MAX == 0x40000000);
+  assert(DECODE("40000000\r\n") == 0);
+  assert(req.chunkLeft == BODY_STREAM_MAX);
+  assert(DECODE("40000001\r\n") == -1);
+  assert(DECODE("ffffffffffffffffffffffff\r\n") == -1);
+  assert(DECODE("00000000000000000000000005\r\nhello\r\n0\r\n\r\n") == 1);
+
+  // A line without LF is given up once it exceeds the limit.
+  memset(text, '0', sizeof(text));
+  assert(decode(text, HEADER_NAME_MAX + HEADER_VALUE_MAX - 1, &req) == 0);
+  assert(decode(text, HEADER_NAME_MAX + HEADER_VALUE_MAX, &req) == -1);
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testChunkedBody() {
+  const char *request =
+      "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n"
+      "GET /hello HTTP/1.1\r\n\r\n";
+  size_t len = strlen(request);
+
+  // The body is decoded in the inbox, at every split, and the pipelined
+  // request that follows it is read from the right place.
+  for (size_t split = 1; split < len; split++) {
+    openConn();
+
+    feed(request, split);
+    feed(request + split, len - split);
+
+    assert(!conn.failed && calls == 2);
+    assert(lastBodyLen == 11 && memcmp(lastBody, "hello world", 11) == 0);
+    assert(count("\r\n\r\nok") == 1 && count("hello") == 1);
+    assert(buff_used(&conn.inbox) == 0);
+
+    closeConn();
+  }
+
+  // One byte per read.
+  openConn();
+  for (size_t i = 0; i < len; i++) feed(request + i, 1);
+  assert(!conn.failed && calls == 2 && lastBodyLen == 11);
+  closeConn();
+
+  // The same, with an empty body.
+  openConn();
+  FEED("POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n");
+  assert(!conn.failed && calls == 1 && lastBodyLen == 0);
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testChunkedStream() {
+  const char *request =
+      "POST /stream HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n"
+      "GET /hello HTTP/1.1\r\n\r\n";
+  size_t len = strlen(request);
+
+  // Only the data of each chunk reaches the handler, at every split.
+  for (size_t split = 1; split < len; split++) {
+    openConn();
+
+    feed(request, split);
+    feed(request + split, len - split);
+
+    assert(!conn.failed && calls == 2);
+    assert(lastBodyLen == 11 && memcmp(lastBody, "hello world", 11) == 0);
+    assert(count("\r\n\r\nok") == 1 && count("hello") == 1);
+
+    closeConn();
+  }
+
+  // Paused after each piece: nothing else is read until it resumes.
+  openConn();
+  pauseBody = true;
+  feed(request, len);
+  assert(conn.paused && lastBodyLen == 5 && calls == 0);
+  http_resumeBody(&conn.client);
+  assert(conn.paused && lastBodyLen == 11 && calls == 0);
+  pauseBody = false;
+  http_resumeBody(&conn.client);
+  assert(!conn.paused && !conn.failed && calls == 2);
+  assert(memcmp(lastBody, "hello world", 11) == 0);
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testChunkedErrors() {
+  static char text[BODY_MAX + 256];
+  size_t n;
+
+  // Content-Length together with chunked, in either order.
+  openConn();
+  FEED("POST /echo HTTP/1.1\r\nContent-Length: 5\r\n"
+       "Transfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n");
+  assert(conn.failed && calls == 0);
+  closeConn();
+
+  openConn();
+  FEED("POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+       "Content-Length: 5\r\n\r\n5\r\nhello\r\n0\r\n\r\n");
+  assert(conn.failed && calls == 0);
+  closeConn();
+
+  // Other codings, and chunked twice.
+  openConn();
+  FEED("POST /echo HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n");
+  assert(conn.failed);
+  closeConn();
+
+  openConn();
+  FEED("POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+       "Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n");
+  assert(conn.failed);
+  closeConn();
+
+  // A bad CRLF after the data, and a bad size.
+  openConn();
+  FEED("POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n");
+  FEED("5\r\nhello");
+  assert(!conn.failed);
+  FEED("!\r\n0\r\n\r\n");
+  assert(conn.failed && calls == 0);
+  closeConn();
+
+  openConn();
+  FEED("POST /stream HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n");
+  FEED("z\r\n");
+  assert(conn.failed && calls == 0);
+  closeConn();
+
+  // A stored body reaching BODY_MAX, across several chunks.
+  for (size_t size = BODY_MAX - 2; size <= BODY_MAX; size++) {
+    openConn();
+    n = (size_t)sprintf(text, "POST /echo HTTP/1.1\r\n"
+                              "Transfer-Encoding: chunked\r\n\r\n"
+                              "10\r\n0123456789abcdef\r\n%zx\r\n",
+                        size - 1 - 16);
+    memset(text + n, 'b', size - 1 - 16);
+    n += size - 1 - 16;
+    n += (size_t)sprintf(text + n, "\r\n1\r\n!\r\n0\r\n\r\n");
+
+    feed(text, n);
+
+    assert(conn.failed == (size >= BODY_MAX));
+    assert(calls == (size < BODY_MAX ? 1 : 0));
+    if (size < BODY_MAX) assert(lastBodyLen == size);
+    closeConn();
+  }
+
+  printf("%s is ok\n", __func__);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// HTTP/2
+////////////////////////////////////////////////////////////////////////////////
+
+static void testH2Request() {
+  char body[64];
+  size_t bodyLen;
+  Frame frame;
+
+  h2Open();
+
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/hello");
+  assert(responseStatus(1, body, &bodyLen) == 200);
+  assert(bodyLen == 5 && memcmp(body, "hello", 5) == 0);
+  assert(calls == 1 && conn.client.h2->numStreams == 0);
+
+  // PING is answered with the same payload.
+  sendFrame(HTTP_H2_FRAME_PING, 0, 0, "12345678", 8);
+  assert(findFrame(HTTP_H2_FRAME_PING, 0, &frame));
+  assert(frame.flags == HTTP_H2_FLAG_ACK && frame.len == 8);
+  assert(memcmp(frame.payload, "12345678", 8) == 0);
+
+  // A body on the stream, after the head.
+  sendHeaders(3, HTTP_H2_FLAG_END_HEADERS, "POST", "/echo");
+  sendFrame(HTTP_H2_FRAME_DATA, 0, 3, "hello", 5);
+  sendFrame(HTTP_H2_FRAME_DATA, HTTP_H2_FLAG_END_STREAM, 3, " world", 6);
+  assert(responseStatus(3, body, &bodyLen) == 200);
+  assert(lastBodyLen == 11 && memcmp(lastBody, "hello world", 11) == 0);
+
+  // The head split across reads, one byte at a time.
+  char block[256];
+  char data[HTTP_H2_FRAME_HEAD + sizeof(block)];
+  size_t len = encodeRequest(block, "GET", "/hello");
+
+  data[0] = 0;
+  data[1] = 0;
+  data[2] = (char)len;
+  data[3] = HTTP_H2_FRAME_HEADERS;
+  data[4] = HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM;
+  http_h2Put32(data + 5, 5);
+  memcpy(data + HTTP_H2_FRAME_HEAD, block, len);
+
+  for (size_t i = 0; i < HTTP_H2_FRAME_HEAD + len; i++) {
+    assert(calls == 2);
+    feed(data + i, 1);
+  }
+  assert(responseStatus(5, body, &bodyLen) == 200 && calls == 3);
+
+  assert(!conn.closing && !conn.failed);
+
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testH2Preface() {
+  // The preface split across reads.
+  openConn();
+  FEED("PRI * HTTP/2.0\r\n");
+  assert(conn.client.h2 == NULL && conn.outLen == 0);
+  FEED("\r\nSM\r\n\r\n");
+  assert(conn.client.h2 != NULL);
+  closeConn();
+
+  // A bad preface is read as HTTP/1.x, which has no such route.
+  openConn();
+  FEED("PRI * HTTP/2.0\r\n\r\nXX\r\n\r\n");
+  assert(conn.client.h2 == NULL);
+  assert(memcmp(conn.out, "HTTP/1.1 404", 12) == 0);
+  assert(conn.failed);
+  closeConn();
+
+  // The preface is only expected at the start of the connection.
+  openConn();
+  FEED("GET /hello HTTP/1.1\r\n\r\nPRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+  assert(conn.client.h2 == NULL && calls == 1 && conn.failed);
+  closeConn();
+
+  // The client preface ends with SETTINGS, not with its ACK or another frame.
+  openConn();
+  FEED("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+  sendFrame(HTTP_H2_FRAME_PING, 0, 0, "12345678", 8);
+  assert(goawayError() == HTTP_H2_ERROR_PROTOCOL && conn.closing);
+  closeConn();
+
+  openConn();
+  FEED("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+  sendFrame(HTTP_H2_FRAME_SETTINGS, HTTP_H2_FLAG_ACK, 0, NULL, 0);
+  assert(goawayError() == HTTP_H2_ERROR_PROTOCOL);
+  closeConn();
+
+  // SETTINGS with a partial entry.
+  openConn();
+  FEED("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+  sendFrame(HTTP_H2_FRAME_SETTINGS, 0, 0, "12345", 5);
+  assert(goawayError() == HTTP_H2_ERROR_FRAME_SIZE);
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testH2FrameSize() {
+  static char payload[HTTP_H2_FRAME_MAX + 1];
+  char body[64];
+  size_t bodyLen;
+
+  // The largest frame is accepted.
+  h2Open();
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS, "POST", "/stream");
+  sendFrame(HTTP_H2_FRAME_DATA, HTTP_H2_FLAG_END_STREAM, 1, payload,
+            HTTP_H2_FRAME_MAX);
+  assert(responseStatus(1, body, &bodyLen) == 200);
+  assert(lastBodyLen == HTTP_H2_FRAME_MAX);
+  closeConn();
+
+  // One byte more is a connection error, detected from the frame head alone,
+  // and nothing after it is processed.
+  h2Open();
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS, "POST", "/stream");
+  sendFrame(HTTP_H2_FRAME_DATA, HTTP_H2_FLAG_END_STREAM, 1, payload,
+            HTTP_H2_FRAME_MAX + 1);
+  assert(goawayError() == HTTP_H2_ERROR_FRAME_SIZE);
+  assert(conn.closing && !conn.held && lastBodyLen == 0);
+  sendFrame(HTTP_H2_FRAME_PING, 0, 0, "12345678", 8);
+  assert(!findFrame(HTTP_H2_FRAME_PING, 0, NULL));
+  closeConn();
+
+  // Fixed-size frames with the wrong size.
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_PING, 0, 0, "1234567", 7);
+  assert(goawayError() == HTTP_H2_ERROR_FRAME_SIZE);
+  closeConn();
+
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 0, "\0\0\1", 3);
+  assert(goawayError() == HTTP_H2_ERROR_FRAME_SIZE);
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testH2Continuation() {
+  char block[256];
+  char body[64];
+  size_t bodyLen;
+  size_t len = encodeRequest(block, "GET", "/hello");
+
+  // The head in HEADERS and two CONTINUATION frames.
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_HEADERS, HTTP_H2_FLAG_END_STREAM, 1, block, 3);
+  sendFrame(HTTP_H2_FRAME_CONTINUATION, 0, 1, block + 3, 4);
+  assert(calls == 0);
+  sendFrame(HTTP_H2_FRAME_CONTINUATION, HTTP_H2_FLAG_END_HEADERS, 1, block + 7,
+            len - 7);
+  assert(responseStatus(1, body, &bodyLen) == 200 && calls == 1);
+  closeConn();
+
+  // Any other frame between them is a connection error.
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_HEADERS, HTTP_H2_FLAG_END_STREAM, 1, block, 3);
+  sendFrame(HTTP_H2_FRAME_PING, 0, 0, "12345678", 8);
+  assert(goawayError() == HTTP_H2_ERROR_PROTOCOL && calls == 0);
+  closeConn();
+
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_HEADERS, HTTP_H2_FLAG_END_STREAM, 1, block, 3);
+  sendHeaders(3, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/hello");
+  assert(goawayError() == HTTP_H2_ERROR_PROTOCOL && calls == 0);
+  closeConn();
+
+  // CONTINUATION of another stream, and without HEADERS.
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_HEADERS, HTTP_H2_FLAG_END_STREAM, 1, block, 3);
+  sendFrame(HTTP_H2_FRAME_CONTINUATION, HTTP_H2_FLAG_END_HEADERS, 3, block + 3,
+            len - 3);
+  assert(goawayError() == HTTP_H2_ERROR_PROTOCOL && calls == 0);
+  closeConn();
+
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_CONTINUATION, HTTP_H2_FLAG_END_HEADERS, 1, block,
+            len);
+  assert(goawayError() == HTTP_H2_ERROR_PROTOCOL);
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testH2DataWindow() {
+  static char payload[HTTP_H2_FRAME_MAX];
+  char body[64];
+  size_t bodyLen;
+
+  // With the body paused, the stream window is not returned: the client may
+  // send up to HTTP_H2_WINDOW bytes, which are stored.
+  h2Open();
+  pauseBody = true;
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS, "POST", "/stream");
+  for (int i = 0; i < 3; i++) {
+    sendFrame(HTTP_H2_FRAME_DATA, 0, 1, payload, HTTP_H2_FRAME_MAX);
+  }
+  sendFrame(HTTP_H2_FRAME_DATA, HTTP_H2_FLAG_END_STREAM, 1, payload,
+            HTTP_H2_WINDOW - 3 * HTTP_H2_FRAME_MAX);
+  assert(resetError(1) == 0 && lastBodyLen == HTTP_H2_FRAME_MAX);
+  pauseBody = false;
+  http_resumeBody(&conn.client.h2->streams->client);
+  assert(responseStatus(1, body, &bodyLen) == 200);
+  assert(lastBodyLen == HTTP_H2_WINDOW && calls == 1);
+  closeConn();
+
+  // One byte over the stream window resets the stream, not the connection.
+  h2Open();
+  pauseBody = true;
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS, "POST", "/stream");
+  for (int i = 0; i < 3; i++) {
+    sendFrame(HTTP_H2_FRAME_DATA, 0, 1, payload, HTTP_H2_FRAME_MAX);
+  }
+  sendFrame(HTTP_H2_FRAME_DATA, 0, 1, payload,
+            HTTP_H2_WINDOW - 3 * HTTP_H2_FRAME_MAX + 1);
+  assert(resetError(1) == HTTP_H2_ERROR_FLOW_CONTROL);
+  assert(goawayError() == 0 && !conn.closing && calls == 0);
+  // The connection window was returned as the data arrived.
+  assert(findFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, NULL));
+  // The stream is gone: its remaining frames are discarded.
+  sendFrame(HTTP_H2_FRAME_DATA, HTTP_H2_FLAG_END_STREAM, 1, payload, 1);
+  assert(goawayError() == 0 && conn.client.h2->numStreams == 0);
+  closeConn();
+
+  // A stored body over BODY_MAX is refused.
+  h2Open();
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS, "POST", "/echo");
+  sendFrame(HTTP_H2_FRAME_DATA, HTTP_H2_FLAG_END_STREAM, 1, payload, BODY_MAX);
+  assert(resetError(1) == HTTP_H2_ERROR_CANCEL && calls == 0);
+  closeConn();
+
+  // DATA on a stream the client already closed.
+  h2Open();
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/defer");
+  sendFrame(HTTP_H2_FRAME_DATA, 0, 1, "x", 1);
+  assert(resetError(1) == HTTP_H2_ERROR_STREAM_CLOSED);
+  assert(http_isCancelled(deferred));
+  assert(http_complete(deferred, onDeferDone, NULL) == 0);
+  runTasks();
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testH2ResetDeferred() {
+  char body[64];
+  size_t bodyLen;
+
+  // Reset while the response is deferred: the stream waits for
+  // http_complete(), which is told, and nothing is sent.
+  h2Open();
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/defer");
+  assert(deferred != NULL && !http_isCancelled(deferred) && conn.held);
+  sendFrame(HTTP_H2_FRAME_RST_STREAM, 0, 1, "\0\0\0\x08", 4);
+  assert(http_isCancelled(deferred));
+  assert(conn.client.h2->numStreams == 1);
+  assert(http_complete(deferred, onDeferDone, NULL) == 0);
+  runTasks();
+  assert(deferDone && deferCancelled);
+  assert(!findFrame(HTTP_H2_FRAME_HEADERS, 1, NULL));
+  assert(conn.client.h2->numStreams == 0 && !conn.held);
+
+  // The other streams carry on.
+  sendHeaders(3, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/defer");
+  assert(http_complete(deferred, onDeferDone, NULL) == 0);
+  runTasks();
+  assert(deferDone && !deferCancelled);
+  assert(responseStatus(3, body, &bodyLen) == 200);
+  assert(bodyLen == 4 && memcmp(body, "late", 4) == 0);
+  assert(goawayError() == 0);
+  closeConn();
+
+  // Reset of an idle stream is a connection error.
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_RST_STREAM, 0, 1, "\0\0\0\x08", 4);
+  assert(goawayError() == HTTP_H2_ERROR_PROTOCOL);
+  closeConn();
+
+  // The connection closes with the response still deferred.
+  h2Open();
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/defer");
+  closeConn();
+  assert(http_isCancelled(deferred));
+  assert(http_complete(deferred, onDeferDone, NULL) == -1);
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testH2ResetStreaming() {
+  Frame frame;
+  size_t sent = 0;
+
+  // The response fills the stream window and waits for WINDOW_UPDATE.
+  h2Open();
+  chunkRounds = 3;
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/chunks");
+  assert(findFrame(HTTP_H2_FRAME_HEADERS, 1, &frame));
+  while (nextFrame(&frame)) {
+    if (frame.type == HTTP_H2_FRAME_DATA && frame.id == 1) sent += frame.len;
+  }
+  assert(sent == HTTP_H2_WINDOW);
+  assert(conn.client.h2->streams->client.onWritable != NULL);
+
+  // Reset by the client: what is left is dropped, and the application is
+  // called to finish, without sending anything else.
+  conn.watching = false;
+  sendFrame(HTTP_H2_FRAME_RST_STREAM, 0, 1, "\0\0\0\x08", 4);
+  assert(conn.watching);
+  // Not even with the windows open again.
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 0, "\0\1\0\0", 4);
+  while (conn.client.h2->numStreams > 0) {
+    assert(conn.watching);
+    conn.watching = false;
+    http_onClientWritable(FD);
+  }
+  assert(chunkRounds == 0);
+  assert(!findFrame(HTTP_H2_FRAME_DATA, 1, NULL));
+  assert(goawayError() == 0 && !conn.held);
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+static void testH2WindowUpdate() {
+  char body[64];
+  size_t bodyLen;
+
+  // The connection window up to its maximum, and one more.
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 0, "\x7f\xfe\0\0", 4);
+  assert(goawayError() == 0);
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 0, "\0\1\0\0", 4);
+  assert(goawayError() == 0);
+  assert(conn.client.h2->sendWindow == HTTP_H2_MAX);
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 0, "\0\0\0\1", 4);
+  assert(goawayError() == HTTP_H2_ERROR_FLOW_CONTROL);
+  closeConn();
+
+  // A zero increment.
+  h2Open();
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 0, "\0\0\0\0", 4);
+  assert(goawayError() == HTTP_H2_ERROR_PROTOCOL);
+  closeConn();
+
+  // On a stream, both reset only the stream.
+  h2Open();
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/defer");
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 1, "\x7f\xff\xff\xff", 4);
+  assert(resetError(1) == HTTP_H2_ERROR_FLOW_CONTROL);
+  assert(http_complete(deferred, onDeferDone, NULL) == 0);
+  runTasks();
+  assert(deferCancelled);
+
+  sendHeaders(3, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/defer");
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 3, "\0\0\0\0", 4);
+  assert(resetError(3) == HTTP_H2_ERROR_PROTOCOL);
+  assert(http_complete(deferred, onDeferDone, NULL) == 0);
+  runTasks();
+  assert(deferCancelled);
+
+  // SETTINGS_INITIAL_WINDOW_SIZE that overflows an open stream window.
+  sendHeaders(5, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/defer");
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 5, "\x7f\xff\0\0", 4);
+  assert(resetError(5) == 0 && goawayError() == 0);
+  sendFrame(HTTP_H2_FRAME_SETTINGS, 0, 0, "\0\x04\0\1\0\0", 6);
+  assert(goawayError() == HTTP_H2_ERROR_FLOW_CONTROL);
+  assert(http_complete(deferred, onDeferDone, NULL) == 0);
+  closeConn();
+  runTasks();
+  assert(deferCancelled);
+
+  // A window opened by WINDOW_UPDATE lets a blocked response finish: the
+  // byte left out is sent once both windows open, and then the application
+  // is called to continue.
+  h2Open();
+  chunkRounds = 1;
+  sendHeaders(1, HTTP_H2_FLAG_END_HEADERS | HTTP_H2_FLAG_END_STREAM, "GET",
+              "/chunks");
+  assert(!conn.watching);
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 0, "\0\0\0\1", 4);
+  assert(!conn.watching);
+  sendFrame(HTTP_H2_FRAME_WINDOW_UPDATE, 0, 1, "\0\0\0\1", 4);
+  assert(conn.watching);
+  http_onClientWritable(FD);
+  assert(conn.client.h2->numStreams == 0 && chunkRounds == 0);
+  assert(responseStatus(1, body, &bodyLen) == 200);
+  assert(bodyLen == 4 * HTTP_H2_FRAME_MAX);
+  assert(goawayError() == 0);
+  closeConn();
+
+  printf("%s is ok\n", __func__);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Opens an HTTP/2 connection and exchanges SETTINGS.
+ */
+static void h2Open() {
+  Frame frame;
+
+  openConn();
+
+  FEED("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+  sendFrame(HTTP_H2_FRAME_SETTINGS, 0, 0, NULL, 0);
+
+  assert(nextFrame(&frame) && frame.type == HTTP_H2_FRAME_SETTINGS);
+  assert(frame.flags == 0 && frame.len == 12);
+  assert(nextFrame(&frame) && frame.type == HTTP_H2_FRAME_SETTINGS);
+  assert(frame.flags == HTTP_H2_FLAG_ACK && frame.len == 0);
+}
+
+static void sendFrame(int type, int flags, uint32_t id, const void *payload,
+                      size_t len) {
+  static char data[HTTP_H2_FRAME_HEAD + HTTP_H2_FRAME_MAX + 1];
+
+  assert(len <= HTTP_H2_FRAME_MAX + 1);
+
+  data[0] = (char)(len >> 16);
+  data[1] = (char)(len >> 8);
+  data[2] = (char)len;
+  data[3] = (char)type;
+  data[4] = (char)flags;
+  http_h2Put32(data + 5, id);
+  if (len > 0) memcpy(data + HTTP_H2_FRAME_HEAD, payload, len);
+
+  feed(data, HTTP_H2_FRAME_HEAD + len);
+}
+
+static void sendHeaders(uint32_t id, int flags, const char *method,
+                        const char *path) {
+  char block[256];
+
+  sendFrame(HTTP_H2_FRAME_HEADERS, flags, id, block,
+            encodeRequest(block, method, path));
+}
+
+static size_t encodeRequest(char *dst, const char *method, const char *path) {
+  size_t len = 0;
+
+  len += hpack_encode(dst + len, ":method", 7, method, strlen(method));
+  len += hpack_encode(dst + len, ":scheme", 7, "http", 4);
+  len += hpack_encode(dst + len, ":path", 5, path, strlen(path));
+  len += hpack_encode(dst + len, ":authority", 10, "localhost", 9);
+
+  return len;
+}
+
+/**
+ * Reads the next frame sent by the server.
+ */
+static bool nextFrame(Frame *frame) {
+  if (conn.outPos == conn.outLen) return false;
+
+  const unsigned char *head = (const unsigned char *)conn.out + conn.outPos;
+
+  assert(conn.outLen - conn.outPos >= HTTP_H2_FRAME_HEAD);
+
+  frame->len = ((size_t)head[0] << 16) | (head[1] << 8) | head[2];
+  frame->type = head[3];
+  frame->flags = head[4];
+  frame->id = http_h2Get32((const char *)head + 5);
+  frame->payload = (const char *)head + HTTP_H2_FRAME_HEAD;
+
+  assert(conn.outLen - conn.outPos >= HTTP_H2_FRAME_HEAD + frame->len);
+
+  conn.outPos += HTTP_H2_FRAME_HEAD + frame->len;
+
+  return true;
+}
+
+/**
+ * Looks for a frame among those not read yet, without reading them.
+ */
+static bool findFrame(int type, uint32_t id, Frame *frame) {
+  size_t pos = conn.outPos;
+  Frame found;
+
+  while (nextFrame(&found)) {
+    if (found.type == type && found.id == id) {
+      if (frame != NULL) *frame = found;
+      conn.outPos = pos;
+      return true;
+    }
+  }
+
+  conn.outPos = pos;
+
+  return false;
+}
+
+/**
+ * @return error code of the GOAWAY sent, or 0.
+ */
+static uint32_t goawayError() {
+  Frame frame;
+
+  if (!findFrame(HTTP_H2_FRAME_GOAWAY, 0, &frame)) return 0;
+
+  assert(frame.len == 8);
+
+  return http_h2Get32(frame.payload + 4);
+}
+
+/**
+ * @return error code of the RST_STREAM sent on the stream, or 0.
+ */
+static uint32_t resetError(uint32_t id) {
+  Frame frame;
+
+  if (!findFrame(HTTP_H2_FRAME_RST_STREAM, id, &frame)) return 0;
+
+  assert(frame.len == 4);
+
+  return http_h2Get32(frame.payload);
+}
+
+/**
+ * Reads the complete response of the stream, which must end with END_STREAM.
+ *
+ * @return :status of the response.
+ */
+static int responseStatus(uint32_t id, char *body, size_t *bodyLen) {
+  Hpack hpack;
+  Frame frame;
+  int status = 0;
+  bool end = false;
+
+  *bodyLen = 0;
+
+  hpack_init(&hpack, HPACK_TABLE_SIZE);
+
+  while (!end && nextFrame(&frame)) {
+    if (frame.id != id) continue;
+
+    if (frame.type == HTTP_H2_FRAME_HEADERS) {
+      assert(frame.flags & HTTP_H2_FLAG_END_HEADERS);
+      assert(hpack_decode(&hpack, frame.payload, frame.len, onStatus,
+                          &status) == 0);
+    } else if (frame.type == HTTP_H2_FRAME_DATA) {
+      // The body of the large responses is not kept.
+      if (*bodyLen + frame.len <= 64) {
+        memcpy(body + *bodyLen, frame.payload, frame.len);
+      }
+      *bodyLen += frame.len;
+    } else {
+      assert(false);
+    }
+
+    end = (frame.flags & HTTP_H2_FLAG_END_STREAM) != 0;
+  }
+
+  hpack_free(&hpack);
+
+  assert(end);
+
+  return status;
+}
+
+static void onStatus(void *context, const HpackField *field) {
+  if (field->nameLen == 7 && memcmp(field->name, ":status", 7) == 0) {
+    *(int *)context = atoi(field->value);
+  }
+}
+
+/**
+ * Parses the request line and the headers of a complete head.
+ */
+static int parse(const char *text, size_t len, HttpReq *req) {
+  static char data[16 * 1024];
+  size_t pos = 0;
+
+  assert(len <= sizeof(data));
+
+  // The parser terminates the fields in place.
+  memcpy(data, text, len);
+
+  http_clearReq(req);
+  req->data = data;
+
+  if (http_parseRequestLine(req, data, len, &pos) ||
+      http_parseHeaders(req, data, len, pos)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Decodes a chunked body into lastBody.
+ *
+ * @return 1, once the body is complete, 0, if it needs more data, or -1.
+ */
+static int decode(const char *data, size_t size, HttpReq *req) {
+  size_t pos = 0;
+  HttpView chunk;
+  int r;
+
+  http_clearReq(req);
+  req->chunked = true;
+  lastBodyLen = 0;
+
+  while (req->chunkState != HTTP_CHUNK_DONE &&
+         (r = http_parseChunk(req, data, size, &pos, &chunk)) != 0) {
+    if (r == -1) return -1;
+    assert(lastBodyLen + chunk.len <= sizeof(lastBody));
+    memcpy(lastBody + lastBodyLen, chunk.data, chunk.len);
+    lastBodyLen += chunk.len;
+  }
+
+  return (req->chunkState == HTTP_CHUNK_DONE) ? 1 : 0;
+}
+
+static size_t scanRef(const char *data, size_t size, char a, char b) {
+  for (size_t i = 0; i < size; i++) {
+    unsigned char c = data[i];
+    if (data[i] == a || data[i] == b || c < 0x20 || c == 0x7f) return i;
+  }
+
+  return size;
+}
+
+static void onHello(HttpClient *client) {
+  calls++;
+  snprintf(lastPath, sizeof(lastPath), "%s", http_reqPath(client));
+  snprintf(lastHeader, sizeof(lastHeader), "%s",
+           http_reqHeader(client, "X-Value"));
+  http_sendStatus(client, HTTP_STATUS_OK);
+  http_send(client, "hello", 5);
+}
+
+static void onEcho(HttpClient *client) {
+  calls++;
+
+  // The streamed body was collected by onStreamBody().
+  if (client->req->handler->onBody == NULL) {
+    HttpView body = http_reqBody(client);
+
+    assert(body.len <= sizeof(lastBody));
+    memcpy(lastBody, body.data, body.len);
+    lastBodyLen = body.len;
+  }
+
+  http_sendStatus(client, HTTP_STATUS_OK);
+  http_send(client, "ok", 2);
+}
+
+static void onStreamBody(HttpClient *client, HttpView chunk) {
+  assert(chunk.len > 0 && lastBodyLen + chunk.len <= sizeof(lastBody));
+  memcpy(lastBody + lastBodyLen, chunk.data, chunk.len);
+  lastBodyLen += chunk.len;
+
+  if (pauseBody) http_pauseBody(client);
+}
+
+static void onDefer(HttpClient *client) {
+  calls++;
+  deferred = http_defer(client);
+  deferDone = false;
+  deferCancelled = false;
+  assert(deferred != NULL);
+}
+
+static void onDeferDone(HttpClient *client, void *arg) {
+  (void)arg;
+
+  deferDone = true;
+  deferCancelled = client == NULL;
+
+  if (client == NULL) return;
+
+  http_sendStatus(client, HTTP_STATUS_OK);
+  http_send(client, "late", 4);
+}
+
+/**
+ * Sends chunkRounds rounds of chunks, each until the output is full or
+ * CHUNKS_MAX chunks were sent.
+ */
+static void onChunks(HttpClient *client) {
+  if (client->streaming == false) {
+    calls++;
+    http_sendStatus(client, HTTP_STATUS_OK);
+  }
+
+  if (chunkRounds == 0) {
+    http_end(client);
+    return;
+  }
+
+  chunkRounds--;
+
+  for (int i = 0; i < CHUNKS_MAX; i++) {
+    if (http_sendChunk(client, chunk, sizeof(chunk))) break;
+  }
+
+  http_onWritable(client, onChunks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Connection
+////////////////////////////////////////////////////////////////////////////////
+
+static void openConn() {
+  buff_clear(&conn.inbox);
+  conn.requestSize = 0;
+  conn.connected = true;
+  conn.busy = false;
+  conn.pumping = false;
+  conn.closing = false;
+  conn.held = false;
+  conn.paused = false;
+  conn.failed = false;
+  conn.watching = false;
+  conn.outLen = 0;
+  conn.outPos = 0;
+  conn.tasksLen = 0;
+
+  calls = 0;
+  lastPath[0] = '\0';
+  lastHeader[0] = '\0';
+  lastBodyLen = 0;
+  pauseBody = false;
+
+  http_onConnected(FD);
+}
+
+static void closeConn() {
+  http_onDisconnected(FD);
+  if (conn.client.req != NULL) http_onClean(FD);
+  conn.connected = false;
+}
+
+/**
+ * Delivers the bytes as one read of the socket.
+ */
+static void feed(const char *data, size_t len) {
+  if (conn.failed) return;
+
+  assert(buff_freespace(&conn.inbox) >= len);
+  assert(buff_writer_write(buff_writer(&conn.inbox), data, len) == (int)len);
+
+  pump();
+}
+
+/**
+ * Processes the inbox as server_processInbox() does.
+ */
+static void pump() {
+  BuffReader *reader = buff_reader(&conn.inbox);
+
+  conn.pumping = true;
+
+  while (!conn.busy && !conn.failed && (!conn.closing || conn.held) &&
+         !conn.paused && !buff_isempty(&conn.inbox)) {
+    size_t used = buff_used(&conn.inbox);
+
+    buff_reader_mark(reader);
+
+    FormatStatus status = http_onFormat(FD, reader);
+
+    if (status == FORMAT_OK) {
+      conn.requestSize = used - buff_used(&conn.inbox);
+      buff_reader_rewind(reader);
+      conn.busy = true;
+      http_onMessage(FD);
+      if (!conn.busy) clean();
+    } else if (status == FORMAT_PART) {
+      // The request does not fit the inbox.
+      if (buff_isfull(&conn.inbox) && !conn.paused) conn.failed = true;
+      break;
+    } else if (status == FORMAT_ERROR) {
+      conn.failed = true;
+    }
+  }
+
+  conn.pumping = false;
+}
+
+static void clean() {
+  http_onClean(FD);
+
+  if (conn.requestSize > 0) {
+    buff_reader_commit(buff_reader(&conn.inbox), conn.requestSize);
+    conn.requestSize = 0;
+  }
+}
+
+/**
+ * Runs the tasks posted to the connection, on a closed one with -1.
+ */
+static void runTasks() {
+  for (int i = 0; i < conn.tasksLen; i++) {
+    conn.tasks[i](conn.connected ? FD : -1, conn.taskArgs[i]);
+  }
+
+  conn.tasksLen = 0;
+}
+
+static size_t count(const char *str) {
+  size_t len = strlen(str);
+  size_t n = 0;
+
+  for (size_t i = 0; i + len <= conn.outLen; i++) {
+    if (memcmp(conn.out + i, str, len) == 0) n++;
+  }
+
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Server
+////////////////////////////////////////////////////////////////////////////////
+
+int server_start(ServerParams params) {
+  (void)params;
+  return 0;
+}
+
+void server_stop(int result) { (void)result; }
+
+void server_append(int clientFd, const void *buff, size_t size) {
+  assert(clientFd == FD && conn.connected);
+  assert(conn.outLen + size <= OUT_MAX);
+  if (size == 0) return;
+  memcpy(conn.out + conn.outLen, buff, size);
+  conn.outLen += size;
+}
+
+void server_appendRef(int clientFd, const void *buff, size_t size) {
+  server_append(clientFd, buff, size);
+}
+
+void server_appendFile(int clientFd, int fd, size_t offset, size_t size) {
+  assert(clientFd == FD && conn.outLen + size <= OUT_MAX);
+  assert(pread(fd, conn.out + conn.outLen, size, (off_t)offset) ==
+         (ssize_t)size);
+  conn.outLen += size;
+}
+
+void *server_clientData(int clientFd) {
+  assert(clientFd == FD);
+  return &conn.client;
+}
+
+void *server_requestData(int clientFd) {
+  assert(clientFd == FD);
+  return &conn.req;
+}
+
+void server_readBody(int clientFd) { assert(clientFd == FD); }
+
+void server_pauseRead(int clientFd) {
+  assert(clientFd == FD);
+  conn.paused = true;
+}
+
+void server_resumeRead(int clientFd) {
+  assert(clientFd == FD);
+  conn.paused = false;
+  if (!conn.pumping) pump();
+}
+
+void server_end(int clientFd) {
+  assert(clientFd == FD);
+
+  conn.busy = false;
+
+  if (!conn.pumping) {
+    clean();
+    pump();
+  }
+}
+
+bool server_outboxFull(int clientFd) {
+  assert(clientFd == FD);
+  return false;
+}
+
+void server_watchWrite(int clientFd) {
+  assert(clientFd == FD);
+  conn.watching = true;
+}
+
+void server_closeAfter(int clientFd) {
+  assert(clientFd == FD);
+  conn.closing = true;
+}
+
+void server_hold(int clientFd, bool hold) {
+  assert(clientFd == FD);
+  conn.held = hold;
+}
+
+ServerConnId server_connId(int clientFd) {
+  assert(clientFd == FD);
+  return 1;
+}
+
+int server_post(ServerConnId id, ServerTask task, void *arg) {
+  assert(id == 1 && conn.tasksLen < TASKS_MAX);
+
+  if (!conn.connected) return -1;
+
+  conn.tasks[conn.tasksLen] = task;
+  conn.taskArgs[conn.tasksLen] = arg;
+  conn.tasksLen++;
+
+  return 0;
+}
+
+bool server_isDraining() { return false; }
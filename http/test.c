@@ -17,7 +17,7 @@ int main() {
   log_ignore("server", LOG_TRAC);
   log_ignore("http", LOG_INFO);
 
-  http_handler("GET", "/test$", handleTest);
+  http_handler("GET", "/test", handleTest);
 
   return http_start(8282, 1000);
 }
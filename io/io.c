@@ -14,27 +14,91 @@
  *   limitations under the License.
  ******************************************************************************/
 
+// clock_gettime() e CLOCK_MONOTONIC, fora do C11 estrito.
+#define _POSIX_C_SOURCE 199309L
+
 #include "io.h"
 
 #include <errno.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "log/log.h"
 
+/**
+ * Monitoramento de um file descriptor. As entradas ficam em uma tabela
+ * contígua, indexada pelo file descriptor, que nunca é realocada: com epoll, o
+ * evento aponta diretamente para a entrada.
+ */
 typedef struct IOFd {
-  void *context;
+  // NULL, caso o file descriptor não seja monitorado.
   IOListener listener;
-  struct epoll_event epollEvent;
+  void *context;
+  uint32_t events;
 } IOFd;
 
+// Limite da tabela de file descriptors, caso RLIMIT_NOFILE seja ilimitado ou
+// grande demais. A memória só é usada à medida que as entradas são tocadas.
+#define IO_FDS_MAX (16 * 1024 * 1024)
+
+/**
+ * Roda hierárquica de temporizadores, com resolução de 1 milissegundo.
+ *
+ * Cada nível possui 64 posições; uma posição do nível n cobre 64^n
+ * milissegundos. Temporizadores distantes ficam nos níveis superiores e descem
+ * de nível (cascata) à medida que o prazo se aproxima, de modo que armar e
+ * cancelar custam O(1), independente da quantidade de temporizadores.
+ */
+#define IO_TIMER_LEVELS 4
+#define IO_TIMER_SLOT_BITS 6
+#define IO_TIMER_SLOTS (1 << IO_TIMER_SLOT_BITS)
+#define IO_TIMER_SLOT_MASK (IO_TIMER_SLOTS - 1)
+#define IO_TIMER_MAX_TICKS \
+  ((UINT64_C(1) << (IO_TIMER_LEVELS * IO_TIMER_SLOT_BITS)) - 1)
+
+typedef struct IOTimerWheel {
+  IOTimer *slots[IO_TIMER_LEVELS][IO_TIMER_SLOTS];
+  // Bit i ligado quando a posição i do nível não está vazia.
+  uint64_t occupied[IO_TIMER_LEVELS];
+  // Último milissegundo processado.
+  uint64_t now;
+  size_t numTimers;
+} IOTimerWheel;
+
+/**
+ * Tarefa postada por io_post(). As tarefas formam uma pilha sem travas, em que
+ * qualquer thread insere no topo e a thread do laço retira todas de uma vez.
+ */
+typedef struct IOPosted {
+  IOTask task;
+  void *arg;
+  struct IOPosted *next;
+} IOPosted;
+
 typedef struct IO {
   int epoll;
-  // Vetor de struct epollEvent, em que os índices são file descriptors.
-  Vetor *fds;
+  // Tabela de monitoramentos, em que os índices são file descriptors.
+  IOFd *fds;
+  size_t fdsSize;
   bool close;
   int closeResult;
+  IOTimerWheel timers;
+  _Atomic(IOPosted *) posted;
+  // Sinaliza ao laço que há tarefas postadas.
+  int postFd;
+  // Eventos retornados por epoll_wait(), com até IO_MAX_EVENTS posições.
+  struct epoll_event *events;
+  int maxEvents;
+  IOHook beforePoll;
+  IOHook afterBatch;
+  void *hooksContext;
 } IO;
 
 static _Thread_local IO *CURRENT = NULL;
@@ -42,6 +106,18 @@ static _Thread_local IO *CURRENT = NULL;
 ////////////////////////////////////////////////////////////////////////////////
 
 static void NULL_LISTENER(void *context, int fd, IOEvent events);
+static uint64_t io_clock();
+static void io_timerLink(IO *io, IOTimer *timer);
+static void io_timerUnlink(IO *io, IOTimer *timer);
+static void io_timerCascade(IO *io, int level);
+static void io_timerAdvance(IO *io);
+static int io_timerTimeout(IO *io);
+static void io_epollWait(IO *io, int timeout);
+static void io_onPostEvent(void *context, int fd, IOEvent events);
+static size_t io_maxFds();
+static IOFd *io_fd(IO *io, int fd);
+static int io_epollCtl(IO *io, int op, int fd, IOFd *ioFd);
+static IOPosted *io_takePosted(IO *io);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -58,9 +134,6 @@ void io_close(IO *io, int result) {
 ////////////////////////////////////////////////////////////////////////////////
 
 int io_run(IO *io, int maxEvents) {
-  const int INFINITE_TIME = -1;
-  struct epoll_event fds[maxEvents];
-
   if (io == NULL) {
     io = io_new();
     if (io == NULL) {
@@ -69,101 +142,188 @@ int io_run(IO *io, int maxEvents) {
     }
   }
 
+  int result = io_loop(io, maxEvents);
+
+  io_runPosted(io);
+  io_free(io);
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int io_loop(IO *io, int maxEvents) {
   CURRENT = io;
 
+  if (maxEvents <= 0 || maxEvents > IO_MAX_EVENTS) maxEvents = IO_MAX_EVENTS;
+
+  io->maxEvents = maxEvents;
+
+  free(io->events);
+
+  io->events = malloc(sizeof(struct epoll_event) * maxEvents);
+
+  if (io->events == NULL) {
+    log_erro("io", "malloc(): %d - %s.\n", errno, strerror(errno));
+    return -1;
+  }
+
   log_dbug("io", "Running io: %d, maxEvents: %d\n", io->epoll, maxEvents);
 
   while (!io->close) {
+    if (io->beforePoll != NULL) io->beforePoll(io->hooksContext);
+
+    // O gancho pode ter encerrado o laço.
+    if (io->close) break;
+
     log_dbug("io", "Waiting events: %d\n", io->epoll);
 
-    int numFds = epoll_wait(io->epoll, fds, maxEvents, INFINITE_TIME);
+    // Sem temporizadores armados, espera indefinidamente.
+    int timeout = io_timerTimeout(io);
 
-    log_dbug("io", "File descriptors ready: %d.\n", numFds);
+    io_epollWait(io, timeout);
 
-    if (numFds == -1 && errno != EINTR) {
-      log_erro("io", "epoll_wait(): %d - %s.\n", errno, strerror(errno));
-      io_close(io, -1);
-      continue;
-    }
+    io_timerAdvance(io);
 
-    for (int i = 0; i < numFds; i++) {
-      int fd = fds[i].data.fd;
-      IOFd *ioFd = vetor_item(io->fds, (size_t)fd);
-      ioFd->listener(ioFd->context, fd, fds[i].events);
-    }
+    // Chamado mesmo que o laço tenha sido encerrado durante a iteração, para
+    // que o trabalho acumulado nela não seja perdido.
+    if (io->afterBatch != NULL) io->afterBatch(io->hooksContext);
   }
 
-  if (close(io->epoll) == -1) {
+  return io->closeResult;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void io_free(IO *io) {
+  if (io == NULL) return;
+
+  if (CURRENT == io) CURRENT = NULL;
+
+  if (io->epoll != -1 && close(io->epoll) == -1) {
     log_erro("io", "close(): %d - %s.\n", errno, strerror(errno));
   }
 
   io->epoll = -1;
 
-  for (int i = 0; i < vetor_qtd(io->fds); i++) {
-    free(vetor_item(io->fds, i));
-  }
+  free(io->fds);
+
+  free(io->events);
+
+  if (io->postFd != -1) close(io->postFd);
 
-  vetor_destruir(io->fds);
+  // Tarefas ainda não executadas são descartadas (ver io_runPosted()).
+  IOPosted *posted = io_takePosted(io);
+
+  while (posted != NULL) {
+    IOPosted *next = posted->next;
+    free(posted);
+    posted = next;
+  }
 
   log_dbug("io", "IO closed: %d.\n", io->epoll);
-  int result = io->closeResult;
 
   free(io);
-
-  return result;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 int io_add(IO *io, int fd, IOEvent events, void *context, IOListener listener) {
-  IOFd *ioFd = vetor_item(io->fds, (size_t)fd);
+  IOFd *ioFd = io_fd(io, fd);
 
   if (ioFd == NULL) {
-    ioFd = malloc(sizeof(IOFd));
-    vetor_inserir(io->fds, (size_t)fd, ioFd);
+    log_erro("io", "io_add(): fd %d beyond the limit of %zu.\n", fd,
+             io->fdsSize);
+    return -1;
   }
 
-  ioFd->epollEvent.events = events;
-  ioFd->epollEvent.data.fd = fd;
+  ioFd->events = events;
   ioFd->context = context;
   ioFd->listener = listener;
 
   log_dbug("io", "Instalando monitor %d.\n", fd);
 
-  return epoll_ctl(io->epoll, EPOLL_CTL_ADD, fd, &ioFd->epollEvent);
+  return io_epollCtl(io, EPOLL_CTL_ADD, fd, ioFd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 int io_mod(IO *io, int fd, IOEvent events, void *context, IOListener listener) {
-  IOFd *ioFd = vetor_item(io->fds, (size_t)fd);
+  IOFd *ioFd = io_fd(io, fd);
 
-  if (ioFd == NULL) return -1;
+  if (ioFd == NULL || ioFd->listener == NULL ||
+      ioFd->listener == NULL_LISTENER) {
+    errno = ENOENT;
+    return -1;
+  }
 
-  ioFd->epollEvent.events = events;
+  ioFd->events = events;
   ioFd->context = context;
   ioFd->listener = listener;
 
   log_dbug("io", "Modificando monitor: %d.\n", fd);
 
-  return epoll_ctl(io->epoll, EPOLL_CTL_MOD, fd, &ioFd->epollEvent);
+  return io_epollCtl(io, EPOLL_CTL_MOD, fd, ioFd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 int io_del(IO *io, int fd) {
-  IOFd *ioFd = vetor_item(io->fds, (size_t)fd);
+  IOFd *ioFd = io_fd(io, fd);
 
-  if (ioFd == NULL) return -1;
+  if (ioFd == NULL || ioFd->listener == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
 
-  ioFd->epollEvent.data.fd = -1;
-  ioFd->epollEvent.events = 0;
+  // Eventos do file descriptor ainda não tratados nesta iteração são
+  // descartados pelo ouvinte nulo.
+  ioFd->events = 0;
   ioFd->context = NULL;
   ioFd->listener = NULL_LISTENER;
 
   log_dbug("io", "Removendo monitor: %d.\n", fd);
 
-  return epoll_ctl(io->epoll, EPOLL_CTL_DEL, fd, &ioFd->epollEvent);
+  return io_epollCtl(io, EPOLL_CTL_DEL, fd, ioFd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int io_epollCtl(IO *io, int op, int fd, IOFd *ioFd) {
+  struct epoll_event event;
+
+  event.events = ioFd->events;
+  event.data.ptr = ioFd;
+
+  return epoll_ctl(io->epoll, op, fd, &event);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static IOFd *io_fd(IO *io, int fd) {
+  if (fd < 0 || (size_t)fd >= io->fdsSize) {
+    errno = EMFILE;
+    return NULL;
+  }
+
+  return &io->fds[fd];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t io_maxFds() {
+  struct rlimit limit;
+
+  if (getrlimit(RLIMIT_NOFILE, &limit)) {
+    log_erro("io", "getrlimit(): %d - %s\n", errno, strerror(errno));
+    return IO_FDS_MAX;
+  }
+
+  if (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > IO_FDS_MAX) {
+    return IO_FDS_MAX;
+  }
+
+  return limit.rlim_cur;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -176,7 +336,16 @@ IO *io_new() {
     return NULL;
   }
 
-  io->epoll = epoll_create1(0);
+  io->epoll = -1;
+  io->postFd = -1;
+  io->events = NULL;
+  io->maxEvents = 0;
+  io->beforePoll = NULL;
+  io->afterBatch = NULL;
+  io->hooksContext = NULL;
+  atomic_init(&io->posted, NULL);
+
+  io->epoll = epoll_create1(EPOLL_CLOEXEC);
 
   if (io->epoll <= 0) {
     log_erro("io", "epoll_create1(): %d - %s.\n", errno, strerror(errno));
@@ -184,10 +353,13 @@ IO *io_new() {
     return NULL;
   }
 
-  io->fds = vetor_criar(10);
+  // Entradas zeradas: nenhum file descriptor monitorado. O calloc() de uma
+  // área grande não toca a memória, que só é usada pelas entradas escritas.
+  io->fdsSize = io_maxFds();
+  io->fds = calloc(io->fdsSize, sizeof(IOFd));
 
   if (io->fds == NULL) {
-    log_erro("io", "vetor_criar()\n");
+    log_erro("io", "calloc(): %d - %s.\n", errno, strerror(errno));
     close(io->epoll);
     free(io);
     return NULL;
@@ -195,6 +367,23 @@ IO *io_new() {
 
   io->close = false;
 
+  memset(&io->timers, 0, sizeof(io->timers));
+  io->timers.now = io_clock();
+
+  io->postFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (io->postFd == -1) {
+    log_erro("io", "eventfd(): %d - %s.\n", errno, strerror(errno));
+    io_free(io);
+    return NULL;
+  }
+
+  if (io_add(io, io->postFd, IO_READ, io, io_onPostEvent)) {
+    log_erro("io", "io_add(): %d - %s.\n", errno, strerror(errno));
+    io_free(io);
+    return NULL;
+  }
+
   CURRENT = io;
 
   log_dbug("io", "IO created: %d.\n", io->epoll);
@@ -204,8 +393,325 @@ IO *io_new() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+void io_setHooks(IO *io, IOHook beforePoll, IOHook afterBatch, void *context) {
+  io->beforePoll = beforePoll;
+  io->afterBatch = afterBatch;
+  io->hooksContext = context;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int io_post(IO *io, IOTask task, void *arg) {
+  IOPosted *posted = malloc(sizeof(IOPosted));
+
+  if (posted == NULL) {
+    log_erro("io", "malloc(): %d - %s.\n", errno, strerror(errno));
+    return -1;
+  }
+
+  posted->task = task;
+  posted->arg = arg;
+
+  IOPosted *top = atomic_load_explicit(&io->posted, memory_order_relaxed);
+
+  do {
+    posted->next = top;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &io->posted, &top, posted, memory_order_release, memory_order_relaxed));
+
+  // Apenas quem insere na pilha vazia acorda o laço: as demais tarefas serão
+  // retiradas junto com a primeira.
+  if (top == NULL) {
+    const uint64_t one = 1;
+
+    if (write(io->postFd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+      log_erro("io", "write(): %d - %s.\n", errno, strerror(errno));
+    }
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Retira todas as tarefas postadas, na ordem em que foram postadas.
+ */
+static IOPosted *io_takePosted(IO *io) {
+  IOPosted *top =
+      atomic_exchange_explicit(&io->posted, NULL, memory_order_acquire);
+  IOPosted *first = NULL;
+
+  while (top != NULL) {
+    IOPosted *next = top->next;
+    top->next = first;
+    first = top;
+    top = next;
+  }
+
+  return first;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void io_onPostEvent(void *context, int fd, IOEvent events) {
+  IO *io = context;
+  uint64_t value;
+
+  // Zera o eventfd antes de retirar as tarefas, de modo que uma tarefa postada
+  // depois da retirada acorda o laço novamente.
+  if (read(fd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+    log_erro("io", "read(): %d - %s.\n", errno, strerror(errno));
+  }
+
+  io_runPosted(io);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void io_runPosted(IO *io) {
+  IOPosted *posted;
+
+  // Uma tarefa pode postar outras.
+  while ((posted = io_takePosted(io)) != NULL) {
+    while (posted != NULL) {
+      IOPosted *next = posted->next;
+      IOTask task = posted->task;
+      void *arg = posted->arg;
+
+      free(posted);
+
+      task(arg);
+
+      posted = next;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 static void NULL_LISTENER(void *context, int fd, IOEvent events) {
   (void)context;
   (void)fd;
   (void)events;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void io_epollWait(IO *io, int timeout) {
+  struct epoll_event *fds = io->events;
+
+  int numFds = epoll_wait(io->epoll, fds, io->maxEvents, timeout);
+
+  log_dbug("io", "File descriptors ready: %d.\n", numFds);
+
+  if (numFds == -1 && errno != EINTR) {
+    log_erro("io", "epoll_wait(): %d - %s.\n", errno, strerror(errno));
+    io_close(io, -1);
+    return;
+  }
+
+  for (int i = 0; i < numFds; i++) {
+    IOFd *ioFd = fds[i].data.ptr;
+    ioFd->listener(ioFd->context, (int)(ioFd - io->fds), fds[i].events);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void io_timerInit(IOTimer *timer, IOTimerListener listener, void *context) {
+  timer->next = NULL;
+  timer->pprev = NULL;
+  timer->expires = 0;
+  timer->listener = listener;
+  timer->context = context;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void io_timerSet(IO *io, IOTimer *timer, int timeout) {
+  IOTimerWheel *wheel = &io->timers;
+
+  if (timer->pprev != NULL) io_timerUnlink(io, timer);
+
+  uint64_t now = io_clock();
+
+  // Sem temporizadores, a roda não avança; basta atualizá-la agora.
+  if (wheel->numTimers == 0) wheel->now = now;
+
+  // Um tick a mais compensa o arredondamento do relógio para milissegundos,
+  // para que o temporizador nunca expire antes do prazo.
+  uint64_t ticks = (timeout > 0) ? (uint64_t)timeout + 1 : 1;
+
+  if (ticks > IO_TIMER_MAX_TICKS) ticks = IO_TIMER_MAX_TICKS;
+
+  timer->expires = now + ticks;
+
+  io_timerLink(io, timer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void io_timerCancel(IO *io, IOTimer *timer) {
+  if (timer->pprev == NULL) return;
+  io_timerUnlink(io, timer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool io_timerActive(const IOTimer *timer) { return timer->pprev != NULL; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t io_clock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void io_timerLink(IO *io, IOTimer *timer) {
+  IOTimerWheel *wheel = &io->timers;
+  uint64_t delta = timer->expires - wheel->now;
+  int level = 0;
+
+  while (level < IO_TIMER_LEVELS - 1 &&
+         delta >= (UINT64_C(1) << ((level + 1) * IO_TIMER_SLOT_BITS))) {
+    level++;
+  }
+
+  int slot = (timer->expires >> (level * IO_TIMER_SLOT_BITS)) &
+             IO_TIMER_SLOT_MASK;
+
+  IOTimer **head = &wheel->slots[level][slot];
+
+  timer->level = level;
+  timer->slot = slot;
+  timer->next = *head;
+  timer->pprev = head;
+  if (*head != NULL) (*head)->pprev = &timer->next;
+  *head = timer;
+
+  wheel->occupied[level] |= UINT64_C(1) << slot;
+  wheel->numTimers++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void io_timerUnlink(IO *io, IOTimer *timer) {
+  IOTimerWheel *wheel = &io->timers;
+
+  *timer->pprev = timer->next;
+  if (timer->next != NULL) timer->next->pprev = timer->pprev;
+
+  if (wheel->slots[timer->level][timer->slot] == NULL) {
+    wheel->occupied[timer->level] &= ~(UINT64_C(1) << timer->slot);
+  }
+
+  timer->next = NULL;
+  timer->pprev = NULL;
+  wheel->numTimers--;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Redistribui nos níveis inferiores os temporizadores da posição atual do
+ * nível, chamada quando o nível inferior completa uma volta.
+ */
+static void io_timerCascade(IO *io, int level) {
+  IOTimerWheel *wheel = &io->timers;
+
+  if (level >= IO_TIMER_LEVELS) return;
+
+  int slot = (wheel->now >> (level * IO_TIMER_SLOT_BITS)) & IO_TIMER_SLOT_MASK;
+
+  if (slot == 0) io_timerCascade(io, level + 1);
+
+  IOTimer *timer;
+
+  while ((timer = wheel->slots[level][slot]) != NULL) {
+    io_timerUnlink(io, timer);
+    io_timerLink(io, timer);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void io_timerAdvance(IO *io) {
+  IOTimerWheel *wheel = &io->timers;
+  uint64_t now = io_clock();
+
+  while (wheel->now < now) {
+    if (wheel->numTimers == 0) {
+      wheel->now = now;
+      break;
+    }
+
+    // Pula direto para o fim da volta quando o nível 0 está vazio.
+    if (wheel->occupied[0] == 0) {
+      uint64_t last = wheel->now | IO_TIMER_SLOT_MASK;
+
+      if (last >= now) {
+        wheel->now = now;
+        break;
+      }
+
+      wheel->now = last;
+    }
+
+    wheel->now++;
+
+    int slot = wheel->now & IO_TIMER_SLOT_MASK;
+
+    if (slot == 0) io_timerCascade(io, 1);
+
+    IOTimer *timer;
+
+    while ((timer = wheel->slots[0][slot]) != NULL) {
+      io_timerUnlink(io, timer);
+      timer->listener(timer->context);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Calcula quanto tempo epoll_wait() pode esperar até o próximo temporizador
+ * expirar ou até a próxima cascata.
+ *
+ * @return tempo em milissegundos, ou -1, caso não haja temporizadores.
+ */
+static int io_timerTimeout(IO *io) {
+  IOTimerWheel *wheel = &io->timers;
+  uint64_t next = UINT64_MAX;
+
+  if (wheel->numTimers == 0) return -1;
+
+  for (int level = 0; level < IO_TIMER_LEVELS; level++) {
+    uint64_t occupied = wheel->occupied[level];
+
+    if (occupied == 0) continue;
+
+    int shift = level * IO_TIMER_SLOT_BITS;
+    uint64_t pos = wheel->now >> shift;
+    int from = (pos + 1) & IO_TIMER_SLOT_MASK;
+
+    // Primeira posição ocupada após a atual, dando a volta no nível.
+    uint64_t rotated = (occupied >> from) | (occupied << ((64 - from) & 63));
+    uint64_t distance = __builtin_ctzll(rotated) + 1;
+    uint64_t at = (pos + distance) << shift;
+
+    if (at < next) next = at;
+  }
+
+  uint64_t now = io_clock();
+
+  if (next <= now) return 0;
+
+  if (next - now > INT_MAX) return INT_MAX;
+
+  return (int)(next - now);
+}
@@ -19,15 +19,21 @@
  * de ouvintes para cada file descriptor monitorado. Além disso, simplifica
  * o uso do epoll, restringindo que cada thread tenha no máximo uma
  * instância de epoll.
+ *
+ * O laço é orientado a prontidão: o ouvinte é avisado de que o file
+ * descriptor está pronto e faz as suas próprias leituras e escritas. Um
+ * backend com io_uring que aproveite accept multishot, buffers fornecidos ao
+ * kernel e envios encadeados exige uma API orientada a conclusões, e não
+ * apenas outra implementação de io_add(), io_mod() e io_run().
  */
 
 #ifndef IO_H
 #define IO_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/epoll.h>
 
-#include "vetor/vetor.h"
-
 typedef enum IOEvent {
   IO_READ = EPOLLIN,
   IO_WRITE = EPOLLOUT,
@@ -45,6 +51,34 @@ typedef void (*IOListener)(void *context, int fd, IOEvent event);
 
 typedef struct IO IO;
 
+typedef void (*IOTimerListener)(void *context);
+
+typedef void (*IOTask)(void *arg);
+
+typedef void (*IOHook)(void *context);
+
+/**
+ * Quantidade máxima de eventos tratados por iteração do laço.
+ */
+#define IO_MAX_EVENTS 1024
+
+/**
+ * Temporizador do laço de eventos. A estrutura pertence a quem o usa (por
+ * exemplo, embutida na estrutura de uma conexão), então armar, rearmar e
+ * cancelar não alocam memória e custam O(1).
+ *
+ * Os campos são internos ao módulo io.
+ */
+typedef struct IOTimer {
+  struct IOTimer *next;
+  struct IOTimer **pprev;
+  uint64_t expires;
+  uint8_t level;
+  uint8_t slot;
+  IOTimerListener listener;
+  void *context;
+} IOTimer;
+
 IO *io_new();
 
 IO *io_current();
@@ -55,8 +89,110 @@ int io_mod(IO *io, int fd, IOEvent events, void *context, IOListener listener);
 
 int io_del(IO *io, int fd);
 
+/**
+ * Executa o laço de eventos até io_close(), e então libera a instância.
+ *
+ * @param  io        instância de IO, ou NULL, para criar uma nova.
+ * @param  maxEvents quantidade máxima de eventos tratados por iteração, até
+ *                   IO_MAX_EVENTS. Se for menor ou igual a zero, usa
+ *                   IO_MAX_EVENTS.
+ * @return           resultado informado em io_close(), ou -1, em caso de
+ *                   erro.
+ */
 int io_run(IO *io, int maxEvents);
 
+/**
+ * Executa o laço de eventos até io_close(), como io_run(), mas sem liberar a
+ * instância. Ela continua válida, por exemplo, para outras threads que ainda
+ * possam postar tarefas, até ser liberada com io_free().
+ *
+ * @param  io        instância de IO.
+ * @param  maxEvents quantidade máxima de eventos tratados por iteração, como
+ *                   em io_run().
+ * @return           resultado informado em io_close(), ou -1, em caso de
+ *                   erro.
+ */
+int io_loop(IO *io, int maxEvents);
+
+/**
+ * Instala funções chamadas a cada iteração do laço: beforePoll, antes de
+ * aguardar os eventos, e afterBatch, após tratar os eventos, as tarefas
+ * postadas e os temporizadores da iteração. Por exemplo, afterBatch pode
+ * enviar de uma só vez as respostas produzidas ao longo da iteração.
+ *
+ * @param io         instância de IO.
+ * @param beforePoll função chamada antes de aguardar eventos, ou NULL.
+ * @param afterBatch função chamada ao final da iteração, ou NULL.
+ * @param context    argumento passado para as funções.
+ */
+void io_setHooks(IO *io, IOHook beforePoll, IOHook afterBatch, void *context);
+
 void io_close(IO *io, int result);
 
+/**
+ * Agenda uma tarefa para ser executada na thread do laço de eventos, na
+ * próxima iteração. Pode ser chamada de qualquer thread, por exemplo, para
+ * entregar ao laço o resultado de uma consulta ao banco de dados. As tarefas
+ * postadas por uma mesma thread são executadas na ordem em que foram postadas.
+ *
+ * Tarefas pendentes quando a instância é liberada são descartadas, sem serem
+ * executadas: após o término do laço, io_runPosted() as executa.
+ *
+ * @param  io   instância de IO, ainda não liberada.
+ * @param  task função executada pelo laço.
+ * @param  arg  argumento passado para task.
+ * @return      0, em caso de sucesso, -1, caso não há memória suficiente.
+ */
+int io_post(IO *io, IOTask task, void *arg);
+
+/**
+ * Executa as tarefas postadas ainda pendentes, inclusive as que elas postarem,
+ * na thread que a chama. Usada após o término do laço, antes de io_free(),
+ * para que toda tarefa aceita por io_post() seja executada.
+ *
+ * @param io instância de IO.
+ */
+void io_runPosted(IO *io);
+
+/**
+ * Inicializa um temporizador, ainda desarmado.
+ *
+ * @param timer    temporizador.
+ * @param listener função chamada, no laço de eventos, quando o prazo expira.
+ * @param context  argumento passado para listener.
+ */
+void io_timerInit(IOTimer *timer, IOTimerListener listener, void *context);
+
+/**
+ * Arma o temporizador para expirar daqui a timeout milissegundos. Se o
+ * temporizador já estiver armado, o prazo anterior é substituído.
+ *
+ * A resolução é de 1 milissegundo, e prazos maiores que cerca de 4,6 horas são
+ * limitados a este valor.
+ *
+ * @param io      instância de IO em que o temporizador será executado.
+ * @param timer   temporizador inicializado com io_timerInit().
+ * @param timeout prazo, em milissegundos.
+ */
+void io_timerSet(IO *io, IOTimer *timer, int timeout);
+
+/**
+ * Desarma o temporizador. Não faz nada se ele não estiver armado.
+ */
+void io_timerCancel(IO *io, IOTimer *timer);
+
+/**
+ * Verifica se o temporizador está armado.
+ */
+bool io_timerActive(const IOTimer *timer);
+
+/**
+ * Libera uma instância de IO que não está em execução.
+ *
+ * Não é necessário chamar esta função após io_run(), pois io_run() libera a
+ * instância ao terminar. Após io_loop(), ao contrário, a instância deve ser
+ * liberada por quem executou o laço.
+ */
+void io_free(IO *io);
+
 #endif
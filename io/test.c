@@ -15,7 +15,8 @@
  ******************************************************************************/
 
 /**
- * Test open and close events.
+ * Test open and close events, level-triggered events, timers and tasks posted
+ * from other threads.
  */
 
 #include <arpa/inet.h>
@@ -32,6 +33,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 #include <assert.h>
 
@@ -42,6 +44,15 @@ static void onServerEvent(void *context, int fd, IOEvent event);
 static pthread_t clientConnect();
 static void * clientTask(void *arg);
 static void * serverTask(void *arg);
+static void testTimers();
+static void onTimer(void *context);
+static long elapsedMs(const struct timespec *start);
+static void testLevelTriggered();
+static void onPipeEvent(void *context, int fd, IOEvent event);
+static void testPost();
+static void *postTask(void *arg);
+static void onPosted(void *arg);
+static void onLatePosted(void *arg);
 
 static bool eventReadThrowred = false;
 
@@ -59,9 +70,123 @@ int main() {
   assert(resClient == NULL);
   assert(resServer == NULL);
 
+  testLevelTriggered();
+  testTimers();
+  testPost();
+
   return 0;
 }
 
+static int pipeEvents = 0;
+
+static void onPipeEvent(void *context, int fd, IOEvent event) {
+  char c;
+
+  assert(context == &pipeEvents);
+  assert((event & IO_READ) != 0);
+
+  // Reads one byte per event: without edge-triggered, the remaining byte is
+  // notified again.
+  assert(read(fd, &c, 1) == 1);
+  assert(c == "ab"[pipeEvents]);
+
+  if (++pipeEvents == 2) {
+    io_close(io_current(), 0);
+  }
+}
+
+static void testLevelTriggered() {
+  int fds[2];
+  IO *io = io_new();
+
+  assert(io != NULL);
+  assert(pipe2(fds, O_NONBLOCK) == 0);
+  assert(write(fds[1], "ab", 2) == 2);
+
+  pipeEvents = 0;
+
+  // Only monitored file descriptors can be modified or removed.
+  assert(io_mod(io, fds[0], IO_READ, NULL, onServerEvent) == -1);
+  assert(io_del(io, fds[0]) == -1);
+
+  // Replacing the listener before running.
+  assert(io_add(io, fds[0], IO_READ, NULL, onServerEvent) == 0);
+  assert(io_mod(io, fds[0], IO_READ, &pipeEvents, onPipeEvent) == 0);
+
+  assert(io_run(io, 10) == 0);
+
+  assert(pipeEvents == 2);
+
+  close(fds[0]);
+  close(fds[1]);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static int timersFired[8];
+static int timersFiredLen = 0;
+static IOTimer timers[5];
+
+static void onTimer(void *context) {
+  int id = (int)(intptr_t)context;
+
+  timersFired[timersFiredLen++] = id;
+
+  // Rearming from inside the listener.
+  if (id == 1 && timersFiredLen == 1) {
+    io_timerSet(io_current(), &timers[1], 20);
+  }
+
+  if (id == 4) {
+    io_close(io_current(), 0);
+  }
+}
+
+static long elapsedMs(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000 +
+         (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void testTimers() {
+  struct timespec start;
+  IO *io = io_new();
+
+  timersFiredLen = 0;
+
+  assert(io != NULL);
+
+  for (int i = 0; i < 5; i++) {
+    io_timerInit(&timers[i], onTimer, (void *)(intptr_t)i);
+  }
+
+  io_timerSet(io, &timers[0], 100);  // level 1, cascades before expiring.
+  io_timerSet(io, &timers[1], 10);
+  io_timerSet(io, &timers[2], 50);
+  io_timerSet(io, &timers[3], 60 * 60 * 1000);  // level 3.
+  io_timerSet(io, &timers[4], 150);
+
+  io_timerCancel(io, &timers[2]);
+  assert(!io_timerActive(&timers[2]));
+  assert(io_timerActive(&timers[3]));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  assert(io_run(io, 10) == 0);
+
+  long elapsed = elapsedMs(&start);
+
+  assert(timersFiredLen == 4);
+  assert(timersFired[0] == 1);
+  assert(timersFired[1] == 1);
+  assert(timersFired[2] == 0);
+  assert(timersFired[3] == 4);
+  assert(elapsed >= 150 && elapsed < 1000);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
 static void * clientTask(void *arg) {
   int fd = -1;
 
@@ -129,6 +254,12 @@ static void * serverTask(void *arg) {
 
   assert(io_run(io, 10) == 0);
 
+  assert(eventReadThrowred);
+
+  eventReadThrowred = false;
+
+  assert(close(fd) == 0);
+
   return NULL;
 }
 
@@ -139,3 +270,90 @@ static pthread_t startServer() {
 
   return thread;
 }
+
+#define POST_THREADS 4
+#define POST_TASKS 10000
+
+static IO *postIo;
+static pthread_t postLoopThread;
+static int postNext[POST_THREADS];
+static int postDone = 0;
+
+static void onPosted(void *arg) {
+  intptr_t value = (intptr_t)arg;
+  int producer = value / POST_TASKS;
+
+  // Tasks run on the loop thread, in the order each producer posted them.
+  assert(pthread_equal(pthread_self(), postLoopThread));
+  assert(value % POST_TASKS == postNext[producer]);
+
+  postNext[producer]++;
+
+  if (++postDone == POST_THREADS * POST_TASKS) {
+    io_close(io_current(), 0);
+  }
+}
+
+static void onLatePosted(void *arg) {
+  int *late = arg;
+
+  assert(pthread_equal(pthread_self(), postLoopThread));
+
+  if (++(*late) == 1) {
+    assert(io_post(postIo, onLatePosted, late) == 0);
+  }
+}
+
+static void *postTask(void *arg) {
+  intptr_t producer = (intptr_t)arg;
+
+  for (int i = 0; i < POST_TASKS; i++) {
+    intptr_t value = producer * POST_TASKS + i;
+    assert(io_post(postIo, onPosted, (void *)value) == 0);
+  }
+
+  return NULL;
+}
+
+static void testPost() {
+  pthread_t threads[POST_THREADS];
+
+  postIo = io_new();
+  postLoopThread = pthread_self();
+  postDone = 0;
+  memset(postNext, 0, sizeof(postNext));
+
+  assert(postIo != NULL);
+
+  for (intptr_t i = 0; i < POST_THREADS; i++) {
+    assert(pthread_create(&threads[i], NULL, postTask, (void *)i) == 0);
+  }
+
+  // Unlike io_run(), io_loop() keeps the instance: producers may still hold it.
+  assert(io_loop(postIo, 10) == 0);
+
+  for (int i = 0; i < POST_THREADS; i++) {
+    assert(pthread_join(threads[i], NULL) == 0);
+  }
+
+  assert(postDone == POST_THREADS * POST_TASKS);
+
+  // Tasks posted after the loop ended still run through io_runPosted(),
+  // including the ones they post.
+  int late = 0;
+
+  assert(io_post(postIo, onLatePosted, &late) == 0);
+
+  io_runPosted(postIo);
+
+  assert(late == 2);
+
+  // The remaining ones are discarded by io_free().
+  assert(io_post(postIo, onLatePosted, &late) == 0);
+
+  io_free(postIo);
+
+  assert(late == 2);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
@@ -0,0 +1,259 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "outbox.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define OUTBOX_SEGMENTS_INIT_SIZE 8
+
+static OutboxSegment *outbox_newSegment(Outbox *outbox);
+static const char *outbox_segmentData(const Outbox *outbox,
+                                      const OutboxSegment *segment);
+
+////////////////////////////////////////////////////////////////////////////////
+
+int outbox_init(Outbox *outbox, size_t areaSize) {
+  // A memória só é alocada quando o primeiro segmento é adicionado.
+  outbox->segments = NULL;
+  outbox->segmentsSize = 0;
+  outbox->area = NULL;
+  outbox->areaSize = 0;
+  outbox->areaInitSize = areaSize > 0 ? areaSize : 1;
+
+  outbox_clear(outbox);
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void outbox_free(Outbox *outbox) {
+  free(outbox->segments);
+  free(outbox->area);
+  outbox->segments = NULL;
+  outbox->segmentsSize = 0;
+  outbox->area = NULL;
+  outbox->areaSize = 0;
+  outbox_clear(outbox);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void outbox_shrink(Outbox *outbox) {
+  if (outbox->pending > 0) return;
+
+  free(outbox->segments);
+  free(outbox->area);
+  outbox->segments = NULL;
+  outbox->segmentsSize = 0;
+  outbox->area = NULL;
+  outbox->areaSize = 0;
+  outbox_clear(outbox);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void outbox_clear(Outbox *outbox) {
+  outbox->segmentsLen = 0;
+  outbox->head = 0;
+  outbox->headSent = 0;
+  outbox->areaLen = 0;
+  outbox->pending = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int outbox_add(Outbox *outbox, const void *data, size_t size) {
+  if (size == 0) return 0;
+
+  if (outbox->areaLen + size > outbox->areaSize) {
+    size_t areaSize =
+        (outbox->areaSize > 0) ? outbox->areaSize : outbox->areaInitSize;
+
+    while (outbox->areaLen + size > areaSize) areaSize *= 2;
+
+    // Segmentos próprios guardam a posição na área, e não ponteiros, por isso
+    // a área pode ser realocada.
+    char *area = realloc(outbox->area, areaSize);
+
+    if (area == NULL) return -1;
+
+    outbox->area = area;
+    outbox->areaSize = areaSize;
+  }
+
+  memcpy(outbox->area + outbox->areaLen, data, size);
+
+  // Dados contíguos na área são acumulados no mesmo segmento.
+  OutboxSegment *last = (outbox->segmentsLen > outbox->head)
+                            ? &outbox->segments[outbox->segmentsLen - 1]
+                            : NULL;
+
+  if (last != NULL && last->data == NULL && last->fd == -1 &&
+      last->offset + last->size == outbox->areaLen) {
+    last->size += size;
+  } else {
+    OutboxSegment *segment = outbox_newSegment(outbox);
+
+    if (segment == NULL) return -1;
+
+    segment->data = NULL;
+    segment->fd = -1;
+    segment->offset = outbox->areaLen;
+    segment->size = size;
+  }
+
+  outbox->areaLen += size;
+  outbox->pending += size;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int outbox_addRef(Outbox *outbox, const void *data, size_t size) {
+  if (size == 0) return 0;
+
+  OutboxSegment *segment = outbox_newSegment(outbox);
+
+  if (segment == NULL) return -1;
+
+  segment->data = data;
+  segment->fd = -1;
+  segment->offset = 0;
+  segment->size = size;
+
+  outbox->pending += size;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int outbox_addFile(Outbox *outbox, int fd, size_t offset, size_t size) {
+  if (size == 0) return 0;
+
+  OutboxSegment *segment = outbox_newSegment(outbox);
+
+  if (segment == NULL) return -1;
+
+  segment->data = NULL;
+  segment->fd = fd;
+  segment->offset = offset;
+  segment->size = size;
+
+  outbox->pending += size;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t outbox_iovec(const Outbox *outbox, struct iovec *iov, size_t count) {
+  size_t n = 0;
+
+  for (size_t i = outbox->head; i < outbox->segmentsLen && n < count; i++) {
+    const OutboxSegment *segment = &outbox->segments[i];
+    size_t sent = (i == outbox->head) ? outbox->headSent : 0;
+
+    if (segment->fd != -1) break;
+
+    iov[n].iov_base = (void *)(outbox_segmentData(outbox, segment) + sent);
+    iov[n].iov_len = segment->size - sent;
+    n++;
+  }
+
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool outbox_file(const Outbox *outbox, int *fd, off_t *offset, size_t *size) {
+  if (outbox->head >= outbox->segmentsLen) return false;
+
+  const OutboxSegment *segment = &outbox->segments[outbox->head];
+
+  if (segment->fd == -1) return false;
+
+  *fd = segment->fd;
+  *offset = segment->offset + outbox->headSent;
+  *size = segment->size - outbox->headSent;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void outbox_commit(Outbox *outbox, size_t nbytes) {
+  if (nbytes > outbox->pending) nbytes = outbox->pending;
+
+  outbox->pending -= nbytes;
+
+  while (nbytes > 0) {
+    const OutboxSegment *segment = &outbox->segments[outbox->head];
+    size_t remaining = segment->size - outbox->headSent;
+
+    if (nbytes < remaining) {
+      outbox->headSent += nbytes;
+      break;
+    }
+
+    nbytes -= remaining;
+    outbox->head++;
+    outbox->headSent = 0;
+  }
+
+  if (outbox->pending == 0) {
+    outbox_clear(outbox);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t outbox_pending(const Outbox *outbox) { return outbox->pending; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool outbox_isempty(const Outbox *outbox) { return outbox->pending == 0; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+static OutboxSegment *outbox_newSegment(Outbox *outbox) {
+  if (outbox->segmentsLen == outbox->segmentsSize) {
+    size_t segmentsSize = (outbox->segmentsSize > 0)
+                              ? outbox->segmentsSize * 2
+                              : OUTBOX_SEGMENTS_INIT_SIZE;
+    OutboxSegment *segments =
+        realloc(outbox->segments, sizeof(OutboxSegment) * segmentsSize);
+
+    if (segments == NULL) return NULL;
+
+    outbox->segments = segments;
+    outbox->segmentsSize = segmentsSize;
+  }
+
+  return &outbox->segments[outbox->segmentsLen++];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static const char *outbox_segmentData(const Outbox *outbox,
+                                      const OutboxSegment *segment) {
+  return (segment->data != NULL) ? segment->data
+                                 : outbox->area + segment->offset;
+}
@@ -0,0 +1,189 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+/**
+ * Fila de saída formada por segmentos, para envio com writev().
+ *
+ * Cada segmento pode ser próprio, quando os dados são copiados para a área de
+ * memória da fila, ou emprestado, quando a fila guarda apenas o ponteiro para
+ * dados que permanecem válidos até serem enviados (por exemplo, o conteúdo de
+ * arquivos carregados pelo módulo assets), ou um trecho de arquivo, enviado
+ * diretamente do file descriptor com sendfile(), sem passar pela memória do
+ * processo.
+ *
+ * O envio avança um cursor sobre os segmentos, sem mover os dados restantes
+ * para o início da fila. A memória é alocada no primeiro segmento adicionado,
+ * reaproveitada quando a fila esvazia e devolvida por outbox_shrink().
+ */
+
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * Quantidade máxima de segmentos passados para cada chamada de writev().
+ */
+#define OUTBOX_IOVEC_MAX 64
+
+typedef struct OutboxSegment {
+  // Dados emprestados, ou NULL quando os dados estão na área da fila.
+  const char *data;
+  // File descriptor do arquivo, ou -1 quando os dados estão em memória.
+  int fd;
+  // Posição dos dados na área da fila, para segmentos próprios, ou no arquivo.
+  size_t offset;
+  size_t size;
+} OutboxSegment;
+
+typedef struct Outbox {
+  OutboxSegment *segments;
+  size_t segmentsLen;
+  size_t segmentsSize;
+  // Primeiro segmento pendente e quantos bytes dele já foram enviados.
+  size_t head;
+  size_t headSent;
+  char *area;
+  size_t areaLen;
+  size_t areaSize;
+  size_t areaInitSize;
+  size_t pending;
+} Outbox;
+
+/**
+ * Inicializa uma fila de saída, sem alocar memória.
+ *
+ * @param  outbox   instância da fila.
+ * @param  areaSize tamanho inicial da área para os segmentos próprios, alocada
+ *                  no primeiro uso.
+ * @return          0, em caso de sucesso.
+ */
+int outbox_init(Outbox *outbox, size_t areaSize);
+
+/**
+ * Libera a memória usada pela fila, mas não a estrutura Outbox.
+ *
+ * @param outbox instância da fila.
+ */
+void outbox_free(Outbox *outbox);
+
+/**
+ * Devolve a memória da fila, caso ela esteja vazia, por exemplo, enquanto a
+ * conexão está ociosa. A fila continua válida e volta a alocar memória no
+ * próximo segmento adicionado.
+ *
+ * @param outbox instância da fila.
+ */
+void outbox_shrink(Outbox *outbox);
+
+/**
+ * Descarta todos os segmentos pendentes.
+ *
+ * @param outbox instância da fila.
+ */
+void outbox_clear(Outbox *outbox);
+
+/**
+ * Copia os dados para o final da fila.
+ *
+ * @param  outbox instância da fila.
+ * @param  data   dados a serem copiados.
+ * @param  size   quantidade de bytes.
+ * @return        0, em caso de sucesso, -1, caso não há memória suficiente.
+ */
+int outbox_add(Outbox *outbox, const void *data, size_t size);
+
+/**
+ * Adiciona ao final da fila um segmento emprestado, sem copiar os dados.
+ *
+ * Os dados devem permanecer válidos e inalterados até que sejam enviados, ou
+ * até que a fila seja limpa.
+ *
+ * @param  outbox instância da fila.
+ * @param  data   dados a serem enviados.
+ * @param  size   quantidade de bytes.
+ * @return        0, em caso de sucesso, -1, caso não há memória suficiente.
+ */
+int outbox_addRef(Outbox *outbox, const void *data, size_t size);
+
+/**
+ * Adiciona ao final da fila um trecho de arquivo, que será enviado diretamente
+ * do file descriptor, sem ser lido para a memória.
+ *
+ * O file descriptor deve permanecer aberto até que o trecho seja enviado, ou
+ * até que a fila seja limpa.
+ *
+ * @param  outbox instância da fila.
+ * @param  fd     file descriptor do arquivo.
+ * @param  offset posição inicial do trecho no arquivo.
+ * @param  size   quantidade de bytes.
+ * @return        0, em caso de sucesso, -1, caso não há memória suficiente.
+ */
+int outbox_addFile(Outbox *outbox, int fd, size_t offset, size_t size);
+
+/**
+ * Passa os segmentos pendentes, a partir do cursor, para um vetor de struct
+ * iovec, pronto para ser usado com writev(). Para antes do primeiro trecho de
+ * arquivo, que deve ser obtido com outbox_file().
+ *
+ * @param  outbox instância da fila.
+ * @param  iov    vetor de struct iovec.
+ * @param  count  quantidade máxima de elementos em iov.
+ * @return        quantidade de elementos preenchidos.
+ */
+size_t outbox_iovec(const Outbox *outbox, struct iovec *iov, size_t count);
+
+/**
+ * Obtém o restante do trecho de arquivo no cursor, caso o próximo segmento a
+ * ser enviado seja um trecho de arquivo.
+ *
+ * @param  outbox instância da fila.
+ * @param  fd     file descriptor do arquivo.
+ * @param  offset posição do restante do trecho no arquivo.
+ * @param  size   quantidade de bytes restantes.
+ * @return        true, se o próximo segmento é um trecho de arquivo, false,
+ *                caso contrário.
+ */
+bool outbox_file(const Outbox *outbox, int *fd, off_t *offset, size_t *size);
+
+/**
+ * Avança o cursor em n bytes enviados. Quando todos os segmentos são enviados,
+ * a fila é esvaziada e sua memória reaproveitada.
+ *
+ * @param outbox instância da fila.
+ * @param nbytes quantidade de bytes enviados.
+ */
+void outbox_commit(Outbox *outbox, size_t nbytes);
+
+/**
+ * Obtém a quantidade de bytes pendentes de envio.
+ *
+ * @param  outbox instância da fila.
+ * @return        quantidade de bytes pendentes.
+ */
+size_t outbox_pending(const Outbox *outbox);
+
+/**
+ * Verifica se não há bytes pendentes de envio.
+ *
+ * @return true, se a fila estiver vazia, false, caso contrário.
+ */
+bool outbox_isempty(const Outbox *outbox);
+
+#endif
@@ -0,0 +1,217 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "outbox.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static void testAddMergesOwnedSegments();
+static void testAddRef();
+static void testCommitPartial();
+static void testAreaGrowth();
+static void testAddFile();
+static void testShrink();
+
+int main() {
+  testAddMergesOwnedSegments();
+  testAddRef();
+  testCommitPartial();
+  testAreaGrowth();
+  testAddFile();
+  testShrink();
+  return 0;
+}
+
+static void testAddMergesOwnedSegments() {
+  Outbox outbox;
+  struct iovec iov[OUTBOX_IOVEC_MAX];
+
+  assert(outbox_init(&outbox, 4) == 0);
+
+  assert(outbox_add(&outbox, "ab", 2) == 0);
+  assert(outbox_add(&outbox, "cd", 2) == 0);
+
+  // Contiguous owned data stays in a single segment.
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 1);
+  assert(iov[0].iov_len == 4);
+  assert(memcmp(iov[0].iov_base, "abcd", 4) == 0);
+  assert(outbox_pending(&outbox) == 4);
+
+  outbox_free(&outbox);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testAddRef() {
+  Outbox outbox;
+  struct iovec iov[OUTBOX_IOVEC_MAX];
+  const char *body = "0123456789";
+
+  assert(outbox_init(&outbox, 16) == 0);
+
+  assert(outbox_add(&outbox, "head", 4) == 0);
+  assert(outbox_addRef(&outbox, body, 10) == 0);
+  assert(outbox_add(&outbox, "tail", 4) == 0);
+
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 3);
+
+  // Borrowed data is not copied.
+  assert(iov[1].iov_base == body);
+  assert(iov[1].iov_len == 10);
+  assert(memcmp(iov[2].iov_base, "tail", 4) == 0);
+  assert(outbox_pending(&outbox) == 18);
+
+  // Only the segments that fit are returned.
+  assert(outbox_iovec(&outbox, iov, 2) == 2);
+
+  outbox_free(&outbox);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testCommitPartial() {
+  Outbox outbox;
+  struct iovec iov[OUTBOX_IOVEC_MAX];
+  const char *body = "0123456789";
+
+  assert(outbox_init(&outbox, 16) == 0);
+
+  assert(outbox_add(&outbox, "head", 4) == 0);
+  assert(outbox_addRef(&outbox, body, 10) == 0);
+
+  // Commit into the middle of the second segment.
+  outbox_commit(&outbox, 7);
+  assert(outbox_pending(&outbox) == 7);
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 1);
+  assert(iov[0].iov_base == body + 3);
+  assert(iov[0].iov_len == 7);
+
+  // New data after a partial commit goes after the pending data.
+  assert(outbox_add(&outbox, "x", 1) == 0);
+  assert(outbox_pending(&outbox) == 8);
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 2);
+  assert(memcmp(iov[1].iov_base, "x", 1) == 0);
+
+  // When everything is sent, the outbox is reset.
+  outbox_commit(&outbox, 8);
+  assert(outbox_isempty(&outbox));
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 0);
+  assert(outbox.areaLen == 0);
+  assert(outbox.segmentsLen == 0);
+
+  outbox_free(&outbox);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testAreaGrowth() {
+  Outbox outbox;
+  struct iovec iov[OUTBOX_IOVEC_MAX];
+  char data[1000];
+
+  memset(data, 'z', sizeof(data));
+
+  assert(outbox_init(&outbox, 8) == 0);
+
+  assert(outbox_add(&outbox, "a", 1) == 0);
+  assert(outbox_addRef(&outbox, "b", 1) == 0);
+
+  // Owned segments survive the reallocation of the area.
+  for (int i = 0; i < 100; i++) {
+    assert(outbox_add(&outbox, data, sizeof(data)) == 0);
+  }
+
+  assert(outbox_pending(&outbox) == 2 + 100 * sizeof(data));
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 3);
+  assert(memcmp(iov[0].iov_base, "a", 1) == 0);
+  assert(iov[2].iov_len == 100 * sizeof(data));
+  assert(((char *)iov[2].iov_base)[0] == 'z');
+
+  outbox_free(&outbox);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testAddFile() {
+  Outbox outbox;
+  struct iovec iov[OUTBOX_IOVEC_MAX];
+  int fd;
+  off_t offset;
+  size_t size;
+
+  assert(outbox_init(&outbox, 16) == 0);
+
+  assert(outbox_add(&outbox, "head", 4) == 0);
+  assert(outbox_addFile(&outbox, 7, 100, 50) == 0);
+  assert(outbox_add(&outbox, "tail", 4) == 0);
+  assert(outbox_pending(&outbox) == 58);
+
+  // In-memory segments stop before the file segment.
+  assert(!outbox_file(&outbox, &fd, &offset, &size));
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 1);
+  assert(memcmp(iov[0].iov_base, "head", 4) == 0);
+  outbox_commit(&outbox, 4);
+
+  // Partial send of the file segment.
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 0);
+  assert(outbox_file(&outbox, &fd, &offset, &size));
+  assert(fd == 7 && offset == 100 && size == 50);
+  outbox_commit(&outbox, 20);
+  assert(outbox_file(&outbox, &fd, &offset, &size));
+  assert(offset == 120 && size == 30);
+  outbox_commit(&outbox, 30);
+
+  // Data after the file is not merged with the data before it.
+  assert(!outbox_file(&outbox, &fd, &offset, &size));
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 1);
+  assert(memcmp(iov[0].iov_base, "tail", 4) == 0);
+
+  outbox_free(&outbox);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testShrink() {
+  Outbox outbox;
+  struct iovec iov[OUTBOX_IOVEC_MAX];
+
+  assert(outbox_init(&outbox, 16) == 0);
+
+  // No memory until the first segment.
+  assert(outbox.area == NULL && outbox.segments == NULL);
+
+  assert(outbox_add(&outbox, "abc", 3) == 0);
+  assert(outbox.area != NULL && outbox.areaSize == 16);
+
+  // Pending data is kept.
+  outbox_shrink(&outbox);
+  assert(outbox.area != NULL);
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 1);
+
+  outbox_commit(&outbox, 3);
+  outbox_shrink(&outbox);
+  assert(outbox.area == NULL && outbox.segments == NULL);
+
+  // The outbox is usable again after shrinking.
+  assert(outbox_add(&outbox, "de", 2) == 0);
+  assert(outbox_iovec(&outbox, iov, OUTBOX_IOVEC_MAX) == 1);
+  assert(memcmp(iov[0].iov_base, "de", 2) == 0);
+
+  outbox_free(&outbox);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
@@ -0,0 +1,379 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "router.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Tipos dos argumentos ":nome", na ordem em que são tentados.
+ */
+typedef enum RouterArgType {
+  ROUTER_ARG_INT,
+  ROUTER_ARG_STR,
+  ROUTER_ARG_TYPES,
+} RouterArgType;
+
+/**
+ * Nó da árvore. Nos nós fixos, text é um trecho do caminho, compartilhado por
+ * todos os padrões abaixo do nó; nos nós de argumento, é o nome do argumento.
+ * Cada filho fixo começa por um caractere diferente, guardado em indices, na
+ * mesma posição do filho.
+ */
+struct RouterNode {
+  char *text;
+  size_t textLen;
+  char *indices;
+  RouterNode **children;
+  int childrenLen;
+  RouterNode *args[ROUTER_ARG_TYPES];
+  RouterNode *catchAll;
+  void *value;
+};
+
+static RouterNode *router_newNode(const char *text, size_t len);
+static void router_freeNode(RouterNode *node);
+static RouterNode *router_insertText(RouterNode *node, const char *text,
+                                     size_t len);
+static int router_addChild(RouterNode *node, RouterNode *child);
+static RouterNode *router_insertArg(RouterNode **slot, const char *name,
+                                    size_t len);
+static const RouterNode *router_match(const RouterNode *node, const char *path,
+                                      size_t len, RouterMatch *match);
+static const char *router_index(const RouterNode *node, char c);
+static bool router_isInt(const char *value, size_t len);
+static bool router_isNameChar(char c);
+
+////////////////////////////////////////////////////////////////////////////////
+
+void router_init(Router *router) { router->root = NULL; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+int router_add(Router *router, const char *pattern, void *value) {
+  if (pattern[0] != '/' || value == NULL) return -1;
+
+  if (router->root == NULL) {
+    router->root = router_newNode("", 0);
+    if (router->root == NULL) return -1;
+  }
+
+  RouterNode *node = router->root;
+  size_t i = 0;
+  int numArgs = 0;
+
+  while (pattern[i] != '\0' && node != NULL) {
+    if (pattern[i] != ':' && pattern[i] != '*') {
+      size_t len = strcspn(pattern + i, ":*");
+      node = router_insertText(node, pattern + i, len);
+      i += len;
+      continue;
+    }
+
+    // Cada argumento ocupa um segmento inteiro.
+    if (pattern[i - 1] != '/' || ++numArgs > ROUTER_ARGS_MAX) return -1;
+
+    bool catchAll = pattern[i] == '*';
+    size_t name = ++i;
+
+    while (router_isNameChar(pattern[i])) i++;
+
+    size_t nameLen = i - name;
+    RouterArgType type = ROUTER_ARG_STR;
+
+    if (!catchAll && strncmp(pattern + i, "<int>", 5) == 0) {
+      type = ROUTER_ARG_INT;
+      i += 5;
+    }
+
+    if (nameLen == 0 || (pattern[i] != '/' && pattern[i] != '\0') ||
+        (catchAll && pattern[i] != '\0')) {
+      return -1;
+    }
+
+    node = router_insertArg(catchAll ? &node->catchAll : &node->args[type],
+                            pattern + name, nameLen);
+  }
+
+  if (node == NULL || node->value != NULL) return -1;
+
+  node->value = value;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool router_find(const Router *router, const char *path, size_t len,
+                 RouterMatch *match) {
+  match->value = NULL;
+  match->argsLen = 0;
+
+  if (router->root == NULL) return false;
+
+  const RouterNode *node = router_match(router->root, path, len, match);
+
+  if (node == NULL) return false;
+
+  match->value = node->value;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void router_free(Router *router) {
+  router_freeNode(router->root);
+  router->root = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static RouterNode *router_newNode(const char *text, size_t len) {
+  RouterNode *node = calloc(1, sizeof(RouterNode));
+
+  if (node == NULL) return NULL;
+
+  node->text = malloc(len + 1);
+
+  if (node->text == NULL) {
+    free(node);
+    return NULL;
+  }
+
+  memcpy(node->text, text, len);
+  node->text[len] = '\0';
+  node->textLen = len;
+
+  return node;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void router_freeNode(RouterNode *node) {
+  if (node == NULL) return;
+
+  for (int i = 0; i < node->childrenLen; i++) {
+    router_freeNode(node->children[i]);
+  }
+
+  for (int i = 0; i < ROUTER_ARG_TYPES; i++) {
+    router_freeNode(node->args[i]);
+  }
+
+  router_freeNode(node->catchAll);
+
+  free(node->children);
+  free(node->indices);
+  free(node->text);
+  free(node);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Insere o trecho fixo abaixo do nó, dividindo o filho que compartilha apenas
+ * parte do trecho.
+ *
+ * @return nó em que o trecho termina, ou NULL, caso não haja memória.
+ */
+static RouterNode *router_insertText(RouterNode *node, const char *text,
+                                     size_t len) {
+  while (len > 0) {
+    const char *index = router_index(node, text[0]);
+
+    if (index == NULL) {
+      RouterNode *child = router_newNode(text, len);
+
+      if (child == NULL || router_addChild(node, child)) {
+        router_freeNode(child);
+        return NULL;
+      }
+
+      return child;
+    }
+
+    int pos = index - node->indices;
+    RouterNode *child = node->children[pos];
+    size_t common = 0;
+
+    while (common < len && common < child->textLen &&
+           text[common] == child->text[common]) {
+      common++;
+    }
+
+    if (common < child->textLen) {
+      // O filho passa a ficar abaixo do prefixo comum.
+      RouterNode *prefix = router_newNode(child->text, common);
+
+      if (prefix == NULL) return NULL;
+
+      memmove(child->text, child->text + common, child->textLen - common + 1);
+      child->textLen -= common;
+
+      if (router_addChild(prefix, child)) {
+        memmove(child->text + common, child->text, child->textLen + 1);
+        memcpy(child->text, prefix->text, common);
+        child->textLen += common;
+        router_freeNode(prefix);
+        return NULL;
+      }
+
+      node->children[pos] = prefix;
+      child = prefix;
+    }
+
+    node = child;
+    text += common;
+    len -= common;
+  }
+
+  return node;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int router_addChild(RouterNode *node, RouterNode *child) {
+  RouterNode **children =
+      realloc(node->children, sizeof(RouterNode *) * (node->childrenLen + 1));
+
+  if (children == NULL) return -1;
+
+  node->children = children;
+
+  char *indices = realloc(node->indices, node->childrenLen + 1);
+
+  if (indices == NULL) return -1;
+
+  node->indices = indices;
+
+  node->children[node->childrenLen] = child;
+  node->indices[node->childrenLen] = child->text[0];
+  node->childrenLen++;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Obtém o nó do argumento, criando-o, caso ainda não exista.
+ *
+ * @return nó, ou NULL, caso já exista um argumento com outro nome na mesma
+ *         posição ou não haja memória.
+ */
+static RouterNode *router_insertArg(RouterNode **slot, const char *name,
+                                    size_t len) {
+  if (*slot == NULL) {
+    *slot = router_newNode(name, len);
+    return *slot;
+  }
+
+  if ((*slot)->textLen != len || memcmp((*slot)->text, name, len) != 0) {
+    return NULL;
+  }
+
+  return *slot;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Procura, abaixo do nó, o padrão correspondente ao restante do caminho:
+ * primeiro pelo filho fixo, depois pelos argumentos. Caso o ramo escolhido não
+ * leve a um padrão, os argumentos capturados nele são descartados e o próximo
+ * ramo é tentado.
+ */
+static const RouterNode *router_match(const RouterNode *node, const char *path,
+                                      size_t len, RouterMatch *match) {
+  if (len == 0 && node->value != NULL) return node;
+
+  if (len > 0) {
+    const char *index = router_index(node, path[0]);
+
+    if (index != NULL) {
+      const RouterNode *child = node->children[index - node->indices];
+
+      if (child->textLen <= len &&
+          memcmp(child->text, path, child->textLen) == 0) {
+        const RouterNode *found = router_match(child, path + child->textLen,
+                                               len - child->textLen, match);
+        if (found != NULL) return found;
+      }
+    }
+
+    const char *slash = memchr(path, '/', len);
+    size_t segment = (slash != NULL) ? (size_t)(slash - path) : len;
+
+    for (int type = 0; type < ROUTER_ARG_TYPES && segment > 0; type++) {
+      const RouterNode *arg = node->args[type];
+
+      if (arg == NULL ||
+          (type == ROUTER_ARG_INT && !router_isInt(path, segment))) {
+        continue;
+      }
+
+      int argsLen = match->argsLen;
+      match->args[match->argsLen++] = (RouterArg){arg->text, path, segment};
+
+      const RouterNode *found =
+          router_match(arg, path + segment, len - segment, match);
+      if (found != NULL) return found;
+
+      match->argsLen = argsLen;
+    }
+  }
+
+  if (node->catchAll != NULL && node->catchAll->value != NULL) {
+    match->args[match->argsLen++] =
+        (RouterArg){node->catchAll->text, path, len};
+    return node->catchAll;
+  }
+
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Procura o filho fixo que começa pelo caractere.
+ */
+static const char *router_index(const RouterNode *node, char c) {
+  if (node->childrenLen == 0) return NULL;
+  return memchr(node->indices, c, node->childrenLen);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static bool router_isInt(const char *value, size_t len) {
+  size_t i = (value[0] == '-') ? 1 : 0;
+
+  if (i == len) return false;
+
+  for (; i < len; i++) {
+    if (value[i] < '0' || value[i] > '9') return false;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static bool router_isNameChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
@@ -0,0 +1,103 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+/**
+ * Roteador de caminhos em árvore radix.
+ *
+ * Os padrões, como "/people/:id", são compostos por trechos fixos e por
+ * argumentos, cada um ocupando um segmento inteiro do caminho:
+ *
+ *   :nome       captura um segmento não vazio;
+ *   :nome<int>  captura somente números inteiros;
+ *   *nome       ao final do padrão, captura o restante do caminho, inclusive
+ *               vazio.
+ *
+ * Os trechos fixos têm prioridade sobre os argumentos, e os argumentos
+ * inteiros sobre os demais, independente da ordem em que os padrões foram
+ * adicionados. A busca percorre o caminho uma única vez, exceto quando um
+ * ramo mais prioritário não leva a nenhum padrão, e não aloca memória.
+ */
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Quantidade máxima de argumentos por padrão.
+ */
+#define ROUTER_ARGS_MAX 8
+
+typedef struct RouterNode RouterNode;
+
+typedef struct Router {
+  RouterNode *root;
+} Router;
+
+/**
+ * Argumento capturado do caminho, sem cópia: value aponta para o próprio
+ * caminho e não é terminado em '\0'.
+ */
+typedef struct RouterArg {
+  const char *name;
+  const char *value;
+  size_t len;
+} RouterArg;
+
+typedef struct RouterMatch {
+  void *value;
+  RouterArg args[ROUTER_ARGS_MAX];
+  int argsLen;
+} RouterMatch;
+
+/**
+ * Inicializa um roteador vazio, sem alocar memória.
+ */
+void router_init(Router *router);
+
+/**
+ * Adiciona um padrão.
+ *
+ * @param  router  roteador.
+ * @param  pattern padrão, iniciado por '/'.
+ * @param  value   valor associado ao padrão, diferente de NULL.
+ * @return         0, em caso de sucesso, -1, caso o padrão seja inválido, já
+ *                 exista, use outro nome para um argumento já existente na
+ *                 mesma posição, ou não haja memória.
+ */
+int router_add(Router *router, const char *pattern, void *value);
+
+/**
+ * Procura o padrão correspondente ao caminho.
+ *
+ * @param  router roteador.
+ * @param  path   caminho, sem parâmetros ("?...").
+ * @param  len    tamanho do caminho.
+ * @param  match  recebe o valor do padrão e os argumentos capturados, válidos
+ *                enquanto o caminho e o roteador não forem alterados.
+ * @return        true, caso algum padrão corresponda ao caminho, false, caso
+ *                contrário.
+ */
+bool router_find(const Router *router, const char *path, size_t len,
+                 RouterMatch *match);
+
+/**
+ * Libera a memória do roteador, mas não os valores associados aos padrões.
+ */
+void router_free(Router *router);
+
+#endif
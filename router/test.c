@@ -0,0 +1,218 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "router.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static void testStatic();
+static void testArgs();
+static void testIntArgs();
+static void testCatchAll();
+static void testBacktrack();
+static void testInvalid();
+static const char *find(Router *router, const char *path, RouterMatch *match);
+static bool argEquals(const RouterMatch *match, int n, const char *name,
+                      const char *value);
+
+int main() {
+  testStatic();
+  testArgs();
+  testIntArgs();
+  testCatchAll();
+  testBacktrack();
+  testInvalid();
+  return 0;
+}
+
+static void testStatic() {
+  Router router;
+  RouterMatch match;
+
+  router_init(&router);
+
+  assert(find(&router, "/", &match) == NULL);
+
+  assert(router_add(&router, "/peoples", "peoples") == 0);
+  assert(router_add(&router, "/people", "people") == 0);
+  assert(router_add(&router, "/pets", "pets") == 0);
+  assert(router_add(&router, "/", "root") == 0);
+
+  // The shared prefixes were split into separate nodes.
+  assert(strcmp(find(&router, "/peoples", &match), "peoples") == 0);
+  assert(strcmp(find(&router, "/people", &match), "people") == 0);
+  assert(strcmp(find(&router, "/pets", &match), "pets") == 0);
+  assert(strcmp(find(&router, "/", &match), "root") == 0);
+  assert(match.argsLen == 0);
+
+  assert(find(&router, "/peop", &match) == NULL);
+  assert(find(&router, "/peoples/", &match) == NULL);
+  assert(find(&router, "/petsx", &match) == NULL);
+
+  // Duplicated pattern.
+  assert(router_add(&router, "/pets", "pets") == -1);
+
+  router_free(&router);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testArgs() {
+  Router router;
+  RouterMatch match;
+
+  router_init(&router);
+
+  assert(router_add(&router, "/peoples/:id", "details") == 0);
+  assert(router_add(&router, "/peoples/:id/pets/:pet", "pet") == 0);
+  assert(router_add(&router, "/peoples/new", "new") == 0);
+
+  assert(strcmp(find(&router, "/peoples/42", &match), "details") == 0);
+  assert(match.argsLen == 1);
+  assert(argEquals(&match, 0, "id", "42"));
+
+  assert(strcmp(find(&router, "/peoples/ana/pets/rex", &match), "pet") == 0);
+  assert(match.argsLen == 2);
+  assert(argEquals(&match, 0, "id", "ana"));
+  assert(argEquals(&match, 1, "pet", "rex"));
+
+  // Static segments win over arguments.
+  assert(strcmp(find(&router, "/peoples/new", &match), "new") == 0);
+  assert(match.argsLen == 0);
+  assert(strcmp(find(&router, "/peoples/newer", &match), "details") == 0);
+
+  // Arguments are never empty.
+  assert(find(&router, "/peoples/", &match) == NULL);
+  assert(find(&router, "/peoples/ana/pets/", &match) == NULL);
+
+  // Another name for an argument in the same position.
+  assert(router_add(&router, "/peoples/:name/friends", "friends") == -1);
+
+  router_free(&router);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testIntArgs() {
+  Router router;
+  RouterMatch match;
+
+  router_init(&router);
+
+  assert(router_add(&router, "/peoples/:slug", "slug") == 0);
+  assert(router_add(&router, "/peoples/:id<int>", "id") == 0);
+
+  assert(strcmp(find(&router, "/peoples/42", &match), "id") == 0);
+  assert(argEquals(&match, 0, "id", "42"));
+
+  assert(strcmp(find(&router, "/peoples/-7", &match), "id") == 0);
+
+  assert(strcmp(find(&router, "/peoples/42a", &match), "slug") == 0);
+  assert(argEquals(&match, 0, "slug", "42a"));
+
+  assert(strcmp(find(&router, "/peoples/-", &match), "slug") == 0);
+
+  router_free(&router);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testCatchAll() {
+  Router router;
+  RouterMatch match;
+
+  router_init(&router);
+
+  assert(router_add(&router, "/*path", "assets") == 0);
+  assert(router_add(&router, "/favicon.ico", "favicon") == 0);
+  assert(router_add(&router, "/api/:version/*rest", "api") == 0);
+
+  assert(strcmp(find(&router, "/imgs/a.png", &match), "assets") == 0);
+  assert(argEquals(&match, 0, "path", "imgs/a.png"));
+
+  assert(strcmp(find(&router, "/", &match), "assets") == 0);
+  assert(argEquals(&match, 0, "path", ""));
+
+  assert(strcmp(find(&router, "/favicon.ico", &match), "favicon") == 0);
+
+  assert(strcmp(find(&router, "/api/v1/a/b", &match), "api") == 0);
+  assert(match.argsLen == 2);
+  assert(argEquals(&match, 0, "version", "v1"));
+  assert(argEquals(&match, 1, "rest", "a/b"));
+
+  // The catch-all must be the last segment.
+  assert(router_add(&router, "/x/*rest/y", "x") == -1);
+
+  router_free(&router);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testBacktrack() {
+  Router router;
+  RouterMatch match;
+
+  router_init(&router);
+
+  assert(router_add(&router, "/a/b/c", "static") == 0);
+  assert(router_add(&router, "/a/:x/d", "arg") == 0);
+
+  // The static branch "/a/b" does not lead to "/d": the argument is tried.
+  assert(strcmp(find(&router, "/a/b/d", &match), "arg") == 0);
+  assert(match.argsLen == 1);
+  assert(argEquals(&match, 0, "x", "b"));
+
+  assert(strcmp(find(&router, "/a/b/c", &match), "static") == 0);
+  assert(match.argsLen == 0);
+
+  assert(find(&router, "/a/b/e", &match) == NULL);
+  assert(match.argsLen == 0);
+
+  router_free(&router);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testInvalid() {
+  Router router;
+
+  router_init(&router);
+
+  assert(router_add(&router, "peoples", "x") == -1);
+  assert(router_add(&router, "/peoples/:", "x") == -1);
+  assert(router_add(&router, "/peoples/a:id", "x") == -1);
+  assert(router_add(&router, "/peoples/:id-x", "x") == -1);
+  assert(router_add(&router, "/peoples/:id<float>", "x") == -1);
+  assert(router_add(&router, "/a/:1/:2/:3/:4/:5/:6/:7/:8/:9", "x") == -1);
+
+  router_free(&router);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static const char *find(Router *router, const char *path, RouterMatch *match) {
+  if (!router_find(router, path, strlen(path), match)) return NULL;
+  return match->value;
+}
+
+static bool argEquals(const RouterMatch *match, int n, const char *name,
+                      const char *value) {
+  const RouterArg *arg = &match->args[n];
+
+  return n < match->argsLen && strcmp(arg->name, name) == 0 &&
+         arg->len == strlen(value) && memcmp(arg->value, value, arg->len) == 0;
+}
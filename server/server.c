@@ -1,3 +1,6 @@
+// splice(), accept4(), pipe2() e siginfo_t, fora do C11 estrito.
+#define _GNU_SOURCE
+
 #include "server.h"
 
 #include <arpa/inet.h>
@@ -5,55 +8,184 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
 #include <signal.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <threads.h>
 #include <unistd.h>
 
 #include "buff/buff.h"
 #include "io/io.h"
 #include "log/log.h"
-#include "str/str.h"
-#include "vetor/vetor.h"
+#include "outbox/outbox.h"
+#include "slab/slab.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 static const int FLAG_TCP_NODELAY = 1;
 static const int FLAG_REUSE_PORT = 1;
 
+// Quantidade de conexões aceitas de uma só vez, caso acceptBatch não seja
+// informado.
+static const int ACCEPT_BATCH_DEFAULT = 64;
+
+// Limite do índice de clientes por file descriptor, caso RLIMIT_NOFILE seja
+// ilimitado ou grande demais para ser alocado de uma só vez.
+static const size_t CLIENTS_INDEX_MAX = 16 * 1024 * 1024;
+
+// Respostas acumuladas além deste tamanho são enviadas durante o processamento
+// do inbox, sem aguardar o final da iteração do laço de eventos.
+static const size_t FLUSH_THRESHOLD = 64 * 1024;
+
 ////////////////////////////////////////////////////////////////////////////////
 
-typedef struct Server {
+typedef struct Client Client;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Prazo armado no temporizador de cada cliente.
+ */
+typedef enum ServerDeadline {
+  SERVER_DEADLINE_NONE,
+  SERVER_DEADLINE_HEADER,
+  SERVER_DEADLINE_BODY,
+  SERVER_DEADLINE_IDLE,
+  SERVER_DEADLINE_WRITE,
+} ServerDeadline;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Cada worker possui a sua própria tabela de clientes, pré-alocada com a sua
+ * cota de maxClients. Somente a thread do worker acessa a tabela, portanto não
+ * há locks: a admissão de uma nova conexão é apenas retirar uma entrada da
+ * lista de entradas livres.
+ */
+typedef struct ServerWorker {
+  int id;
   int fd;
+  // O socket de escuta, fixo após a inicialização, mesmo depois que a
+  // drenagem fecha fd: server_exec() o lê a partir de qualquer thread.
+  int listenFd;
+  // Acorda o worker para encerrar ou drenar, a partir de outra thread ou de
+  // um tratador de sinal.
+  int wakeFd;
   bool canAccept;
-  Vetor *clients;
-  size_t numClients;
+  bool accepting;
+  bool draining;
+  IOTimer drainTimer;
+  int maxEvents;
+  // Laço de eventos do worker, liberado somente por server_freeWorker(), após
+  // o término da thread.
+  IO *io;
+  // O mesmo laço, publicado para as demais threads (server_post()) enquanto
+  // está em execução, ou NULL, quando não aceita mais tarefas.
+  _Atomic(IO *) postIo;
+  thrd_t thread;
+  Client *clients;
+  Client *freeClients;
+  // Clientes com respostas a serem enviadas ao final da iteração do laço.
+  Client *dirtyClients;
+  int maxClients;
+  int numClients;
+  // Pool de memória dos inboxes, com um slab por classe de tamanho, de
+  // inboxInitSize, dobrando, até inboxMaxSize.
+  Slab *inboxSlabs;
+  int numInboxSlabs;
+  // Pools dos dados da aplicação, por conexão e por requisição.
+  Slab clientDataSlab;
+  Slab requestDataSlab;
+} ServerWorker;
+
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct Server {
+  // Índice de clientes por file descriptor. Cada posição só é escrita pelo
+  // worker dono da conexão, ao aceitá-la e ao fechá-la.
+  _Atomic(Client *) *clients;
+  size_t clientsSize;
+  atomic_size_t numClients;
+  atomic_size_t numAccepted;
+  atomic_size_t numRejected;
   ServerParams params;
-  bool close;
-  IO *listen;
-  IO *workers[8];
-  thrd_t thWorkers[8];
+  atomic_bool close;
+  atomic_bool draining;
+  atomic_int result;
+  ServerWorker *workers;
+  int numWorkers;
+  // Sockets de escuta herdados de outra instância (SERVER_LISTEN_FDS_ENV).
+  int *inheritedFds;
+  int numInheritedFds;
 } Server;
 
 ////////////////////////////////////////////////////////////////////////////////
 
-typedef struct Client {
-  int fd;
-  str_t *outbox;
+struct Client {
+  // Cada entrada ocupa linhas de cache próprias, sem compartilhá-las com as
+  // entradas vizinhas.
+  alignas(SLAB_ALIGN) int fd;
+  ServerWorker *worker;
+  Client *next;
+  Outbox outbox;
   bool canWrite;
+  // O inbox só possui memória enquanto há dados recebidos não processados.
   Buff inbox;
+  // Classe de tamanho do inbox no pool do worker, ou -1, sem memória.
+  int inboxSlab;
   bool busy;
+  bool pumping;
   bool canRead;
   bool readClosed;
-} Client;
+  // A aplicação suspendeu a leitura (server_pauseRead()).
+  bool readPaused;
+  // A aplicação aguarda espaço na fila de saída (server_watchWrite()).
+  bool watchWrite;
+  IOTimer timer;
+  ServerDeadline deadline;
+  // A conexão será fechada após a resposta atual (drenagem ou
+  // server_closeAfter()).
+  bool closing;
+  // Respostas em andamento fora da requisição atual (server_hold()).
+  bool held;
+  void *data;
+  void *requestData;
+  // Bytes da requisição em andamento, retidos no início do inbox até a
+  // resposta ser concluída.
+  size_t requestSize;
+  // Distingue as conexões que usaram esta entrada (ver server_connId()).
+  uint32_t serial;
+  // Posição na lista de clientes com respostas a serem enviadas, ou NULL.
+  Client *dirtyNext;
+  Client **dirtyPrev;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Tarefa postada por server_post(), com a conexão a que se destina.
+ */
+typedef struct ServerPosted {
+  ServerTask task;
+  void *arg;
+  ServerConnId conn;
+  Client *client;
+} ServerPosted;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -61,60 +193,79 @@ static Server server;
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static Client *server_newClient(int fd);
+static Client *server_newClient(ServerWorker *worker, int fd);
+static void server_releaseClient(Client *client);
 static Client *server_client(int fd);
-static void server_read(Client *client);
+static ssize_t server_read(Client *client);
 static void server_write(Client *client);
+static ssize_t server_writeIovec(Client *client, struct iovec *iov,
+                                 size_t iovcnt);
+static ssize_t server_writeFile(Client *client);
+static void server_pump(Client *client);
+static void server_settle(Client *client);
+static void server_markDirty(Client *client);
+static void server_unmarkDirty(Client *client);
+static void server_flush(void *arg);
 static void server_onClientEvent(void *arg, int fd, IOEvent events);
-static void server_acceptClients();
+static void server_acceptClients(ServerWorker *worker);
 static void server_onListenEvent(void *arg, int fd, IOEvent events);
-static void server_processInbox(Client *client);
+static int server_processInbox(Client *client);
 static int server_setupSigTermHandler();
 static void server_sigTermHandler(int signum, siginfo_t *info, void *ptr);
 static int server_init(ServerParams params);
+static int server_initWorker(ServerWorker *worker, int id);
+static int server_listen(int id);
+static int server_setupListen(int fd);
+static int server_parseInheritedFds();
+static void server_closeInheritedFds();
+static void server_requestStop(int result, bool drain);
+static void server_wake();
+static int server_wakeWorker(ServerWorker *worker);
+static void server_onWakeEvent(void *arg, int fd, IOEvent events);
+static void server_startDrain(ServerWorker *worker);
+static void server_onDrainTimeout(void *arg);
+static bool server_isIdle(const Client *client);
+static size_t server_maxFds();
 static void server_free();
+static void server_freeWorker(ServerWorker *worker);
 static void server_freeClient(Client *client);
 static int server_worker(void *arg);
+static void server_setDeadline(Client *client, ServerDeadline deadline);
+static void server_updateDeadline(Client *client);
+static void server_onTimeout(void *arg);
+static int server_numInboxSlabs();
+static size_t server_inboxSize(int slab);
+static int server_acquireInbox(Client *client);
+static int server_growInbox(Client *client);
+static void server_releaseInbox(Client *client);
+static void server_clean(Client *client);
+static void server_onPosted(void *arg);
+static void server_onWritable(int clientFd, void *arg);
 
 ////////////////////////////////////////////////////////////////////////////////
 
 int server_start(ServerParams params) {
   if (server_init(params)) return -1;
 
-  server.workers[0] = io_new();
-  server.workers[1] = io_new();
-  server.workers[2] = io_new();
-  server.workers[3] = io_new();
-  server.workers[4] = io_new();
-  server.workers[5] = io_new();
-  server.workers[6] = io_new();
-  server.workers[7] = io_new();
-
-  if (thrd_create(&server.thWorkers[0], server_worker, server.workers[0]))
-    return -1;
-
-  if (thrd_create(&server.thWorkers[1], server_worker, server.workers[1]))
-    return -1;
-
-  if (thrd_create(&server.thWorkers[2], server_worker, server.workers[2]))
-    return -1;
-
-  if (thrd_create(&server.thWorkers[3], server_worker, server.workers[3]))
-    return -1;
-
-  if (thrd_create(&server.thWorkers[4], server_worker, server.workers[4]))
-    return -1;
-
-  if (thrd_create(&server.thWorkers[5], server_worker, server.workers[5]))
-    return -1;
+  int started = 1;
 
-  if (thrd_create(&server.thWorkers[6], server_worker, server.workers[6]))
-    return -1;
+  for (; started < server.numWorkers; started++) {
+    ServerWorker *worker = &server.workers[started];
+    if (thrd_create(&worker->thread, server_worker, worker) != thrd_success) {
+      log_erro("server", "thrd_create(): %d - %s\n", errno, strerror(errno));
+      server_stop(-1);
+      break;
+    }
+  }
 
-  if (thrd_create(&server.thWorkers[7], server_worker, server.workers[7]))
-    return -1;
+  // A thread que iniciou o servidor também atende como o primeiro worker.
+  int r = server_worker(&server.workers[0]);
 
-  int r = io_run(server.listen, 100);
+  for (int i = 1; i < started; i++) {
+    int rw = 0;
+    thrd_join(server.workers[i].thread, &rw);
+    if (rw != 0) r = rw;
+  }
 
   server_free();
 
@@ -126,15 +277,21 @@ int server_start(ServerParams params) {
 ////////////////////////////////////////////////////////////////////////////////
 
 static int server_worker(void *arg) {
-  IO *io = arg;
-  int maxClients = server.params.maxClients / 8;
+  ServerWorker *worker = arg;
+
+  log_info("server-worker", "Started: %d, maxEvents: %d\n", worker->id,
+           worker->maxEvents);
 
-  log_info("server-worker", "Started: %ld, maxClients: %d\n", thrd_current(),
-           maxClients);
+  atomic_store(&worker->postIo, worker->io);
 
-  int r = io_run(io, maxClients);
+  int r = io_loop(worker->io, worker->maxEvents);
 
-  log_info("server-worker", "Closed: %ld\n", thrd_current());
+  // Tarefas postadas a partir daqui não seriam executadas. Uma thread que já
+  // obteve a instância ainda pode usá-la: server_freeWorker() só a libera
+  // depois que as threads de todos os workers terminam.
+  atomic_store(&worker->postIo, NULL);
+
+  log_info("server-worker", "Closed: %d\n", worker->id);
 
   return r;
 }
@@ -144,73 +301,436 @@ static int server_worker(void *arg) {
 static int server_init(ServerParams params) {
   log_info("server", "Initializing...\n");
 
-  server.params = params;
-  server.fd = -1;
-  server.canAccept = false;
-  server.numClients = 0;
-  server.clients = vetor_criar(params.maxClients);
+  if (params.numWorkers <= 0) {
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    params.numWorkers = (numCpus > 0) ? (int)numCpus : 1;
+  }
 
-  if (server.clients == NULL) goto error;
+  if (params.maxClients <= 0) {
+    log_erro("server", "Invalid maxClients: %d\n", params.maxClients);
+    return -1;
+  }
 
-  struct sockaddr_in address = {0};
-  address.sin_addr.s_addr = htonl(INADDR_ANY);
-  address.sin_family = AF_INET;
-  address.sin_port = htons(params.port);
+  if (params.backlog <= 0) params.backlog = SOMAXCONN;
 
-  server.fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (params.acceptBatch <= 0) params.acceptBatch = ACCEPT_BATCH_DEFAULT;
 
-  if (server.fd == -1) goto error;
+  if (params.deferAccept < 0) params.deferAccept = 0;
 
-  if (setsockopt(server.fd, SOL_SOCKET, SO_REUSEPORT, &FLAG_REUSE_PORT,
-                 sizeof(FLAG_REUSE_PORT))) {
+  if (params.inboxMaxSize <= 0) {
+    log_erro("server", "Invalid inboxMaxSize: %d\n", params.inboxMaxSize);
+    return -1;
+  }
+
+  if (params.inboxInitSize <= 0 || params.inboxInitSize > params.inboxMaxSize) {
+    params.inboxInitSize = params.inboxMaxSize;
+  }
+
+  // Todo worker precisa de ao menos uma vaga, senão as conexões direcionadas
+  // pelo kernel ao seu socket de escuta nunca seriam aceitas.
+  if (params.numWorkers > params.maxClients) {
+    params.numWorkers = params.maxClients;
+  }
+
+  server.params = params;
+  atomic_init(&server.close, false);
+  atomic_init(&server.draining, false);
+  atomic_init(&server.result, 0);
+  atomic_init(&server.numClients, 0);
+  atomic_init(&server.numAccepted, 0);
+  atomic_init(&server.numRejected, 0);
+  server.numWorkers = 0;
+  server.clientsSize = server_maxFds();
+  server.clients = calloc(server.clientsSize, sizeof(*server.clients));
+
+  if (server.clients == NULL) {
+    log_erro("server", "calloc(): %d - %s\n", errno, strerror(errno));
+    goto error;
+  }
+
+  server.workers = calloc(params.numWorkers, sizeof(ServerWorker));
+
+  if (server.workers == NULL) {
+    log_erro("server", "calloc(): %d - %s\n", errno, strerror(errno));
     goto error;
   }
 
-  if (bind(server.fd, &address, sizeof(address))) goto error;
+  if (server_parseInheritedFds()) goto error;
 
-  if (fcntl(server.fd, F_SETFL, O_NONBLOCK)) goto error;
+  for (int i = 0; i < params.numWorkers; i++) {
+    if (server_initWorker(&server.workers[i], i)) goto error;
+    server.numWorkers++;
+  }
 
-  if (listen(server.fd, 10)) goto error;
+  // Sockets herdados além da quantidade de workers não são usados.
+  server_closeInheritedFds();
 
+  log_info("server", "Workers: %d\n", server.numWorkers);
   log_info("server", "Concurrency max: %d\n", params.maxClients);
   log_info("server", "Waiting for connections on port: %d.\n", params.port);
 
-  server.listen = io_new();
+  if (server_setupSigTermHandler()) goto error;
+
+  return 0;
+
+error:
+  server_closeInheritedFds();
+  server_free();
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int server_initWorker(ServerWorker *worker, int id) {
+  int numWorkers = server.params.numWorkers;
+
+  worker->id = id;
+  worker->fd = -1;
+  worker->listenFd = -1;
+  worker->wakeFd = -1;
+  worker->io = NULL;
+  atomic_init(&worker->postIo, NULL);
+  worker->canAccept = false;
+  worker->accepting = false;
+  worker->draining = false;
+  io_timerInit(&worker->drainTimer, server_onDrainTimeout, worker);
+  worker->numClients = 0;
+  worker->numInboxSlabs = server_numInboxSlabs();
+  worker->inboxSlabs = calloc(worker->numInboxSlabs, sizeof(Slab));
+
+  if (worker->inboxSlabs == NULL) {
+    log_erro("server", "calloc(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  // Apenas calcula as classes: as páginas são alocadas sob demanda, pela
+  // thread do worker.
+  for (int i = 0; i < worker->numInboxSlabs; i++) {
+    slab_init(&worker->inboxSlabs[i], server_inboxSize(i));
+  }
+
+  // Distribui maxClients entre os workers, de modo que a soma das cotas seja
+  // exatamente maxClients.
+  worker->maxClients = server.params.maxClients / numWorkers;
+  worker->maxClients += (id < server.params.maxClients % numWorkers) ? 1 : 0;
+  worker->maxEvents = worker->maxClients;
+
+  slab_init(&worker->clientDataSlab, server.params.clientDataSize);
+  slab_init(&worker->requestDataSlab, server.params.requestDataSize);
+
+  worker->clients =
+      aligned_alloc(SLAB_ALIGN, worker->maxClients * sizeof(Client));
+
+  if (worker->clients == NULL) {
+    log_erro("server", "aligned_alloc(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  memset(worker->clients, 0, worker->maxClients * sizeof(Client));
+
+  worker->freeClients = NULL;
+  worker->dirtyClients = NULL;
+
+  for (int i = worker->maxClients - 1; i >= 0; i--) {
+    Client *client = &worker->clients[i];
+    client->fd = -1;
+    client->worker = worker;
+    client->inboxSlab = -1;
+    client->data = NULL;
+    client->requestData = NULL;
+    buff_wrap(&client->inbox, NULL, 0);
+    outbox_init(&client->outbox, server.params.outboxInitSize);
+    io_timerInit(&client->timer, server_onTimeout, client);
+    client->next = worker->freeClients;
+    worker->freeClients = client;
+  }
+
+  worker->fd = server_listen(id);
+
+  if (worker->fd == -1) goto error;
+
+  worker->listenFd = worker->fd;
+
+  worker->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (worker->wakeFd == -1) {
+    log_erro("server", "eventfd(): %d - %s\n", errno, strerror(errno));
+    goto error;
+  }
+
+  worker->io = io_new();
+
+  if (worker->io == NULL) {
+    log_erro("server", "io_new()\n");
+    goto error;
+  }
 
-  if (io_add(server.listen, server.fd, IO_READ | IO_EDGE_TRIGGERED, NULL,
+  io_setHooks(worker->io, NULL, server_flush, worker);
+
+  if (io_add(worker->io, worker->fd, IO_READ | IO_EDGE_TRIGGERED, worker,
              server_onListenEvent)) {
+    log_erro("server", "io_add(): %d - %s.\n", errno, strerror(errno));
     goto error;
   }
 
-  if (server_setupSigTermHandler()) goto error;
+  if (io_add(worker->io, worker->wakeFd, IO_READ, worker, server_onWakeEvent)) {
+    log_erro("server", "io_add(): %d - %s.\n", errno, strerror(errno));
+    goto error;
+  }
 
   return 0;
 
 error:
-  if (server.fd != -1) close(server.fd);
+  server_freeWorker(worker);
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Cria um socket de escuta com SO_REUSEPORT, permitindo que cada worker tenha
+ * o seu próprio socket na mesma porta. Assim, o kernel distribui as novas
+ * conexões entre os workers, sem que uma única thread aceite todas elas.
+ *
+ * Se houver um socket herdado de outra instância para o worker, ele é usado no
+ * lugar de um novo.
+ */
+static int server_listen(int id) {
+  if (id < server.numInheritedFds && server.inheritedFds[id] != -1) {
+    int fd = server.inheritedFds[id];
+    server.inheritedFds[id] = -1;
+
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) || fcntl(fd, F_SETFD, FD_CLOEXEC)) {
+      log_erro("server", "fcntl(): %d - %s\n", errno, strerror(errno));
+      close(fd);
+      return -1;
+    }
+
+    // O socket já está escutando, mas backlog e deferAccept podem ter mudado.
+    if (server_setupListen(fd)) {
+      close(fd);
+      return -1;
+    }
+
+    log_info("server", "Worker %d: using inherited socket %d.\n", id, fd);
+
+    return fd;
+  }
+
+  struct sockaddr_in address = {0};
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_family = AF_INET;
+  address.sin_port = htons(server.params.port);
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd == -1) {
+    log_erro("server", "socket(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &FLAG_REUSE_PORT,
+                 sizeof(FLAG_REUSE_PORT))) {
+    log_erro("server", "setsockopt(SO_REUSEPORT): %d - %s\n", errno,
+             strerror(errno));
+    goto error;
+  }
+
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address))) {
+    log_erro("server", "bind(): %d - %s\n", errno, strerror(errno));
+    goto error;
+  }
+
+  if (fcntl(fd, F_SETFL, O_NONBLOCK)) goto error;
+
+  if (server_setupListen(fd)) goto error;
+
+  return fd;
+
+error:
+  close(fd);
   return -1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Configura o aceite de conexões e coloca o socket em escuta.
+ *
+ * Com TCP_DEFER_ACCEPT, o kernel só entrega a conexão quando o primeiro dado
+ * da requisição chega, de modo que o worker não é acordado, nem ocupa uma vaga,
+ * por conexões que ainda não enviaram nada.
+ */
+static int server_setupListen(int fd) {
+  if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &server.params.deferAccept,
+                 sizeof(server.params.deferAccept))) {
+    log_erro("server", "setsockopt(TCP_DEFER_ACCEPT): %d - %s\n", errno,
+             strerror(errno));
+    return -1;
+  }
+
+  if (listen(fd, server.params.backlog)) {
+    log_erro("server", "listen(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Lê os sockets de escuta herdados de outra instância, e remove a variável de
+ * ambiente, para que não seja repassada a outros programas.
+ */
+static int server_parseInheritedFds() {
+  const char *value = getenv(SERVER_LISTEN_FDS_ENV);
+
+  server.inheritedFds = NULL;
+  server.numInheritedFds = 0;
+
+  if (value == NULL || value[0] == '\0') return 0;
+
+  server.inheritedFds = malloc(sizeof(int) * (strlen(value) / 2 + 1));
+
+  if (server.inheritedFds == NULL) {
+    log_erro("server", "malloc(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  const char *c = value;
+
+  while (*c != '\0') {
+    char *end = NULL;
+    long fd = strtol(c, &end, 10);
+    int listening = 0;
+    socklen_t len = sizeof(listening);
+
+    if (end == c || fd < 0 || fd > INT_MAX) {
+      log_erro("server", "Invalid %s: %s\n", SERVER_LISTEN_FDS_ENV, value);
+      break;
+    }
+
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) ||
+        !listening) {
+      log_erro("server", "Inherited fd %ld is not a listening socket.\n", fd);
+    } else {
+      server.inheritedFds[server.numInheritedFds++] = fd;
+    }
+
+    c = (*end == ',') ? end + 1 : end;
+    if (*end != ',' && *end != '\0') break;
+  }
+
+  unsetenv(SERVER_LISTEN_FDS_ENV);
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_closeInheritedFds() {
+  for (int i = 0; i < server.numInheritedFds; i++) {
+    if (server.inheritedFds[i] == -1) continue;
+    log_info("server", "Closing unused inherited socket %d.\n",
+             server.inheritedFds[i]);
+    close(server.inheritedFds[i]);
+  }
+
+  free(server.inheritedFds);
+  server.inheritedFds = NULL;
+  server.numInheritedFds = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Obtém o maior file descriptor possível do processo, usado para dimensionar
+ * o índice de clientes de uma só vez, sem realocações.
+ */
+static size_t server_maxFds() {
+  struct rlimit limit;
+
+  if (getrlimit(RLIMIT_NOFILE, &limit)) {
+    log_erro("server", "getrlimit(): %d - %s\n", errno, strerror(errno));
+    return CLIENTS_INDEX_MAX;
+  }
+
+  if (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > CLIENTS_INDEX_MAX) {
+    return CLIENTS_INDEX_MAX;
+  }
+
+  return limit.rlim_cur;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 static void server_free() {
-  for (int i = 0; i < vetor_qtd(server.clients); i++) {
-    Client *client = vetor_item(server.clients, i);
-    server_freeClient(client);
-    vetor_inserir(server.clients, i, NULL);
+  int numWorkers = server.numWorkers;
+
+  // O tratador de SIGTERM, ainda instalado, deixa de acordar os workers antes
+  // que eles sejam liberados.
+  server.numWorkers = 0;
+  atomic_signal_fence(memory_order_seq_cst);
+
+  for (int i = 0; i < numWorkers; i++) {
+    server_freeWorker(&server.workers[i]);
   }
 
-  vetor_destruir(server.clients);
+  free(server.workers);
+  server.workers = NULL;
+
+  free(server.clients);
   server.clients = NULL;
+  server.clientsSize = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_freeWorker(ServerWorker *worker) {
+  // Chamada após o término das threads dos workers: nenhuma outra thread
+  // ainda usa a instância de IO.
+  if (worker->clients != NULL) {
+    for (int i = 0; i < worker->maxClients; i++) {
+      Client *client = &worker->clients[i];
+      if (client->fd != -1) server_close(client->fd);
+      server_freeClient(client);
+    }
+  }
+
+  // As tarefas que server_post() aceitou ainda são executadas, com as conexões
+  // já fechadas (client -1), para que liberem os seus argumentos.
+  if (worker->io != NULL) io_runPosted(worker->io);
+
+  io_free(worker->io);
+  worker->io = NULL;
+
+  free(worker->clients);
+  worker->clients = NULL;
+  worker->freeClients = NULL;
+
+  if (worker->inboxSlabs != NULL) {
+    for (int i = 0; i < worker->numInboxSlabs; i++) {
+      slab_free(&worker->inboxSlabs[i]);
+    }
+  }
+
+  free(worker->inboxSlabs);
+  worker->inboxSlabs = NULL;
+  worker->numInboxSlabs = 0;
+
+  slab_free(&worker->clientDataSlab);
+  slab_free(&worker->requestDataSlab);
+
+  if (worker->fd != -1 && close(worker->fd)) {
+    log_erro("server", "close(): %d - %s.\n", errno, strerror(errno));
+  }
+
+  worker->fd = -1;
 
-  io_close(server.workers[0], 0);
-  io_close(server.workers[1], 0);
-  io_close(server.workers[2], 0);
-  io_close(server.workers[3], 0);
-  io_close(server.workers[4], 0);
-  io_close(server.workers[5], 0);
-  io_close(server.workers[6], 0);
-  io_close(server.workers[7], 0);
+  if (worker->wakeFd != -1) close(worker->wakeFd);
+
+  worker->wakeFd = -1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -227,21 +747,38 @@ static int server_setupSigTermHandler() {
     return -1;
   }
 
+  // Escrever em uma conexão fechada pelo cliente, por exemplo, ao concluir uma
+  // resposta com server_post(), deve resultar em EPIPE, e não encerrar o
+  // processo.
+  if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+    log_erro("server", "signal(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
   return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 static void server_sigTermHandler(int signum, siginfo_t *info, void *ptr) {
-  server_stop(0);
+  // Um tratador de sinal não pode registrar mensagens: a drenagem é apenas
+  // sinalizada, com escritas atômicas e write(), e os workers a registram ao
+  // acordar. O errno da thread interrompida é preservado.
+  int savedErrno = errno;
+  server_requestStop(0, server.params.drainTimeout > 0);
+  errno = savedErrno;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 static void server_onListenEvent(void *arg, int fd, IOEvent events) {
+  ServerWorker *worker = arg;
+
+  if (atomic_load(&server.close) || worker->draining) return;
+
   if (events & IO_READ) {
-    server.canAccept = true;
-    server_acceptClients();
+    worker->canAccept = true;
+    server_acceptClients(worker);
     return;
   }
 
@@ -258,21 +795,44 @@ static void server_onListenEvent(void *arg, int fd, IOEvent events) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void server_acceptClients() {
-  while (server.canAccept && server.numClients < server.params.maxClients) {
+static void server_acceptClients(ServerWorker *worker) {
+  // Evita reentrada quando server_close() é chamado de dentro do laço.
+  if (worker->accepting) return;
+
+  worker->accepting = true;
+
+  int batch = 0;
+
+  while (!atomic_load(&server.close) && !worker->draining &&
+         worker->canAccept && worker->freeClients != NULL) {
+    // Após um lote, o worker atende os eventos das conexões já aceitas antes
+    // de continuar: acordar a si mesmo devolve o controle ao laço de eventos,
+    // que retoma o aceite na próxima volta.
+    if (batch++ == server.params.acceptBatch) {
+      if (server_wakeWorker(worker)) {
+        log_erro("server", "write(): %d - %s.\n", errno, strerror(errno));
+      }
+      break;
+    }
+
     struct sockaddr address;
     socklen_t addressTamanho = sizeof(address);
 
-    int clientFd = accept4(server.fd, &address, &addressTamanho, SOCK_NONBLOCK);
+    int clientFd =
+        accept4(worker->fd, &address, &addressTamanho,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
 
     if (clientFd == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        server.canAccept = false;
+        worker->canAccept = false;
         log_dbug("server", "Try again.\n");
         break;
+      } else if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
       } else {
         log_erro("server", "tcp_accept(): %d - %s\n", errno, strerror(errno));
-        continue;
+        worker->canAccept = false;
+        break;
       }
     }
 
@@ -280,157 +840,570 @@ static void server_acceptClients() {
                    sizeof(FLAG_TCP_NODELAY))) {
       log_erro("server", "client %d >>> setsockopt(TCP_NODELAY): %d - %s\n",
                clientFd, errno, strerror(errno));
+      close(clientFd);
       continue;
     }
 
-    server.numClients++;
-
-    log_dbug("server", "client %d >>> connection accepted [%d/%d].\n", clientFd,
-             server.numClients, server.params.maxClients);
-
-    Client *client = server_newClient(clientFd);
+    Client *client = server_newClient(worker, clientFd);
 
     if (client == NULL) {
       log_erro("server", "client %d >>> server_newClient()\n", clientFd);
-      server_close(clientFd);
-      break;
+      atomic_fetch_add_explicit(&server.numRejected, 1, memory_order_relaxed);
+      close(clientFd);
+      continue;
     }
 
-    server.params.onConnected(client->fd);
+    size_t numClients =
+        atomic_fetch_add_explicit(&server.numClients, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&server.numAccepted, 1, memory_order_relaxed);
 
-    server.params.onClean(client->fd);
+    log_dbug("server", "client %d >>> connection accepted [%ld/%d].\n",
+             clientFd, numClients + 1, server.params.maxClients);
+
+    server.params.onConnected(client->fd);
 
-    IO *worker = server.workers[server.numClients % 8];
+    server_clean(client);
 
-    if (io_add(worker, client->fd, IO_READ | IO_EDGE_TRIGGERED, NULL,
+    if (io_add(worker->io, client->fd, IO_READ | IO_EDGE_TRIGGERED, client,
                server_onClientEvent)) {
       log_erro("server", "io_add(): %d - %s.\n", errno, strerror(errno));
       server_close(clientFd);
       continue;
     }
-  }
 
-  if (server.close) {
-    log_info("server", "Close listen socket: %d.\n", server.fd);
-    if (close(server.fd)) {
-      log_erro("server", "close(): %d - %s.\n", errno, strerror(errno));
-    }
+    server_updateDeadline(client);
   }
+
+  worker->accepting = false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static Client *server_newClient(int fd) {
-  Client *client = vetor_item(server.clients, fd);
+static Client *server_newClient(ServerWorker *worker, int fd) {
+  if (fd < 0 || (size_t)fd >= server.clientsSize) {
+    log_erro("server", "client %d >>> file descriptor out of range: %ld\n", fd,
+             server.clientsSize);
+    return NULL;
+  }
 
-  if (client == NULL) {
-    client = malloc(sizeof(Client));
+  Client *client = worker->freeClients;
 
-    if (client == NULL) {
-      log_erro("server", "malloc(): %d - %s\n", errno, strerror(errno));
-      return NULL;
-    }
+  if (client == NULL) return NULL;
 
-    if (buff_init(&client->inbox, server.params.inboxMaxSize)) {
-      log_erro("server", "buff_init()\n");
-      free(client);
-      return NULL;
-    }
+  // Além dos dados da aplicação, nenhuma memória é reservada para a conexão:
+  // o inbox é obtido do pool quando chegam dados, e o outbox, quando há algo a
+  // ser enviado.
+  if (server.params.clientDataSize > 0) {
+    client->data = slab_alloc(&worker->clientDataSlab);
 
-    if ((client->outbox = str_new(server.params.outboxInitSize)) == NULL) {
-      log_erro("server", "str_new()\n");
-      buff_free(&client->inbox);
-      free(client);
+    if (client->data == NULL) {
+      log_erro("server", "slab_alloc(): %d - %s\n", errno, strerror(errno));
       return NULL;
     }
-
-    vetor_inserir(server.clients, fd, client);
   }
 
+  worker->freeClients = client->next;
+  worker->numClients++;
+
+  client->next = NULL;
   client->fd = fd;
   client->canRead = false;
   client->readClosed = false;
+  client->readPaused = false;
+  client->watchWrite = false;
   client->canWrite = true;
   client->busy = false;
-  buff_clear(&client->inbox);
-  str_clear(client->outbox);
+  client->pumping = false;
+  client->deadline = SERVER_DEADLINE_NONE;
+  client->closing = false;
+  client->held = false;
 
-  return client;
-}
+  if (++client->serial == 0) client->serial = 1;
 
-////////////////////////////////////////////////////////////////////////////////
+  atomic_store_explicit(&server.clients[fd], client, memory_order_release);
 
-static void server_freeClient(Client *client) {
-  if (client == NULL) return;
-  buff_free(&client->inbox);
-  str_free(&client->outbox);
-  free(client);
+  return client;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static Client *server_client(int fd) { return vetor_item(server.clients, fd); }
+static void server_releaseClient(Client *client) {
+  ServerWorker *worker = client->worker;
 
-////////////////////////////////////////////////////////////////////////////////
+  // A requisição em andamento foi interrompida: a aplicação ainda limpa o seu
+  // estado.
+  if (client->requestData != NULL) server.params.onClean(client->fd);
 
-void server_send(int clientFd, const void *buff, size_t size) {
-  Client *client = server_client(clientFd);
+  atomic_store_explicit(&server.clients[client->fd], NULL,
+                        memory_order_release);
 
-  if (str_addcstrlen(&client->outbox, buff, size)) {
-    log_erro("server", "str_addcstrlen()\n");
-    server_close(clientFd);
-    return;
-  }
+  server_unmarkDirty(client);
+
+  // Em server_freeWorker(), após uma falha na inicialização, a instância de IO
+  // pode não existir.
+  if (worker->io != NULL) io_timerCancel(worker->io, &client->timer);
 
-  server_write(client);
+  buff_clear(&client->inbox);
+  server_releaseInbox(client);
+  outbox_clear(&client->outbox);
+  outbox_shrink(&client->outbox);
+
+  slab_release(&worker->clientDataSlab, client->data);
+  slab_release(&worker->requestDataSlab, client->requestData);
+  client->data = NULL;
+  client->requestData = NULL;
+  client->requestSize = 0;
+
+  client->fd = -1;
+  client->next = worker->freeClients;
+  worker->freeClients = client;
+  worker->numClients--;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void server_onFlush(Client *client) {
-  server.params.onClean(client->fd);
-  server_processInbox(client);
+static void server_freeClient(Client *client) {
+  if (client == NULL) return;
+  // A memória do inbox pertence ao pool do worker.
+  outbox_free(&client->outbox);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void server_onClientEvent(void *arg, int fd, IOEvent events) {
-  Client *client = server_client(fd);
+static Client *server_client(int fd) {
+  if (fd < 0 || (size_t)fd >= server.clientsSize) return NULL;
+  return atomic_load_explicit(&server.clients[fd], memory_order_acquire);
+}
 
-  if (events & IO_READ) {
-    log_dbug("server", "client %d >>> can read.\n", client->fd);
-    client->canRead = true;
-    server_read(client);
+////////////////////////////////////////////////////////////////////////////////
+
+void *server_clientData(int clientFd) {
+  Client *client = server_client(clientFd);
+  return (client != NULL) ? client->data : NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void *server_requestData(int clientFd) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL || server.params.requestDataSize <= 0) return NULL;
+
+  if (client->requestData == NULL) {
+    client->requestData = slab_alloc(&client->worker->requestDataSlab);
+
+    if (client->requestData == NULL) {
+      log_erro("server", "client %d >>> slab_alloc(): %d - %s\n", clientFd,
+               errno, strerror(errno));
+    }
+  }
+
+  return client->requestData;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Prepara a conexão para a próxima requisição: a aplicação limpa o seu estado
+ * e os dados da requisição concluída voltam para o pool.
+ */
+static void server_clean(Client *client) {
+  server.params.onClean(client->fd);
+
+  slab_release(&client->worker->requestDataSlab, client->requestData);
+  client->requestData = NULL;
+
+  // Somente agora os bytes da requisição deixam o inbox.
+  if (client->requestSize > 0) {
+    buff_reader_commit(buff_reader(&client->inbox), client->requestSize);
+    client->requestSize = 0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_send(int clientFd, const void *buff, size_t size) {
+  server_append(clientFd, buff, size);
+  server_end(clientFd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_append(int clientFd, const void *buff, size_t size) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) {
+    log_erro("server", "client %d <<< send to a closed client.\n", clientFd);
     return;
   }
 
-  if (events & IO_WRITE) {
-    log_dbug("server", "client %d <<< can write.\n", client->fd);
-    client->canWrite = true;
-    server_write(client);
+  if (outbox_add(&client->outbox, buff, size)) {
+    log_erro("server", "outbox_add()\n");
+    server_close(clientFd);
     return;
   }
 
-  if (events & IO_CLOSED) {
-    log_dbug("server", "client %d - closed.\n", client->fd);
-    server_close(client->fd);
+  // Fora do processamento do inbox, parte de uma resposta produzida aos poucos:
+  // é enviada ao final da iteração.
+  if (!client->pumping) server_markDirty(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_appendRef(int clientFd, const void *buff, size_t size) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) {
+    log_erro("server", "client %d <<< send to a closed client.\n", clientFd);
     return;
   }
 
-  if (events & IO_ERROR) {
+  if (outbox_addRef(&client->outbox, buff, size)) {
+    log_erro("server", "outbox_addRef()\n");
+    server_close(clientFd);
+    return;
+  }
+
+  if (!client->pumping) server_markDirty(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_appendFile(int clientFd, int fd, size_t offset, size_t size) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) {
+    log_erro("server", "client %d <<< send to a closed client.\n", clientFd);
+    return;
+  }
+
+  if (outbox_addFile(&client->outbox, fd, offset, size)) {
+    log_erro("server", "outbox_addFile()\n");
+    server_close(clientFd);
+    return;
+  }
+
+  if (!client->pumping) server_markDirty(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_readBody(int clientFd) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) return;
+
+  server_setDeadline(client, SERVER_DEADLINE_BODY);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_pauseRead(int clientFd) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) return;
+
+  client->readPaused = true;
+
+  // O prazo do corpo não corre enquanto a aplicação não consome os dados.
+  if (client->deadline == SERVER_DEADLINE_BODY) {
+    server_setDeadline(client, SERVER_DEADLINE_BODY);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_resumeRead(int clientFd) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL || !client->readPaused) return;
+
+  client->readPaused = false;
+
+  // O cliente tem novamente bodyTimeout para enviar o restante do corpo.
+  if (client->deadline == SERVER_DEADLINE_BODY) {
+    server_setDeadline(client, SERVER_DEADLINE_BODY);
+  }
+
+  // Fora do processamento do inbox, os dados pendentes e os que aguardam no
+  // socket voltam a ser processados.
+  if (!client->pumping) server_pump(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_end(int clientFd) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) {
+    log_erro("server", "client %d <<< send to a closed client.\n", clientFd);
+    return;
+  }
+
+  // A resposta da requisição atual está completa.
+  client->busy = false;
+
+  // Durante o processamento do inbox, a resposta apenas entra na fila e será
+  // enviada junto com as demais. Fora dele, a resposta foi concluída de forma
+  // assíncrona, então as requisições pendentes voltam a ser processadas.
+  if (!client->pumping) {
+    server_clean(client);
+    server_pump(client);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_closeAfter(int clientFd) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) return;
+
+  client->closing = true;
+
+  // Sem resposta em andamento, a conexão é fechada ao final da iteração.
+  if (!client->pumping) server_markDirty(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_hold(int clientFd, bool hold) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL || client->held == hold) return;
+
+  client->held = hold;
+
+  // Sem respostas em andamento, o próximo passo da conexão é decidido ao
+  // final da iteração.
+  if (!hold && !client->pumping) server_markDirty(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool server_outboxFull(int clientFd) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) return false;
+
+  return outbox_pending(&client->outbox) >= FLUSH_THRESHOLD;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_watchWrite(int clientFd) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) return;
+
+  client->watchWrite = true;
+
+  // A fila é verificada por server_flush(), mesmo que esteja vazia.
+  server_markDirty(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_onClientEvent(void *arg, int fd, IOEvent events) {
+  Client *client = arg;
+  ServerWorker *worker = client->worker;
+
+  if (client->fd != fd) {
+    log_erro("server", "client %d - event for a closed client.\n", fd);
+    return;
+  }
+
+  if (events & (IO_READ | IO_WRITE)) {
+    if (events & IO_READ) {
+      log_dbug("server", "client %d >>> can read.\n", client->fd);
+      client->canRead = true;
+    }
+    if (events & IO_WRITE) {
+      log_dbug("server", "client %d <<< can write.\n", client->fd);
+      client->canWrite = true;
+    }
+    server_pump(client);
+  } else if (events & IO_CLOSED) {
+    log_dbug("server", "client %d - closed.\n", client->fd);
+    server_close(client->fd);
+  } else if (events & IO_ERROR) {
     log_erro("server", "client %d - unknown error. Closing client...\n",
              client->fd);
     server_close(client->fd);
+  } else {
+    log_erro("server", "client %d - unknown event (events = %x).\n",
+             client->fd, events);
+  }
+
+  // Se alguma conexão foi fechada, há vagas para as conexões pendentes. Isso é
+  // feito aqui, e não em server_close(), para que a entrada recém liberada não
+  // seja reutilizada enquanto ainda está sendo usada na pilha de chamadas.
+  server_acceptClients(worker);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Conduz a conexão enquanto houver progresso: lê o que estiver disponível no
+ * socket e despacha todas as requisições completas do inbox (pipelining). As
+ * respostas acumuladas são enviadas de uma só vez por server_flush(), ao final
+ * da iteração do laço de eventos.
+ */
+static void server_pump(Client *client) {
+  if (client->pumping) return;
+
+  client->pumping = true;
+
+  bool progress = true;
+
+  while (progress) {
+    progress = false;
+
+    if (server_read(client) > 0) progress = true;
+
+    if (client->fd == -1) return;
+
+    if (server_processInbox(client) > 0) progress = true;
+
+    if (client->fd == -1) return;
+
+    // Limita a memória usada por um cliente que envia muitas requisições de
+    // uma só vez.
+    if (outbox_pending(&client->outbox) >= FLUSH_THRESHOLD) {
+      server_write(client);
+      if (client->fd == -1) return;
+    }
+  }
+
+  client->pumping = false;
+
+  // A fila pode ter sido esvaziada acima, e a aplicação que aguarda espaço
+  // ainda deve ser avisada por server_flush().
+  if ((client->canWrite && !outbox_isempty(&client->outbox)) ||
+      client->watchWrite) {
+    server_markDirty(client);
+    // Tudo o que foi recebido já foi processado.
+    server_releaseInbox(client);
+    return;
+  }
+
+  server_settle(client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Decide o próximo passo da conexão, após o processamento do inbox ou o envio
+ * das respostas: fechá-la ou armar o prazo adequado.
+ */
+static void server_settle(Client *client) {
+  // O cliente não enviará mais nada, então a conexão é fechada quando não
+  // houver mais respostas a serem produzidas ou enviadas.
+  if (client->readClosed && !client->busy && !client->held &&
+      !client->readPaused && outbox_isempty(&client->outbox)) {
+    log_dbug("server", "client %d >>> no tasks, closing...\n", client->fd);
+    server_close(client->fd);
     return;
   }
 
-  log_erro("server", "client %d - unknown event (events = %x).\n", client->fd,
-           events);
+  // Durante a drenagem, ou após server_closeAfter(), a conexão é fechada
+  // assim que a requisição em andamento é respondida.
+  if (client->closing && !client->busy && !client->held &&
+      outbox_isempty(&client->outbox)) {
+    log_dbug("server", "client %d >>> drained, closing...\n", client->fd);
+    server_close(client->fd);
+    return;
+  }
+
+  server_updateDeadline(client);
+
+  // Tudo o que foi recebido já foi processado: a memória do inbox volta para
+  // o pool. Da mesma forma, a do outbox, se não há resposta a ser enviada.
+  server_releaseInbox(client);
+
+  if (!client->busy) outbox_shrink(&client->outbox);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_markDirty(Client *client) {
+  if (client->dirtyPrev != NULL) return;
+
+  ServerWorker *worker = client->worker;
+
+  client->dirtyNext = worker->dirtyClients;
+  client->dirtyPrev = &worker->dirtyClients;
+
+  if (worker->dirtyClients != NULL) {
+    worker->dirtyClients->dirtyPrev = &client->dirtyNext;
+  }
+
+  worker->dirtyClients = client;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_unmarkDirty(Client *client) {
+  if (client->dirtyPrev == NULL) return;
+
+  *client->dirtyPrev = client->dirtyNext;
+
+  if (client->dirtyNext != NULL) {
+    client->dirtyNext->dirtyPrev = client->dirtyPrev;
+  }
+
+  client->dirtyNext = NULL;
+  client->dirtyPrev = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Envia, ao final de cada iteração do laço de eventos, as respostas produzidas
+ * durante a iteração, com uma única escrita por cliente, independente de
+ * quantas vezes a resposta foi complementada (por exemplo, a cada
+ * http_sendHeader()).
+ */
+static void server_flush(void *arg) {
+  ServerWorker *worker = arg;
+  Client *client;
+
+  while ((client = worker->dirtyClients) != NULL) {
+    server_unmarkDirty(client);
+
+    server_write(client);
+
+    if (client->fd == -1) continue;
+
+    // A aplicação é avisada na próxima iteração, e não aqui: o que ela produzir
+    // será enviado após os eventos das demais conexões, sem monopolizar o laço
+    // enquanto o socket aceitar escrita.
+    if (client->watchWrite &&
+        outbox_pending(&client->outbox) < FLUSH_THRESHOLD) {
+      client->watchWrite = false;
+      if (server_post(server_connId(client->fd), server_onWritable, NULL)) {
+        log_erro("server", "server_post()\n");
+        server_close(client->fd);
+        continue;
+      }
+    }
+
+    server_settle(client);
+  }
+
+  // Conexões podem ter sido fechadas durante o envio. Como em
+  // server_onClientEvent(), as vagas são preenchidas somente aqui, quando
+  // nenhum cliente está mais em uso na pilha de chamadas.
+  server_acceptClients(worker);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 static void server_write(Client *client) {
+  struct iovec iov[OUTBOX_IOVEC_MAX];
+
+  if (outbox_isempty(&client->outbox)) return;
+
   if (!client->canWrite) {
     log_dbug("server",
              "client %d >>> outbox is busy, waiting for the write signal.\n",
@@ -438,33 +1411,42 @@ static void server_write(Client *client) {
     return;
   }
 
-  while (true) {
-    ssize_t nwritten =
-        write(client->fd, str_cstr(client->outbox), str_len(client->outbox));
+  bool progress = false;
+
+  while (!outbox_isempty(&client->outbox)) {
+    size_t iovcnt = outbox_iovec(&client->outbox, iov, OUTBOX_IOVEC_MAX);
+
+    ssize_t nwritten = (iovcnt > 0) ? server_writeIovec(client, iov, iovcnt)
+                                    : server_writeFile(client);
+
+    if (nwritten == 0 && iovcnt == 0) {
+      log_erro("server", "client %d <<< file truncated while sending.\n",
+               client->fd);
+      server_close(client->fd);
+      return;
+    }
 
     if (nwritten >= 0) {
-      str_rm(client->outbox, 0, nwritten);
+      progress = true;
+      outbox_commit(&client->outbox, nwritten);
       log_dbug("server", "client %d <<< (%d bytes)\n", client->fd, nwritten);
-      if (str_len(client->outbox) == 0) {
-        client->busy = false;
-        server_onFlush(client);
-        break;
-      } else {
-        continue;
-      }
+      continue;
     }
 
     if (errno == EAGAIN) {
       log_dbug("server", "client %d <<< can't write, try again.\n", client->fd);
       client->canWrite = false;
-      if (io_mod(io_current(), client->fd,
-                 IO_READ | IO_WRITE | IO_EDGE_TRIGGERED, NULL,
+      // O prazo de escrita é renovado sempre que o envio avança.
+      if (progress || client->deadline != SERVER_DEADLINE_WRITE) {
+        server_setDeadline(client, SERVER_DEADLINE_WRITE);
+      }
+      if (io_mod(client->worker->io, client->fd,
+                 IO_READ | IO_WRITE | IO_EDGE_TRIGGERED, client,
                  server_onClientEvent)) {
         log_erro("server", "io_mod(): %d - %s.\n", errno, strerror(errno));
         server_close(client->fd);
-        return;
       }
-      break;
+      return;
     }
 
     if (errno == EINTR) {
@@ -478,26 +1460,88 @@ static void server_write(Client *client) {
 
     return;
   }
+}
 
-  if (client->readClosed) {
-    log_dbug("server", "client %d <<< no more reading or writing, closing.\n",
-             client->fd);
-    server_close(client->fd);
-    return;
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Envia os segmentos em memória com uma única chamada. Caso haja mais dados
+ * depois deles (um trecho de arquivo ou segmentos além de OUTBOX_IOVEC_MAX), o
+ * kernel é avisado com MSG_MORE, para que o cabeçalho de uma resposta não siga
+ * em um pacote separado do corpo.
+ *
+ * @return quantidade de bytes enviados, ou -1, em caso de erro (errno).
+ */
+static ssize_t server_writeIovec(Client *client, struct iovec *iov,
+                                 size_t iovcnt) {
+  struct msghdr msg;
+  size_t size = 0;
+
+  for (size_t i = 0; i < iovcnt; i++) size += iov[i].iov_len;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iovcnt;
+
+  int flags = MSG_NOSIGNAL;
+
+  if (size < outbox_pending(&client->outbox)) flags |= MSG_MORE;
+
+  return sendmsg(client->fd, &msg, flags);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Envia o trecho de arquivo no cursor do outbox direto do file descriptor para
+ * o socket, sem cópia para a memória do processo.
+ *
+ * @return quantidade de bytes enviados, ou -1, em caso de erro (errno).
+ */
+static ssize_t server_writeFile(Client *client) {
+  int fd;
+  off_t offset;
+  size_t size;
+
+  if (!outbox_file(&client->outbox, &fd, &offset, &size)) return 0;
+
+  ssize_t nwritten = sendfile(client->fd, fd, &offset, size);
+
+  // sendfile() exige um arquivo que suporte mmap(); para pipes, splice().
+  if (nwritten == -1 && errno == EINVAL) {
+    nwritten = splice(fd, NULL, client->fd, NULL, size,
+                      SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
   }
+
+  return nwritten;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void server_read(Client *client) {
-  log_dbug("server", "client %d >>> read\n", client->fd);
+/**
+ * Lê do socket até encher o inbox ou não haver mais dados disponíveis.
+ *
+ * @return quantidade de bytes lidos, ou -1, caso a conexão tenha sido fechada.
+ */
+static ssize_t server_read(Client *client) {
+  // Com a leitura suspensa, os dados se acumulam no socket e o TCP reduz a
+  // janela de recepção.
+  if (client->readPaused) return 0;
 
   if (!client->canRead) {
     log_dbug("server", "client %d >>> no pending data.\n", client->fd);
-    return;
+    return 0;
+  }
+
+  log_dbug("server", "client %d >>> read\n", client->fd);
+
+  if (server_acquireInbox(client)) {
+    server_close(client->fd);
+    return -1;
   }
 
   BuffWriter *writer = buff_writer(&client->inbox);
+  ssize_t total = 0;
 
   while (!buff_writer_isfull(writer)) {
     ssize_t r =
@@ -515,19 +1559,14 @@ static void server_read(Client *client) {
         log_erro("server", "client %d >>> error: %d - %s\n", client->fd, errno,
                  strerror(errno));
         server_close(client->fd);
-        return;
+        return -1;
       }
     }
 
     if (r == 0) {
       log_dbug("server", "client %d >>> read closed\n", client->fd);
       client->readClosed = true;
-      if (!client->busy && str_len(client->outbox) == 0 &&
-          buff_isempty(&client->inbox)) {
-        log_dbug("server", "client %d >>> no tasks, closing...\n", client->fd);
-        server_close(client->fd);
-        return;
-      }
+      client->canRead = false;
       break;
     }
 
@@ -535,64 +1574,656 @@ static void server_read(Client *client) {
                 "client %d >>> (%d bytes) ", client->fd, r);
 
     buff_writer_commit(writer, r);
+
+    total += r;
   }
 
-  server_processInbox(client);
+  return total;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void server_processInbox(Client *client) {
-  // Ignora novas requisições enquanto houver uma requisição em andamento.
+/**
+ * Despacha, em ordem, todas as requisições completas do inbox. As respostas
+ * enviadas pelo onMessage() durante o despacho apenas entram na fila do outbox.
+ *
+ * @return quantidade de requisições despachadas, ou -1, caso a conexão tenha
+ *         sido fechada.
+ */
+static int server_processInbox(Client *client) {
+  BuffReader *reader = buff_reader(&client->inbox);
+  int dispatched = 0;
+
+  // Enquanto o socket não aceitar mais escrita, novas requisições não são
+  // processadas, evitando que o outbox cresça sem limites. A conexão mantida
+  // por server_hold() continua processando o inbox mesmo ao ser fechada: as
+  // respostas em andamento podem depender do que o cliente ainda envia.
+  while (!client->busy && (!client->closing || client->held) &&
+         client->canWrite && !client->readPaused &&
+         !buff_isempty(&client->inbox)) {
+    size_t used = buff_used(&client->inbox);
+
+    buff_reader_mark(reader);
+
+    switch (server.params.onFormat(client->fd, reader)) {
+      case FORMAT_OK:
+        // Os bytes consumidos voltam ao inbox, onde ficam retidos até a
+        // resposta ser concluída: a aplicação pode referenciá-los sem cópia.
+        client->requestSize = used - buff_used(&client->inbox);
+        buff_reader_rewind(reader);
+        // Requisição recebida por completo: o prazo de leitura termina.
+        server_setDeadline(client, SERVER_DEADLINE_NONE);
+        // Durante a drenagem, esta é a última requisição da conexão.
+        client->closing = client->worker->draining;
+        client->busy = true;
+        dispatched++;
+        server.params.onMessage(client->fd);
+        if (client->fd == -1) return -1;
+        // Resposta já enfileirada: prepara o cliente para a próxima requisição.
+        if (!client->busy) server_clean(client);
+        break;
+      case FORMAT_PART:
+        // A aplicação não aceita mais dados por enquanto: o inbox cheio não
+        // indica uma requisição grande demais.
+        if (client->readPaused) return dispatched;
+        // A requisição não coube no inbox: aumenta até o limite.
+        if (buff_isfull(&client->inbox) && server_growInbox(client)) {
+          log_erro("server", "client %d >>> request too large, closing...\n",
+                   client->fd);
+          server_close(client->fd);
+          return -1;
+        }
+        // O cliente não enviará o restante da requisição.
+        if (client->readClosed) {
+          log_dbug("server", "client %d >>> incomplete request, closing...\n",
+                   client->fd);
+          server_close(client->fd);
+          return -1;
+        }
+        // O prazo conta a partir do primeiro byte da requisição e não é
+        // renovado a cada leitura.
+        if (client->deadline != SERVER_DEADLINE_HEADER &&
+            client->deadline != SERVER_DEADLINE_BODY) {
+          server_setDeadline(client, SERVER_DEADLINE_HEADER);
+        }
+        return dispatched;
+      case FORMAT_SKIP:
+        if (client->fd == -1) return -1;
+        // Nada a responder, mas os bytes recebidos até aqui foram processados.
+        if (client->deadline != SERVER_DEADLINE_NONE) {
+          server_setDeadline(client, SERVER_DEADLINE_NONE);
+        }
+        break;
+      case FORMAT_ERROR:
+        log_erro("server", "client %d >>> onReceive() fail.\n", client->fd);
+        server_close(client->fd);
+        return -1;
+    }
+  }
+
   if (client->busy) {
     log_dbug("server",
              "client %d >>> waiting for completion of the current request.\n",
              client->fd);
-    return;
   }
 
-  if (buff_isempty(&client->inbox)) {
-    log_dbug("server", "client %d >>> inbox empty.\n", client->fd);
-    return;
-  }
+  return dispatched;
+}
 
-  BuffReader *reader = buff_reader(&client->inbox);
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_setDeadline(Client *client, ServerDeadline deadline) {
+  int timeout = 0;
 
-  switch (server.params.onFormat(client->fd, reader)) {
-    case FORMAT_OK:
-      client->busy = true;
-      server.params.onMessage(client->fd);
+  switch (deadline) {
+    case SERVER_DEADLINE_NONE:
       break;
-    case FORMAT_PART:
+    case SERVER_DEADLINE_HEADER:
+      timeout = server.params.headerTimeout;
       break;
-    case FORMAT_ERROR:
-      log_erro("server", "client %d >>> onReceive() fail.\n", client->fd);
-      server_close(client->fd);
+    case SERVER_DEADLINE_BODY:
+      timeout = server.params.bodyTimeout;
+      break;
+    case SERVER_DEADLINE_IDLE:
+      timeout = server.params.idleTimeout;
       break;
+    case SERVER_DEADLINE_WRITE:
+      timeout = server.params.writeTimeout;
+      break;
+  }
+
+  // Com a leitura suspensa, o prazo do corpo só volta a correr em
+  // server_resumeRead().
+  if (deadline == SERVER_DEADLINE_BODY && client->readPaused) timeout = 0;
+
+  client->deadline = deadline;
+
+  if (timeout > 0) {
+    io_timerSet(client->worker->io, &client->timer, timeout);
+  } else {
+    io_timerCancel(client->worker->io, &client->timer);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Escolhe o prazo da conexão conforme o que ela aguarda, após cada rodada de
+ * leitura, processamento e escrita.
+ */
+static void server_updateDeadline(Client *client) {
+  // Aguardando o socket aceitar escrita: prazo armado em server_write().
+  if (!client->canWrite && !outbox_isempty(&client->outbox)) return;
+
+  // Aguardando a aplicação concluir a resposta: sem prazo.
+  if (client->busy || client->held) {
+    if (client->deadline != SERVER_DEADLINE_NONE) {
+      server_setDeadline(client, SERVER_DEADLINE_NONE);
+    }
+    return;
+  }
+
+  // Aguardando o restante da requisição: prazo armado no primeiro byte.
+  if (client->deadline == SERVER_DEADLINE_HEADER ||
+      client->deadline == SERVER_DEADLINE_BODY) {
+    return;
+  }
+
+  if (client->deadline != SERVER_DEADLINE_IDLE) {
+    server_setDeadline(client, SERVER_DEADLINE_IDLE);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Quantidade de classes de tamanho do inbox: inboxInitSize, dobrando, até
+ * inboxMaxSize.
+ */
+static int server_numInboxSlabs() {
+  int num = 1;
+
+  for (size_t size = server.params.inboxInitSize;
+       size < (size_t)server.params.inboxMaxSize; size *= 2) {
+    num++;
+  }
+
+  return num;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t server_inboxSize(int slab) {
+  size_t size = (size_t)server.params.inboxInitSize << slab;
+  size_t max = server.params.inboxMaxSize;
+  return (size < max) ? size : max;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Obtém do pool do worker a memória do inbox, na menor classe de tamanho,
+ * caso o cliente ainda não a possua.
+ */
+static int server_acquireInbox(Client *client) {
+  if (client->inboxSlab != -1) return 0;
+
+  char *data = slab_alloc(&client->worker->inboxSlabs[0]);
+
+  if (data == NULL) {
+    log_erro("server", "client %d >>> slab_alloc(): %d - %s\n", client->fd,
+             errno, strerror(errno));
+    return -1;
+  }
+
+  buff_wrap(&client->inbox, data, server_inboxSize(0));
+  client->inboxSlab = 0;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Move o inbox para a próxima classe de tamanho do pool.
+ *
+ * @return 0, em caso de sucesso, -1, caso o inbox já esteja no tamanho máximo
+ *         ou não haja memória suficiente.
+ */
+static int server_growInbox(Client *client) {
+  ServerWorker *worker = client->worker;
+  int slab = client->inboxSlab + 1;
+
+  if (slab >= worker->numInboxSlabs) return -1;
+
+  char *data = slab_alloc(&worker->inboxSlabs[slab]);
+
+  if (data == NULL) {
+    log_erro("server", "client %d >>> slab_alloc(): %d - %s\n", client->fd,
+             errno, strerror(errno));
+    return -1;
   }
+
+  char *old = buff_move(&client->inbox, data, server_inboxSize(slab));
+
+  slab_release(&worker->inboxSlabs[client->inboxSlab], old);
+  client->inboxSlab = slab;
+
+  log_dbug("server", "client %d >>> inbox: %ld bytes.\n", client->fd,
+           server_inboxSize(slab));
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Devolve a memória do inbox para o pool do worker, caso esteja vazio.
+ */
+static void server_releaseInbox(Client *client) {
+  if (client->inboxSlab == -1 || !buff_isempty(&client->inbox)) return;
+
+  slab_release(&client->worker->inboxSlabs[client->inboxSlab],
+               client->inbox.data);
+  buff_wrap(&client->inbox, NULL, 0);
+  client->inboxSlab = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_onTimeout(void *arg) {
+  Client *client = arg;
+  ServerWorker *worker = client->worker;
+
+  log_dbug("server", "client %d >>> timeout (deadline = %d), closing...\n",
+           client->fd, client->deadline);
+
+  server_close(client->fd);
+
+  // Uma vaga foi liberada.
+  server_acceptClients(worker);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 void server_close(int clientFd) {
-  server.numClients--;
+  Client *client = server_client(clientFd);
+
+  // A conexão já foi fechada, por exemplo, por um erro de escrita durante o
+  // processamento de uma requisição.
+  if (client == NULL) {
+    log_dbug("server", "client %d - already closed.\n", clientFd);
+    return;
+  }
+
+  // A aplicação ainda pode consultar os dados da conexão.
+  server.params.onDisconnected(clientFd);
+
+  server_releaseClient(client);
+
+  size_t numClients =
+      atomic_fetch_sub_explicit(&server.numClients, 1, memory_order_relaxed);
 
   if (close(clientFd)) {
     log_erro("server", "close(): %d - %s.\n", errno, strerror(errno));
   }
 
-  log_dbug("server", "Connection closed [%d/%d]: %d.\n", server.numClients,
+  log_dbug("server", "Connection closed [%ld/%d]: %d.\n", numClients - 1,
            server.params.maxClients, clientFd);
 
-  server.params.onDisconnected(clientFd);
+  ServerWorker *worker = client->worker;
 
-  server_acceptClients();
+  if (worker->draining && worker->numClients == 0 && worker->io != NULL) {
+    log_info("server-worker", "Drained: %d\n", worker->id);
+    io_close(worker->io, atomic_load(&server.result));
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 void server_stop(int result) {
   log_info("server", "Stoping...\n");
-  server.close = true;
-  io_close(server.listen, result);
+  server_requestStop(result, false);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void server_drain(int result) {
+  if (server.params.drainTimeout <= 0) {
+    server_stop(result);
+    return;
+  }
+
+  log_info("server", "Draining...\n");
+  server_requestStop(result, true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Sinaliza aos workers o encerramento, imediato ou com drenagem. Usa apenas
+ * escritas atômicas e write(), de modo que também pode ser chamada pelo
+ * tratador de SIGTERM.
+ */
+static void server_requestStop(int result, bool drain) {
+  atomic_store(&server.result, result);
+  atomic_store(drain ? &server.draining : &server.close, true);
+  server_wake();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool server_isDraining() { return atomic_load(&server.draining); }
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Acorda todos os workers. Usa apenas write(), sem registrar falhas, para que
+ * possa ser chamada de um tratador de sinal.
+ */
+static void server_wake() {
+  for (int i = 0; i < server.numWorkers; i++) {
+    server_wakeWorker(&server.workers[i]);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @return 0, em caso de sucesso, -1, em caso de erro (errno).
+ */
+static int server_wakeWorker(ServerWorker *worker) {
+  const uint64_t one = 1;
+
+  if (worker->wakeFd == -1) return 0;
+
+  // Com o contador do eventfd no limite, o worker já será acordado.
+  if (write(worker->wakeFd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ServerConnId server_connId(int clientFd) {
+  Client *client = server_client(clientFd);
+
+  if (client == NULL) return SERVER_CONN_NONE;
+
+  return ((uint64_t)client->serial << 32) | (uint32_t)clientFd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int server_post(ServerConnId conn, ServerTask task, void *arg) {
+  Client *client = server_client((int)(uint32_t)conn);
+
+  // A conexão já foi fechada. A entrada pode ter sido reaproveitada por outra
+  // conexão, o que é verificado pelo worker, ao executar a tarefa.
+  if (client == NULL || conn == SERVER_CONN_NONE) return -1;
+
+  // Cada entrada pertence sempre ao mesmo worker.
+  ServerWorker *worker = client->worker;
+  ServerPosted *posted = malloc(sizeof(ServerPosted));
+
+  if (posted == NULL) {
+    log_erro("server", "malloc(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  posted->task = task;
+  posted->arg = arg;
+  posted->conn = conn;
+  posted->client = client;
+
+  IO *io = atomic_load(&worker->postIo);
+
+  if (io == NULL || io_post(io, server_onPosted, posted)) {
+    free(posted);
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_onPosted(void *arg) {
+  ServerPosted *posted = arg;
+  ServerTask task = posted->task;
+  void *taskArg = posted->arg;
+  int clientFd = (int)(uint32_t)posted->conn;
+  uint32_t serial = (uint32_t)(posted->conn >> 32);
+  Client *client = posted->client;
+
+  free(posted);
+
+  // Somente este worker altera a entrada, então a comparação é segura aqui.
+  if (server_client(clientFd) != client || client->serial != serial) {
+    clientFd = -1;
+  }
+
+  task(clientFd, taskArg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_onWritable(int clientFd, void *arg) {
+  if (clientFd == -1 || server.params.onWritable == NULL) return;
+
+  server.params.onWritable(clientFd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_onWakeEvent(void *arg, int fd, IOEvent events) {
+  ServerWorker *worker = arg;
+  uint64_t value;
+
+  if (read(fd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+    log_erro("server", "read(): %d - %s.\n", errno, strerror(errno));
+  }
+
+  if (atomic_load(&server.close)) {
+    log_info("server-worker", "Stopping: %d\n", worker->id);
+    io_close(worker->io, atomic_load(&server.result));
+    return;
+  }
+
+  if (atomic_load(&server.draining) && !worker->draining) {
+    server_startDrain(worker);
+    return;
+  }
+
+  // Continua o aceite interrompido ao fim de um lote.
+  server_acceptClients(worker);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Deixa de aceitar conexões e fecha as conexões sem requisição em andamento.
+ * As demais são fechadas conforme as suas respostas são enviadas.
+ */
+static void server_startDrain(ServerWorker *worker) {
+  log_info("server-worker", "Draining: %d, connections: %d\n", worker->id,
+           worker->numClients);
+
+  worker->draining = true;
+  worker->canAccept = false;
+
+  // Fecha apenas o file descriptor deste processo: se o socket foi repassado
+  // a uma nova instância (server_exec()), ele continua aceitando conexões.
+  if (worker->fd != -1) {
+    io_del(worker->io, worker->fd);
+    close(worker->fd);
+    worker->fd = -1;
+  }
+
+  if (worker->numClients == 0) {
+    log_info("server-worker", "Drained: %d\n", worker->id);
+    io_close(worker->io, atomic_load(&server.result));
+    return;
+  }
+
+  io_timerSet(worker->io, &worker->drainTimer, server.params.drainTimeout);
+
+  // Ao fechar a última conexão, server_close() encerra o worker.
+  for (int i = 0; i < worker->maxClients; i++) {
+    Client *client = &worker->clients[i];
+
+    if (client->fd == -1) continue;
+
+    // Lê o que o cliente já enviou, para que uma requisição ainda não
+    // processada seja respondida, e não descartada com o fechamento.
+    if (!client->busy) {
+      client->canRead = true;
+      server_pump(client);
+      if (client->fd == -1) continue;
+    }
+
+    if (server_isIdle(client)) {
+      server_close(client->fd);
+    } else if (client->busy || client->held ||
+               !outbox_isempty(&client->outbox)) {
+      client->closing = true;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void server_onDrainTimeout(void *arg) {
+  ServerWorker *worker = arg;
+
+  log_info("server-worker", "Drain timeout: %d, closing %d connections.\n",
+           worker->id, worker->numClients);
+
+  io_close(worker->io, atomic_load(&server.result));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Verifica se a conexão não possui requisição em andamento: nem parcialmente
+ * recebida, nem aguardando resposta, nem com resposta a ser enviada.
+ */
+static bool server_isIdle(const Client *client) {
+  return !client->busy && !client->held && outbox_isempty(&client->outbox) &&
+         client->deadline != SERVER_DEADLINE_HEADER &&
+         client->deadline != SERVER_DEADLINE_BODY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int server_exec(const char *path, char *const argv[]) {
+  extern char **environ;
+  char listenFds[256] = SERVER_LISTEN_FDS_ENV "=";
+  size_t len = strlen(listenFds);
+  int numEnv = 0;
+  int status[2] = {-1, -1};
+  char **envp = NULL;
+  int numFds = 0;
+
+  // Após o início do encerramento, os workers fecham os sockets de escuta.
+  if (atomic_load(&server.close) || atomic_load(&server.draining)) {
+    log_erro("server", "server_exec(): the server is stopping.\n");
+    return -1;
+  }
+
+  for (int i = 0; i < server.numWorkers; i++) {
+    int fd = server.workers[i].listenFd;
+
+    if (fd == -1) continue;
+
+    len += snprintf(listenFds + len, sizeof(listenFds) - len, "%s%d",
+                    (numFds++ > 0) ? "," : "", fd);
+
+    if (len >= sizeof(listenFds)) {
+      log_erro("server", "Too many listen sockets to inherit.\n");
+      return -1;
+    }
+  }
+
+  while (environ[numEnv] != NULL) numEnv++;
+
+  envp = malloc(sizeof(char *) * (numEnv + 2));
+
+  if (envp == NULL) {
+    log_erro("server", "malloc(): %d - %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  int envLen = 0;
+
+  for (int i = 0; i < numEnv; i++) {
+    if (strncmp(environ[i], SERVER_LISTEN_FDS_ENV "=",
+                strlen(SERVER_LISTEN_FDS_ENV "=")) == 0) {
+      continue;
+    }
+    envp[envLen++] = environ[i];
+  }
+
+  envp[envLen++] = listenFds;
+  envp[envLen] = NULL;
+
+  // O pipe, fechado pelo execve() bem sucedido, informa se o programa falhou.
+  if (pipe2(status, O_CLOEXEC)) {
+    log_erro("server", "pipe2(): %d - %s\n", errno, strerror(errno));
+    goto error;
+  }
+
+  pid_t pid = fork();
+
+  if (pid == -1) {
+    log_erro("server", "fork(): %d - %s\n", errno, strerror(errno));
+    goto error;
+  }
+
+  if (pid == 0) {
+    // Processo filho: somente funções seguras após fork() até o execve().
+    for (int i = 0; i < server.numWorkers; i++) {
+      int fd = server.workers[i].listenFd;
+      if (fd != -1) fcntl(fd, F_SETFD, 0);
+    }
+
+    execve(path, argv, envp);
+
+    int error = errno;
+    if (write(status[1], &error, sizeof(error)) == -1) _exit(127);
+    _exit(127);
+  }
+
+  close(status[1]);
+  status[1] = -1;
+
+  int error = 0;
+  ssize_t n;
+
+  while ((n = read(status[0], &error, sizeof(error))) == -1 && errno == EINTR) {
+  }
+
+  if (n > 0) {
+    errno = error;
+    log_erro("server", "execve(): %d - %s\n", errno, strerror(errno));
+    waitpid(pid, NULL, 0);
+    goto error;
+  }
+
+  close(status[0]);
+  free(envp);
+
+  log_info("server", "New instance started: %d.\n", pid);
+
+  server_drain(0);
+
+  return 0;
+
+error:
+  if (status[0] != -1) close(status[0]);
+  if (status[1] != -1) close(status[1]);
+  free(envp);
+  return -1;
 }
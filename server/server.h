@@ -1,12 +1,19 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "buff/buff.h"
 
 typedef enum FormatStatus {
   FORMAT_OK,
   FORMAT_PART,
   FORMAT_ERROR,
+  // Bytes consumidos sem formar uma requisição, como os frames de controle do
+  // HTTP/2: o processamento do inbox continua. Ao menos um byte deve ser
+  // consumido.
+  FORMAT_SKIP,
 } FormatStatus;
 
 typedef void (*ServerOnConnected)(int client);
@@ -19,25 +26,272 @@ typedef void (*ServerOnClean)(int client);
 
 typedef FormatStatus (*ServerOnFormat)(int client, BuffReader *reader);
 
+typedef void (*ServerOnWritable)(int client);
+
+/**
+ * Identifica uma conexão, mesmo que o seu file descriptor seja reaproveitado
+ * por outra conexão depois de fechada.
+ */
+typedef uint64_t ServerConnId;
+
+#define SERVER_CONN_NONE ((ServerConnId)0)
+
+/**
+ * Tarefa executada pelo worker da conexão. client é -1 caso a conexão tenha
+ * sido fechada antes da execução; a tarefa ainda deve liberar arg.
+ */
+typedef void (*ServerTask)(int client, void *arg);
+
 typedef struct ServerParams {
   int port;
   char *host;
   int maxClients;
+  // Quantidade de workers, cada um com o seu socket de escuta e o seu laço de
+  // eventos. Se for menor ou igual a zero, usa a quantidade de CPUs online.
+  int numWorkers;
+  // Tamanho da fila de conexões pendentes de cada socket de escuta. Se for
+  // menor ou igual a zero, usa SOMAXCONN.
+  int backlog;
+  // Segundos que o kernel aguarda pelo primeiro dado da conexão antes de
+  // entregá-la ao worker (TCP_DEFER_ACCEPT). Zero entrega a conexão assim que
+  // o handshake termina.
+  int deferAccept;
+  // Quantidade máxima de conexões aceitas por vez, antes de atender os eventos
+  // das conexões já aceitas. Se for menor ou igual a zero, usa 64.
+  int acceptBatch;
+  // O inbox de cada conexão é obtido de um pool do worker somente quando chegam
+  // dados, começando com inboxInitSize bytes e dobrando, enquanto uma
+  // requisição não couber, até inboxMaxSize. Requisições maiores encerram a
+  // conexão. Se inboxInitSize for menor ou igual a zero, usa inboxMaxSize.
+  int inboxInitSize;
   int inboxMaxSize;
   int outboxInitSize;
+  // Tamanho dos dados da aplicação por conexão (server_clientData()) e por
+  // requisição em andamento (server_requestData()). Ambos são obtidos de
+  // pools do worker, alinhados à linha de cache. Zero desativa.
+  int clientDataSize;
+  int requestDataSize;
+  // Prazos, em milissegundos, para encerrar conexões lentas ou ociosas, que
+  // ocupariam para sempre uma vaga de maxClients. Zero desativa o prazo.
+  //
+  // headerTimeout: para receber a requisição, desde o seu primeiro byte. O
+  // prazo não é renovado a cada byte recebido, para que um cliente que envia
+  // a requisição aos poucos (slowloris) não segure a conexão.
+  // bodyTimeout: para receber o corpo, a partir de server_readBody(), que pode
+  // renová-lo a cada parte consumida.
+  // idleTimeout: de espera pela próxima requisição, sem nada pendente.
+  // writeTimeout: sem progresso no envio das respostas.
+  int headerTimeout;
+  int bodyTimeout;
+  int idleTimeout;
+  int writeTimeout;
+  // Prazo, em milissegundos, para as requisições em andamento terminarem
+  // durante a drenagem (server_drain()). Zero faz server_drain() equivaler a
+  // server_stop().
+  int drainTimeout;
+  // Consome do inbox uma requisição. Os bytes consumidos na chamada que
+  // retorna FORMAT_OK permanecem no inbox, sem serem movidos ou sobrescritos,
+  // até server_end(): o onMessage pode referenciá-los sem copiá-los.
   ServerOnFormat onFormat;
   ServerOnMessage onMessage;
   ServerOnConnected onConnected;
+  // Chamado antes de os dados da conexão (server_clientData()) serem
+  // liberados.
   ServerOnDisconnected onDisconnected;
   ServerOnClean onClean;
+  // Chamado após server_watchWrite(), quando a fila de saída do cliente volta
+  // a ter espaço. Pode ser NULL.
+  ServerOnWritable onWritable;
 } ServerParams;
 
 int server_start(ServerParams params);
 
+/**
+ * Nome da variável de ambiente com os sockets de escuta herdados de outra
+ * instância do servidor (ver server_exec()), separados por vírgula.
+ */
+#define SERVER_LISTEN_FDS_ENV "SERVER_LISTEN_FDS"
+
+/**
+ * Envia a resposta da requisição atual. Equivale a server_append() seguido de
+ * server_end().
+ */
 void server_send(int clientFd, const void *buff, size_t size);
 
+/**
+ * Copia parte da resposta para a fila de saída do cliente, sem concluí-la.
+ */
+void server_append(int clientFd, const void *buff, size_t size);
+
+/**
+ * Adiciona parte da resposta à fila de saída do cliente sem copiá-la. Os dados
+ * devem permanecer válidos até serem enviados, por exemplo, o conteúdo de um
+ * arquivo carregado em memória.
+ */
+void server_appendRef(int clientFd, const void *buff, size_t size);
+
+/**
+ * Adiciona à fila de saída do cliente um trecho de arquivo, enviado com
+ * sendfile() (ou splice(), caso fd seja um pipe), sem passar pela memória do
+ * processo. O file descriptor deve permanecer aberto até o trecho ser enviado.
+ */
+void server_appendFile(int clientFd, int fd, size_t offset, size_t size);
+
+/**
+ * Obtém os dados da aplicação associados à conexão, com clientDataSize bytes,
+ * alocados ao aceitar a conexão e devolvidos ao pool ao fechá-la. O conteúdo
+ * não é inicializado: isso cabe ao onConnected.
+ *
+ * @param  clientFd conexão.
+ * @return          dados da conexão, ou NULL, caso a conexão esteja fechada ou
+ *                  clientDataSize seja zero.
+ */
+void *server_clientData(int clientFd);
+
+/**
+ * Obtém os dados da aplicação associados à requisição em andamento, com
+ * requestDataSize bytes. Na primeira chamada de cada requisição, os dados são
+ * obtidos do pool, sem inicialização. Eles são devolvidos ao pool após o
+ * onClean, de modo que conexões ociosas não os ocupam. O onClean também é
+ * chamado ao fechar a conexão durante uma requisição.
+ *
+ * @param  clientFd conexão.
+ * @return          dados da requisição, ou NULL, caso a conexão esteja
+ *                  fechada, requestDataSize seja zero ou não haja memória.
+ */
+void *server_requestData(int clientFd);
+
+/**
+ * Informa, durante o onFormat, que o cabeçalho da requisição atual foi
+ * recebido: a partir de agora, o restante da requisição (o corpo) deve chegar
+ * dentro de bodyTimeout.
+ *
+ * A aplicação que consome o corpo à medida que ele chega pode chamá-la a cada
+ * parte consumida, renovando o prazo, que passa a limitar apenas o intervalo
+ * entre as partes. Enquanto a leitura estiver suspensa (server_pauseRead()),
+ * o prazo não corre.
+ */
+void server_readBody(int clientFd);
+
+/**
+ * Suspende a leitura da conexão e o processamento do inbox até
+ * server_resumeRead(), por exemplo, enquanto a aplicação não consegue consumir
+ * o corpo de uma requisição tão rápido quanto ele chega. Os dados pendentes
+ * permanecem no socket. Ambas devem ser chamadas pelo worker da conexão.
+ */
+void server_pauseRead(int clientFd);
+
+void server_resumeRead(int clientFd);
+
+/**
+ * Conclui a resposta da requisição atual. As respostas produzidas durante uma
+ * iteração do laço de eventos são enviadas juntas, com uma única escrita por
+ * conexão, ao final da iteração.
+ */
+void server_end(int clientFd);
+
+/**
+ * Verifica se a fila de saída do cliente acumula mais dados do que o socket
+ * está aceitando. Nesse caso, a aplicação que produz a resposta aos poucos deve
+ * parar e aguardar o onWritable (server_watchWrite()), em vez de continuar
+ * acumulando a resposta em memória.
+ *
+ * @param  clientFd conexão.
+ * @return          true, caso a fila esteja cheia, false, caso contrário ou a
+ *                  conexão esteja fechada.
+ */
+bool server_outboxFull(int clientFd);
+
+/**
+ * Solicita uma chamada ao onWritable assim que a fila de saída do cliente não
+ * estiver cheia (server_outboxFull()), após as escritas do final da iteração do
+ * laço de eventos. A chamada ocorre na iteração seguinte, uma única vez por
+ * solicitação, e não ocorre caso a conexão seja fechada antes.
+ */
+void server_watchWrite(int clientFd);
+
+/**
+ * Fecha a conexão assim que a resposta da requisição atual for enviada. As
+ * requisições seguintes, já recebidas ou não, são descartadas.
+ */
+void server_closeAfter(int clientFd);
+
+/**
+ * Indica se a conexão possui respostas em andamento que não bloqueiam o
+ * processamento do inbox, como os streams do HTTP/2. Enquanto possuir, a
+ * conexão não é fechada por server_closeAfter(), pela drenagem, pelo fim da
+ * leitura ou pelo prazo de ociosidade, como se houvesse uma requisição em
+ * andamento, e o inbox continua sendo processado, para que o protocolo receba
+ * o que essas respostas aguardam do cliente.
+ */
+void server_hold(int clientFd, bool hold);
+
 void server_close(int clientFd);
 
+/**
+ * Obtém o identificador da conexão, para uso com server_post().
+ *
+ * @param  clientFd conexão.
+ * @return          identificador, ou SERVER_CONN_NONE, caso a conexão esteja
+ *                  fechada.
+ */
+ServerConnId server_connId(int clientFd);
+
+/**
+ * Agenda uma tarefa para ser executada pelo worker da conexão. As demais
+ * funções deste módulo só podem ser chamadas pela thread do worker; esta pode
+ * ser chamada de qualquer thread, enquanto o servidor está em execução, por
+ * exemplo, para concluir com server_send() uma resposta calculada por outra
+ * thread.
+ *
+ * @param  conn identificador obtido com server_connId().
+ * @param  task tarefa.
+ * @param  arg  argumento passado para task.
+ * @return      0, em caso de sucesso, -1, caso a conexão já esteja fechada, o
+ *              worker já tenha encerrado o seu laço ou não haja memória (a
+ *              tarefa não será executada).
+ */
+int server_post(ServerConnId conn, ServerTask task, void *arg);
+
 void server_stop(int result);
 
+/**
+ * Encerra o servidor de forma graciosa: os workers deixam de aceitar novas
+ * conexões, fecham as conexões ociosas e aguardam as requisições em andamento
+ * por até drainTimeout milissegundos. Cada conexão é fechada assim que a sua
+ * requisição em andamento é respondida.
+ *
+ * Pode ser chamada por qualquer thread, mas não por um tratador de sinal, pois
+ * registra no log. O servidor é drenado ao receber SIGTERM.
+ *
+ * @param result valor a ser retornado por server_start().
+ */
+void server_drain(int result);
+
+/**
+ * Verifica se o servidor está sendo drenado, para que o protocolo avise o
+ * cliente, na próxima resposta, que a conexão será fechada (por exemplo, com o
+ * cabeçalho HTTP "Connection: close").
+ */
+bool server_isDraining();
+
+/**
+ * Reinicia o servidor sem recusar conexões: executa o programa path, que herda
+ * os sockets de escuta por meio da variável de ambiente SERVER_LISTEN_FDS_ENV,
+ * e então drena esta instância. Ao chamar server_start(), o novo processo usa
+ * os sockets herdados em vez de criar novos, de modo que as conexões pendentes
+ * não são perdidas.
+ *
+ * Pode ser chamada por qualquer thread, mas não depois de server_stop() ou
+ * server_drain(), nem concorrentemente com elas: os workers, ao encerrar,
+ * fecham os sockets de escuta.
+ *
+ * @param  path endereço do programa.
+ * @param  argv argumentos do programa, terminados por NULL.
+ * @return      0, em caso de sucesso, -1, caso o servidor já esteja sendo
+ *              encerrado ou o programa não pôde ser executado (esta
+ *              instância continua em execução).
+ */
+int server_exec(const char *path, char *const argv[]);
+
 #endif
\ No newline at end of file
@@ -61,11 +61,25 @@ int main() {
   params.port = 2000;
   params.host = "127.0.0.1";
   params.maxClients = 10;
+  params.numWorkers = 0;
+  params.backlog = 0;
+  params.deferAccept = 0;
+  params.acceptBatch = 0;
+  params.inboxInitSize = 1024;
   params.inboxMaxSize = 4096;
+  params.outboxInitSize = 1024;
+  params.clientDataSize = 0;
+  params.requestDataSize = 0;
+  params.headerTimeout = 10 * 1000;
+  params.bodyTimeout = 10 * 1000;
+  params.idleTimeout = 60 * 1000;
+  params.writeTimeout = 30 * 1000;
+  params.drainTimeout = 10 * 1000;
   params.onConnected = onConnected;
   params.onFormat = onFormat;
   params.onMessage = onMessage;
   params.onDisconnected = onDisconnected;
+  params.onWritable = NULL;
 
   return server_start(params);
 }
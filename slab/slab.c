@@ -0,0 +1,114 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "slab.h"
+
+#include <stdlib.h>
+
+/**
+ * Cabeçalho de cada página, ocupando a primeira linha de cache, para que os
+ * objetos seguintes permaneçam alinhados.
+ */
+struct SlabPage {
+  SlabPage *next;
+};
+
+#define SLAB_PAGE_HEADER_SIZE SLAB_ALIGN
+
+static int slab_newPage(Slab *slab);
+
+////////////////////////////////////////////////////////////////////////////////
+
+void slab_init(Slab *slab, size_t size) {
+  if (size < sizeof(void *)) size = sizeof(void *);
+
+  slab->size = (size + SLAB_ALIGN - 1) & ~((size_t)SLAB_ALIGN - 1);
+  slab->objsPerPage = (SLAB_PAGE_SIZE - SLAB_PAGE_HEADER_SIZE) / slab->size;
+  if (slab->objsPerPage == 0) slab->objsPerPage = 1;
+  slab->freeObjs = NULL;
+  slab->pages = NULL;
+  slab->numPages = 0;
+  slab->numUsed = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void *slab_alloc(Slab *slab) {
+  if (slab->freeObjs == NULL && slab_newPage(slab)) return NULL;
+
+  void *obj = slab->freeObjs;
+
+  // Objetos livres guardam, no início, o próximo objeto livre.
+  slab->freeObjs = *(void **)obj;
+  slab->numUsed++;
+
+  return obj;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void slab_release(Slab *slab, void *obj) {
+  if (obj == NULL) return;
+
+  *(void **)obj = slab->freeObjs;
+  slab->freeObjs = obj;
+  slab->numUsed--;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void slab_free(Slab *slab) {
+  SlabPage *page = slab->pages;
+
+  while (page != NULL) {
+    SlabPage *next = page->next;
+    free(page);
+    page = next;
+  }
+
+  slab->freeObjs = NULL;
+  slab->pages = NULL;
+  slab->numPages = 0;
+  slab->numUsed = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t slab_used(const Slab *slab) { return slab->numUsed; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int slab_newPage(Slab *slab) {
+  size_t pageSize = SLAB_PAGE_HEADER_SIZE + slab->objsPerPage * slab->size;
+  SlabPage *page = aligned_alloc(SLAB_ALIGN, pageSize);
+
+  if (page == NULL) return -1;
+
+  page->next = slab->pages;
+  slab->pages = page;
+  slab->numPages++;
+
+  char *objs = (char *)page + SLAB_PAGE_HEADER_SIZE;
+
+  // Encadeia os objetos em ordem crescente de endereço.
+  for (size_t i = slab->objsPerPage; i > 0; i--) {
+    void *obj = objs + (i - 1) * slab->size;
+    *(void **)obj = slab->freeObjs;
+    slab->freeObjs = obj;
+  }
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+/**
+ * Alocador de objetos de tamanho fixo (slab).
+ *
+ * Os objetos são alocados em páginas, alinhados à linha de cache, e os objetos
+ * liberados voltam para uma lista de objetos livres, de onde são reaproveitados
+ * sem chamar malloc() ou free(). A memória das páginas só é devolvida ao
+ * sistema por slab_free().
+ *
+ * Não há sincronização: cada instância deve ser usada por uma única thread,
+ * por exemplo, uma por worker. As páginas são alocadas na primeira vez em que
+ * são necessárias, pela thread que usa o slab, de modo que o kernel as
+ * posiciona no nó NUMA dessa thread.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/**
+ * Alinhamento dos objetos, igual ao tamanho da linha de cache.
+ */
+#define SLAB_ALIGN 64
+
+/**
+ * Tamanho aproximado de cada página de objetos. Objetos maiores ocupam uma
+ * página cada.
+ */
+#define SLAB_PAGE_SIZE (64 * 1024)
+
+typedef struct SlabPage SlabPage;
+
+typedef struct Slab {
+  // Tamanho de cada objeto, arredondado para múltiplo de SLAB_ALIGN.
+  size_t size;
+  size_t objsPerPage;
+  void *freeObjs;
+  SlabPage *pages;
+  size_t numPages;
+  size_t numUsed;
+} Slab;
+
+/**
+ * Inicializa um slab, sem alocar memória.
+ *
+ * @param slab instância do slab.
+ * @param size tamanho de cada objeto.
+ */
+void slab_init(Slab *slab, size_t size);
+
+/**
+ * Aloca um objeto. O conteúdo do objeto não é inicializado.
+ *
+ * @param  slab instância do slab.
+ * @return      objeto alinhado em SLAB_ALIGN, ou NULL, caso não há memória
+ *              suficiente.
+ */
+void *slab_alloc(Slab *slab);
+
+/**
+ * Devolve um objeto, obtido com slab_alloc() do mesmo slab, para a lista de
+ * objetos livres.
+ *
+ * @param slab instância do slab.
+ * @param obj  objeto, ou NULL.
+ */
+void slab_release(Slab *slab, void *obj);
+
+/**
+ * Libera todas as páginas do slab, inclusive dos objetos ainda em uso.
+ *
+ * @param slab instância do slab.
+ */
+void slab_free(Slab *slab);
+
+/**
+ * Obtém a quantidade de objetos em uso.
+ */
+size_t slab_used(const Slab *slab);
+
+#endif
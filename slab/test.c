@@ -0,0 +1,131 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "slab.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static void testAllocAligned();
+static void testReleaseReuses();
+static void testManyPages();
+static void testLargeObjects();
+
+int main() {
+  testAllocAligned();
+  testReleaseReuses();
+  testManyPages();
+  testLargeObjects();
+  return 0;
+}
+
+static void testAllocAligned() {
+  Slab slab;
+
+  slab_init(&slab, 10);
+
+  assert(slab.size == SLAB_ALIGN);
+
+  char *a = slab_alloc(&slab);
+  char *b = slab_alloc(&slab);
+
+  assert(a != NULL && b != NULL);
+  assert((uintptr_t)a % SLAB_ALIGN == 0);
+  assert((uintptr_t)b % SLAB_ALIGN == 0);
+  assert(b == a + SLAB_ALIGN);
+  assert(slab_used(&slab) == 2);
+
+  slab_free(&slab);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testReleaseReuses() {
+  Slab slab;
+
+  slab_init(&slab, 100);
+
+  void *a = slab_alloc(&slab);
+  void *b = slab_alloc(&slab);
+
+  slab_release(&slab, a);
+  assert(slab_used(&slab) == 1);
+
+  // The last released object is the next one allocated.
+  assert(slab_alloc(&slab) == a);
+
+  slab_release(&slab, b);
+  slab_release(&slab, a);
+  slab_release(&slab, NULL);
+  assert(slab_used(&slab) == 0);
+  assert(slab.numPages == 1);
+
+  slab_free(&slab);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testManyPages() {
+  Slab slab;
+  void *objs[5000];
+
+  slab_init(&slab, 128);
+
+  for (int i = 0; i < 5000; i++) {
+    objs[i] = slab_alloc(&slab);
+    assert(objs[i] != NULL);
+    memset(objs[i], i % 256, 128);
+  }
+
+  assert(slab.numPages == (5000 + slab.objsPerPage - 1) / slab.objsPerPage);
+
+  // Objects do not overlap.
+  for (int i = 0; i < 5000; i++) {
+    assert(((unsigned char *)objs[i])[127] == i % 256);
+  }
+
+  for (int i = 0; i < 5000; i++) {
+    slab_release(&slab, objs[i]);
+  }
+
+  assert(slab_used(&slab) == 0);
+
+  slab_free(&slab);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testLargeObjects() {
+  Slab slab;
+
+  slab_init(&slab, 3 * SLAB_PAGE_SIZE);
+
+  assert(slab.objsPerPage == 1);
+
+  char *a = slab_alloc(&slab);
+  char *b = slab_alloc(&slab);
+
+  assert(a != NULL && b != NULL && a != b);
+  memset(a, 'a', 3 * SLAB_PAGE_SIZE);
+  memset(b, 'b', 3 * SLAB_PAGE_SIZE);
+  assert(a[3 * SLAB_PAGE_SIZE - 1] == 'a');
+  assert(slab.numPages == 2);
+
+  slab_free(&slab);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
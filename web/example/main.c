@@ -19,16 +19,18 @@
 
 int main() {
   // Module People
-  web_handler("GET", "^/peoples$", webPeoples_list);
-  web_handler("POST", "^/peoples$", webPeoples_add);
-  web_handler("DELETE", "^/peoples/(.*)$", webPeoples_remove);
-  web_handler("PUT", "^/peoples/(.*)$", webPeoples_update);
-  web_handler("GET", "^/peoples/(.*)$", webPeoples_details);
-  web_redirect("/$", "^/peoples$");
+  web_handler("GET", "/peoples", webPeoples_list);
+  web_handler("POST", "/peoples", webPeoples_add);
+  web_handler("DELETE", "/peoples/:id", webPeoples_remove);
+  web_handler("PUT", "/peoples/:id", webPeoples_update);
+  web_handler("GET", "/peoples/:id", webPeoples_details);
+  web_redirect("/", "/peoples");
 
   // Assets
-  web_assets("^(/.*)$", "web/example/public/");
-  web_redirect("^/favicon.ico$", "/imgs/favicon/favicon.ico");
+  web_assets("/*path", "web/example/public/");
+  web_cacheControl("/css/*", "public, max-age=86400");
+  web_cacheControl("*.html", "no-cache");
+  web_redirect("/favicon.ico", "/imgs/favicon/favicon.ico");
 
   return web_start(2000, 1000);
 }
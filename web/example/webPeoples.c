@@ -16,6 +16,7 @@
 
 #include "webPeoples.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -64,20 +65,31 @@ void webPeoples_list(HttpClient *client) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void onPeoplesAddResp(PeoplesAddSig *sig, PeoplesStatus status) {
-  HttpClient *client = sig->client;
+/**
+ * Responde, na thread da conexão, o resultado das operações sem retorno. O
+ * status é passado no próprio argumento.
+ */
+static void sendStatus(HttpClient *client, void *arg) {
+  PeoplesStatus status = (PeoplesStatus)(intptr_t)arg;
+
+  // Cliente desconectado antes da resposta.
+  if (client == NULL) return;
+
+  http_sendStatus(client, HTTP_STATUS_OK);
+  http_sendType(client, HTTP_TYPE_JSON);
 
   if (status == PEOPLES_OK) {
-    http_sendStatus(client, HTTP_STATUS_OK);
-    http_sendType(client, HTTP_TYPE_JSON);
     http_send(client, "{\"status\": \"ok\"}", strlen("{\"status\": \"ok\"}"));
   } else {
-    http_sendStatus(client, HTTP_STATUS_OK);
-    http_sendType(client, HTTP_TYPE_JSON);
     http_send(client, "{\"status\": \"error\"}",
               strlen("{\"status\": \"error\"}"));
   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
 
+static void onPeoplesAddResp(PeoplesAddSig *sig, PeoplesStatus status) {
+  http_complete(sig->client, sendStatus, (void *)(intptr_t)status);
   free(sig);
 }
 
@@ -86,9 +98,16 @@ void webPeoples_add(HttpClient *client) {
   sig->name = http_reqParam(client, "name");
   sig->email = http_reqParam(client, "email");
   sig->callback = onPeoplesAddResp;
-  sig->client = client;
+  sig->client = http_defer(client);
 
-  log_info("web-peoples", "body = %s\n", http_reqBody(client));
+  if (sig->client == NULL) {
+    http_sendError(client);
+    free(sig);
+    return;
+  }
+
+  HttpView body = http_reqBody(client);
+  log_info("web-peoples", "body = %.*s\n", (int)body.len, body.data);
 
   peoples_add(sig);
 }
@@ -96,19 +115,7 @@ void webPeoples_add(HttpClient *client) {
 ////////////////////////////////////////////////////////////////////////////////
 
 static void onPeoplesRemoveResp(PeoplesRemoveSig *sig, PeoplesStatus status) {
-  HttpClient *client = sig->client;
-
-  if (status == PEOPLES_OK) {
-    http_sendStatus(client, HTTP_STATUS_OK);
-    http_sendType(client, HTTP_TYPE_JSON);
-    http_send(client, "{\"status\": \"ok\"}", strlen("{\"status\": \"ok\"}"));
-  } else {
-    http_sendStatus(client, HTTP_STATUS_OK);
-    http_sendType(client, HTTP_TYPE_JSON);
-    http_send(client, "{\"status\": \"error\"}",
-              strlen("{\"status\": \"error\"}"));
-  }
-
+  http_complete(sig->client, sendStatus, (void *)(intptr_t)status);
   free(sig);
 }
 
@@ -116,7 +123,13 @@ void webPeoples_remove(HttpClient *client) {
   PeoplesRemoveSig *sig = malloc(sizeof(PeoplesRemoveSig));
   sig->id = http_reqParam(client, "id");
   sig->callback = onPeoplesRemoveResp;
-  sig->client = client;
+  sig->client = http_defer(client);
+
+  if (sig->client == NULL) {
+    http_sendError(client);
+    free(sig);
+    return;
+  }
 
   peoples_remove(sig);
 }
@@ -124,19 +137,7 @@ void webPeoples_remove(HttpClient *client) {
 ////////////////////////////////////////////////////////////////////////////////
 
 static void onPeoplesUpdateResp(PeoplesUpdateSig *sig, PeoplesStatus status) {
-  HttpClient *client = sig->client;
-
-  if (status == PEOPLES_OK) {
-    http_sendStatus(client, HTTP_STATUS_OK);
-    http_sendType(client, HTTP_TYPE_JSON);
-    http_send(client, "{\"status\": \"ok\"}", strlen("{\"status\": \"ok\"}"));
-  } else {
-    http_sendStatus(client, HTTP_STATUS_OK);
-    http_sendType(client, HTTP_TYPE_JSON);
-    http_send(client, "{\"status\": \"error\"}",
-              strlen("{\"status\": \"error\"}"));
-  }
-
+  http_complete(sig->client, sendStatus, (void *)(intptr_t)status);
   free(sig);
 }
 
@@ -146,17 +147,32 @@ void webPeoples_update(HttpClient *client) {
   sig->name = http_reqParam(client, "name");
   sig->email = http_reqParam(client, "email");
   sig->callback = onPeoplesUpdateResp;
-  sig->client = client;
+  sig->client = http_defer(client);
+
+  if (sig->client == NULL) {
+    http_sendError(client);
+    free(sig);
+    return;
+  }
 
   peoples_update(sig);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static void onPeoplesDetailsResp(PeoplesDetailsSig *sig, PeoplesStatus status) {
-  HttpClient *client = sig->client;
+/**
+ * Responde os detalhes na thread da conexão. O status da consulta é indicado
+ * pelo id, vazio em caso de erro.
+ */
+static void sendDetails(HttpClient *client, void *arg) {
+  PeoplesDetailsSig *sig = arg;
 
-  if (status == PEOPLES_OK) {
+  if (client == NULL) {
+    free(sig);
+    return;
+  }
+
+  if (sig->resp.id[0] != '\0') {
     str_t *body = str_new(1000);
 
     str_fmt(body,
@@ -176,11 +192,23 @@ static void onPeoplesDetailsResp(PeoplesDetailsSig *sig, PeoplesStatus status) {
   free(sig);
 }
 
+static void onPeoplesDetailsResp(PeoplesDetailsSig *sig, PeoplesStatus status) {
+  if (status != PEOPLES_OK) sig->resp.id[0] = '\0';
+
+  if (http_complete(sig->client, sendDetails, sig)) free(sig);
+}
+
 void webPeoples_details(HttpClient *client) {
   PeoplesDetailsSig *sig = malloc(sizeof(PeoplesDetailsSig));
-  sig->id = http_reqArg(client, 0);
+  sig->id = http_reqNamedArg(client, "id");
   sig->callback = onPeoplesDetailsResp;
-  sig->client = client;
+  sig->client = http_defer(client);
+
+  if (sig->client == NULL) {
+    http_sendError(client);
+    free(sig);
+    return;
+  }
 
   peoples_details(sig);
 }
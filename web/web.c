@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,16 +37,41 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 
+typedef struct WebCache {
+  const char *pattern;
+  const char *value;
+} WebCache;
+
+////////////////////////////////////////////////////////////////////////////////
+
 typedef struct Web {
   HashTable *redirects;
   char publicDir[PATH_MAX];
+  // Cache-Control por padrão de endereço (web_cacheControl()).
+  WebCache caches[WEB_CACHE_MAX];
+  int cachesLen;
 } Web;
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static thread_local Web web = {
+static Web web = {
     .redirects = NULL,
     .publicDir = {0},
+    .cachesLen = 0,
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Codificações das versões comprimidas dos arquivos, na ordem de preferência:
+ * a versão brotli costuma ser menor do que a gzip.
+ */
+static const struct {
+  AssetsEncoding encoding;
+  const char *name;
+} WEB_ENCODINGS[] = {
+    {ASSETS_ENCODING_BR, "br"},
+    {ASSETS_ENCODING_GZIP, "gzip"},
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -53,6 +79,7 @@ static thread_local Web web = {
 static HttpMimeType mimeTypeByFilename(const char *filename);
 static void web_redirectHandler(HttpClient *client);
 static void web_assetHandler(HttpClient *client);
+static const char *web_cacheControlOf(const char *path);
 static int web_init();
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -154,9 +181,96 @@ static void web_assetHandler(HttpClient *client) {
     return;
   }
 
-  http_sendStatus(client, HTTP_STATUS_OK);
-  http_sendType(client, mimeTypeByFilename(pathFile));
-  http_send(client, assets_get(pathFile), assets_size(pathFile));
+  // Endereço a partir do diretório público, começando por '/'.
+  const char *pathAsset = pathFile + strlen(web.publicDir);
+
+  if (pathAsset[-1] == '/') pathAsset--;
+
+  const char *pathSend = pathFile;
+  const char *encoding = NULL;
+  bool varies = false;
+
+  for (size_t i = 0; i < sizeof(WEB_ENCODINGS) / sizeof(WEB_ENCODINGS[0]);
+       i++) {
+    const char *path = assets_encoded(pathFile, WEB_ENCODINGS[i].encoding);
+
+    if (path == NULL) continue;
+
+    varies = true;
+
+    if (encoding == NULL &&
+        http_reqAcceptsEncoding(client, WEB_ENCODINGS[i].name)) {
+      pathSend = path;
+      encoding = WEB_ENCODINGS[i].name;
+    }
+  }
+
+  const char *etag = assets_etag(pathSend);
+  time_t mtime = assets_mtime(pathSend);
+  const char *cacheControl = web_cacheControlOf(pathAsset);
+
+  // A cópia em cache do navegador continua válida: somente o cabeçalho é
+  // enviado.
+  bool notModified = http_reqNotModified(client, etag, mtime);
+
+  if (notModified) {
+    http_sendStatus(client, HTTP_STATUS_NOT_MODIFIED);
+  } else {
+    http_sendStatus(client, HTTP_STATUS_OK);
+    http_sendType(client, mimeTypeByFilename(pathFile));
+
+    if (encoding != NULL) {
+      http_sendHeader(client, "Content-Encoding", encoding);
+    }
+  }
+
+  http_sendHeader(client, "ETag", etag);
+  http_sendHeaderTime(client, "Last-Modified", mtime);
+
+  if (cacheControl != NULL) {
+    http_sendHeader(client, "Cache-Control", cacheControl);
+  }
+
+  // Os caches guardam uma resposta por codificação aceita.
+  if (varies) http_sendHeader(client, "Vary", "Accept-Encoding");
+
+  if (notModified) {
+    http_send(client, NULL, 0);
+    return;
+  }
+
+  int fd = assets_fd(pathSend);
+
+  if (fd >= 0) {
+    http_sendFile(client, fd, 0, assets_size(pathSend));
+  } else {
+    http_sendRef(client, assets_get(pathSend), assets_size(pathSend));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int web_cacheControl(const char *pattern, const char *value) {
+  if (web.cachesLen == WEB_CACHE_MAX) {
+    log_erro("web", "Too many cache patterns: %s\n", pattern);
+    return -1;
+  }
+
+  web.caches[web.cachesLen++] = (WebCache){pattern, value};
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static const char *web_cacheControlOf(const char *path) {
+  for (int i = 0; i < web.cachesLen; i++) {
+    if (fnmatch(web.caches[i].pattern, path, 0) == 0) {
+      return web.caches[i].value;
+    }
+  }
+
+  return NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -19,6 +19,8 @@
 
 #include "http/http.h"
 
+#define WEB_CACHE_MAX 32
+
 typedef void (*WebHandler)(HttpClient *client);
 
 void web_handler(const char *method, const char *path, WebHandler handler);
@@ -29,6 +31,13 @@ void web_stop(int result);
 
 void web_assets(const char *from, const char *to);
 
+// Envia o cabeçalho "Cache-Control: value" nas respostas dos arquivos de
+// web_assets() cujo endereço, a partir do diretório público, como
+// "/css/style.css", corresponda a pattern (fnmatch(), como "*.js"). Vale o
+// primeiro padrão correspondente, na ordem em que foram adicionados. Os textos
+// não são copiados. Retorna -1 caso já existam WEB_CACHE_MAX padrões.
+int web_cacheControl(const char *pattern, const char *value);
+
 void web_redirect(const char *from, const char *to);
 
 #endif
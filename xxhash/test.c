@@ -0,0 +1,87 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "xxhash.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static void testVectors();
+static void testParts();
+static void testSeed();
+
+static unsigned char data[100];
+
+int main() {
+  for (size_t i = 0; i < sizeof(data); i++) data[i] = (i * 31 + 7) % 251;
+
+  testVectors();
+  testParts();
+  testSeed();
+  return 0;
+}
+
+static void testVectors() {
+  // Values from the reference implementation, covering the tail paths (8, 4
+  // and 1 byte) and inputs shorter and longer than one 32-byte block.
+  assert(xxhash("", 0, 0) == 0xef46db3751d8e999ULL);
+  assert(xxhash("abc", 3, 0) == 0x44bc2cf5ad770999ULL);
+  assert(xxhash(data, 1, 0) == 0xa96c7f0ce858bbb7ULL);
+  assert(xxhash(data, 3, 0) == 0x56e6957632a487f9ULL);
+  assert(xxhash(data, 4, 0) == 0xc60d15b1e3ff8f04ULL);
+  assert(xxhash(data, 8, 0) == 0x3da5c7aa269683e0ULL);
+  assert(xxhash(data, 31, 0) == 0x3391303d485e846eULL);
+  assert(xxhash(data, 32, 0) == 0x40b7aff75d45bbc8ULL);
+  assert(xxhash(data, 33, 0) == 0x4997cae4951c17a5ULL);
+  assert(xxhash(data, 100, 0) == 0xf0b29a915621716dULL);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testParts() {
+  // Any split gives the same hash as the whole content.
+  for (size_t split = 0; split <= sizeof(data); split++) {
+    XXHash hash;
+
+    xxhash_init(&hash, 0);
+    xxhash_update(&hash, data, split);
+    xxhash_update(&hash, data + split, sizeof(data) - split);
+
+    assert(xxhash_digest(&hash) == 0xf0b29a915621716dULL);
+  }
+
+  // Byte by byte, with a digest in the middle.
+  XXHash hash;
+
+  xxhash_init(&hash, 0);
+
+  for (size_t i = 0; i < sizeof(data); i++) {
+    xxhash_update(&hash, data + i, 1);
+    if (i == 32) assert(xxhash_digest(&hash) == 0x4997cae4951c17a5ULL);
+  }
+
+  assert(xxhash_digest(&hash) == 0xf0b29a915621716dULL);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
+
+static void testSeed() {
+  assert(xxhash("abc", 3, 1) == 0xbea9ca8199328908ULL);
+  assert(xxhash(data, sizeof(data), 0x9e3779b185ebca87ULL) ==
+         0x6e4dd064c5f9d766ULL);
+
+  printf("%s is ok\n", __FUNCTION__);
+}
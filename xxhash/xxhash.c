@@ -0,0 +1,198 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+#include "xxhash.h"
+
+#include <string.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t xxhash_rotl(uint64_t value, int bits);
+static uint64_t xxhash_round(uint64_t acc, uint64_t lane);
+static uint64_t xxhash_merge(uint64_t hash, uint64_t acc);
+static uint64_t xxhash_read64(const unsigned char *data);
+static uint32_t xxhash_read32(const unsigned char *data);
+static const unsigned char *xxhash_blocks(uint64_t acc[4],
+                                          const unsigned char *data,
+                                          const unsigned char *end);
+
+////////////////////////////////////////////////////////////////////////////////
+
+void xxhash_init(XXHash *hash, uint64_t seed) {
+  hash->acc[0] = seed + PRIME1 + PRIME2;
+  hash->acc[1] = seed + PRIME2;
+  hash->acc[2] = seed;
+  hash->acc[3] = seed - PRIME1;
+  hash->seed = seed;
+  hash->len = 0;
+  hash->buffLen = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void xxhash_update(XXHash *hash, const void *data, size_t len) {
+  if (len == 0) return;
+
+  const unsigned char *pos = data;
+  const unsigned char *end = pos + len;
+
+  hash->len += len;
+
+  // Completa o bloco iniciado na chamada anterior.
+  if (hash->buffLen > 0) {
+    size_t fill = sizeof(hash->buff) - hash->buffLen;
+
+    if (len < fill) {
+      memcpy(hash->buff + hash->buffLen, pos, len);
+      hash->buffLen += len;
+      return;
+    }
+
+    memcpy(hash->buff + hash->buffLen, pos, fill);
+    xxhash_blocks(hash->acc, hash->buff, hash->buff + sizeof(hash->buff));
+    hash->buffLen = 0;
+    pos += fill;
+  }
+
+  pos = xxhash_blocks(hash->acc, pos, end);
+
+  hash->buffLen = end - pos;
+  memcpy(hash->buff, pos, hash->buffLen);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint64_t xxhash_digest(const XXHash *hash) {
+  uint64_t h;
+
+  if (hash->len >= sizeof(hash->buff)) {
+    h = xxhash_rotl(hash->acc[0], 1) + xxhash_rotl(hash->acc[1], 7) +
+        xxhash_rotl(hash->acc[2], 12) + xxhash_rotl(hash->acc[3], 18);
+
+    for (int i = 0; i < 4; i++) h = xxhash_merge(h, hash->acc[i]);
+  } else {
+    h = hash->seed + PRIME5;
+  }
+
+  h += hash->len;
+
+  // Os bytes que não completam um bloco: de 8 em 8, de 4 em 4 e um a um.
+  const unsigned char *pos = hash->buff;
+  const unsigned char *end = pos + hash->buffLen;
+
+  for (; pos + 8 <= end; pos += 8) {
+    h ^= xxhash_round(0, xxhash_read64(pos));
+    h = xxhash_rotl(h, 27) * PRIME1 + PRIME4;
+  }
+
+  if (pos + 4 <= end) {
+    h ^= xxhash_read32(pos) * PRIME1;
+    h = xxhash_rotl(h, 23) * PRIME2 + PRIME3;
+    pos += 4;
+  }
+
+  for (; pos < end; pos++) {
+    h ^= *pos * PRIME5;
+    h = xxhash_rotl(h, 11) * PRIME1;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint64_t xxhash(const void *data, size_t len, uint64_t seed) {
+  XXHash hash;
+
+  xxhash_init(&hash, seed);
+  xxhash_update(&hash, data, len);
+
+  return xxhash_digest(&hash);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t xxhash_rotl(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t xxhash_round(uint64_t acc, uint64_t lane) {
+  acc += lane * PRIME2;
+  acc = xxhash_rotl(acc, 31);
+  return acc * PRIME1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t xxhash_merge(uint64_t hash, uint64_t acc) {
+  hash ^= xxhash_round(0, acc);
+  return hash * PRIME1 + PRIME4;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Lê um inteiro little-endian, em qualquer alinhamento.
+ */
+static uint64_t xxhash_read64(const unsigned char *data) {
+  uint64_t value = 0;
+
+  for (int i = 7; i >= 0; i--) value = (value << 8) | data[i];
+
+  return value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t xxhash_read32(const unsigned char *data) {
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+         ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Processa os blocos de 32 bytes completos entre data e end.
+ *
+ * @return início dos bytes restantes, que não completam um bloco.
+ */
+static const unsigned char *xxhash_blocks(uint64_t acc[4],
+                                          const unsigned char *data,
+                                          const unsigned char *end) {
+  for (; end - data >= 32; data += 32) {
+    for (int i = 0; i < 4; i++) {
+      acc[i] = xxhash_round(acc[i], xxhash_read64(data + i * 8));
+    }
+  }
+
+  return data;
+}
@@ -0,0 +1,66 @@
+/*******************************************************************************
+ *   Copyright 2020 Assis Vieira
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ ******************************************************************************/
+
+/**
+ * Hash de 64 bits XXH64, não criptográfico, para identificar conteúdos, como o
+ * dos arquivos no ETag. Produz os mesmos valores da implementação de
+ * referência (https://github.com/Cyan4973/xxHash).
+ *
+ * O conteúdo pode ser informado de uma só vez, com xxhash(), ou em partes,
+ * com xxhash_update(), como ao ler um arquivo grande em blocos.
+ */
+
+#ifndef XXHASH_H
+#define XXHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct XXHash {
+  // Acumuladores das quatro faixas de 8 bytes de cada bloco de 32 bytes.
+  uint64_t acc[4];
+  uint64_t seed;
+  uint64_t len;
+  // Bytes que ainda não completam um bloco.
+  unsigned char buff[32];
+  size_t buffLen;
+} XXHash;
+
+/**
+ * Inicializa o cálculo em partes.
+ *
+ * @param hash estado do cálculo.
+ * @param seed semente: hashes com sementes diferentes são independentes.
+ */
+void xxhash_init(XXHash *hash, uint64_t seed);
+
+/**
+ * Acrescenta uma parte do conteúdo.
+ */
+void xxhash_update(XXHash *hash, const void *data, size_t len);
+
+/**
+ * Obtém o hash do conteúdo acrescentado até aqui, sem alterar o estado: o
+ * cálculo pode continuar.
+ */
+uint64_t xxhash_digest(const XXHash *hash);
+
+/**
+ * Calcula o hash do conteúdo de uma só vez.
+ */
+uint64_t xxhash(const void *data, size_t len, uint64_t seed);
+
+#endif